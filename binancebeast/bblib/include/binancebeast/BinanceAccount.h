@@ -0,0 +1,718 @@
+#ifndef BINANCEBEAST_ACCOUNT_H
+#define BINANCEBEAST_ACCOUNT_H
+
+#include "BinanceBeast.h"
+#include "BinanceRcu.h"
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+
+namespace bblib
+{
+    struct AccountBalance
+    {
+        string asset;
+        double walletBalance = 0;
+        double crossWalletBalance = 0;
+        double balanceChange = 0;           // except PnL and commission, from the last ACCOUNT_UPDATE
+        std::int64_t updateTime = 0;        // milliseconds
+    };
+
+
+    struct AccountPosition
+    {
+        string symbol;
+        string positionSide;                // BOTH, LONG or SHORT
+        double amount = 0;
+        double entryPrice = 0;
+        double unrealizedProfit = 0;
+        double markPrice = 0;               // only from MARGIN_CALL
+        bool isolated = false;
+        double isolatedWallet = 0;
+        std::int64_t updateTime = 0;        // milliseconds
+    };
+
+
+    struct AccountOrder
+    {
+        string symbol;
+        string clientOrderId;
+        std::int64_t orderId = 0;
+        string side;
+        string positionSide;
+        string type;
+        string timeInForce;
+        string status;
+        double price = 0;
+        double stopPrice = 0;
+        double averagePrice = 0;
+        double quantity = 0;
+        double filledQuantity = 0;
+        bool reduceOnly = false;
+        std::int64_t updateTime = 0;        // milliseconds
+    };
+
+
+    /// An immutable copy of the account's state. Only positions with a non-zero amount and open orders are kept.
+    class AccountSnapshot
+    {
+    public:
+        using Balances = std::unordered_map<string, AccountBalance>;        // by asset
+        using Positions = std::unordered_map<string, AccountPosition>;      // by positionKey()
+        using Orders = std::unordered_map<std::int64_t, AccountOrder>;      // by order id
+
+
+        static string positionKey (const string_view symbol, const string_view positionSide)
+        {
+            string key {symbol};
+            key += ':';
+            key += positionSide;
+            return key;
+        }
+
+
+        const Balances& balances() const { return *m_balances; }
+        const Positions& positions() const { return *m_positions; }
+        const Orders& openOrders() const { return *m_orders; }
+
+        bool isBootstrapped() const { return m_bootstrapped; }
+        bool isStale() const { return m_stale; }                            // the listen key expired, events may have been missed
+        std::int64_t eventTime() const { return m_eventTime; }             // of the last event applied, milliseconds
+        std::uint64_t version() const { return m_version; }                // incremented for each change
+        std::uint64_t marginCalls() const { return m_marginCalls; }
+
+
+    private:
+        friend class AccountState;
+
+        std::shared_ptr<const Balances> m_balances = std::make_shared<Balances>();
+        std::shared_ptr<const Positions> m_positions = std::make_shared<Positions>();
+        std::shared_ptr<const Orders> m_orders = std::make_shared<Orders>();
+        bool m_bootstrapped = false;
+        bool m_stale = false;
+        std::int64_t m_eventTime = 0;
+        std::uint64_t m_version = 0;
+        std::uint64_t m_marginCalls = 0;
+    };
+
+
+    /// Keeps balances, positions and open orders for a futures account, so they don't need to be polled with REST.
+    ///
+    /// bootstrap() requests the account and open orders once, then the user data events, passed to onUserData(), are
+    /// applied to them: ACCOUNT_UPDATE to balances and positions, ORDER_TRADE_UPDATE to open orders and MARGIN_CALL to
+    /// positions. Events received before bootstrap completes are kept and applied after it, events older than the
+    /// bootstrapped state are ignored.
+    ///
+    /// Reads, from any thread, never lock or wait for updates. Each change publishes a new snapshot; only the table
+    /// which changed is copied, the others are shared with the previous snapshot.
+    ///
+    /// If the listen key expires the snapshot is marked stale, call bootstrap() again when the user data stream has
+    /// been restarted.
+    ///
+    /// bootstrap(BinanceBeast&) requires the AccountState to be owned by a std::shared_ptr, so replies which arrive after
+    /// it's destroyed are dropped.
+    class AccountState : public std::enable_shared_from_this<AccountState>
+    {
+    public:
+        using BootstrapHandler = std::function<void(const bool success, const string& failMessage)>;
+
+
+        /// Market::USDM or Market::COINM, throws for other markets.
+        explicit AccountState (const Market market) : m_snapshot(std::make_unique<AccountSnapshot>())
+        {
+            if (market == Market::USDM)
+            {
+                m_timePath = "/fapi/v1/time";
+                m_accountPath = "/fapi/v2/account";
+                m_openOrdersPath = "/fapi/v1/openOrders";
+            }
+            else if (market == Market::COINM)
+            {
+                m_timePath = "/dapi/v1/time";
+                m_accountPath = "/dapi/v1/account";
+                m_openOrdersPath = "/dapi/v1/openOrders";
+            }
+            else
+                throw std::runtime_error("AccountState requires Market::USDM or Market::COINM");
+        }
+
+
+        /// Request the account and open orders, and the server time. Call after startUserData() so events aren't
+        /// missed between the requests and the stream starting. The handler, if set, is called once all replies are
+        /// applied, or on the first to fail. Throws if the AccountState isn't owned by a std::shared_ptr.
+        void bootstrap (BinanceBeast& bb, BootstrapHandler handler = nullptr)
+        {
+            auto weak = weak_from_this();
+
+            if (weak.expired())
+                throw std::runtime_error("AccountState::bootstrap() requires the AccountState to be owned by a std::shared_ptr");
+
+            auto request = std::make_shared<BootstrapRequest>();
+            request->handler = std::move(handler);
+            request->sent = std::chrono::steady_clock::now();
+
+            {
+                std::scoped_lock lock (m_writeMux);
+                m_bootstrap = request;
+            }
+
+            bb.sendRestRequest([weak, request](RestResponse result)
+            {
+                if (auto self = weak.lock())
+                    self->onBootstrapReply(request, std::move(result), Reply::Time);
+
+            }, m_timePath, RestSign::Unsigned, RestParams{}, RequestType::Get);
+
+            bb.sendRestRequest([weak, request](RestResponse result)
+            {
+                if (auto self = weak.lock())
+                    self->onBootstrapReply(request, std::move(result), Reply::Account);
+
+            }, m_accountPath, RestSign::HMAC_SHA256, RestParams{}, RequestType::Get);
+
+            bb.sendRestRequest([weak, request](RestResponse result)
+            {
+                if (auto self = weak.lock())
+                    self->onBootstrapReply(request, std::move(result), Reply::OpenOrders);
+
+            }, m_openOrdersPath, RestSign::HMAC_SHA256, RestParams{}, RequestType::Get);
+        }
+
+
+        /// Pass each response from the user data stream. Other events are ignored.
+        void onUserData (const WsResponse& response)
+        {
+            if (response.state != WsResponse::State::Success || !response.json.is_object())
+                return;
+
+            std::scoped_lock lock (m_writeMux);
+
+            if (m_bootstrap)
+                m_pending.push_back(response.json);
+            else
+                apply(response.json.as_object(), 0);
+        }
+
+
+        /// Apply the replies from /fapi/v2/account and /fapi/v1/openOrders (or dapi), if not using bootstrap().
+        void bootstrap (const json::value& account, const json::value& openOrders)
+        {
+            std::scoped_lock lock (m_writeMux);
+            applyBootstrap(account, openOrders);
+        }
+
+
+        /// Calls f(const AccountSnapshot&), the snapshot is only valid within f. Lock free, from any thread.
+        template <typename F>
+        decltype(auto) read (F&& f) const
+        {
+            return m_snapshot.read(std::forward<F>(f));
+        }
+
+
+        std::optional<AccountBalance> balance (const string& asset) const
+        {
+            return read([&asset](const AccountSnapshot& snapshot) -> std::optional<AccountBalance>
+            {
+                if (auto it = snapshot.balances().find(asset); it != snapshot.balances().end())
+                    return it->second;
+
+                return std::nullopt;
+            });
+        }
+
+
+        /// positionSide is BOTH in one-way mode, LONG or SHORT in hedge mode.
+        std::optional<AccountPosition> position (const string& symbol, const string& positionSide = "BOTH") const
+        {
+            const auto key = AccountSnapshot::positionKey(symbol, positionSide);
+
+            return read([&key](const AccountSnapshot& snapshot) -> std::optional<AccountPosition>
+            {
+                if (auto it = snapshot.positions().find(key); it != snapshot.positions().end())
+                    return it->second;
+
+                return std::nullopt;
+            });
+        }
+
+
+        std::optional<AccountOrder> order (const std::int64_t orderId) const
+        {
+            return read([orderId](const AccountSnapshot& snapshot) -> std::optional<AccountOrder>
+            {
+                if (auto it = snapshot.openOrders().find(orderId); it != snapshot.openOrders().end())
+                    return it->second;
+
+                return std::nullopt;
+            });
+        }
+
+
+        /// Open orders for a symbol, or all if 'symbol' is empty.
+        std::vector<AccountOrder> openOrders (const string& symbol = "") const
+        {
+            return read([&symbol](const AccountSnapshot& snapshot)
+            {
+                std::vector<AccountOrder> orders;
+
+                for (auto& [id, order] : snapshot.openOrders())
+                {
+                    if (symbol.empty() || order.symbol == symbol)
+                        orders.push_back(order);
+                }
+
+                return orders;
+            });
+        }
+
+
+        std::vector<AccountPosition> positions () const
+        {
+            return read([](const AccountSnapshot& snapshot)
+            {
+                std::vector<AccountPosition> positions;
+
+                for (auto& [key, position] : snapshot.positions())
+                    positions.push_back(position);
+
+                return positions;
+            });
+        }
+
+
+        bool isBootstrapped() const
+        {
+            return read([](const AccountSnapshot& snapshot) { return snapshot.isBootstrapped(); });
+        }
+
+
+    private:
+        enum class Reply { Time, Account, OpenOrders };
+
+
+        struct BootstrapRequest
+        {
+            BootstrapHandler handler;
+            std::chrono::steady_clock::time_point sent;
+            std::optional<std::int64_t> since;              // exchange time, ms
+            std::optional<json::value> account;
+            std::optional<json::value> openOrders;
+            bool failed = false;
+        };
+
+
+        static double toDouble (const json::object& object, const string_view key)
+        {
+            if (auto value = object.if_contains(key))
+            {
+                if (value->is_string())
+                    return std::strtod(value->as_string().c_str(), nullptr);
+                else if (value->is_number())
+                    return value->to_number<double>();
+            }
+
+            return 0;
+        }
+
+
+        static std::int64_t toInt (const json::object& object, const string_view key)
+        {
+            if (auto value = object.if_contains(key); value && value->is_number())
+                return value->to_number<std::int64_t>();
+
+            return 0;
+        }
+
+
+        static string toString (const json::object& object, const string_view key)
+        {
+            if (auto value = object.if_contains(key); value && value->is_string())
+                return string{value->as_string().c_str()};
+
+            return {};
+        }
+
+
+        static bool toBool (const json::object& object, const string_view key)
+        {
+            auto value = object.if_contains(key);
+            return value && value->is_bool() && value->as_bool();
+        }
+
+
+        static bool isFinal (const string& status)
+        {
+            return status == "FILLED" || status == "CANCELED" || status == "EXPIRED" || status == "REJECTED" || status == "EXPIRED_IN_MATCH";
+        }
+
+
+        void onBootstrapReply (const std::shared_ptr<BootstrapRequest>& request, RestResponse&& result, const Reply reply)
+        {
+            BootstrapHandler handler;
+            bool success = false;
+            string failMessage;
+
+            {
+                std::scoped_lock lock (m_writeMux);
+
+                // a later bootstrap() replaced this one
+                if (m_bootstrap != request || request->failed)
+                    return;
+
+                const auto& path = reply == Reply::Time ? m_timePath : (reply == Reply::Account ? m_accountPath : m_openOrdersPath);
+                const auto serverTime = reply == Reply::Time && !result.hasErrorCode() && result.json.is_object() ? toInt(result.json.as_object(), "serverTime") : 0;
+
+                if (result.hasErrorCode() || (reply == Reply::Time && serverTime == 0))
+                {
+                    request->failed = true;
+                    failMessage = path + ": " + (result.failMessage.empty() ? string{"no serverTime"} : result.failMessage);
+                    handler = request->handler;
+
+                    // apply events as they arrive, to whatever state there is
+                    m_bootstrap.reset();
+                    applyPending(0);
+                }
+                else
+                {
+                    if (reply == Reply::Time)
+                    {
+                        // the requests were sent together, so the account was read no earlier than the server time less
+                        // the round trip. Compared with the events' exchange times, so the local clock's offset doesn't matter
+                        const auto roundTrip = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - request->sent).count();
+                        request->since = serverTime - roundTrip;
+                    }
+                    else
+                        (reply == Reply::Account ? request->account : request->openOrders) = std::move(result.json);
+
+                    if (!request->since || !request->account || !request->openOrders)
+                        return;
+
+                    applyBootstrap(*request->account, *request->openOrders);
+
+                    m_bootstrap.reset();
+                    applyPending(*request->since);
+
+                    handler = request->handler;
+                    success = true;
+                }
+            }
+
+            if (handler)
+                handler(success, failMessage);
+        }
+
+
+        void applyBootstrap (const json::value& account, const json::value& openOrders)
+        {
+            auto snapshot = std::make_unique<AccountSnapshot>(m_snapshot.writerView());
+            auto balances = std::make_shared<AccountSnapshot::Balances>();
+            auto positions = std::make_shared<AccountSnapshot::Positions>();
+            auto orders = std::make_shared<AccountSnapshot::Orders>();
+
+            if (auto object = account.if_object())
+            {
+                if (auto assets = object->if_contains("assets"); assets && assets->is_array())
+                {
+                    for (auto& value : assets->as_array())
+                    {
+                        auto& asset = value.as_object();
+
+                        AccountBalance balance;
+                        balance.asset = toString(asset, "asset");
+                        balance.walletBalance = toDouble(asset, "walletBalance");
+                        balance.crossWalletBalance = toDouble(asset, "crossWalletBalance");
+                        balance.updateTime = toInt(asset, "updateTime");
+
+                        (*balances)[balance.asset] = std::move(balance);
+                    }
+                }
+
+                if (auto all = object->if_contains("positions"); all && all->is_array())
+                {
+                    for (auto& value : all->as_array())
+                    {
+                        auto& entry = value.as_object();
+
+                        AccountPosition position;
+                        position.symbol = toString(entry, "symbol");
+                        position.positionSide = toString(entry, "positionSide");
+                        position.amount = toDouble(entry, "positionAmt");
+                        position.entryPrice = toDouble(entry, "entryPrice");
+                        position.unrealizedProfit = toDouble(entry, "unrealizedProfit");
+                        position.isolated = toBool(entry, "isolated");
+                        position.isolatedWallet = toDouble(entry, "isolatedWallet");
+                        position.updateTime = toInt(entry, "updateTime");
+
+                        if (position.amount != 0)
+                            (*positions)[AccountSnapshot::positionKey(position.symbol, position.positionSide)] = std::move(position);
+                    }
+                }
+            }
+
+            if (auto array = openOrders.if_array())
+            {
+                for (auto& value : *array)
+                {
+                    auto& entry = value.as_object();
+
+                    AccountOrder order;
+                    order.symbol = toString(entry, "symbol");
+                    order.clientOrderId = toString(entry, "clientOrderId");
+                    order.orderId = toInt(entry, "orderId");
+                    order.side = toString(entry, "side");
+                    order.positionSide = toString(entry, "positionSide");
+                    order.type = toString(entry, "type");
+                    order.timeInForce = toString(entry, "timeInForce");
+                    order.status = toString(entry, "status");
+                    order.price = toDouble(entry, "price");
+                    order.stopPrice = toDouble(entry, "stopPrice");
+                    order.averagePrice = toDouble(entry, "avgPrice");
+                    order.quantity = toDouble(entry, "origQty");
+                    order.filledQuantity = toDouble(entry, "executedQty");
+                    order.reduceOnly = toBool(entry, "reduceOnly");
+                    order.updateTime = toInt(entry, "updateTime");
+
+                    (*orders)[order.orderId] = std::move(order);
+                }
+            }
+
+            snapshot->m_balances = std::move(balances);
+            snapshot->m_positions = std::move(positions);
+            snapshot->m_orders = std::move(orders);
+            snapshot->m_bootstrapped = true;
+            snapshot->m_stale = false;
+            ++snapshot->m_version;
+
+            m_snapshot.update(std::move(snapshot));
+        }
+
+
+        /// Events received whilst bootstrapping. Positions and orders not in the replies are only added by events
+        /// at or after 'since', the exchange time when the requests were sent (ms).
+        void applyPending (const std::int64_t since)
+        {
+            for (auto& event : m_pending)
+                apply(event.as_object(), since);
+
+            m_pending.clear();
+        }
+
+
+        /// 'since' - positions and orders which are not in the snapshot are only added from events at or after this
+        /// time (ms).
+        void apply (const json::object& event, const std::int64_t since)
+        {
+            auto type = event.if_contains("e");
+
+            if (!type || !type->is_string())
+                return;
+
+            const auto& name = type->as_string();
+
+            if (name == "ACCOUNT_UPDATE")
+                applyAccountUpdate(event, since);
+            else if (name == "ORDER_TRADE_UPDATE")
+                applyOrderUpdate(event, since);
+            else if (name == "MARGIN_CALL")
+                applyMarginCall(event);
+            else if (name == "listenKeyExpired")
+            {
+                auto snapshot = std::make_unique<AccountSnapshot>(m_snapshot.writerView());
+                snapshot->m_stale = true;
+                ++snapshot->m_version;
+                m_snapshot.update(std::move(snapshot));
+            }
+        }
+
+
+        void applyAccountUpdate (const json::object& event, const std::int64_t since)
+        {
+            const auto eventTime = toInt(event, "E");
+            auto update = event.if_contains("a");
+
+            if (!update || !update->is_object())
+                return;
+
+            const auto& current = m_snapshot.writerView();
+            std::shared_ptr<AccountSnapshot::Balances> balances;
+            std::shared_ptr<AccountSnapshot::Positions> positions;
+
+            if (auto all = update->as_object().if_contains("B"); all && all->is_array())
+            {
+                for (auto& value : all->as_array())
+                {
+                    auto& entry = value.as_object();
+                    const auto asset = toString(entry, "a");
+
+                    if (auto it = current.balances().find(asset); it != current.balances().end() && it->second.updateTime > eventTime)
+                        continue;
+
+                    if (!balances)
+                        balances = std::make_shared<AccountSnapshot::Balances>(current.balances());
+
+                    auto& balance = (*balances)[asset];
+                    balance.asset = asset;
+                    balance.walletBalance = toDouble(entry, "wb");
+                    balance.crossWalletBalance = toDouble(entry, "cw");
+                    balance.balanceChange = toDouble(entry, "bc");
+                    balance.updateTime = eventTime;
+                }
+            }
+
+            if (auto all = update->as_object().if_contains("P"); all && all->is_array())
+            {
+                for (auto& value : all->as_array())
+                {
+                    auto& entry = value.as_object();
+                    const auto key = AccountSnapshot::positionKey(toString(entry, "s"), toString(entry, "ps"));
+
+                    auto it = current.positions().find(key);
+
+                    if (it != current.positions().end() ? it->second.updateTime > eventTime : eventTime < since)
+                        continue;
+
+                    if (!positions)
+                        positions = std::make_shared<AccountSnapshot::Positions>(current.positions());
+
+                    AccountPosition position;
+                    position.symbol = toString(entry, "s");
+                    position.positionSide = toString(entry, "ps");
+                    position.amount = toDouble(entry, "pa");
+                    position.entryPrice = toDouble(entry, "ep");
+                    position.unrealizedProfit = toDouble(entry, "up");
+                    position.isolated = toString(entry, "mt") == "isolated";
+                    position.isolatedWallet = toDouble(entry, "iw");
+                    position.updateTime = eventTime;
+
+                    if (position.amount == 0)
+                        positions->erase(key);
+                    else
+                        (*positions)[key] = std::move(position);
+                }
+            }
+
+            publish(eventTime, std::move(balances), std::move(positions), nullptr);
+        }
+
+
+        void applyOrderUpdate (const json::object& event, const std::int64_t since)
+        {
+            auto update = event.if_contains("o");
+
+            if (!update || !update->is_object())
+                return;
+
+            const auto& entry = update->as_object();
+            const auto& current = m_snapshot.writerView();
+            const auto orderId = toInt(entry, "i");
+            const auto time = toInt(entry, "T");
+            const auto status = toString(entry, "X");
+
+            auto existing = current.openOrders().find(orderId);
+            const bool isOpen = existing != current.openOrders().end();
+
+            if (isOpen && existing->second.updateTime > time)
+                return;
+            else if (!isOpen && (isFinal(status) || time < since))
+                return;
+
+            auto orders = std::make_shared<AccountSnapshot::Orders>(current.openOrders());
+
+            if (isFinal(status))
+                orders->erase(orderId);
+            else
+            {
+                auto& order = (*orders)[orderId];
+                order.symbol = toString(entry, "s");
+                order.clientOrderId = toString(entry, "c");
+                order.orderId = orderId;
+                order.side = toString(entry, "S");
+                order.positionSide = toString(entry, "ps");
+                order.type = toString(entry, "o");
+                order.timeInForce = toString(entry, "f");
+                order.status = status;
+                order.price = toDouble(entry, "p");
+                order.stopPrice = toDouble(entry, "sp");
+                order.averagePrice = toDouble(entry, "ap");
+                order.quantity = toDouble(entry, "q");
+                order.filledQuantity = toDouble(entry, "z");
+                order.reduceOnly = toBool(entry, "R");
+                order.updateTime = time;
+            }
+
+            publish(toInt(event, "E"), nullptr, nullptr, std::move(orders));
+        }
+
+
+        void applyMarginCall (const json::object& event)
+        {
+            const auto& current = m_snapshot.writerView();
+            auto positions = std::make_shared<AccountSnapshot::Positions>(current.positions());
+
+            if (auto all = event.if_contains("p"); all && all->is_array())
+            {
+                for (auto& value : all->as_array())
+                {
+                    auto& entry = value.as_object();
+                    const auto key = AccountSnapshot::positionKey(toString(entry, "s"), toString(entry, "ps"));
+
+                    if (auto it = positions->find(key); it != positions->end())
+                    {
+                        it->second.markPrice = toDouble(entry, "mp");
+                        it->second.unrealizedProfit = toDouble(entry, "up");
+                    }
+                }
+            }
+
+            auto snapshot = std::make_unique<AccountSnapshot>(current);
+            snapshot->m_positions = std::move(positions);
+            snapshot->m_eventTime = std::max(snapshot->m_eventTime, toInt(event, "E"));
+            ++snapshot->m_marginCalls;
+            ++snapshot->m_version;
+
+            m_snapshot.update(std::move(snapshot));
+        }
+
+
+        /// Publish a snapshot with the tables which changed, those that are null are shared with the current snapshot.
+        void publish (const std::int64_t eventTime, std::shared_ptr<AccountSnapshot::Balances> balances, std::shared_ptr<AccountSnapshot::Positions> positions,
+                      std::shared_ptr<AccountSnapshot::Orders> orders)
+        {
+            if (!balances && !positions && !orders)
+                return;
+
+            auto snapshot = std::make_unique<AccountSnapshot>(m_snapshot.writerView());
+
+            if (balances)
+                snapshot->m_balances = std::move(balances);
+
+            if (positions)
+                snapshot->m_positions = std::move(positions);
+
+            if (orders)
+                snapshot->m_orders = std::move(orders);
+
+            snapshot->m_eventTime = std::max(snapshot->m_eventTime, eventTime);
+            ++snapshot->m_version;
+
+            m_snapshot.update(std::move(snapshot));
+        }
+
+
+    private:
+        string m_timePath;
+        string m_accountPath;
+        string m_openOrdersPath;
+        RcuValue<AccountSnapshot> m_snapshot;
+        std::mutex m_writeMux;                              // updates, reads don't lock
+        std::shared_ptr<BootstrapRequest> m_bootstrap;      // whilst bootstrapping
+        std::vector<json::value> m_pending;                 // events received whilst bootstrapping
+    };
+}
+
+#endif
@@ -4,6 +4,13 @@
 
 #include "BinanceRest.h"
 #include "BinanceWebsockets.h"
+#include "BinanceFeedArbiter.h"
+#include "BinanceSequence.h"
+#include "BinanceKlines.h"
+#include "BinanceReplay.h"
+#include "BinanceUrlEncode.h"
+#include "BinanceSlotRegistry.h"
+#include "BinanceRuntime.h"
 
 #include <openssl/hmac.h>   // to sign query params
 #include <iostream>
@@ -13,17 +20,21 @@
 #include <unordered_map>
 #include <sstream>
 #include <set>
+#include <limits>
+#include <pthread.h>
 
 
 namespace bblib
 {
+    class WsApiSession;
+
+
     enum class RestSign
     {
         Unsigned,
         HMAC_SHA256
     };
 
-    
 
     /// 
     /// REST API docs:  https://binance-docs.github.io/apidocs/futures/en/#market-data-endpoints, 
@@ -47,32 +58,7 @@ namespace bblib
     class BinanceBeast
     {
     private:
-        struct IoContext
-        {
-            IoContext () = default;
-            IoContext(IoContext&&) = default;
-
-            IoContext(const IoContext&) = delete;
-            IoContext& operator=(const IoContext&) = delete;
-
-            ~IoContext()
-            {
-                guard.reset();
-                ioc->stop();
-                iocThread.join();
-            }
-
-            void start()
-            {
-                ioc = std::make_unique<net::io_context>();
-                guard = std::make_unique<net::executor_work_guard<net::io_context::executor_type>> (ioc->get_executor());
-                iocThread = std::move(std::thread([this]() { ioc->run(); }));
-            }
-            
-            std::unique_ptr<net::io_context> ioc;
-            std::thread iocThread;
-            std::unique_ptr<net::executor_work_guard<net::io_context::executor_type>> guard;
-        };
+        using IoContext = BinanceRuntime::IoContext;
 
         enum class UserDataStreamMode
         {
@@ -81,6 +67,21 @@ namespace bblib
             Close
         };
 
+        /// The sessions that belong to a WsToken. Usually one session, but an arbitrated stream has one per leg
+        /// and subscribe() opens more sessions when the existing ones are full.
+        /// The dispatcher, handler and arbiter don't change once registered, the mutex is for the others.
+        struct WsTokenSessions
+        {
+            std::mutex mux;
+            std::vector<std::shared_ptr<WsSession>> sessions;
+            std::vector<std::set<string>> streams;      // streams subscribed on each session, same index as 'sessions'
+            std::shared_ptr<FeedArbiter> arbiter;
+            std::shared_ptr<SequenceValidator> sequencer;
+            std::shared_ptr<WsHandlerDispatcher> dispatcher;
+            WebSocketResponseHandler handler;
+            bool combined = true;                       // false for "/ws/<stream>", so sessions opened by subscribe() are raw too
+        };
+
 
     public:
         BinanceBeast() ;
@@ -93,6 +94,63 @@ namespace bblib
         /// nRestIoContexts - how many asio::io_context to handle REST calls. Leave as default if unsure.
         /// nWebsockIoContexts - how many asio::io_context to handle websockets. Leave as default if unsure.
         void start(const ConnectionConfig& config, const size_t nRestIoContexts = 4, const size_t nWebsockIoContexts = 6);
+
+        /// As start(const ConnectionConfig&, const size_t, const size_t) but with control of each io_context's thread,
+        /// i.e. CPU affinity and scheduling policy.
+        ///
+        /// If iocs.orders is not empty, those io_contexts are only used for order entry: REST requests that are not a GET
+        /// and have "/order" or "Orders" in the path, such as "/fapi/v1/order", "/fapi/v1/batchOrders" and "/fapi/v1/allOpenOrders".
+        /// This keeps order latency independent of busy market data or other REST traffic.
+        ///
+        /// Throws if a thread's affinity or scheduling policy can't be set.
+        void start(const ConnectionConfig& config, const IoContextsConfig& iocs);
+
+        /// Run on the application's io_contexts rather than creating threads, i.e. to handle feeds on the same thread
+        /// as the strategy. With ExternalIoContexts::handlers set, REST and websocket handlers are called on that
+        /// executor, so with ExternalIoContexts::Make(ioc) everything happens on the threads running 'ioc'.
+        ///
+        /// The io_contexts must outlive this object. Websockets are closed when this is destroyed, but the io_contexts 
+        /// are not stopped.
+        void start(const ConnectionConfig& config, const ExternalIoContexts& iocs);
+
+        /// Reactor mode: no threads are created. Every REST response, websocket message and timer is delivered from
+        /// poll() or run_for(), called by the application, so handlers are always on the application's thread and
+        /// strategy state needs no locks. Call all functions from that thread. See BinanceRuntime::startReactor().
+        void startReactor(const ConnectionConfig& config, const std::chrono::seconds dnsTtl = std::chrono::seconds{60});
+
+        /// Reactor mode, run the handlers that are ready without blocking. Returns the number run. 
+        /// Throws if not started with startReactor().
+        size_t poll()
+        {
+            return m_runtime->poll();
+        }
+
+        /// Reactor mode, run handlers for up to 'duration', waiting for work. Returns the number run.
+        /// Throws if not started with startReactor().
+        template<typename Rep, typename Period>
+        size_t run_for (const std::chrono::duration<Rep, Period>& duration)
+        {
+            return m_runtime->run_for(duration);
+        }
+
+        /// Start on a runtime shared with other clients, rather than creating threads for this client. The runtime must
+        /// be started, see BinanceRuntime::Make(). This client's websockets are closed when it's destroyed, but the
+        /// runtime's threads keep running for its other clients.
+        ///
+        /// Root certificates are loaded on the runtime, BinanceRuntime::loadRootCertificate(), not this client.
+        void start(const ConnectionConfig& config, std::shared_ptr<BinanceRuntime> runtime);
+
+        /// The runtime this client runs on.
+        std::shared_ptr<BinanceRuntime> runtime() const
+        {
+            return m_runtime;
+        }
+
+        /// The config passed to start().
+        const ConnectionConfig& config() const
+        {
+            return m_config;
+        }
         
         /// Send a request to a REST endpoint.
         /// Some requests require a signature, the Binance API docs will say "HMAC SHA256" if so.
@@ -124,11 +182,70 @@ namespace bblib
         /// This starts a combined stream, for example receiving mark price for two different symbols without having to separate calls
         /// to startWebSocket(), and two response handlers, you can combine both into one stream.
         ///
+        /// There is no limit on the number of streams. If there are more than ConnectionConfig::maxStreamsPerConnection, the 
+        /// streams are split across connections on the least loaded io_contexts, still with one token, and the handler is 
+        /// still called from one thread. Connections are opened within Binance's connection attempt limit, 
+        /// ConnectionConfig::maxConnectionAttempts, so a very large set may take time to be fully connected.
+        ///
         /// Warning: if stream does not exist, Binance does not report this. Instead no data is pushed.
         ///
         /// See https://binance-docs.github.io/apidocs/futures/en/#websocket-market-streams 
         WsToken startWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams);
 
+        /// As startWebSocket(WebSocketResponseHandler, const std::set<string>&) but the update ids of diff depth streams
+        /// are validated, so a missed event is reported rather than silently corrupting a book. 
+        /// With SequenceConfig::resync, a gap is recovered with a REST depth snapshot, without reconnecting, 
+        /// which requires ConnectionConfig::market to be set. See SequenceValidator.
+        WsToken startWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams, SequenceConfig sequence);
+
+        /// Gaps and resyncs for a token returned by startWebSocket() with a SequenceConfig, otherwise all zero.
+        SequenceStats getSequenceStats (const WsToken& token);
+
+        /// Record the raw frames of websockets started after this call, including user data, to the recorder's journal.
+        /// Each record has the token id and a connection id, unique to this BinanceBeast. Pass nullptr to stop recording 
+        /// for new websockets. Call from the thread that starts websockets.
+        void setRecorder (std::shared_ptr<MarketDataRecorder> recorder)
+        {
+            m_recorder = std::move(recorder);
+        }
+
+        /// Start an arbitrated stream: the streams are subscribed over 'nLegs' independent connections, each
+        /// connecting to a different IP if the host resolves to more than one. Each event is passed to the handler 
+        /// the first time it arrives on any leg, copies arriving later on the other legs are dropped.
+        ///
+        /// Events are de-duplicated per stream and symbol using the event's "u", "a" or "E" field.
+        /// Use getArbitrationStats() to see how often each leg wins and by how much.
+        /// Stop with stopWebSocket(), which closes all legs.
+        WsToken startArbitratedWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams, const size_t nLegs = 2);
+
+        /// Per-leg win rate and latency advantage for a token returned by startArbitratedWebSocket().
+        /// If the token is unknown or not arbitrated, the returned stats have no legs.
+        ArbitrationStats getArbitrationStats (const WsToken& token);
+
+        /// Latency histograms for a token's responses, from Binance's event time to the end of the handler.
+        /// See WsLatencyStats for the stages. Recording is lock free, so this can be called while the stream is running.
+        /// If the token is unknown the snapshots are empty.
+        WsLatencySnapshot getLatencyStats (const WsToken& token);
+
+        /// Subscribe to more streams on an existing token, without reconnecting, using Binance's SUBSCRIBE method.
+        /// Streams are added to the token's existing connections, up to ConnectionConfig::maxStreamsPerConnection per
+        /// connection. A new connection is only opened when the existing connections are full.
+        /// If the token was returned by startWebSocket() with an empty set of streams, the first call opens the connection.
+        /// For arbitrated streams, the streams are subscribed on every leg.
+        ///
+        /// The stream data is passed to the token's handler. replyHandler, if set, is called with Binance's reply
+        /// for each connection the request is sent to. Streams the token already has are ignored.
+        void subscribe (const WsToken& token, const std::set<string>& streams, WebSocketResponseHandler replyHandler = nullptr);
+
+        /// Unsubscribe from streams, using Binance's UNSUBSCRIBE method. The connections stay open, even if they no longer
+        /// have any streams, so that later subscribe() calls can use them.
+        /// replyHandler, if set, is called with Binance's reply for each connection the request is sent to.
+        void unsubscribe (const WsToken& token, const std::set<string>& streams, WebSocketResponseHandler replyHandler = nullptr);
+
+        /// Request the streams subscribed on each of the token's connections, using Binance's LIST_SUBSCRIPTIONS method.
+        /// The handler is called once per connection, the "result" is an array of stream names.
+        void listSubscriptions (const WsToken& token, WebSocketResponseHandler replyHandler);
+
         /// Closes a websocket connection, including user data stream.
         /// token - the token, as returned from startWebSocket() or startUserData().
         /// handler - will be called when the stream is closed. The WebSocketResponseHandler::state will be State::Disconnect.
@@ -148,6 +265,12 @@ namespace bblib
         void closeUserData (WebSocketResponseHandler handler, const string_view stream);
 
 
+        /// Open a session to Binance's websocket API, for order entry without a REST request per order. See WsApiSession,
+        /// include BinanceWsApi.h. The handler, if set, is called if the connection fails.
+        /// Requires ConnectionConfig::wsOrderApiUri, which MakeLiveConfig(), MakeTestNetConfig() and MakeMockConfig() set.
+        std::shared_ptr<WsApiSession> startWsApi (WebSocketResponseHandler handler = nullptr);
+
+
         /// Load PEM file with root certificates. Use this in production, but for test/dev then the default certificate is likely ok.
         /// Call this before start().
         void loadRootCertificate (std::filesystem::path& path)
@@ -156,7 +279,7 @@ namespace bblib
                 fail("path to root certificate does not exist");
             else
             {
-                m_sslCtx->load_verify_file(path);                               
+                m_runtime->loadRootCertificate(path);
             }
         }
 
@@ -164,36 +287,51 @@ namespace bblib
         /// Call this before start().
         void addRootVerifyPath(const std::filesystem::path& path)
         {
-            m_sslCtx->add_verify_path(path);
+            m_runtime->addRootVerifyPath(path);
         }
         
 
-        /// Encode the string as a URL. Used for calls to the batchOrder, see the neworder example.
+        /// Encode the string as a URL. For batch orders, encodeBatchOrders() encodes the orders directly, see the neworder example.
         static std::string urlEncode (const string_view& s)  
         {
-            std::ostringstream os;
+            string encoded;
+            bblib::urlEncode(s, encoded);
+            return encoded;
+        }
+
+
+        /// HMAC SHA256 of 'data' with 'key', as lower case hex. Used to sign REST requests.
+        static string createSignature(const string& key, const string& data) noexcept
+        {
+            string hash;
 
-            for ( std::string_view::const_iterator ci = s.cbegin(); ci != s.cend(); ++ci )
+            if (unsigned char* digest = HMAC(EVP_sha256(), key.c_str(), static_cast<int>(key.size()), (unsigned char*)data.c_str(), data.size(), NULL, NULL); digest)
             {
-                if ( (*ci >= 'a' && *ci <= 'z') ||
-                     (*ci >= 'A' && *ci <= 'Z') ||
-                     (*ci >= '0' && *ci <= '9') )
-                { // allowed
-                    os << *ci;
-                }
-                else if ( *ci == ' ')
-                {
-                    os << '+';
-                }
-                else
-                {
-                    os << '%' << to_hex(*ci >> 4) << to_hex(*ci % 16);
-                }
+                hash = b2a_hex((char*)digest, 32);
             }
 
-            return os.str();
+            return hash;
         }
 
+
+        static string b2a_hex(const char* byte_arr, const int n) noexcept
+        {
+            const static std::string HexCodes = "0123456789abcdef";
+            string HexString;
+            for (int i = 0; i < n; ++i)
+            {
+                unsigned char BinValue = byte_arr[i];
+                HexString += HexCodes[(BinValue >> 4) & 0x0F];
+                HexString += HexCodes[BinValue & 0x0F];
+            }
+            return HexString;
+        }
+
+
+        /// The request target for a REST request: the path and query params. If signing, the timestamp and signature
+        /// params are added. Without params it's the path. The params are moved from.
+        static string makeRestTarget (const string& path, QueryParams& params, const bool sign, const string& secretKey);
+
         
 
     private:
@@ -201,28 +339,77 @@ namespace bblib
         void stop();
 
 
-        WsToken createWsSession (const string& host, const std::string& path, WebSocketResponseHandler&& handler);
-
+        WsToken createWsSession (const string& host, const std::string& path, WebSocketResponseHandler&& handler, std::set<string> streams = {});
 
-        inline void createRestSession(const string& host, const string& path, const bool createStrand, RestResponseHandler&& rc,  const bool sign, RestParams params, const RequestType type = RequestType::Get);
 
+        std::shared_ptr<WsSession> makeWsSession (IoContext& ioc, std::shared_ptr<WsHandlerDispatcher> dispatcher, const size_t nStreams);
 
-        inline net::io_context& getWsIoContext() noexcept;
         
+        /// Runs the session now, or later if Binance's connection attempt limit has been reached.
+        void runWsSession (const WsToken::TokenId id, std::shared_ptr<WsSession> session, const string& path, const string& host = "");
+
+
+        template<typename Streams>
+        static string makeCombinedStreamPath (const Streams& streams)
+        {
+            std::stringstream target ;
+            
+            for (auto& stream : streams)
+                target << stream + "/";
 
-        inline net::io_context& getRestIoContext() noexcept;
+            return "/stream?streams=" + target.str();
+        }
 
 
-        inline string createSignature(const string& key, const string& data) noexcept
+        /// "/ws/<stream>/<stream>...", the events are not wrapped in {"stream":...,"data":...}.
+        template<typename Streams>
+        static string makeRawStreamPath (const Streams& streams)
         {
-            string hash;
+            string target {"/ws"};
 
-            if (unsigned char* digest = HMAC(EVP_sha256(), key.c_str(), static_cast<int>(key.size()), (unsigned char*)data.c_str(), data.size(), NULL, NULL); digest)
-            {
-                hash = b2a_hex((char*)digest, 32);
-            }
+            for (auto& stream : streams)
+                target += "/" + stream;
 
-            return hash;
+            return target;
+        }
+
+
+        static json::object makeStreamRequest (const string_view method, const std::set<string>& streams)
+        {
+            json::array params;
+            for (auto& stream : streams)
+                params.emplace_back(stream);
+
+            return json::object {{"method", method}, {"params", std::move(params)}};
+        }
+
+
+        inline void createRestSession(const string& host, const string& path, const bool createStrand, RestResponseHandler&& rc,  const bool sign, RestParams params, const RequestType type = RequestType::Get);
+
+
+        static bool isOrderEntry (const string_view path, const RequestType type)
+        {
+            return type != RequestType::Get && (path.find("/order") != string_view::npos || path.find("Orders") != string_view::npos);
+        }
+
+
+        /// Callbacks from the runtime's threads that use this client check it's alive first, because a shared runtime
+        /// outlives its clients.
+        struct Lifetime
+        {
+            std::mutex mux;
+            bool alive = true;
+        };
+
+
+        /// Call f() if this client hasn't been stopped, holding the lifetime's lock so it can't be stopped until f() returns.
+        template<typename F>
+        static void ifAlive (const std::shared_ptr<Lifetime>& lifetime, F&& f)
+        {
+            std::scoped_lock lock (lifetime->mux);
+
+            if (lifetime->alive)
+                f();
         }
 
 
@@ -241,7 +428,7 @@ namespace bblib
             }
 
             // Look up the domain name
-            auto const results = resolver.resolve(m_config.restApiUri, "443");
+            auto const results = resolver.resolve(m_config.restApiUri, m_config.restPort);
 
             // Make the connection on the IP address we get from a lookup
             beast::get_lowest_layer(stream).connect(results);
@@ -317,43 +504,19 @@ namespace bblib
         }
 
 
-        inline string b2a_hex(char* byte_arr, const int n) noexcept
-        {
-            const static std::string HexCodes = "0123456789abcdef";
-            string HexString;
-            for (int i = 0; i < n; ++i)
-            {
-                unsigned char BinValue = byte_arr[i];
-                HexString += HexCodes[(BinValue >> 4) & 0x0F];
-                HexString += HexCodes[BinValue & 0x0F];
-            }
-            return HexString;
-        }
-
-
-        static unsigned char to_hex (const unsigned char x)
-        {
-            return x + (x > 9 ? ('A'-10) : '0');
-        }
-
-
     private:
 
         ConnectionConfig m_config;
         string m_listenKey;
-        std::shared_ptr<ssl::context> m_sslCtx;
-
-        // REST
-        net::thread_pool m_restCallersThreadPool;       // The users's callback functions are called from this pool rather than using the io_context's thread
-        std::vector<IoContext> m_restIocThreads;
-        std::atomic_size_t m_nextRestIoContext;
+        std::shared_ptr<BinanceRuntime> m_runtime;          // io_contexts, callers' pool, SSL contexts, possibly shared with other clients
+        bool m_ownsRuntime = true;
+        std::shared_ptr<ssl::context> m_sslCtx;             // the runtime's, for m_config.verifyPeer
+        std::shared_ptr<Lifetime> m_lifetime = std::make_shared<Lifetime>();
 
         // WebSockets
-        std::vector<IoContext> m_wsIocThreads;
-        std::atomic_size_t m_nextWsIoContext;
-        std::atomic_uint32_t m_nextWsId;
-        std::map<WsToken::TokenId, std::shared_ptr<WsSession>> m_wsSessions;
-        std::mutex m_wsSessionsMux;
+        SlotRegistry<std::shared_ptr<WsTokenSessions>> m_wsSessions;     // by WsToken::TokenId
+        std::shared_ptr<MarketDataRecorder> m_recorder;
+        std::atomic_uint32_t m_nextConnectionId {1};
     };
 
 }   // namespace BinanceBeast
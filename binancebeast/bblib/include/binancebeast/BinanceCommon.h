@@ -11,11 +11,19 @@
 #include <boost/asio/thread_pool.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/json.hpp>
+#include "BinanceEd25519.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <tuple>
 #include <string>
 #include <string_view>
+#include <sched.h>
+#include <sys/socket.h>
 
 
 namespace bblib
@@ -52,6 +60,138 @@ namespace bblib
     };
 
 
+    /// How an io_context's thread is run. 
+    struct ThreadConfig
+    {
+        enum class RunMode
+        {
+            Blocking,       // io_context::run(), the thread sleeps in epoll when there's no work
+            Spin            // io_context::poll() in a loop, see spinPolls
+        };
+
+        int cpu = -1;                       // pin the thread to this CPU, -1 to leave to the OS
+        int schedPolicy = SCHED_OTHER;      // SCHED_OTHER, SCHED_FIFO or SCHED_RR. FIFO and RR usually require privileges
+        int schedPriority = 0;              // for SCHED_FIFO and SCHED_RR, 1 (low) to 99 (high). Must be 0 for SCHED_OTHER
+
+        /// Spin avoids the wake up from epoll on each frame, at the cost of a CPU core at 100%.
+        /// Best used with 'cpu' set, for the io_contexts that need it, i.e. order entry and book ticker.
+        RunMode runMode = RunMode::Blocking;
+
+        /// For RunMode::Spin, the number of consecutive polls that find no work before parking the thread in epoll, 
+        /// for up to parkTimeout or until there's work. 0 never parks.
+        std::uint64_t spinPolls = 0;
+        std::chrono::microseconds parkTimeout {1000};
+
+        /// If not 0, sockets on this io_context have SO_BUSY_POLL set to this, so the kernel busy polls the device queue
+        /// for up to this time on a receive. Requires CAP_NET_ADMIN to set above net.core.busy_read, and for epoll,
+        /// net.core.busy_poll must be non-zero. 
+        int busyPollMicros = 0;
+    };
+
+
+    /// Runs the io_context on the calling thread, as set by the config's runMode, until the io_context is stopped.
+    inline void runIoContext (net::io_context& ioc, const ThreadConfig& config)
+    {
+        if (config.runMode == ThreadConfig::RunMode::Blocking)
+        {
+            ioc.run();
+            return;
+        }
+
+        std::uint64_t idlePolls = 0;
+
+        while (!ioc.stopped())
+        {
+            if (ioc.poll())
+                idlePolls = 0;
+            else if (config.spinPolls && ++idlePolls >= config.spinPolls)
+            {
+                ioc.run_one_for(config.parkTimeout);
+                idlePolls = 0;
+            }
+        }
+    }
+
+
+    /// Set SO_BUSY_POLL on the socket, see ThreadConfig::busyPollMicros.
+    template<typename Socket>
+    void setSocketBusyPoll (Socket& socket, const int micros, beast::error_code& ec)
+    {
+        ec = {};
+
+        if (micros > 0 && ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &micros, sizeof(micros)) != 0)
+            ec = beast::error_code{errno, boost::system::system_category()};
+    }
+
+
+    /// Load on an io_context, used to decide where to place new sessions and requests.
+    /// The counters are updated by the sessions, on the io_context's thread.
+    struct IoContextLoad
+    {
+        using Clock = std::chrono::steady_clock;
+
+        /// Parsing cost is roughly a fixed cost per message plus a cost per byte. This is how many bytes
+        /// are treated as costing the same as one message when comparing load, see cost().
+        static constexpr double BytesPerMessageCost = 512;
+
+        struct Rates
+        {
+            double messages = 0;    // per second
+            double bytes = 0;       // per second
+        };
+
+
+        /// Messages and bytes per second, measured since the previous sample. The sample, and cost(), are updated 
+        /// if it's older than minInterval, otherwise the previous rates are returned.
+        Rates rates (const Clock::duration minInterval = std::chrono::seconds{1})
+        {
+            std::scoped_lock lock (m_sampleMux);
+
+            const auto now = Clock::now();
+            
+            if (now - m_lastSample >= minInterval)
+            {
+                const auto messageCount = messages.load(std::memory_order_relaxed);
+                const auto byteCount = bytes.load(std::memory_order_relaxed);
+                const auto seconds = std::chrono::duration<double>(now - m_lastSample).count();
+
+                m_rates.messages = static_cast<double>(messageCount - m_lastMessages) / seconds;
+                m_rates.bytes = static_cast<double>(byteCount - m_lastBytes) / seconds;
+                m_lastMessages = messageCount;
+                m_lastBytes = byteCount;
+                m_lastSample = now;
+                m_cost.store(m_rates.messages + m_rates.bytes / BytesPerMessageCost, std::memory_order_relaxed);
+            }
+
+            return m_rates;
+        }
+
+
+        /// Observed load as a single figure, in messages per second, as of the last call to rates(). BinanceRuntime
+        /// samples every second, so this is a read of an atomic when choosing an io_context for a request.
+        double cost () const noexcept
+        {
+            return m_cost.load(std::memory_order_relaxed);
+        }
+
+
+        std::atomic_uint64_t messages {0};
+        std::atomic_uint64_t bytes {0};
+        std::atomic_int64_t streams {0};        // websocket streams on this io_context
+        std::atomic_int64_t pending {0};        // REST requests in progress on this io_context
+        std::atomic_uint64_t busyPollErrors {0};    // sockets SO_BUSY_POLL couldn't be set on, i.e. EPERM without CAP_NET_ADMIN
+        std::atomic_uint64_t timestampErrors {0};   // websockets SO_TIMESTAMPNS couldn't be enabled on
+
+    private:
+        std::mutex m_sampleMux;
+        Clock::time_point m_lastSample {Clock::now()};
+        std::uint64_t m_lastMessages = 0;
+        std::uint64_t m_lastBytes = 0;
+        Rates m_rates;
+        std::atomic<double> m_cost {0};
+    };
+
+
     struct ConnectionConfig
     {   
         static std::tuple<string, string> readKeyFile (const std::filesystem::path& p, const bool isLive)
@@ -117,6 +257,22 @@ namespace bblib
             return MakeConfig(apiKey, secretKey, true, market);
         }
 
+        /// For a local server which serves REST and websockets on one port, such as the mock server (binancebeast/mock).
+        /// The peer is not verified because the mock server's certificate is self-signed.
+        static ConnectionConfig MakeMockConfig (const Market market, const string& port, const string& apiKey = "", const string& secretKey = "", const string& host = "127.0.0.1")
+        {
+            ConnectionConfig config {host, host, false, ConnectionKeys{apiKey, secretKey}, port, port};
+            config.market = market;
+            config.wsOrderApiUri = host;
+            config.wsOrderApiPort = port;
+            config.wsOrderApiPath = market == Market::USDM ? "/ws-fapi/v1" : market == Market::COINM ? "/ws-dapi/v1" : "/ws-api/v3";
+
+            if (market == Market::SPOT)
+                config.maxStreamsPerConnection = 1024;
+
+            return config;
+        }
+
     public:
         struct ConnectionKeys
         {
@@ -131,6 +287,7 @@ namespace bblib
 
             string api;
             string secret;
+            std::shared_ptr<const Ed25519Key> ed25519;     // for an Ed25519 API key, see WsApiSession::logon()
         };
 
 
@@ -159,33 +316,52 @@ namespace bblib
             static std::string DefaultUsdFuturesTestnetRestUri {"testnet.binancefuture.com"};
             static std::string DefaultUsdFuturesWsUri {"fstream.binance.com"};
             static std::string DefaultUsdFuturesRestUri {"fapi.binance.com"};
+            static std::string DefaultUsdFuturesTestnetWsOrderApiUri {"testnet.binancefuture.com"};
+            static std::string DefaultUsdFuturesWsOrderApiUri {"ws-fapi.binance.com"};
 
             // COIN-M
             static std::string DefaultCoinFuturesTestnetWsUri {"dstream.binancefuture.com"};
             static std::string DefaultCoinFuturesTestnetRestUri {"testnet.binancefuture.com"};
             static std::string DefaultCoinFuturesWsUri {"dstream.binance.com"};
             static std::string DefaultCoinFuturesRestUri {"dapi.binance.com"};
+            static std::string DefaultCoinFuturesTestnetWsOrderApiUri {"testnet.binancefuture.com"};
+            static std::string DefaultCoinFuturesWsOrderApiUri {"ws-dapi.binance.com"};
 
             // SPOT
             static std::string DefaultSpotWsUri {"stream.binance.com"};
             static std::string DefaultSpotRestUri {"api.binance.com"};
             static std::string DefaultSpotTestnetWsUri {"testnet.binance.vision"};
             static std::string DefaultSpotTestnetRestUri {"testnet.binance.vision"};
+            static std::string DefaultSpotWsOrderApiUri {"ws-api.binance.com"};
+            static std::string DefaultSpotTestnetWsOrderApiUri {"ws-api.testnet.binance.vision"};
             
             if (market == Market::USDM)
             {
-                return (isLive ?    ConnectionConfig {DefaultUsdFuturesRestUri, DefaultUsdFuturesWsUri, true, ConnectionKeys{apiKey, secretKey}} : 
-                                    ConnectionConfig {DefaultUsdFuturesTestnetRestUri, DefaultUsdFuturesTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}} );                
+                auto config = (isLive ? ConnectionConfig {DefaultUsdFuturesRestUri, DefaultUsdFuturesWsUri, true, ConnectionKeys{apiKey, secretKey}} : 
+                                        ConnectionConfig {DefaultUsdFuturesTestnetRestUri, DefaultUsdFuturesTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}} );                
+                config.market = market;
+                config.wsOrderApiUri = isLive ? DefaultUsdFuturesWsOrderApiUri : DefaultUsdFuturesTestnetWsOrderApiUri;
+                config.wsOrderApiPath = "/ws-fapi/v1";
+                return config;
             }
             else if (market == Market::COINM)
             {
-                return (isLive ?    ConnectionConfig {DefaultCoinFuturesRestUri, DefaultCoinFuturesWsUri, true, ConnectionKeys{apiKey, secretKey}} :
-                                    ConnectionConfig {DefaultCoinFuturesTestnetRestUri, DefaultCoinFuturesTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}});
+                auto config = (isLive ? ConnectionConfig {DefaultCoinFuturesRestUri, DefaultCoinFuturesWsUri, true, ConnectionKeys{apiKey, secretKey}} :
+                                        ConnectionConfig {DefaultCoinFuturesTestnetRestUri, DefaultCoinFuturesTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}});
+                config.market = market;
+                config.wsOrderApiUri = isLive ? DefaultCoinFuturesWsOrderApiUri : DefaultCoinFuturesTestnetWsOrderApiUri;
+                config.wsOrderApiPath = "/ws-dapi/v1";
+                return config;
             }
             else if (market == Market::SPOT)
             {
-                return (isLive ?    ConnectionConfig {DefaultSpotRestUri, DefaultSpotWsUri, true, ConnectionKeys{apiKey, secretKey}, "443", "9443"} :
-                                    ConnectionConfig {DefaultSpotTestnetRestUri, DefaultSpotTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}});
+                auto config = (isLive ? ConnectionConfig {DefaultSpotRestUri, DefaultSpotWsUri, true, ConnectionKeys{apiKey, secretKey}, "443", "9443"} :
+                                        ConnectionConfig {DefaultSpotTestnetRestUri, DefaultSpotTestnetWsUri, false, ConnectionKeys{apiKey, secretKey}});
+                config.maxStreamsPerConnection = 1024;
+                config.market = market;
+                config.wsOrderApiUri = isLive ? DefaultSpotWsOrderApiUri : DefaultSpotTestnetWsOrderApiUri;
+                config.wsOrderApiPath = "/ws-api/v3";
+                return config;
             }
             else
                 throw std::runtime_error ("Invalid market type"); 
@@ -200,6 +376,134 @@ namespace bblib
         bool usingTestRootCertificates;
         string restPort = "443";
         string wsPort = "443";
+        size_t maxStreamsPerConnection = 200;   // Binance limit on streams per websocket connection, futures is 200, spot is 1024
+        size_t maxConnectionAttempts = 300;     // Binance limit on websocket connection attempts per IP within connectionAttemptsWindow
+        std::chrono::seconds connectionAttemptsWindow {300};
+        bool kernelReceiveTimestamps = false;   // websocket receive times from the kernel (SO_TIMESTAMPNS), see WsResponse::kernelReceiveTime
+        Market market = Market::None;           // set by MakeLiveConfig(), MakeTestNetConfig() and MakeMockConfig(), used to select REST paths such as the depth snapshot
+        string wsOrderApiUri;                   // Binance's websocket API, for order entry with BinanceBeast::startWsApi()
+        string wsOrderApiPath;
+        string wsOrderApiPort = "443";
+    };
+
+    
+    /// Limits connection attempts to 'max' within any 'window'. Attempts are reserved in order, 
+    /// an attempt beyond the limit is given a later time rather than refused.
+    class ConnectionRateLimiter
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        ConnectionRateLimiter (const size_t max, const Clock::duration window) : m_max(std::max<size_t>(max, 1)), m_window(window)
+        {
+        }
+
+
+        /// Reserve an attempt, returns the earliest time the connection can be made.
+        Clock::time_point reserve()
+        {
+            std::scoped_lock lock (m_mux);
+
+            const auto now = Clock::now();
+
+            while (!m_attempts.empty() && m_attempts.front() + m_window <= now)
+                m_attempts.pop_front();
+
+            auto when = m_attempts.empty() ? now : std::max(now, m_attempts.back());
+
+            if (m_attempts.size() >= m_max)
+                when = std::max(when, m_attempts[m_attempts.size() - m_max] + m_window);
+
+            m_attempts.push_back(when);
+            return when;
+        }
+
+
+    private:
+        const size_t m_max;
+        const Clock::duration m_window;
+        std::deque<Clock::time_point> m_attempts;
+        std::mutex m_mux;
+    };
+
+
+    /// Caches resolved addresses by host and port for 'ttl', so sessions to the same host, across all the clients of a
+    /// BinanceRuntime, don't each query DNS. A ttl of zero disables caching, every resolve queries DNS.
+    /// Thread safe. Failed lookups are not cached.
+    class DnsCache : public std::enable_shared_from_this<DnsCache>
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit DnsCache (const Clock::duration ttl) : m_ttl(ttl)
+        {
+        }
+
+
+        /// Resolve with the resolver, or from the cache. The handler is called as by tcp::resolver::async_resolve(), 
+        /// on the resolver's executor.
+        template<typename Handler>
+        void resolve (tcp::resolver& resolver, const string_view host, const string_view port, Handler&& handler)
+        {
+            auto key = string{host}.append(1, ':').append(port);
+
+            if (m_ttl > Clock::duration::zero())
+            {
+                std::scoped_lock lock (m_mux);
+
+                if (auto it = m_entries.find(key); it != m_entries.end() && Clock::now() < it->second.expires)
+                {
+                    ++m_hits;
+                    net::post(resolver.get_executor(), [handler = std::forward<Handler>(handler), results = it->second.results]() mutable
+                    {
+                        handler(beast::error_code{}, std::move(results));
+                    });
+                    return;
+                }
+            }
+
+            resolver.async_resolve(host, port, [self = shared_from_this(), key = std::move(key), handler = std::forward<Handler>(handler)](beast::error_code ec, tcp::resolver::results_type results) mutable
+            {
+                if (!ec && self->m_ttl > Clock::duration::zero())
+                {
+                    std::scoped_lock lock (self->m_mux);
+                    ++self->m_misses;
+                    self->m_entries[key] = Entry{results, Clock::now() + self->m_ttl};
+                }
+
+                handler(ec, std::move(results));
+            });
+        }
+
+
+        /// Remove all entries, so the next resolve of each host queries DNS.
+        void clear()
+        {
+            std::scoped_lock lock (m_mux);
+            m_entries.clear();
+        }
+
+
+        /// Resolves answered from the cache, and resolves that were cached after querying DNS.
+        std::pair<std::uint64_t, std::uint64_t> hitsAndMisses() const
+        {
+            std::scoped_lock lock (m_mux);
+            return {m_hits, m_misses};
+        }
+
+
+    private:
+        struct Entry
+        {
+            tcp::resolver::results_type results;
+            Clock::time_point expires;
+        };
+
+        const Clock::duration m_ttl;
+        mutable std::mutex m_mux;
+        std::map<string, Entry> m_entries;
+        std::uint64_t m_hits = 0;
+        std::uint64_t m_misses = 0;
     };
 
     
@@ -218,13 +522,13 @@ namespace bblib
         throw std::runtime_error(what);
     }
 
-    /// Call the user's callback with the failure on the thread pool.
+    /// Call the user's callback with the failure on the callers' executor, usually the thread pool.
     template<typename ResultT>
-    inline void fail(beast::error_code ec, const string what, net::thread_pool& callerPool, std::function<void(ResultT)> callback)
+    inline void fail(beast::error_code ec, const string what, const net::any_io_executor& callerExecutor, std::function<void(ResultT)> callback)
     {
         if (callback)
         {
-            net::post(callerPool, boost::bind(callback, ResultT {std::move(what + " " + ec.message())})); // call callback with  a Failed state
+            net::post(callerExecutor, boost::bind(callback, ResultT {std::move(what + " " + ec.message())})); // call callback with  a Failed state
         }    
     }
 
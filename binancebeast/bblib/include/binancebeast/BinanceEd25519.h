@@ -0,0 +1,119 @@
+#ifndef BINANCEBEAST_ED25519_H
+#define BINANCEBEAST_ED25519_H
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+namespace bblib
+{
+    /// An Ed25519 private key, for Binance API keys of the Ed25519 type. Signatures are base64, as Binance expects.
+    ///
+    /// Binance's websocket API accepts an Ed25519 signature for session.logon, after which requests on that connection
+    /// don't need a signature, see WsApiSession::logon().
+    ///
+    /// Create the key pair with:
+    ///     openssl genpkey -algorithm ed25519 -out private.pem
+    ///     openssl pkey -in private.pem -pubout -out public.pem
+    /// then register public.pem with Binance.
+    ///
+    /// sign() is thread safe.
+    class Ed25519Key
+    {
+    public:
+        /// From a PEM (PKCS #8) private key. Throws if it's not an Ed25519 private key.
+        static std::shared_ptr<const Ed25519Key> fromPem (const std::string_view pem)
+        {
+            std::unique_ptr<BIO, decltype(&BIO_free)> bio {BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size())), &BIO_free};
+            EVP_PKEY * key = bio ? PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr) : nullptr;
+
+            if (!key)
+                throw std::runtime_error("Ed25519 key: not a PEM private key");
+            else if (EVP_PKEY_id(key) != EVP_PKEY_ED25519)
+            {
+                EVP_PKEY_free(key);
+                throw std::runtime_error("Ed25519 key: the private key is not Ed25519");
+            }
+
+            return std::shared_ptr<const Ed25519Key>{new Ed25519Key{key}};
+        }
+
+
+        /// From a PEM file, i.e. private.pem created as above.
+        static std::shared_ptr<const Ed25519Key> fromFile (const std::filesystem::path& path)
+        {
+            if (!std::filesystem::exists(path))
+                throw std::runtime_error("Ed25519 key: file does not exist");
+
+            std::ifstream file (path);
+            std::stringstream pem;
+            pem << file.rdbuf();
+
+            return fromPem(pem.str());
+        }
+
+
+        ~Ed25519Key()
+        {
+            EVP_PKEY_free(m_key);
+        }
+
+        Ed25519Key (const Ed25519Key&) = delete;
+        Ed25519Key& operator= (const Ed25519Key&) = delete;
+
+
+        /// The Ed25519 signature of 'data', base64 encoded.
+        std::string sign (const std::string_view data) const
+        {
+            std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx {EVP_MD_CTX_new(), &EVP_MD_CTX_free};
+
+            unsigned char signature [64];
+            size_t size = sizeof(signature);
+
+            // Ed25519 hashes internally, so no digest
+            if (!ctx || EVP_DigestSignInit(ctx.get(), nullptr, nullptr, nullptr, m_key) != 1 ||
+                EVP_DigestSign(ctx.get(), signature, &size, reinterpret_cast<const unsigned char *>(data.data()), data.size()) != 1)
+            {
+                throw std::runtime_error("Ed25519 key: sign failed");
+            }
+
+            std::string encoded (4 * ((size + 2) / 3), '\0');
+            encoded.resize(EVP_EncodeBlock(reinterpret_cast<unsigned char *>(encoded.data()), signature, static_cast<int>(size)));
+            return encoded;
+        }
+
+
+        /// The public key, as PEM, which is registered with Binance.
+        std::string publicKeyPem() const
+        {
+            std::unique_ptr<BIO, decltype(&BIO_free)> bio {BIO_new(BIO_s_mem()), &BIO_free};
+
+            if (!bio || PEM_write_bio_PUBKEY(bio.get(), m_key) != 1)
+                throw std::runtime_error("Ed25519 key: failed to write public key");
+
+            char * data = nullptr;
+            const auto size = BIO_get_mem_data(bio.get(), &data);
+            return std::string(data, static_cast<size_t>(size));
+        }
+
+
+    private:
+        explicit Ed25519Key (EVP_PKEY * key) : m_key(key)
+        {
+        }
+
+
+    private:
+        EVP_PKEY * m_key;
+    };
+}
+
+#endif
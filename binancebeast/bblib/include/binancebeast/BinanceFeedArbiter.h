@@ -0,0 +1,337 @@
+#ifndef BINANCEBEAST_FEEDARBITER_H
+#define BINANCEBEAST_FEEDARBITER_H
+
+#include "BinanceWebsockets.h"
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+namespace bblib
+{
+    /// Statistics for one leg (connection) of an arbitrated stream.
+    struct ArbitrationLegStats
+    {
+        /// Fraction of events received on this leg that it delivered first.
+        double winRate() const
+        {
+            return received ? static_cast<double>(wins) / static_cast<double>(received) : 0.0;
+        }
+
+        /// Average lead over the slower leg(s) when this leg won.
+        std::chrono::nanoseconds meanAdvantage() const
+        {
+            return advantageSamples ? advantageTotal / static_cast<std::int64_t>(advantageSamples) : std::chrono::nanoseconds{0};
+        }
+
+        std::uint64_t received = 0;         // keyed events received on this leg
+        std::uint64_t wins = 0;             // events this leg delivered first
+        std::uint64_t duplicates = 0;       // events already delivered by another leg
+        std::uint64_t stale = 0;            // events older than the last delivered event for the same key
+        std::uint64_t wireWins = 0;         // duplicates that arrived at the host before the delivered copy, see below
+        bool connected = true;              // false once the leg's connection has failed
+
+        std::uint64_t advantageSamples = 0; // number of times a slower leg later received an event this leg won
+        std::chrono::nanoseconds advantageTotal {0};
+        std::chrono::nanoseconds advantageMax {0};
+
+        // advantageHistogram[i] counts leads in [2^(i-1), 2^i) microseconds, [0] is < 1us, the last bucket is open ended
+        std::array<std::uint64_t, 24> advantageHistogram {};
+    };
+
+
+    /// Statistics for an arbitrated stream, see BinanceBeast::startArbitratedWebSocket().
+    struct ArbitrationStats
+    {
+        std::vector<ArbitrationLegStats> legs;
+        std::uint64_t delivered = 0;        // events passed to the handler
+        std::uint64_t unkeyed = 0;          // responses without an event id, delivered from the lowest connected leg
+    };
+
+
+    /// Receives the same streams from several WsSessions ("legs") and delivers each event to the handler
+    /// the first time it arrives on any leg. Later copies from the other legs are dropped.
+    ///
+    /// Events are identified by the stream name and symbol, with the event id taken from "t" for trades, "a" for
+    /// aggregate trades and "u" (update id) for book tickers and depth. An event is delivered if its id is greater
+    /// than the last one delivered for the same stream/symbol. Events without an id, i.e. mark price and klines, are
+    /// unkeyed, their event time isn't unique. Those are delivered from the lowest numbered leg which is connected, so
+    /// they fail over to the next leg if that leg's connection fails.
+    ///
+    /// Legs call onReceive() from their io_context threads. As with WsSession, the handler is called from a
+    /// thread pool, in the order events are delivered. Latency stats are only recorded for delivered events.
+    ///
+    /// Leads are measured with WsResponse::arrivalTime(), so with kernel receive timestamps a duplicate can turn out to
+    /// have reached the host first but been read later, e.g. because its io_context was busy. That is counted as a
+    /// wireWin for the duplicate's leg and the lead is credited to it.
+    class FeedArbiter
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+
+        /// See WsHandlerDispatcher for the handlerExecutor.
+        FeedArbiter (WebSocketResponseHandler handler, const size_t nLegs, const std::optional<net::any_io_executor>& handlerExecutor = std::nullopt)
+            :   m_dispatcher(std::make_shared<WsHandlerDispatcher>(std::move(handler), handlerExecutor))
+        {
+            m_stats.legs.resize(nLegs);
+        }
+
+
+        /// Called by a leg for each decoded response.
+        void onReceive (const size_t leg, WsResponse&& response)
+        {
+            const auto now = response.receiveTime == Clock::time_point{} ? Clock::now() : response.arrivalTime();
+
+            {
+                std::scoped_lock lock (m_mux);
+
+                if (!pick(leg, response, now))
+                    return;
+
+                m_pending.emplace_back(std::move(response));
+
+                if (m_delivering)
+                    return;
+
+                m_delivering = true;
+            }
+
+            deliverPending();
+        }
+
+
+        /// Called by a leg when its connection fails. The leg no longer delivers unkeyed events, and the failure is
+        /// passed to the handler, in order with the delivered events.
+        void onFailure (const size_t leg, WsResponse&& response)
+        {
+            {
+                std::scoped_lock lock (m_mux);
+
+                m_stats.legs[leg].connected = false;
+                m_pending.emplace_back(std::move(response));
+
+                if (m_delivering)
+                    return;
+
+                m_delivering = true;
+            }
+
+            deliverPending();
+        }
+
+
+        ArbitrationStats stats() const
+        {
+            std::scoped_lock lock (m_mux);
+            return m_stats;
+        }
+
+
+        WebSocketResponseHandler handler() const
+        {
+            return m_dispatcher->handler();
+        }
+
+
+        const std::shared_ptr<WsHandlerDispatcher>& dispatcher() const
+        {
+            return m_dispatcher;
+        }
+
+
+    private:
+        /// Called with m_mux held. Updates the stats, returns true if the response is to be delivered.
+        bool pick (const size_t leg, const WsResponse& response, const Clock::time_point now)
+        {
+            std::uint64_t id = 0;
+
+            if (!eventKey(response.json, m_key, id))
+            {
+                if (leg != firstConnectedLeg())
+                    return false;
+
+                ++m_stats.unkeyed;
+                return true;
+            }
+
+            auto& legStats = m_stats.legs[leg];
+            ++legStats.received;
+
+            if (auto it = m_events.find(m_key); it == m_events.end() || id > it->second.id)
+            {
+                auto& event = it == m_events.end() ? m_events[m_key] : it->second;
+                event.id = id;
+                event.firstArrival = now;
+                event.winner = leg;
+
+                ++legStats.wins;
+                ++m_stats.delivered;
+                return true;
+            }
+            else if (id == it->second.id)
+            {
+                ++legStats.duplicates;
+
+                if (const auto lead = std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second.firstArrival); lead.count() >= 0)
+                    recordAdvantage(m_stats.legs[it->second.winner], lead);
+                else
+                {
+                    ++legStats.wireWins;
+                    recordAdvantage(legStats, -lead);
+                }
+            }
+            else
+            {
+                ++legStats.stale;
+            }
+
+            return false;
+        }
+
+
+        /// Called with m_mux held. The leg which delivers unkeyed events.
+        size_t firstConnectedLeg() const
+        {
+            for (size_t leg = 0 ; leg < m_stats.legs.size() ; ++leg)
+            {
+                if (m_stats.legs[leg].connected)
+                    return leg;
+            }
+
+            return m_stats.legs.size();
+        }
+
+
+        /// One leg at a time delivers, so events are dispatched in the order they were picked. The other legs queue
+        /// their events and return, rather than waiting on m_mux whilst dispatch() blocks on a full handler queue.
+        void deliverPending()
+        {
+            std::vector<WsResponse> responses;
+
+            while (true)
+            {
+                {
+                    std::scoped_lock lock (m_mux);
+
+                    if (m_pending.empty())
+                    {
+                        m_delivering = false;
+                        return;
+                    }
+
+                    responses.swap(m_pending);
+                }
+
+                for (auto& response : responses)
+                    deliver(std::move(response));
+
+                responses.clear();
+            }
+        }
+
+
+        void deliver (WsResponse&& response)
+        {
+            if (response.receiveTime != Clock::time_point{})
+                recordReceiveLatency(*m_dispatcher->latency(), response);
+
+            m_dispatcher->dispatch(std::move(response));
+        }
+
+
+        struct EventState
+        {
+            std::uint64_t id = 0;
+            Clock::time_point firstArrival;
+            size_t winner = 0;
+        };
+
+
+        static bool readEventId (const json::value * value, std::uint64_t& id)
+        {
+            if (!value)
+                return false;
+            else if (value->is_uint64())
+                id = value->as_uint64();
+            else if (value->is_int64())
+                id = static_cast<std::uint64_t>(value->as_int64());
+            else
+                return false;
+
+            return true;
+        }
+
+
+        /// Creates the de-duplication key (stream and symbol) and extracts the event id.
+        static bool eventKey (const json::value& msg, string& key, std::uint64_t& id)
+        {
+            const json::object * object = msg.if_object();
+            if (!object)
+                return false;
+
+            key.clear();
+
+            // combined stream: {"stream":"<streamName>","data":<rawPayload>}
+            const json::value * data = &msg;
+            if (auto stream = object->if_contains("stream"); stream && stream->is_string())
+            {
+                key = stream->as_string();
+
+                if (data = object->if_contains("data"); !data)
+                    return false;
+            }
+
+            // "all market" arrays (!markPrice@arr, !ticker@arr) only have the event time, so are unkeyed
+            if (auto event = data->if_object())
+            {
+                if (auto symbol = event->if_contains("s"); symbol && symbol->is_string())
+                {
+                    key += '|';
+                    key += symbol->as_string();
+                }
+
+                if (auto type = event->if_contains("e"); type && type->is_string())
+                {
+                    if (type->as_string() == "trade")
+                        return readEventId(event->if_contains("t"), id);
+                    else if (type->as_string() == "aggTrade")
+                        return readEventId(event->if_contains("a"), id);
+                }
+
+                // bookTicker (SPOT's has no "e") and depthUpdate
+                return readEventId(event->if_contains("u"), id);
+            }
+
+            return false;
+        }
+
+
+        static void recordAdvantage (ArbitrationLegStats& winner, const std::chrono::nanoseconds lead)
+        {
+            ++winner.advantageSamples;
+            winner.advantageTotal += lead;
+            winner.advantageMax = std::max(winner.advantageMax, lead);
+
+            size_t bucket = 0;
+            for (auto us = lead.count() / 1000; us > 0 && bucket < winner.advantageHistogram.size() - 1; us >>= 1)
+                ++bucket;
+
+            ++winner.advantageHistogram[bucket];
+        }
+
+
+    private:
+        std::shared_ptr<WsHandlerDispatcher> m_dispatcher;
+        mutable std::mutex m_mux;
+        std::unordered_map<string, EventState> m_events;
+        ArbitrationStats m_stats;
+        string m_key;                       // reused to avoid an allocation per event
+        std::vector<WsResponse> m_pending;  // picked, not yet dispatched
+        bool m_delivering = false;          // a leg is in deliverPending()
+    };
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef BINANCEBEAST_KLINES_H
+#define BINANCEBEAST_KLINES_H
+
+#include "BinanceWebsockets.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+
+namespace bblib
+{
+    /// A candle, with the same fields as Binance's kline.
+    struct Kline
+    {
+        std::int64_t openTime = 0;      // milliseconds
+        std::int64_t closeTime = 0;     // milliseconds, openTime + interval - 1 as Binance does
+        double open = 0;
+        double high = 0;
+        double low = 0;
+        double close = 0;
+        double volume = 0;
+        double quoteVolume = 0;
+        double takerBuyVolume = 0;
+        double takerBuyQuoteVolume = 0;
+        std::uint64_t trades = 0;
+        bool closed = false;
+    };
+
+
+    /// Builds klines for any number of intervals from a trade stream, so klines don't need their own streams,
+    /// and a candle is closed as soon as the first trade of the next candle arrives rather than when Binance pushes it.
+    ///
+    /// Feed it "<symbol>@aggTrade" responses with onAggTrade(), or trades from elsewhere with addTrade(). Each trade
+    /// updates the current candle of each interval, in O(1) per interval. Closed candles are kept in a ring buffer of
+    /// 'history' candles per symbol and interval.
+    ///
+    /// A candle with no trades is closed with the previous close for open, high, low and close, as Binance does.
+    /// If there are no trades, candles are only closed when the next trade arrives, or when advance() is called,
+    /// i.e. from a timer.
+    ///
+    /// Intervals are aligned to the epoch (UTC), a week to Monday. Months are not supported.
+    ///
+    /// Not thread safe, call from the handler's thread.
+    class KlineBuilder
+    {
+    public:
+        using Interval = std::chrono::milliseconds;
+        using KlineHandler = std::function<void(const string& symbol, const Interval interval, const Kline& kline)>;
+
+
+        /// The handler is called for each closed candle, and if 'emitInProgress' is true, also with the current
+        /// candle after each trade.
+        KlineBuilder (const std::vector<Interval>& intervals, KlineHandler handler, const size_t history = 1000, const bool emitInProgress = false)
+            :   m_intervals(intervals),
+                m_handler(std::move(handler)),
+                m_history(std::max<size_t>(1, history)),
+                m_emitInProgress(emitInProgress)
+        {
+            for (auto interval : m_intervals)
+            {
+                if (interval.count() <= 0)
+                    throw std::runtime_error("kline interval must be positive");
+            }
+        }
+
+
+        /// Binance's interval names: 1s, 1m, 3m, 5m, 15m, 30m, 1h, 2h, 4h, 6h, 8h, 12h, 1d, 3d, 1w.
+        /// Throws for an invalid interval, and for months.
+        static Interval parseInterval (const string_view name)
+        {
+            char * end = nullptr;
+            const string number {name.substr(0, name.empty() ? 0 : name.size() - 1)};
+            const auto n = std::strtoll(number.c_str(), &end, 10);
+
+            if (number.empty() || *end != '\0' || n <= 0)
+                throw std::runtime_error("invalid kline interval: " + string{name});
+
+            switch (name.back())
+            {
+                case 's':   return std::chrono::seconds{n};
+                case 'm':   return std::chrono::minutes{n};
+                case 'h':   return std::chrono::hours{n};
+                case 'd':   return std::chrono::hours{24 * n};
+                case 'w':   return std::chrono::hours{24 * 7 * n};
+                default:    throw std::runtime_error("invalid kline interval: " + string{name});
+            }
+        }
+
+
+        /// Update klines from an aggTrade event, raw or combined stream. Returns false if it is not an aggTrade.
+        bool onAggTrade (const json::value& msg)
+        {
+            const json::object * event = msg.if_object();
+
+            if (event)
+            {
+                if (auto data = event->if_contains("data"))
+                    event = data->if_object();
+            }
+
+            if (!event)
+                return false;
+            else if (auto e = event->if_contains("e"); !e || !e->is_string() || e->as_string() != "aggTrade")
+                return false;
+
+            const auto& symbol = event->at("s").as_string();
+            const auto price = std::strtod(event->at("p").as_string().c_str(), nullptr);
+            const auto quantity = std::strtod(event->at("q").as_string().c_str(), nullptr);
+            const auto trades = json::value_to<std::uint64_t>(event->at("l")) - json::value_to<std::uint64_t>(event->at("f")) + 1;
+
+            m_symbol.assign(symbol.data(), symbol.size());
+            addTrade(m_symbol, json::value_to<std::int64_t>(event->at("T")), price, quantity, event->at("m").as_bool(), trades);
+            return true;
+        }
+
+
+        /// Update klines with a trade. 'time' is the trade time in milliseconds. 'trades' is the number of trades
+        /// this represents, i.e. an aggregate trade.
+        void addTrade (const string& symbol, const std::int64_t time, const double price, const double quantity, const bool buyerMaker, const std::uint64_t trades = 1)
+        {
+            for (auto& series : seriesFor(symbol))
+            {
+                const auto openTime = alignedOpenTime(series.interval, time);
+
+                if (series.current.closeTime == 0)
+                    startCandle(series, openTime, price);
+                else if (openTime > series.current.openTime)
+                    roll(symbol, series, openTime);
+                else if (openTime < series.current.openTime)
+                    continue;   // late trade, the candle is already closed
+
+                auto& candle = series.current;
+
+                if (candle.trades == 0)
+                    candle.open = candle.high = candle.low = price;
+                else
+                {
+                    candle.high = std::max(candle.high, price);
+                    candle.low = std::min(candle.low, price);
+                }
+
+                candle.close = price;
+                candle.volume += quantity;
+                candle.quoteVolume += price * quantity;
+                candle.trades += trades;
+
+                if (!buyerMaker)
+                {
+                    candle.takerBuyVolume += quantity;
+                    candle.takerBuyQuoteVolume += price * quantity;
+                }
+
+                if (m_emitInProgress && m_handler)
+                    m_handler(symbol, series.interval, candle);
+            }
+        }
+
+
+        /// Close candles that end before 'now' (milliseconds), for when there are no trades to close them.
+        void advance (const std::int64_t now)
+        {
+            for (auto& [symbol, allSeries] : m_series)
+            {
+                for (auto& series : allSeries)
+                {
+                    if (series.current.closeTime != 0 && now > series.current.closeTime)
+                        roll(symbol, series, alignedOpenTime(series.interval, now));
+                }
+            }
+        }
+
+
+        /// The current, not closed, candle, or nullptr if there have been no trades for the symbol.
+        const Kline * current (const string& symbol, const Interval interval) const
+        {
+            const auto series = find(symbol, interval);
+            return series && series->current.closeTime != 0 ? &series->current : nullptr;
+        }
+
+
+        /// Closed candles, oldest first, up to 'history' candles.
+        std::vector<Kline> history (const string& symbol, const Interval interval) const
+        {
+            std::vector<Kline> klines;
+
+            if (const auto series = find(symbol, interval))
+            {
+                klines.reserve(series->count);
+
+                const auto first = (series->next + series->ring.size() - series->count) % series->ring.size();
+
+                for (size_t i = 0 ; i < series->count ; ++i)
+                    klines.push_back(series->ring[(first + i) % series->ring.size()]);
+            }
+
+            return klines;
+        }
+
+
+        const std::vector<Interval>& intervals() const
+        {
+            return m_intervals;
+        }
+
+
+    private:
+        struct Series
+        {
+            Interval interval;
+            Kline current;
+            std::vector<Kline> ring;
+            size_t next = 0;
+            size_t count = 0;
+        };
+
+
+        static std::int64_t alignedOpenTime (const Interval interval, const std::int64_t time)
+        {
+            // the epoch is a Thursday, Binance's weeks start on Monday
+            static constexpr std::int64_t WeekOffset = 4 * 24 * 60 * 60 * 1000LL;
+
+            const auto length = interval.count();
+            const auto offset = length % (7 * 24 * 60 * 60 * 1000LL) == 0 ? WeekOffset : 0;
+
+            return ((time - offset) / length) * length + offset;
+        }
+
+
+        std::vector<Series>& seriesFor (const string& symbol)
+        {
+            auto it = m_series.find(symbol);
+
+            if (it == m_series.end())
+            {
+                std::vector<Series> allSeries (m_intervals.size());
+
+                for (size_t i = 0 ; i < m_intervals.size() ; ++i)
+                {
+                    allSeries[i].interval = m_intervals[i];
+                    allSeries[i].ring.resize(m_history);
+                }
+
+                it = m_series.emplace(symbol, std::move(allSeries)).first;
+            }
+
+            return it->second;
+        }
+
+
+        const Series * find (const string& symbol, const Interval interval) const
+        {
+            if (auto it = m_series.find(symbol); it != m_series.end())
+            {
+                for (auto& series : it->second)
+                {
+                    if (series.interval == interval)
+                        return &series;
+                }
+            }
+
+            return nullptr;
+        }
+
+
+        static void startCandle (Series& series, const std::int64_t openTime, const double price)
+        {
+            series.current = Kline{};
+            series.current.openTime = openTime;
+            series.current.closeTime = openTime + series.interval.count() - 1;
+            series.current.open = series.current.high = series.current.low = series.current.close = price;
+        }
+
+
+        /// Close the current candle, and any empty candles, so the current candle opens at 'openTime'.
+        void roll (const string& symbol, Series& series, const std::int64_t openTime)
+        {
+            const auto length = series.interval.count();
+            const auto previousClose = series.current.close;
+
+            close(symbol, series);
+
+            // no point creating more empty candles than can be kept
+            auto next = std::max(series.current.openTime + length, openTime - static_cast<std::int64_t>(m_history) * length);
+
+            for ( ; next < openTime ; next += length)
+            {
+                startCandle(series, next, previousClose);
+                close(symbol, series);
+            }
+
+            startCandle(series, openTime, previousClose);
+        }
+
+
+        void close (const string& symbol, Series& series)
+        {
+            series.current.closed = true;
+
+            series.ring[series.next] = series.current;
+            series.next = (series.next + 1) % series.ring.size();
+            series.count = std::min(series.count + 1, series.ring.size());
+
+            if (m_handler)
+                m_handler(symbol, series.interval, series.current);
+        }
+
+
+    private:
+        std::vector<Interval> m_intervals;
+        KlineHandler m_handler;
+        size_t m_history;
+        bool m_emitInProgress;
+        std::unordered_map<string, std::vector<Series>> m_series;
+        string m_symbol;    // reused to avoid an allocation per trade
+    };
+}
+
+#endif
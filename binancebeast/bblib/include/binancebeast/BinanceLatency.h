@@ -0,0 +1,191 @@
+#ifndef BINANCEBEAST_LATENCY_H
+#define BINANCEBEAST_LATENCY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+namespace bblib
+{
+    /// A copy of a LatencyHistogram's counts, to query percentiles etc.
+    struct LatencySnapshot
+    {
+        /// The value (nanoseconds) at or below which 'p' (0.0 to 1.0) of the samples are.
+        /// Accurate to the histogram's bucket size, within ~6%.
+        std::int64_t percentile (const double p) const;
+
+        std::int64_t mean() const
+        {
+            return count ? sum / static_cast<std::int64_t>(count) : 0;
+        }
+
+        void merge (const LatencySnapshot& other)
+        {
+            if (counts.size() < other.counts.size())
+                counts.resize(other.counts.size());
+
+            for (size_t i = 0 ; i < other.counts.size() ; ++i)
+                counts[i] += other.counts[i];
+
+            count += other.count;
+            sum += other.sum;
+            max = std::max(max, other.max);
+        }
+
+        std::vector<std::uint64_t> counts;
+        std::uint64_t count = 0;
+        std::int64_t sum = 0;       // nanoseconds
+        std::int64_t max = 0;       // nanoseconds
+    };
+
+
+    /// Log-linear (HDR style) histogram of nanosecond latencies. Values below 16ns are exact, above that each power
+    /// of 2 is split into 16 buckets, so a value is recorded within ~6%. Values above MaxValue, 2^43 - 1ns or ~146
+    /// minutes, are clamped into the last bucket.
+    ///
+    /// record() is lock free and can be called from any thread, snapshot() can be called from any thread at any time.
+    class LatencyHistogram
+    {
+    public:
+        static constexpr unsigned SubBucketBits = 4;
+        static constexpr std::uint64_t SubBuckets = 1U << SubBucketBits;
+        static constexpr unsigned MaxExponent = 42;
+        static constexpr size_t NumBuckets = (MaxExponent - SubBucketBits + 1) * SubBuckets + SubBuckets;
+        static constexpr std::int64_t MaxValue = (std::int64_t{1} << (MaxExponent + 1)) - 1;     // the last bucket's highest value
+
+
+        void record (const std::chrono::nanoseconds latency)
+        {
+            record(latency.count());
+        }
+
+
+        void record (std::int64_t nanos)
+        {
+            if (nanos < 0)
+            {
+                // clocks are not in sync, i.e. Binance's clock to ours
+                m_negative.fetch_add(1, std::memory_order_relaxed);
+                nanos = 0;
+            }
+
+            m_counts[bucketIndex(static_cast<std::uint64_t>(nanos))].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_sum.fetch_add(nanos, std::memory_order_relaxed);
+
+            for (auto max = m_max.load(std::memory_order_relaxed) ; nanos > max && !m_max.compare_exchange_weak(max, nanos, std::memory_order_relaxed) ; )
+                ;
+        }
+
+
+        LatencySnapshot snapshot() const
+        {
+            LatencySnapshot snap;
+            snap.counts.resize(NumBuckets);
+
+            for (size_t i = 0 ; i < NumBuckets ; ++i)
+                snap.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+
+            snap.count = m_count.load(std::memory_order_relaxed);
+            snap.sum = m_sum.load(std::memory_order_relaxed);
+            snap.max = m_max.load(std::memory_order_relaxed);
+            return snap;
+        }
+
+
+        /// Number of negative values recorded (as 0).
+        std::uint64_t negative() const
+        {
+            return m_negative.load(std::memory_order_relaxed);
+        }
+
+
+        static size_t bucketIndex (const std::uint64_t nanos)
+        {
+            if (nanos < SubBuckets)
+                return static_cast<size_t>(nanos);
+
+            const unsigned exponent = std::min<unsigned>(63 - __builtin_clzll(nanos), MaxExponent);
+            const unsigned shift = exponent - SubBucketBits;
+            const auto subBucket = std::min<std::uint64_t>(nanos >> shift, 2 * SubBuckets - 1) - SubBuckets;
+
+            return (exponent - SubBucketBits + 1) * SubBuckets + static_cast<size_t>(subBucket);
+        }
+
+
+        /// The highest value that is recorded in the bucket.
+        static std::int64_t bucketValue (const size_t index)
+        {
+            if (index < SubBuckets)
+                return static_cast<std::int64_t>(index);
+
+            const auto exponent = index / SubBuckets + SubBucketBits - 1;
+            const auto subBucket = index % SubBuckets;
+            const auto shift = exponent - SubBucketBits;
+
+            return static_cast<std::int64_t>(((SubBuckets + subBucket + 1) << shift) - 1);
+        }
+
+
+    private:
+        std::array<std::atomic_uint64_t, NumBuckets> m_counts {};
+        std::atomic_uint64_t m_count {0};
+        std::atomic_int64_t m_sum {0};
+        std::atomic_int64_t m_max {0};
+        std::atomic_uint64_t m_negative {0};
+    };
+
+
+    inline std::int64_t LatencySnapshot::percentile (const double p) const
+    {
+        if (count == 0)
+            return 0;
+
+        const auto target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p * static_cast<double>(count) + 0.5));
+        std::uint64_t seen = 0;
+
+        for (size_t i = 0 ; i < counts.size() ; ++i)
+        {
+            if (seen += counts[i]; seen >= target)
+                return std::min(LatencyHistogram::bucketValue(i), max);
+        }
+
+        return max;
+    }
+
+
+    /// Latency stages of websocket responses, see WsLatencyStats.
+    struct WsLatencySnapshot
+    {
+        LatencySnapshot exchangeToSocket;
+        LatencySnapshot socketToParse;
+        LatencySnapshot parseToHandler;
+        LatencySnapshot handlerDuration;
+    };
+
+
+    /// Where the time goes for websocket responses:
+    ///     - exchangeToSocket: Binance's event time ("E") to the frame being read. E is in milliseconds and from Binance's
+    ///                         clock, so this includes the difference between their clock and ours
+    ///     - socketToParse:    frame read to JSON parsed
+    ///     - parseToHandler:   JSON parsed to the handler being called, i.e. time queued for the handler
+    ///     - handlerDuration:  time in the handler
+    struct WsLatencyStats
+    {
+        WsLatencySnapshot snapshot() const
+        {
+            return WsLatencySnapshot{exchangeToSocket.snapshot(), socketToParse.snapshot(), parseToHandler.snapshot(), handlerDuration.snapshot()};
+        }
+
+        LatencyHistogram exchangeToSocket;
+        LatencyHistogram socketToParse;
+        LatencyHistogram parseToHandler;
+        LatencyHistogram handlerDuration;
+    };
+}
+
+#endif
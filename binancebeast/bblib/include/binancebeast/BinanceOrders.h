@@ -0,0 +1,583 @@
+#ifndef BINANCEBEAST_ORDERS_H
+#define BINANCEBEAST_ORDERS_H
+
+#include "BinanceBeast.h"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+namespace bblib
+{
+    /// A new order. Empty fields are not sent.
+    struct OrderRequest
+    {
+        string symbol;
+        string side;            // BUY or SELL
+        string type;            // LIMIT, MARKET, etc
+        string timeInForce;
+        string quantity;
+        string price;
+        string stopPrice;
+        string positionSide;
+        string reduceOnly;
+        string workingType;
+    };
+
+
+    /// An order's state and when each stage of its life happened. Trivially copyable.
+    struct OrderRecord
+    {
+        using Clock = std::chrono::steady_clock;
+
+        enum class State : std::uint8_t
+        {
+            Free,
+            Sending,            // sent, no reply or event yet
+            New,                // acked by the REST reply or an ORDER_TRADE_UPDATE
+            PartiallyFilled,
+            Filled,
+            Canceled,
+            Expired,
+            Rejected,           // Binance replied with an error, see errorCode
+            Unknown,            // the request failed without Binance's reply, or Binance doesn't know the outcome. The
+                                // order may be live: resolved by an ORDER_TRADE_UPDATE or query()
+        };
+
+        bool isFinal() const
+        {
+            return state == State::Filled || state == State::Canceled || state == State::Expired || state == State::Rejected;
+        }
+
+        std::uint64_t sequence = 0;     // in the client order id
+        std::int64_t orderId = 0;       // Binance's, once acked
+        std::int64_t errorCode = 0;     // Binance's error code when Rejected or Unknown, 0 if there was no reply
+        double quantity = 0;
+        double price = 0;
+        double filledQuantity = 0;
+        double averagePrice = 0;
+        State state = State::Free;
+        bool isBuy = false;
+        char symbol [22] {};
+
+        Clock::time_point sendTime;         // send() called
+        Clock::time_point writeTime;        // request written to the socket, see RestTiming
+        Clock::time_point ackTime;          // REST reply read
+        Clock::time_point firstFillTime;    // first TRADE event received
+        Clock::time_point finalTime;        // FILLED, CANCELED or EXPIRED event received, or rejected
+        std::int64_t exchangeAckTime = 0;   // Binance's updateTime in the REST reply, milliseconds
+        std::int64_t exchangeFinalTime = 0; // Binance's transaction time of the final event, milliseconds
+    };
+
+
+    /// Latency of orders' stages, from send() to:
+    ///     - sendToWrite:      the request being written to the socket. Includes signing, connect and TLS handshake
+    ///     - sendToAck:        the REST reply
+    ///     - sendToFirstFill:  the first fill's ORDER_TRADE_UPDATE
+    ///     - sendToFinal:      the final ORDER_TRADE_UPDATE (filled, canceled or expired) or rejection
+    struct OrderLatencySnapshot
+    {
+        LatencySnapshot sendToWrite;
+        LatencySnapshot sendToAck;
+        LatencySnapshot sendToFirstFill;
+        LatencySnapshot sendToFinal;
+    };
+
+
+    struct OrderManagerConfig
+    {
+        size_t capacity = 4096;         // orders in the table, rounded up to a power of 2. Limits the orders that aren't final
+        string clientIdPrefix;          // default is "bb" and the start time, so ids are unique across restarts
+    };
+
+
+    /// Sends orders with a client order id and tracks them from send to final state, correlating the REST reply with
+    /// the user data ORDER_TRADE_UPDATE events by client order id.
+    ///
+    /// Orders are kept in a table allocated on construction, indexed by the client order id's sequence number, so
+    /// finding an order is O(1) and there are no allocations per order. The table is a ring: an order's entry is reused
+    /// 'capacity' orders later, send() throws if that order is not yet final.
+    ///
+    /// Pass the user data responses to onUserData(). The handler, if set, is called after each change to an order, from
+    /// the REST callers' thread pool or the user data handler's thread.
+    ///
+    /// An order is only Rejected when Binance replies with an error. If the request fails otherwise, i.e. a timeout or
+    /// the connection closing after it was written, the order is Unknown and keeps its entry until an event or query()
+    /// resolves it.
+    ///
+    /// Futures only (USDM and COINM).
+    class OrderManager
+    {
+    public:
+        using OrderHandler = std::function<void(const OrderRecord&)>;
+
+
+        OrderManager (BinanceBeast& bb, const Market market, OrderHandler handler = nullptr, OrderManagerConfig config = {})
+            :   m_bb(bb),
+                m_handler(std::move(handler)),
+                m_slots(roundUpPowerOf2(std::max<size_t>(config.capacity, 2))),
+                m_mask(m_slots.size() - 1)
+        {
+            if (market == Market::USDM)
+                m_orderPath = "/fapi/v1/order";
+            else if (market == Market::COINM)
+                m_orderPath = "/dapi/v1/order";
+            else
+                throw std::runtime_error("OrderManager requires Market::USDM or Market::COINM");
+
+            if (config.clientIdPrefix.empty())
+            {
+                const auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                config.clientIdPrefix = "bb" + std::to_string(now) + "-";
+            }
+
+            m_prefix = std::move(config.clientIdPrefix);
+        }
+
+
+        /// Send a new order, returning its client order id. Throws if the table has no free entry.
+        string send (const OrderRequest& request)
+        {
+            const auto sequence = m_nextSequence.fetch_add(1, std::memory_order_relaxed);
+            auto& slot = m_slots[sequence & m_mask];
+
+            {
+                SlotLock lock {slot};
+
+                if (slot.record.state != OrderRecord::State::Free && !slot.record.isFinal())
+                    throw std::runtime_error("order table full, order " + std::to_string(slot.record.sequence) + " is not final");
+
+                auto& record = slot.record;
+                record = OrderRecord{};
+                record.sequence = sequence;
+                record.state = OrderRecord::State::Sending;
+                record.isBuy = request.side == "BUY";
+                record.quantity = std::strtod(request.quantity.c_str(), nullptr);
+                record.price = std::strtod(request.price.c_str(), nullptr);
+                request.symbol.copy(record.symbol, sizeof(record.symbol) - 1);
+                record.sendTime = OrderRecord::Clock::now();
+            }
+
+            auto clientOrderId = m_prefix + std::to_string(sequence);
+
+            QueryParams params {{"symbol", request.symbol}, {"side", request.side}, {"type", request.type}, {"newClientOrderId", clientOrderId}};
+
+            const auto optional = [&params](const char * name, const string& value)
+            {
+                if (!value.empty())
+                    params.emplace(name, value);
+            };
+
+            optional("timeInForce", request.timeInForce);
+            optional("quantity", request.quantity);
+            optional("price", request.price);
+            optional("stopPrice", request.stopPrice);
+            optional("positionSide", request.positionSide);
+            optional("reduceOnly", request.reduceOnly);
+            optional("workingType", request.workingType);
+
+            m_bb.sendRestRequest([this, sequence](RestResponse result)
+            {
+                onAck(sequence, std::move(result));
+
+            }, m_orderPath, RestSign::HMAC_SHA256, RestParams{std::move(params)}, RequestType::Post);
+
+            return clientOrderId;
+        }
+
+
+        /// Cancel an order. The handler is called with Binance's reply, the order's state changes with the
+        /// ORDER_TRADE_UPDATE event.
+        void cancel (const string& clientOrderId, RestResponseHandler handler = nullptr)
+        {
+            auto record = find(clientOrderId);
+
+            if (!record)
+            {
+                if (handler)
+                    handler(RestResponse{string{"cancel(): order not found"}});
+                return;
+            }
+
+            m_bb.sendRestRequest([handler](RestResponse result)
+            {
+                if (handler)
+                    handler(std::move(result));
+
+            }, m_orderPath, RestSign::HMAC_SHA256, RestParams{QueryParams{{"symbol", record->symbol}, {"origClientOrderId", clientOrderId}}}, RequestType::Delete);
+        }
+
+
+        /// Query an order with GET /order and apply its status, i.e. to resolve an Unknown order. An order which Binance
+        /// doesn't have (-2013) becomes Rejected, so query once it can no longer be in flight. The handler is called
+        /// with Binance's reply, after it's applied.
+        void query (const string& clientOrderId, RestResponseHandler handler = nullptr)
+        {
+            auto record = find(clientOrderId);
+
+            if (!record)
+            {
+                if (handler)
+                    handler(RestResponse{string{"query(): order not found"}});
+                return;
+            }
+
+            m_bb.sendRestRequest([this, sequence = record->sequence, handler](RestResponse result)
+            {
+                onQuery(sequence, result);
+
+                if (handler)
+                    handler(std::move(result));
+
+            }, m_orderPath, RestSign::HMAC_SHA256, RestParams{QueryParams{{"symbol", record->symbol}, {"origClientOrderId", clientOrderId}}}, RequestType::Get);
+        }
+
+
+        /// Pass each response from the user data stream. Events for orders not sent by this manager are ignored.
+        void onUserData (const WsResponse& response)
+        {
+            const auto receiveTime = response.receiveTime == WsResponse::Clock::time_point{} ? OrderRecord::Clock::now() : response.receiveTime;
+
+            auto event = response.json.if_object();
+
+            if (response.state != WsResponse::State::Success || !event)
+                return;
+            else if (auto e = event->if_contains("e"); !e || !e->is_string() || e->as_string() != "ORDER_TRADE_UPDATE")
+                return;
+
+            auto order = event->if_contains("o");
+            auto clientId = order && order->is_object() ? order->as_object().if_contains("c") : nullptr;
+
+            if (!clientId || !clientId->is_string())
+                return;
+
+            const auto sequence = parseSequence(string_view{clientId->as_string().data(), clientId->as_string().size()});
+
+            if (!sequence)
+                return;
+
+            auto& o = order->as_object();
+            const auto status = stringField(o, "X");
+            const bool trade = stringField(o, "x") == "TRADE";
+
+            update(*sequence, [&](OrderRecord& record)
+            {
+                if (auto id = o.if_contains("i"); id && id->is_number())
+                    record.orderId = id->to_number<std::int64_t>();
+
+                record.filledQuantity = doubleField(o, "z");
+                record.averagePrice = doubleField(o, "ap");
+
+                if (trade && record.firstFillTime == OrderRecord::Clock::time_point{})
+                {
+                    record.firstFillTime = receiveTime;
+                    m_latency.sendToFirstFill.record(receiveTime - record.sendTime);
+                }
+
+                if (setState(record, status))
+                {
+                    record.finalTime = receiveTime;
+
+                    if (auto t = o.if_contains("T"); t && t->is_number())
+                        record.exchangeFinalTime = t->to_number<std::int64_t>();
+
+                    m_latency.sendToFinal.record(receiveTime - record.sendTime);
+                }
+            });
+        }
+
+
+        /// A copy of the order, if it's in the table.
+        std::optional<OrderRecord> find (const string_view clientOrderId) const
+        {
+            if (auto sequence = parseSequence(clientOrderId))
+                return find(*sequence);
+
+            return std::nullopt;
+        }
+
+
+        std::optional<OrderRecord> find (const std::uint64_t sequence) const
+        {
+            auto& slot = m_slots[sequence & m_mask];
+            SlotLock lock {slot};
+
+            if (slot.record.state != OrderRecord::State::Free && slot.record.sequence == sequence)
+                return slot.record;
+
+            return std::nullopt;
+        }
+
+
+        /// Orders sent which are not final.
+        size_t live() const
+        {
+            size_t count = 0;
+
+            for (auto& slot : m_slots)
+            {
+                SlotLock lock {slot};
+
+                if (slot.record.state != OrderRecord::State::Free && !slot.record.isFinal())
+                    ++count;
+            }
+
+            return count;
+        }
+
+
+        OrderLatencySnapshot latency() const
+        {
+            return OrderLatencySnapshot{m_latency.sendToWrite.snapshot(), m_latency.sendToAck.snapshot(), m_latency.sendToFirstFill.snapshot(), m_latency.sendToFinal.snapshot()};
+        }
+
+
+        const string& clientIdPrefix() const
+        {
+            return m_prefix;
+        }
+
+
+    private:
+        // an entry per cache line (or two), so updates to adjacent orders don't contend
+        struct alignas(64) Slot
+        {
+            mutable std::atomic_flag busy = ATOMIC_FLAG_INIT;
+            OrderRecord record;
+        };
+
+
+        /// Held only to copy or change a record.
+        struct SlotLock
+        {
+            explicit SlotLock (const Slot& s) : slot(s)
+            {
+                while (slot.busy.test_and_set(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+
+            ~SlotLock()
+            {
+                slot.busy.clear(std::memory_order_release);
+            }
+
+            const Slot& slot;
+        };
+
+
+        struct LatencyStats
+        {
+            LatencyHistogram sendToWrite;
+            LatencyHistogram sendToAck;
+            LatencyHistogram sendToFirstFill;
+            LatencyHistogram sendToFinal;
+        };
+
+
+        static size_t roundUpPowerOf2 (const size_t n)
+        {
+            size_t size = 1;
+            while (size < n)
+                size <<= 1;
+            return size;
+        }
+
+
+        static string_view stringField (const json::object& object, const string_view key)
+        {
+            if (auto value = object.if_contains(key); value && value->is_string())
+                return string_view{value->as_string().data(), value->as_string().size()};
+
+            return {};
+        }
+
+
+        static double doubleField (const json::object& object, const string_view key)
+        {
+            if (auto value = object.if_contains(key); value && value->is_string())
+                return std::strtod(value->as_string().c_str(), nullptr);
+
+            return 0;
+        }
+
+
+        /// Binance's error code in a reply, 0 if there isn't one.
+        static std::int64_t errorCode (const json::value& reply)
+        {
+            if (auto object = reply.if_object())
+            {
+                if (auto code = object->if_contains("code"); code && code->is_number())
+                    return code->to_number<std::int64_t>();
+            }
+
+            return 0;
+        }
+
+
+        /// Sets the state from Binance's order status, returns true if it became final.
+        static bool setState (OrderRecord& record, const string_view status)
+        {
+            if (status == "NEW" && (record.state == OrderRecord::State::Sending || record.state == OrderRecord::State::Unknown))
+                record.state = OrderRecord::State::New;
+            else if (status == "PARTIALLY_FILLED")
+                record.state = OrderRecord::State::PartiallyFilled;
+            else if (status == "FILLED" || status == "CANCELED" || status == "EXPIRED" || status == "EXPIRED_IN_MATCH")
+            {
+                record.state = status == "FILLED" ? OrderRecord::State::Filled : status == "CANCELED" ? OrderRecord::State::Canceled : OrderRecord::State::Expired;
+                return true;
+            }
+
+            return false;
+        }
+
+
+        std::optional<std::uint64_t> parseSequence (const string_view clientOrderId) const
+        {
+            if (clientOrderId.size() <= m_prefix.size() || clientOrderId.compare(0, m_prefix.size(), m_prefix) != 0)
+                return std::nullopt;
+
+            std::uint64_t sequence = 0;
+            const auto digits = clientOrderId.substr(m_prefix.size());
+
+            if (auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), sequence); ec != std::errc{} || end != digits.data() + digits.size())
+                return std::nullopt;
+
+            return sequence;
+        }
+
+
+        /// Applies 'change' to the order, if it's still in the table, then calls the handler.
+        template <typename Change>
+        void update (const std::uint64_t sequence, Change&& change)
+        {
+            auto& slot = m_slots[sequence & m_mask];
+            OrderRecord copy;
+
+            {
+                SlotLock lock {slot};
+
+                if (slot.record.state == OrderRecord::State::Free || slot.record.sequence != sequence)
+                    return;
+
+                change(slot.record);
+                copy = slot.record;
+            }
+
+            if (m_handler)
+                m_handler(copy);
+        }
+
+
+        void onAck (const std::uint64_t sequence, RestResponse&& result)
+        {
+            const auto ackTime = result.timing.receiveTime == RestTiming::Clock::time_point{} ? OrderRecord::Clock::now() : result.timing.receiveTime;
+            const bool error = result.hasErrorCode();
+
+            update(sequence, [&](OrderRecord& record)
+            {
+                record.ackTime = ackTime;
+                record.writeTime = result.timing.writeTime;
+
+                if (record.writeTime != OrderRecord::Clock::time_point{})
+                    m_latency.sendToWrite.record(record.writeTime - record.sendTime);
+
+                m_latency.sendToAck.record(ackTime - record.sendTime);
+
+                if (error)
+                {
+                    const auto code = errorCode(result.json);
+
+                    if (code != 0 && code != UnknownErrorCode && code != UnknownStatusCode && result.status < 500)
+                    {
+                        // the user data stream has no event for a rejected order
+                        record.errorCode = code;
+                        record.state = OrderRecord::State::Rejected;
+                        record.finalTime = ackTime;
+                        m_latency.sendToFinal.record(ackTime - record.sendTime);
+                    }
+                    else if (record.state == OrderRecord::State::Sending)
+                    {
+                        // no reply from Binance, or its backend failed or timed out: the order may have been placed, and
+                        // its event may have arrived first
+                        record.errorCode = code;
+                        record.state = OrderRecord::State::Unknown;
+                    }
+                }
+                else if (auto object = result.json.if_object())
+                {
+                    if (auto id = object->if_contains("orderId"); id && id->is_number())
+                        record.orderId = id->to_number<std::int64_t>();
+
+                    if (auto time = object->if_contains("updateTime"); time && time->is_number())
+                        record.exchangeAckTime = time->to_number<std::int64_t>();
+
+                    // the user data event may have arrived first
+                    if (record.state == OrderRecord::State::Sending)
+                        record.state = OrderRecord::State::New;
+                }
+            });
+        }
+
+
+        void onQuery (const std::uint64_t sequence, RestResponse& result)
+        {
+            const auto now = OrderRecord::Clock::now();
+            const bool error = result.hasErrorCode();
+            const auto code = error ? errorCode(result.json) : 0;
+
+            if (error ? code != OrderNotFoundCode : !result.json.is_object())
+                return;
+
+            update(sequence, [&](OrderRecord& record)
+            {
+                if (record.isFinal())
+                    return;
+
+                if (code == OrderNotFoundCode)
+                {
+                    record.errorCode = code;
+                    record.state = OrderRecord::State::Rejected;
+                    record.finalTime = now;
+                    return;
+                }
+
+                auto& o = result.json.as_object();
+
+                if (auto id = o.if_contains("orderId"); id && id->is_number())
+                    record.orderId = id->to_number<std::int64_t>();
+
+                record.filledQuantity = doubleField(o, "executedQty");
+                record.averagePrice = doubleField(o, "avgPrice");
+
+                if (setState(record, stringField(o, "status")))
+                {
+                    record.finalTime = now;
+
+                    if (auto time = o.if_contains("updateTime"); time && time->is_number())
+                        record.exchangeFinalTime = time->to_number<std::int64_t>();
+                }
+            });
+        }
+
+
+    private:
+        static constexpr std::int64_t UnknownErrorCode = -1001;         // internal error, execution status unknown
+        static constexpr std::int64_t UnknownStatusCode = -1007;        // timeout waiting for the backend, execution status unknown
+        static constexpr std::int64_t OrderNotFoundCode = -2013;
+
+        BinanceBeast& m_bb;
+        OrderHandler m_handler;
+        string m_orderPath;
+        string m_prefix;
+        std::vector<Slot> m_slots;
+        const size_t m_mask;
+        std::atomic_uint64_t m_nextSequence {1};
+        LatencyStats m_latency;
+    };
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef BINANCEBEAST_RCU_H
+#define BINANCEBEAST_RCU_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+
+namespace bblib
+{
+    /// An immutable value which is replaced rather than changed (read-copy-update), so readers on any thread never
+    /// lock or wait, even whilst it's being replaced.
+    ///
+    /// read() calls a function with the current value. update() publishes a new value then waits until no reader can
+    /// still be using the old value before deleting it. Reads are counted on one of two counters, switching on each
+    /// update, so a steady stream of readers doesn't hold up an update.
+    ///
+    /// One update at a time, the caller serialises updates. Don't call update() from within read().
+    template <typename T>
+    class RcuValue
+    {
+    public:
+        explicit RcuValue (std::unique_ptr<const T> initial) : m_current(initial.release())
+        {
+        }
+
+        ~RcuValue()
+        {
+            delete m_current.load();
+        }
+
+        RcuValue (const RcuValue&) = delete;
+        RcuValue& operator= (const RcuValue&) = delete;
+
+
+        /// Calls f(const T&) with the current value, returning what f returns. The reference is only valid within f.
+        template <typename F>
+        decltype(auto) read (F&& f) const
+        {
+            // sequentially consistent with update()'s exchange and its loads of the counters: either update() sees
+            // this reader or this reader sees the new value
+            auto& readers = m_readers[m_epoch.load() & 1];
+            readers.fetch_add(1);
+
+            struct Unpin
+            {
+                ~Unpin() { readers.fetch_sub(1, std::memory_order_release); }
+                std::atomic_uint64_t& readers;
+            } unpin {readers};
+
+            return std::forward<F>(f)(*m_current.load());
+        }
+
+
+        /// The current value, only for the thread which calls update().
+        const T& writerView() const
+        {
+            return *m_current.load(std::memory_order_relaxed);
+        }
+
+
+        /// Publish a new value. Returns when the old value has been deleted.
+        void update (std::unique_ptr<const T> value)
+        {
+            std::unique_ptr<const T> old {m_current.exchange(value.release())};
+
+            // a reader of the old value is counted on one of the counters from before the exchange until it's done,
+            // so it's seen by one of these
+            for (int i = 0 ; i < 2 ; ++i)
+            {
+                const auto epoch = m_epoch.fetch_add(1);
+
+                while (m_readers[epoch & 1].load() != 0)
+                    std::this_thread::yield();
+            }
+        }
+
+
+    private:
+        std::atomic<const T *> m_current;
+        std::atomic_uint64_t m_epoch {0};
+        mutable std::atomic_uint64_t m_readers [2] {};
+    };
+}
+
+#endif
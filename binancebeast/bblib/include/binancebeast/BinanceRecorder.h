@@ -0,0 +1,382 @@
+#ifndef BINANCEBEAST_RECORDER_H
+#define BINANCEBEAST_RECORDER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace bblib
+{
+    /// Journal file format. A journal is a sequence of segment files, "<prefix>.<index>.bbj", each starting with a
+    /// JournalSegmentHeader followed by records. Each record is a JournalRecordHeader then the raw websocket frame,
+    /// padded to 8 bytes. A record with length 0 or JournalRecordHeader::EndOfSegment ends the segment.
+    /// All fields are little endian (host order, x86_64/aarch64).
+    struct JournalSegmentHeader
+    {
+        static constexpr std::uint64_t Magic = 0x314C4E524A424242ULL;     // "BBBJRNL1"
+        static constexpr std::uint32_t Version = 1;
+
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t headerSize;
+        std::uint64_t segmentIndex;
+        std::int64_t createTime;            // nanoseconds since epoch
+        std::uint8_t reserved[32];
+    };
+
+    static_assert(sizeof(JournalSegmentHeader) == 64);
+
+
+    struct JournalRecordHeader
+    {
+        static constexpr std::uint32_t EndOfSegment = 0xFFFFFFFF;
+        static constexpr std::uint32_t KernelTimestamp = 1;     // flag: receiveTime is from the kernel, see ConnectionConfig::kernelReceiveTimestamps
+
+        std::uint32_t length;               // frame bytes, written last
+        std::uint32_t token;                // WsToken id
+        std::uint32_t connection;           // unique per websocket connection (WsSession)
+        std::uint32_t flags;
+        std::int64_t receiveTime;           // nanoseconds since epoch
+        std::int64_t monotonicTime;         // nanoseconds, steady clock
+    };
+
+    static_assert(sizeof(JournalRecordHeader) == 32);
+
+
+    struct RecorderConfig
+    {
+        std::filesystem::path directory;
+        std::string prefix = "marketdata";
+        size_t segmentSize = 64 * 1024 * 1024;
+
+        /// MAP_POPULATE so writers don't page fault on a new segment. The constructor maps 3 segments, so this commits
+        /// 3 * segmentSize and blocks until it's paged in, as does the background thread for each later segment.
+        bool prefault = false;
+    };
+
+
+    /// Appends raw websocket frames to a memory mapped journal, see JournalSegmentHeader for the format.
+    ///
+    /// append() is lock free and never blocks: space is reserved with a CAS on the journal position then the frame
+    /// is copied into the mapped segment. A background thread maps the next segment before it's needed and
+    /// closes segments once all writers are done with them. If the next segment is not ready when needed, or
+    /// a frame is larger than a segment, the frame is dropped and counted in Stats::dropped.
+    ///
+    /// Use with BinanceBeast::setRecorder().
+    class MarketDataRecorder
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t records = 0;
+            std::uint64_t bytes = 0;
+            std::uint64_t dropped = 0;
+            std::uint64_t segments = 0;     // segments created
+        };
+
+
+        /// Throws if the directory or first segment can't be created.
+        explicit MarketDataRecorder (RecorderConfig config) : m_config(std::move(config))
+        {
+            if (m_config.segmentSize < 64 * 1024 || m_config.segmentSize % 8 != 0)
+                throw std::runtime_error("recorder segmentSize must be a multiple of 8 and at least 64KB");
+
+            std::filesystem::create_directories(m_config.directory);
+
+            // the lookahead segments too, so appends straight after construction aren't dropped
+            for (std::uint64_t index = 0 ; index <= Lookahead ; ++index)
+            {
+                if (std::string error; !createSegment(index, error))
+                    throw std::runtime_error(error);
+            }
+
+            m_position.store(HeaderSize);
+            m_thread = std::thread{[this]{ manage(); }};
+        }
+
+
+        /// Call once nothing else is appending, which is the case when the last session holding it is destroyed.
+        ~MarketDataRecorder()
+        {
+            {
+                std::scoped_lock lock (m_mux);
+                m_stop = true;
+            }
+            m_cv.notify_one();
+            m_thread.join();
+
+            const auto position = m_position.load();
+            const auto current = position / m_config.segmentSize;
+
+            for (auto& segment : m_segments)
+            {
+                if (const auto index = segment.index.load(); index == current)
+                    closeSegment(segment, position % m_config.segmentSize);
+                else if (index < current)
+                    closeSegment(segment, segment.used.load());
+                else if (index != NoSegment)
+                {
+                    // prepared but never used
+                    closeSegment(segment, 0);
+                    std::filesystem::remove(segmentPath(m_config.directory, m_config.prefix, index));
+                }
+            }
+        }
+
+
+        MarketDataRecorder (const MarketDataRecorder&) = delete;
+        MarketDataRecorder& operator= (const MarketDataRecorder&) = delete;
+
+
+        /// Append a frame. Thread safe and lock free. Returns false if the frame was dropped.
+        bool append (const std::uint32_t token, const std::uint32_t connection, const std::int64_t receiveTime, const std::int64_t monotonicTime,
+                     const std::uint32_t flags, const void * data, const size_t size)
+        {
+            const auto recordSize = align(sizeof(JournalRecordHeader) + size);
+            const auto segmentSize = m_config.segmentSize;
+
+            // strictly less than, so there's always room for the end of segment marker
+            if (HeaderSize + recordSize >= segmentSize)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            auto position = m_position.load(std::memory_order_acquire);
+
+            while (true)
+            {
+                const auto index = position / segmentSize;
+                const auto offset = position % segmentSize;
+
+                if (offset + recordSize < segmentSize)
+                {
+                    if (m_position.compare_exchange_weak(position, position + recordSize, std::memory_order_acq_rel))
+                    {
+                        write(slot(index), offset, recordSize, token, connection, receiveTime, monotonicTime, flags, data, size);
+                        return true;
+                    }
+                }
+                else
+                {
+                    auto& next = slot(index + 1);
+
+                    if (next.index.load(std::memory_order_acquire) != index + 1)
+                    {
+                        m_dropped.fetch_add(1, std::memory_order_relaxed);
+                        m_cv.notify_one();
+                        return false;
+                    }
+
+                    if (m_position.compare_exchange_weak(position, (index + 1) * segmentSize + HeaderSize + recordSize, std::memory_order_acq_rel))
+                    {
+                        endSegment(slot(index), offset);
+                        write(next, HeaderSize, recordSize, token, connection, receiveTime, monotonicTime, flags, data, size);
+                        m_cv.notify_one();      // prepare the segment after this one
+                        return true;
+                    }
+                }
+            }
+        }
+
+
+        Stats stats() const
+        {
+            return Stats{m_records.load(), m_bytes.load(), m_dropped.load(), m_segmentsCreated.load()};
+        }
+
+
+        static std::filesystem::path segmentPath (const std::filesystem::path& directory, const std::string& prefix, const std::uint64_t index)
+        {
+            std::ostringstream name;
+            name << prefix << '.' << std::setw(6) << std::setfill('0') << index << ".bbj";
+            return directory / name.str();
+        }
+
+
+    private:
+        static constexpr size_t HeaderSize = sizeof(JournalSegmentHeader);
+        static constexpr size_t Slots = 4;
+        static constexpr size_t Lookahead = 2;     // segments mapped ahead of the current one
+        static constexpr std::uint64_t NoSegment = ~0ULL;
+
+
+        struct Segment
+        {
+            std::atomic<char *> base {nullptr};
+            std::atomic_uint64_t index {NoSegment};
+            std::atomic_uint64_t committed {0};     // bytes written or skipped, the segment is done when it's segmentSize
+            std::atomic_uint64_t used {0};          // offset of the end marker, 0 until known
+            int fd = -1;
+        };
+
+
+        static size_t align (const size_t n)
+        {
+            return (n + 7) & ~size_t{7};
+        }
+
+
+        Segment& slot (const std::uint64_t index)
+        {
+            return m_segments[index % Slots];
+        }
+
+
+        void write (Segment& segment, const size_t offset, const size_t recordSize, const std::uint32_t token, const std::uint32_t connection,
+                    const std::int64_t receiveTime, const std::int64_t monotonicTime, const std::uint32_t flags, const void * data, const size_t size)
+        {
+            auto record = segment.base.load(std::memory_order_acquire) + offset;
+            auto header = reinterpret_cast<JournalRecordHeader *>(record);
+
+            header->token = token;
+            header->connection = connection;
+            header->flags = flags;
+            header->receiveTime = receiveTime;
+            header->monotonicTime = monotonicTime;
+            std::memcpy(record + sizeof(JournalRecordHeader), data, size);
+
+            // a reader of a live segment sees the length only once the record is complete
+            __atomic_store_n(&header->length, static_cast<std::uint32_t>(size), __ATOMIC_RELEASE);
+
+            segment.committed.fetch_add(recordSize, std::memory_order_release);
+            m_records.fetch_add(1, std::memory_order_relaxed);
+            m_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+
+        void endSegment (Segment& segment, const size_t offset)
+        {
+            auto header = reinterpret_cast<JournalRecordHeader *>(segment.base.load(std::memory_order_acquire) + offset);
+            __atomic_store_n(&header->length, JournalRecordHeader::EndOfSegment, __ATOMIC_RELEASE);
+
+            segment.used.store(offset, std::memory_order_relaxed);
+            segment.committed.fetch_add(m_config.segmentSize - offset, std::memory_order_release);
+        }
+
+
+        bool createSegment (const std::uint64_t index, std::string& error)
+        {
+            const auto path = segmentPath(m_config.directory, m_config.prefix, index);
+            auto& segment = slot(index);
+
+            const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                error = "recorder can't create " + path.string() + ": " + std::strerror(errno);
+                return false;
+            }
+
+            if (::ftruncate(fd, static_cast<off_t>(m_config.segmentSize)) != 0)
+            {
+                error = "recorder can't size " + path.string() + ": " + std::strerror(errno);
+                ::close(fd);
+                return false;
+            }
+
+            auto base = ::mmap(nullptr, m_config.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED | (m_config.prefault ? MAP_POPULATE : 0), fd, 0);
+            if (base == MAP_FAILED)
+            {
+                error = "recorder can't map " + path.string() + ": " + std::strerror(errno);
+                ::close(fd);
+                return false;
+            }
+
+            auto header = static_cast<JournalSegmentHeader *>(base);
+            header->magic = JournalSegmentHeader::Magic;
+            header->version = JournalSegmentHeader::Version;
+            header->headerSize = HeaderSize;
+            header->segmentIndex = index;
+            header->createTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+            segment.fd = fd;
+            segment.committed.store(HeaderSize);
+            segment.used.store(0);
+            segment.base.store(static_cast<char *>(base), std::memory_order_release);
+            segment.index.store(index, std::memory_order_release);
+
+            m_segmentsCreated.fetch_add(1);
+            return true;
+        }
+
+
+        /// Unmap and truncate to the used size.
+        void closeSegment (Segment& segment, const size_t used)
+        {
+            if (auto base = segment.base.exchange(nullptr))
+                ::munmap(base, m_config.segmentSize);
+
+            if (segment.fd >= 0)
+            {
+                [[maybe_unused]] auto rc = ::ftruncate(segment.fd, static_cast<off_t>(used));
+                ::close(segment.fd);
+                segment.fd = -1;
+            }
+
+            segment.index.store(NoSegment, std::memory_order_release);
+        }
+
+
+        /// Background thread: close finished segments and prepare the next one.
+        void manage()
+        {
+            std::unique_lock lock (m_mux);
+
+            while (!m_stop)
+            {
+                lock.unlock();
+
+                const auto current = m_position.load(std::memory_order_acquire) / m_config.segmentSize;
+
+                for (auto& segment : m_segments)
+                {
+                    if (const auto index = segment.index.load(std::memory_order_acquire); index != NoSegment && index < current &&
+                        segment.committed.load(std::memory_order_acquire) == m_config.segmentSize)
+                    {
+                        closeSegment(segment, segment.used.load());
+                    }
+                }
+
+                for (auto next = current + 1 ; next <= current + Lookahead ; ++next)
+                {
+                    // on failure appends are dropped until it's created, try again later
+                    if (std::string error; slot(next).index.load(std::memory_order_acquire) == NoSegment)
+                        createSegment(next, error);
+                }
+
+                lock.lock();
+                m_cv.wait_for(lock, std::chrono::milliseconds{10});
+            }
+        }
+
+
+    private:
+        RecorderConfig m_config;
+        std::array<Segment, Slots> m_segments;
+        std::atomic_uint64_t m_position {0};        // segment index * segmentSize + offset
+        std::atomic_uint64_t m_records {0};
+        std::atomic_uint64_t m_bytes {0};
+        std::atomic_uint64_t m_dropped {0};
+        std::atomic_uint64_t m_segmentsCreated {0};
+        std::thread m_thread;
+        std::mutex m_mux;
+        std::condition_variable m_cv;
+        bool m_stop = false;
+    };
+}
+
+#endif
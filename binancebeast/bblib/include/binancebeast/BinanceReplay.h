@@ -0,0 +1,370 @@
+#ifndef BINANCEBEAST_REPLAY_H
+#define BINANCEBEAST_REPLAY_H
+
+#include "BinanceWebsockets.h"
+#include "BinanceRecorder.h"
+#include <algorithm>
+#include <future>
+#include <set>
+#include <vector>
+
+
+namespace bblib
+{
+    /// Reads the records of a journal written by MarketDataRecorder, in the order they were written, across all segments.
+    class JournalReader
+    {
+    public:
+        struct Record
+        {
+            JournalRecordHeader header;
+            std::string_view frame;     // valid until the next call to next()
+        };
+
+
+        /// Throws if there are no segments for the prefix in the directory.
+        JournalReader (const std::filesystem::path& directory, const string& prefix)
+        {
+            const auto start = prefix + ".";
+
+            for (auto& entry : std::filesystem::directory_iterator{directory})
+            {
+                const auto name = entry.path().filename().string();
+
+                if (entry.is_regular_file() && name.rfind(start, 0) == 0 && entry.path().extension() == ".bbj")
+                    m_segments.push_back(entry.path());
+            }
+
+            if (m_segments.empty())
+                throw std::runtime_error("no journal segments for " + (directory / prefix).string());
+
+            // the index is zero padded so this sorts by index
+            std::sort(m_segments.begin(), m_segments.end());
+        }
+
+
+        ~JournalReader()
+        {
+            unmap();
+        }
+
+
+        JournalReader (const JournalReader&) = delete;
+        JournalReader& operator= (const JournalReader&) = delete;
+
+
+        /// Returns false at the end of the journal.
+        bool next (Record& record)
+        {
+            while (true)
+            {
+                if (!m_base && !mapNext())
+                    return false;
+
+                if (m_offset + sizeof(JournalRecordHeader) <= m_size)
+                {
+                    std::memcpy(&record.header, m_base + m_offset, sizeof(JournalRecordHeader));
+
+                    const auto length = record.header.length;
+
+                    if (length != 0 && length != JournalRecordHeader::EndOfSegment && m_offset + sizeof(JournalRecordHeader) + length <= m_size)
+                    {
+                        record.frame = std::string_view{m_base + m_offset + sizeof(JournalRecordHeader), length};
+                        m_offset += (sizeof(JournalRecordHeader) + length + 7) & ~size_t{7};
+                        return true;
+                    }
+                }
+
+                // end of this segment
+                unmap();
+            }
+        }
+
+
+    private:
+        bool mapNext()
+        {
+            while (m_nextSegment < m_segments.size())
+            {
+                const auto& path = m_segments[m_nextSegment++];
+
+                const int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    throw std::runtime_error("can't open " + path.string() + ": " + std::strerror(errno));
+
+                m_size = std::filesystem::file_size(path);
+
+                if (m_size >= sizeof(JournalSegmentHeader))
+                {
+                    auto base = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    ::close(fd);
+
+                    if (base == MAP_FAILED)
+                        throw std::runtime_error("can't map " + path.string() + ": " + std::strerror(errno));
+
+                    ::madvise(base, m_size, MADV_SEQUENTIAL);
+
+                    JournalSegmentHeader header;
+                    std::memcpy(&header, base, sizeof(header));
+
+                    if (header.magic != JournalSegmentHeader::Magic || header.version != JournalSegmentHeader::Version)
+                    {
+                        ::munmap(base, m_size);
+                        throw std::runtime_error("not a journal segment: " + path.string());
+                    }
+
+                    m_base = static_cast<const char *>(base);
+                    m_offset = header.headerSize;
+                    return true;
+                }
+
+                ::close(fd);
+            }
+
+            return false;
+        }
+
+
+        void unmap()
+        {
+            if (m_base)
+                ::munmap(const_cast<char *>(m_base), m_size);
+
+            m_base = nullptr;
+        }
+
+
+    private:
+        std::vector<std::filesystem::path> m_segments;
+        size_t m_nextSegment = 0;
+        const char * m_base = nullptr;
+        size_t m_size = 0;
+        size_t m_offset = 0;
+    };
+
+
+    struct ReplaySource
+    {
+        std::filesystem::path directory;
+        string prefix = "marketdata";
+    };
+
+
+    struct ReplayConfig
+    {
+        std::vector<ReplaySource> sources;  // several journals are merged by receive time
+        double speed = 0;                   // 0 is as fast as possible, 1 is real time, 2 twice real time, etc
+        std::set<std::uint32_t> tokens;     // only replay records from these tokens, all if empty
+        bool useDispatcher = true;          // call the handler from a WsHandlerDispatcher, as live sessions do, otherwise from run()'s thread
+    };
+
+
+    struct ReplayStats
+    {
+        double recordsPerSecond() const
+        {
+            return elapsed.count() ? static_cast<double>(records) * 1e9 / static_cast<double>(elapsed.count()) : 0.0;
+        }
+
+        double megabytesPerSecond() const
+        {
+            return elapsed.count() ? static_cast<double>(bytes) * 1e9 / static_cast<double>(elapsed.count()) / (1024.0 * 1024.0) : 0.0;
+        }
+
+        std::uint64_t records = 0;          // passed to the handler
+        std::uint64_t bytes = 0;
+        std::uint64_t skipped = 0;          // not in ReplayConfig::tokens
+        std::uint64_t parseErrors = 0;      // passed to the handler as a Fail response
+        std::chrono::nanoseconds elapsed {0};
+    };
+
+
+    /// Replays recorded journals through a WebSocketResponseHandler, as a WsSession would: each frame is parsed to a
+    /// WsResponse and, by default, passed to the handler by a WsHandlerDispatcher, so the handler runs on the same
+    /// path, with the same latency stats, as it does live.
+    ///
+    /// Responses have receiveWallTime (and kernelReceiveTime, if recorded) set to the recorded time, and receiveTime
+    /// and parseTime set to the replay's steady clock.
+    ///
+    /// Records from several journals are merged by receive time. Within a journal, records are in the order they were
+    /// written.
+    class ReplayEngine
+    {
+    public:
+        ReplayEngine (ReplayConfig config, WebSocketResponseHandler handler) : m_config(std::move(config)), m_handler(std::move(handler))
+        {
+            if (m_config.sources.empty())
+                throw std::runtime_error("replay has no sources");
+            else if (m_config.speed < 0)
+                throw std::runtime_error("replay speed must not be negative");
+
+            if (m_config.useDispatcher)
+                m_dispatcher = std::make_shared<WsHandlerDispatcher>(m_handler);
+        }
+
+
+        /// Replays all records, blocking until done or stop() is called. When using the dispatcher, this includes
+        /// waiting for the handler to finish with the last record. Throws if a journal can't be read.
+        ReplayStats run()
+        {
+            using namespace std::chrono;
+
+            std::vector<std::unique_ptr<JournalReader>> readers;
+            std::vector<JournalReader::Record> heads;
+
+            for (auto& source : m_config.sources)
+            {
+                readers.emplace_back(std::make_unique<JournalReader>(source.directory, source.prefix));
+                heads.emplace_back();
+            }
+
+            // min-heap of readers by their next record's receive time
+            std::vector<size_t> heap;
+            const auto later = [&heads](const size_t a, const size_t b) { return heads[a].header.receiveTime > heads[b].header.receiveTime; };
+
+            for (size_t i = 0 ; i < readers.size() ; ++i)
+            {
+                if (readers[i]->next(heads[i]))
+                    heap.push_back(i);
+            }
+            std::make_heap(heap.begin(), heap.end(), later);
+
+            m_stop = false;
+            resetStats();
+
+            const auto start = steady_clock::now();
+            const auto firstTime = heap.empty() ? 0 : heads[heap.front()].header.receiveTime;
+
+            while (!heap.empty() && !m_stop.load(std::memory_order_relaxed))
+            {
+                std::pop_heap(heap.begin(), heap.end(), later);
+
+                const auto source = heap.back();
+                auto& record = heads[source];
+
+                if (m_config.tokens.empty() || m_config.tokens.count(record.header.token))
+                {
+                    if (m_config.speed > 0)
+                        std::this_thread::sleep_until(start + duration_cast<steady_clock::duration>(nanoseconds{record.header.receiveTime - firstTime} / m_config.speed));
+
+                    replay(record);
+                }
+                else
+                    m_skipped.fetch_add(1, std::memory_order_relaxed);
+
+                if (readers[source]->next(record))
+                    std::push_heap(heap.begin(), heap.end(), later);
+                else
+                    heap.pop_back();
+            }
+
+            if (m_dispatcher)
+            {
+                // the dispatcher calls handlers in order, so once this is called the last record has been handled
+                std::promise<void> done;
+                m_dispatcher->dispatch([&done](WsResponse) { done.set_value(); }, WsResponse{WsResponse::State::Disconnect});
+                done.get_future().wait();
+            }
+
+            m_elapsed.store(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+
+            return stats();
+        }
+
+
+        /// Stop run() after the current record. Thread safe.
+        void stop()
+        {
+            m_stop = true;
+        }
+
+
+        /// Thread safe, can be called whilst run() is replaying for progress. 'elapsed' is only set when run() returns.
+        ReplayStats stats() const
+        {
+            ReplayStats stats;
+            stats.records = m_records.load();
+            stats.bytes = m_bytes.load();
+            stats.skipped = m_skipped.load();
+            stats.parseErrors = m_parseErrors.load();
+            stats.elapsed = std::chrono::nanoseconds{m_elapsed.load()};
+            return stats;
+        }
+
+
+        /// The handler latency stats when using the dispatcher, otherwise nullptr.
+        std::shared_ptr<WsLatencyStats> latency() const
+        {
+            return m_dispatcher ? m_dispatcher->latency() : nullptr;
+        }
+
+
+    private:
+        void replay (const JournalReader::Record& record)
+        {
+            using namespace std::chrono;
+
+            const auto receiveTime = WsResponse::Clock::now();
+            const system_clock::time_point recorded {duration_cast<system_clock::duration>(nanoseconds{record.header.receiveTime})};
+
+            json::error_code ec;
+            auto value = json::parse(json::string_view{record.frame.data(), record.frame.size()}, ec);
+
+            if (ec)
+            {
+                m_parseErrors.fetch_add(1, std::memory_order_relaxed);
+                deliver(WsResponse{"replay json parse: " + ec.message()});
+                return;
+            }
+
+            WsResponse response {std::move(value)};
+            response.receiveTime = receiveTime;
+            response.parseTime = WsResponse::Clock::now();
+            response.receiveWallTime = recorded;
+
+            if (record.header.flags & JournalRecordHeader::KernelTimestamp)
+                response.kernelReceiveTime = recorded;
+
+            if (m_dispatcher)
+                recordReceiveLatency(*m_dispatcher->latency(), response);
+
+            m_records.fetch_add(1, std::memory_order_relaxed);
+            m_bytes.fetch_add(record.frame.size(), std::memory_order_relaxed);
+
+            deliver(std::move(response));
+        }
+
+
+        void deliver (WsResponse&& response)
+        {
+            if (m_dispatcher)
+                m_dispatcher->dispatch(std::move(response));
+            else
+                m_handler(std::move(response));
+        }
+
+
+        void resetStats()
+        {
+            m_records = 0;
+            m_bytes = 0;
+            m_skipped = 0;
+            m_parseErrors = 0;
+            m_elapsed = 0;
+        }
+
+
+    private:
+        ReplayConfig m_config;
+        WebSocketResponseHandler m_handler;
+        std::shared_ptr<WsHandlerDispatcher> m_dispatcher;
+        std::atomic_bool m_stop {false};
+        std::atomic_uint64_t m_records {0};
+        std::atomic_uint64_t m_bytes {0};
+        std::atomic_uint64_t m_skipped {0};
+        std::atomic_uint64_t m_parseErrors {0};
+        std::atomic_int64_t m_elapsed {0};
+    };
+}
+
+#endif
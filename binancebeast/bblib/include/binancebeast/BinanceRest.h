@@ -28,6 +28,21 @@ namespace bblib
         Put
     };
 
+    /// When each stage of a REST request completed, for breaking down order latency. Set by RestSession, only
+    /// stages that completed are set.
+    struct RestTiming
+    {
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point requestTime;      // session created, before the query is built and signed
+        Clock::time_point runTime;          // query built and signed, resolving
+        Clock::time_point connectTime;      // TCP connected
+        Clock::time_point handshakeTime;    // TLS handshake done
+        Clock::time_point writeTime;        // request written to the socket
+        Clock::time_point receiveTime;      // response read from the socket
+    };
+
+
     struct RestResponse
     {
         enum class State { Fail, Success };
@@ -80,6 +95,8 @@ namespace bblib
         json::value json;
         State state;
         string failMessage;
+        RestTiming timing;      // set when the request was written and a response read
+        unsigned status = 0;    // the HTTP status, 0 if there was no response
     };
 
     
@@ -121,23 +138,55 @@ namespace bblib
         explicit RestSession(net::any_io_executor ex, std::shared_ptr<ssl::context> ctx,
                             const ConnectionConfig::ConnectionKeys& keys,
                             const RestResponseHandler&& callback,
-                            net::thread_pool& threadPool) :
+                            net::any_io_executor callerExecutor) :
             m_resolver(ex),
             m_stream(ex, *ctx),
             m_apiKeys(keys),
             m_callback(callback),
-            m_threadPool(threadPool)
+            m_callerExecutor(std::move(callerExecutor))
+        {
+            m_timing.requestTime = RestTiming::Clock::now();
+        }
+
+
+        ~RestSession()
+        {
+            if (m_load)
+                m_load->pending.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+
+        /// Count this request against an io_context's load. Call before run().
+        void setLoad (std::shared_ptr<IoContextLoad> load)
+        {
+            m_load = std::move(load);
+            m_load->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+
+
+        /// Set SO_BUSY_POLL on the socket when connected, see ThreadConfig::busyPollMicros. Call before run().
+        void setBusyPoll (const int micros)
         {
+            m_busyPollMicros = micros;
+        }
+
+
+        /// Resolve the host through the cache rather than querying DNS for each request. Call before run().
+        void setDnsCache (std::shared_ptr<DnsCache> cache)
+        {
+            m_dnsCache = std::move(cache);
         }
 
 
         void run(const string& host, const string& port, const string& target, const int version, const RequestType type)
         {
+            m_timing.runTime = RestTiming::Clock::now();
+
             // set SNI Hostname (many hosts need this to handshake successfully)
             if (!SSL_set_tlsext_host_name(m_stream.native_handle(), host.c_str()))
             {
                 beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
-                fail(ec, "SNI hostname", m_threadPool, m_callback);
+                fail(ec, "SNI hostname", m_callerExecutor, m_callback);
             }
             else
             {
@@ -150,7 +199,10 @@ namespace bblib
                 m_req.insert("X-MBX-APIKEY", m_apiKeys.api);
                 
                 // look up the domain name
-                m_resolver.async_resolve(host, port, beast::bind_front_handler(&RestSession::on_resolve,shared_from_this()));
+                if (m_dnsCache)
+                    m_dnsCache->resolve(m_resolver, host, port, beast::bind_front_handler(&RestSession::on_resolve,shared_from_this()));
+                else
+                    m_resolver.async_resolve(host, port, beast::bind_front_handler(&RestSession::on_resolve,shared_from_this()));
             }
         }
 
@@ -158,7 +210,7 @@ namespace bblib
         void on_resolve(beast::error_code ec, tcp::resolver::results_type results)
         {
             if (ec)
-                fail(ec, "resolve", m_threadPool, m_callback);
+                fail(ec, "resolve", m_callerExecutor, m_callback);
             else
             {
                 beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(10));   // TODO is this ok
@@ -171,9 +223,18 @@ namespace bblib
         void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
         {
             if (ec)
-                fail(ec, "connect", m_threadPool, m_callback);
+                fail(ec, "connect", m_callerExecutor, m_callback);
             else
             {
+                m_timing.connectTime = RestTiming::Clock::now();
+
+                if (m_busyPollMicros)
+                {
+                    // not fatal, the request still works without it, and the callback is only called with the reply
+                    if (setSocketBusyPoll(beast::get_lowest_layer(m_stream).socket(), m_busyPollMicros, ec); ec && m_load)
+                        m_load->busyPollErrors.fetch_add(1, std::memory_order_relaxed);
+                }
+
                 // Perform the SSL handshake
                 m_stream.async_handshake( ssl::stream_base::client, beast::bind_front_handler(&RestSession::on_handshake, shared_from_this()));
             }            
@@ -183,9 +244,11 @@ namespace bblib
         void on_handshake(beast::error_code ec)
         {        
             if (ec)
-                fail(ec, "handshake", m_threadPool, m_callback);
+                fail(ec, "handshake", m_callerExecutor, m_callback);
             else
             {
+                m_timing.handshakeTime = RestTiming::Clock::now();
+
                 // Set a timeout on the operation
                 beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(5));
 
@@ -198,21 +261,31 @@ namespace bblib
 
         void on_write(beast::error_code ec, std::size_t /*bytes_transferred*/)
         {
+            m_timing.writeTime = RestTiming::Clock::now();
+
             // connected and handshaked, so can begin reading websocket data
 
             beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(30));   
 
             if (ec)
-                fail(ec, "write", m_threadPool, m_callback);
+                fail(ec, "write", m_callerExecutor, m_callback);
             else 
                 http::async_read(m_stream, m_buffer, m_res, beast::bind_front_handler(&RestSession::on_read, shared_from_this()));
         }
 
 
-        void on_read(beast::error_code ec, std::size_t /*bytes_transferred*/)
+        void on_read(beast::error_code ec, std::size_t bytes_transferred)
         {
             if (ec)
-                return fail(ec, "read", m_threadPool, m_callback);
+                return fail(ec, "read", m_callerExecutor, m_callback);
+
+            m_timing.receiveTime = RestTiming::Clock::now();
+
+            if (m_load)
+            {
+                m_load->messages.fetch_add(1, std::memory_order_relaxed);
+                m_load->bytes.fetch_add(bytes_transferred, std::memory_order_relaxed);
+            }
 
             if (m_res.result() == http::status::not_found)
                 return fail("path not found", m_callback);
@@ -223,18 +296,22 @@ namespace bblib
                 
                 if (auto value = json::parse(std::move(m_res.body()), ec); ec)
                 {
-                    fail(ec, "json read", m_threadPool, m_callback);
+                    fail(ec, "json read", m_callerExecutor, m_callback);
                 }
                 else
                 {   
                     RestResponse result {std::move(value)};
-                    net::post(m_threadPool, boost::bind(m_callback, std::move(result)));
+                    result.timing = m_timing;
+                    result.status = m_res.result_int();
+                    net::post(m_callerExecutor, boost::bind(m_callback, std::move(result)));
                 }            
             }
             else
             {
                 RestResponse result {"Content type invalid: " + string{m_res[http::field::content_type]}};
-                net::post(m_threadPool, boost::bind(m_callback, std::move(result)));
+                result.timing = m_timing;
+                result.status = m_res.result_int();
+                net::post(m_callerExecutor, boost::bind(m_callback, std::move(result)));
             }
         }
 
@@ -249,7 +326,7 @@ namespace bblib
             }
 
             if (ec)
-                return fail(ec, "shutdown", m_threadPool, m_callback);
+                return fail(ec, "shutdown", m_callerExecutor, m_callback);
 
             // If we get here then the connection is closed gracefully
         }
@@ -257,13 +334,17 @@ namespace bblib
 
     private:
         tcp::resolver m_resolver;
+        std::shared_ptr<DnsCache> m_dnsCache;
         beast::ssl_stream<beast::tcp_stream> m_stream;
         beast::flat_buffer m_buffer;
         http::request<http::string_body> m_req;
         http::response<http::string_body> m_res;
         ConnectionConfig::ConnectionKeys m_apiKeys;
         RestResponseHandler m_callback;
-        net::thread_pool& m_threadPool;
+        net::any_io_executor m_callerExecutor;       // the user's callback is called on this, usually the thread pool
+        std::shared_ptr<IoContextLoad> m_load;
+        int m_busyPollMicros = 0;
+        RestTiming m_timing;
     };
 }
 
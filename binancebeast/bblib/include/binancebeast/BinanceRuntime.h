@@ -0,0 +1,632 @@
+#ifndef BINANCEBEAST_RUNTIME_H
+#define BINANCEBEAST_RUNTIME_H
+
+#include "BinanceCommon.h"
+#include "SslCertificates.h"
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+
+
+namespace bblib
+{
+    /// The io_contexts to create, one per ThreadConfig.
+    struct IoContextsConfig
+    {
+        /// Default thread settings, nRest and nWebsock io_contexts and no order entry io_contexts.
+        static IoContextsConfig Make (const size_t nRest, const size_t nWebsock, const size_t nOrders = 0)
+        {
+            return IoContextsConfig {std::vector<ThreadConfig>(nRest), std::vector<ThreadConfig>(nWebsock), std::vector<ThreadConfig>(nOrders)};
+        }
+
+        std::vector<ThreadConfig> rest;
+        std::vector<ThreadConfig> websockets;
+        std::vector<ThreadConfig> orders;       // dedicated to order entry, see BinanceBeast::start(). If empty the rest io_contexts are used
+
+        /// How long resolved addresses are cached, see DnsCache. Zero queries DNS for every connection.
+        std::chrono::seconds dnsTtl {60};
+    };
+
+
+    /// io_contexts run by the application rather than by threads the runtime creates, so the library can run on the
+    /// application's event loop, see BinanceRuntime::Make(const ExternalIoContexts&).
+    ///
+    /// The io_contexts must be running, or be run, and outlive the runtime. They can be the same io_context.
+    struct ExternalIoContexts
+    {
+        /// All networking and handlers on one io_context.
+        static ExternalIoContexts Make (net::io_context& ioc)
+        {
+            return ExternalIoContexts {{&ioc}, {&ioc}, {}, ioc.get_executor()};
+        }
+
+        std::vector<net::io_context*> rest;
+        std::vector<net::io_context*> websockets;
+        std::vector<net::io_context*> orders;           // as IoContextsConfig::orders, if empty the rest io_contexts are used
+
+        /// REST and websocket handlers are called on this rather than the runtime's threads. Websocket handlers are
+        /// called on a strand, so in order, as usual. If not set, handlers are called from the runtime's thread pool
+        /// and the websocket dispatchers' threads.
+        std::optional<net::any_io_executor> handlers;
+
+        std::chrono::seconds dnsTtl {60};
+        int busyPollMicros = 0;                         // see ThreadConfig::busyPollMicros
+    };
+
+
+
+    /// The threads and shared state that BinanceBeast clients run on: the io_contexts, the pool that calls REST
+    /// handlers, the SSL contexts, the DNS cache and the connection attempt limiter.
+    ///
+    /// Each BinanceBeast has its own runtime unless it's started with one, so many clients, i.e. one per account or
+    /// per market, can share the same threads:
+    ///
+    ///     auto runtime = BinanceRuntime::Make(IoContextsConfig::Make(2, 4));
+    ///
+    ///     BinanceBeast usdm, spot;
+    ///     usdm.start(ConnectionConfig::MakeLiveConfig(Market::USDM, futuresKeyFile), runtime);
+    ///     spot.start(ConnectionConfig::MakeLiveConfig(Market::SPOT, spotKeyFile), runtime);
+    ///
+    /// The thread count is that of the runtime, however many clients there are. Each websocket token still has a
+    /// thread to call its handler, see WsHandlerDispatcher.
+    ///
+    /// Binance limits connection attempts per IP, so the limiter is shared by all the runtime's clients. It's created
+    /// with the first client's ConnectionConfig::maxConnectionAttempts and connectionAttemptsWindow.
+    ///
+    /// Each io_context's load is sampled once a second by a timer on the first io_context, so with external
+    /// io_contexts there is always a timer pending until the runtime stops.
+    ///
+    /// The runtime is kept by its clients, it stops when the last client and the caller's shared_ptr are destroyed.
+    /// Don't release the last reference from a handler, that would join the handler's own thread.
+    class BinanceRuntime
+    {
+    public:
+        /// An io_context and the thread that runs it.
+        struct IoContext
+        {
+            IoContext () = default;
+            IoContext(IoContext&&) = default;
+
+            IoContext(const IoContext&) = delete;
+            IoContext& operator=(const IoContext&) = delete;
+
+            ~IoContext()
+            {
+                guard.reset();
+
+                // an external io_context is the application's, so it's left running
+                if (owned)
+                    owned->stop();
+
+                if (iocThread.joinable())
+                    iocThread.join();
+            }
+
+            void start(const ThreadConfig& config, const string& name)
+            {
+                owned = std::make_unique<net::io_context>();
+                ioc = owned.get();
+                guard = std::make_unique<net::executor_work_guard<net::io_context::executor_type>> (ioc->get_executor());
+                busyPollMicros = config.busyPollMicros;
+                iocThread = std::move(std::thread([this, config]() { runIoContext(*ioc, config); }));
+
+                // name shows in top, perf, gdb, etc. Max 15 characters
+                pthread_setname_np(iocThread.native_handle(), name.substr(0, 15).c_str());
+
+                if (config.cpu >= 0)
+                {
+                    cpu_set_t cpus;
+                    CPU_ZERO(&cpus);
+                    CPU_SET(config.cpu, &cpus);
+
+                    if (auto err = pthread_setaffinity_np(iocThread.native_handle(), sizeof(cpus), &cpus); err)
+                        fail(beast::error_code{err, boost::system::system_category()}, (" setting affinity for " + name).c_str());
+                }
+
+                if (config.schedPolicy != SCHED_OTHER || config.schedPriority != 0)
+                {
+                    sched_param param {};
+                    param.sched_priority = config.schedPriority;
+
+                    if (auto err = pthread_setschedparam(iocThread.native_handle(), config.schedPolicy, &param); err)
+                        fail(beast::error_code{err, boost::system::system_category()}, (" setting scheduling policy for " + name).c_str());
+                }
+            }
+
+            /// Create the io_context without a thread, it's run by the application calling BinanceRuntime::poll().
+            void startReactor()
+            {
+                owned = std::make_unique<net::io_context>(1);
+                ioc = owned.get();
+
+                // so run_for() waits for the duration rather than returning when there's no work
+                guard = std::make_unique<net::executor_work_guard<net::io_context::executor_type>> (ioc->get_executor());
+            }
+
+            /// Use an io_context run by the application, without a thread.
+            void attach(net::io_context& external, const int busyPoll)
+            {
+                ioc = &external;
+                busyPollMicros = busyPoll;
+            }
+
+            net::io_context * ioc = nullptr;
+            std::unique_ptr<net::io_context> owned;         // null if external
+            std::shared_ptr<IoContextLoad> load = std::make_shared<IoContextLoad>();
+            int busyPollMicros = 0;
+            std::thread iocThread;
+            std::unique_ptr<net::executor_work_guard<net::io_context::executor_type>> guard;
+        };
+
+
+    public:
+        /// A started runtime, to share between clients.
+        static std::shared_ptr<BinanceRuntime> Make (const IoContextsConfig& iocs)
+        {
+            auto runtime = std::make_shared<BinanceRuntime>();
+            runtime->start(iocs);
+            return runtime;
+        }
+
+
+        /// A runtime on the application's io_contexts, which creates no threads if ExternalIoContexts::handlers is set.
+        static std::shared_ptr<BinanceRuntime> Make (const ExternalIoContexts& iocs)
+        {
+            auto runtime = std::make_shared<BinanceRuntime>();
+            runtime->start(iocs);
+            return runtime;
+        }
+
+
+        BinanceRuntime()
+        {
+            m_sslCtx = std::make_shared<ssl::context> (ssl::context::tlsv12_client);
+            m_sslCtx->set_verify_mode(ssl::verify_none);
+
+            m_sslVerifyCtx = std::make_shared<ssl::context> (ssl::context::tlsv12_client);
+            m_sslVerifyCtx->set_verify_mode(ssl::verify_peer);
+        }
+
+
+        ~BinanceRuntime()
+        {
+            stop();
+        }
+
+        BinanceRuntime (const BinanceRuntime&) = delete;
+        BinanceRuntime& operator= (const BinanceRuntime&) = delete;
+
+
+        /// Start the io_contexts' threads. Throws if already started, or if a thread's affinity or scheduling policy
+        /// can't be set.
+        void start (const IoContextsConfig& iocs)
+        {
+            if (started())
+                throw std::runtime_error("BinanceRuntime: already started");
+
+            m_dnsCache = std::make_shared<DnsCache>(iocs.dnsTtl);
+            m_nextWsIoContext = 0;
+            m_restCallersThreadPool = std::make_unique<net::thread_pool>();
+
+            startIoContexts(m_restIocThreads, iocs.rest, "bbrest");
+            startIoContexts(m_wsIocThreads, iocs.websockets, "bbws");
+            startIoContexts(m_orderIocThreads, iocs.orders, "bborder");
+            startLoadSampler();
+
+            m_started.store(true, std::memory_order_release);
+        }
+
+
+        /// Use the application's io_contexts, see ExternalIoContexts. Throws if already started or if there are no
+        /// rest or websocket io_contexts.
+        void start (const ExternalIoContexts& iocs)
+        {
+            if (started())
+                throw std::runtime_error("BinanceRuntime: already started");
+            else if (iocs.rest.empty() || iocs.websockets.empty())
+                throw std::runtime_error("BinanceRuntime: external io_contexts require at least one rest and one websocket io_context");
+
+            m_dnsCache = std::make_shared<DnsCache>(iocs.dnsTtl);
+            m_nextWsIoContext = 0;
+            m_handlerExecutor = iocs.handlers;
+            m_external = true;
+
+            if (!m_handlerExecutor)
+                m_restCallersThreadPool = std::make_unique<net::thread_pool>();
+
+            attachIoContexts(m_restIocThreads, iocs.rest, iocs.busyPollMicros);
+            attachIoContexts(m_wsIocThreads, iocs.websockets, iocs.busyPollMicros);
+            attachIoContexts(m_orderIocThreads, iocs.orders, iocs.busyPollMicros);
+            startLoadSampler();
+
+            m_started.store(true, std::memory_order_release);
+        }
+
+
+        /// No threads: one io_context for all networking, timers and handlers, run by the application calling poll() 
+        /// or run_for(), so every handler is called on the application's thread. Throws if already started.
+        ///
+        /// asio's resolver runs getaddrinfo() on its own internal thread, the result is still delivered by poll().
+        /// With the DNS cache that's once per host per dnsTtl.
+        void startReactor (const std::chrono::seconds dnsTtl = std::chrono::seconds{60})
+        {
+            if (started())
+                throw std::runtime_error("BinanceRuntime: already started");
+
+            m_dnsCache = std::make_shared<DnsCache>(dnsTtl);
+            m_nextWsIoContext = 0;
+
+            m_restIocThreads.resize(1);
+            m_restIocThreads[0].startReactor();
+
+            m_wsIocThreads.resize(1);
+            m_wsIocThreads[0].attach(*m_restIocThreads[0].ioc, 0);
+
+            m_reactor = m_restIocThreads[0].ioc;
+            m_handlerExecutor = m_reactor->get_executor();
+            startLoadSampler();
+
+            m_started.store(true, std::memory_order_release);
+        }
+
+
+        /// Reactor mode, run the handlers that are ready, without blocking. Returns the number of handlers run.
+        /// Call from one thread. Throws if not started with startReactor().
+        size_t poll()
+        {
+            return reactor().poll();
+        }
+
+
+        /// Reactor mode, run handlers for up to 'duration', waiting for work. Returns the number of handlers run.
+        /// Call from one thread. Throws if not started with startReactor().
+        template<typename Rep, typename Period>
+        size_t run_for (const std::chrono::duration<Rep, Period>& duration)
+        {
+            return reactor().run_for(duration);
+        }
+
+
+        bool isReactor() const
+        {
+            return m_reactor != nullptr;
+        }
+
+
+        /// Stop and join the io_contexts' threads. Sessions still running are abandoned. External io_contexts are not
+        /// stopped, their sessions keep running until closed.
+        void stop()
+        {
+            m_started.store(false, std::memory_order_release);
+            m_reactor = nullptr;
+
+            if (m_loadSampler)
+            {
+                // the timer is only used on its io_context's thread
+                m_loadSampler->stopped = true;
+                net::post(m_loadSampler->timer.get_executor(), [sampler = m_loadSampler] { sampler->timer.cancel(); });
+                m_loadSampler.reset();
+            }
+
+            m_wsIocThreads.clear();
+            m_restIocThreads.clear();
+            m_orderIocThreads.clear();
+        }
+
+
+        bool started() const
+        {
+            return m_started.load(std::memory_order_acquire);
+        }
+
+
+        /// If started with the application's io_contexts.
+        bool external() const
+        {
+            return m_external;
+        }
+
+
+        /// The number of io_context threads the runtime created, excluding the callers' pool. Zero with external
+        /// io_contexts or in reactor mode.
+        size_t threadCount() const
+        {
+            const auto threads = [](const std::vector<IoContext>& iocs)
+            {
+                return std::count_if(iocs.cbegin(), iocs.cend(), [](const IoContext& ioc) { return ioc.iocThread.joinable(); });
+            };
+
+            return threads(m_restIocThreads) + threads(m_wsIocThreads) + threads(m_orderIocThreads);
+        }
+
+
+        /// Connections which couldn't set SO_BUSY_POLL, over all io_contexts, see IoContextLoad::busyPollErrors. The
+        /// connections work without it, so this isn't reported to the handlers.
+        std::uint64_t busyPollErrors() const
+        {
+            return sumLoads(&IoContextLoad::busyPollErrors);
+        }
+
+
+        /// Websockets which couldn't enable kernel receive timestamps, see IoContextLoad::timestampErrors. Their
+        /// responses have user space timestamps instead.
+        std::uint64_t timestampErrors() const
+        {
+            return sumLoads(&IoContextLoad::timestampErrors);
+        }
+
+
+        /// The SSL context for a client's ConnectionConfig::verifyPeer.
+        std::shared_ptr<ssl::context> sslContext (const bool verifyPeer) const
+        {
+            return verifyPeer ? m_sslVerifyCtx : m_sslCtx;
+        }
+
+
+        /// Load the certificates shipped with Beast, for ConnectionConfig::usingTestRootCertificates. Loaded once.
+        void useTestRootCertificates()
+        {
+            std::scoped_lock lock (m_mux);
+
+            if (m_testCertificatesLoaded)
+                return;
+
+            boost::system::error_code ec;
+
+            for (auto& ctx : {m_sslCtx, m_sslVerifyCtx})
+            {
+                load_test_certificates(*ctx, ec);
+
+                if (ec)
+                    fail(ec, "failed to load root certificates");
+            }
+
+            m_testCertificatesLoaded = true;
+        }
+
+
+        /// Load a PEM file with root certificates, see BinanceBeast::loadRootCertificate(). Call before the runtime's
+        /// clients connect.
+        void loadRootCertificate (const std::filesystem::path& path)
+        {
+            if (!std::filesystem::exists(path))
+                fail("path to root certificate does not exist");
+
+            m_sslCtx->load_verify_file(path);
+            m_sslVerifyCtx->load_verify_file(path);
+        }
+
+
+        /// Add a directory of PEM certificate authority files, see BinanceBeast::addRootVerifyPath().
+        void addRootVerifyPath (const std::filesystem::path& path)
+        {
+            m_sslCtx->add_verify_path(path);
+            m_sslVerifyCtx->add_verify_path(path);
+        }
+
+
+        std::shared_ptr<DnsCache> dnsCache() const
+        {
+            return m_dnsCache;
+        }
+
+
+        /// The connection attempt limiter, created by the first call.
+        ConnectionRateLimiter& connectionLimiter (const ConnectionConfig& config)
+        {
+            std::scoped_lock lock (m_mux);
+
+            if (!m_connectionLimiter)
+                m_connectionLimiter = std::make_unique<ConnectionRateLimiter>(config.maxConnectionAttempts, config.connectionAttemptsWindow);
+
+            return *m_connectionLimiter;
+        }
+
+
+        /// The users's REST handlers are called on this rather than on the io_context's thread: the thread pool or, 
+        /// with external io_contexts, ExternalIoContexts::handlers.
+        net::any_io_executor callerExecutor()
+        {
+            if (m_handlerExecutor)
+                return *m_handlerExecutor;
+            else if (!m_restCallersThreadPool)
+                throw std::runtime_error("BinanceRuntime: not started");
+
+            return m_restCallersThreadPool->get_executor();
+        }
+
+
+        /// The executor for websocket handlers, if set by ExternalIoContexts::handlers. Otherwise each token's 
+        /// handler has a thread, see WsHandlerDispatcher.
+        const std::optional<net::any_io_executor>& handlerExecutor() const
+        {
+            return m_handlerExecutor;
+        }
+
+
+        /// The least loaded websocket io_context.
+        IoContext& wsIoContext()
+        {
+            return leastLoaded(m_wsIocThreads);
+        }
+
+
+        /// The next websocket io_context, round robin, so successive calls return different io_contexts.
+        IoContext& nextWsIoContext() noexcept
+        {
+            return m_wsIocThreads[m_nextWsIoContext.fetch_add(1) % m_wsIocThreads.size()];
+        }
+
+
+        /// The least loaded REST io_context, or order entry io_context if orderEntry and there are order io_contexts.
+        IoContext& restIoContext (const bool orderEntry)
+        {
+            return leastLoaded(orderEntry && !m_orderIocThreads.empty() ? m_orderIocThreads : m_restIocThreads);
+        }
+
+
+        /// Least loaded by observed message and byte rate, see IoContextLoad::cost(). Websocket streams and pending REST
+        /// requests that haven't been measured yet are estimated from the average cost per stream/request.
+        /// Only reads atomics, so it's cheap enough to call for each REST request.
+        static IoContext& leastLoaded (std::vector<IoContext>& iocs)
+        {
+            // sessions that have only just started haven't been measured, so they are estimated by their stream count or
+            // pending request count, using the average cost per stream/request seen so far
+            double totalCost = 0;
+            std::int64_t totalUnits = 0;
+
+            for (auto& ioc : iocs)
+            {
+                totalCost += ioc.load->cost();
+                totalUnits += ioc.load->streams.load() + ioc.load->pending.load();
+            }
+
+            const double costPerUnit = totalUnits > 0 && totalCost > 0 ? totalCost / static_cast<double>(totalUnits) : 1.0;
+
+            size_t leastLoadedIndex = 0;
+            double leastCost = std::numeric_limits<double>::max();
+
+            for (size_t i = 0 ; i < iocs.size() ; ++i)
+            {
+                const auto units = iocs[i].load->streams.load() + iocs[i].load->pending.load();
+                const auto cost = std::max(iocs[i].load->cost(), static_cast<double>(units) * costPerUnit);
+
+                if (cost < leastCost)
+                {
+                    leastCost = cost;
+                    leastLoadedIndex = i;
+                }
+            }
+
+            return iocs[leastLoadedIndex];
+        }
+
+
+    private:
+        std::uint64_t sumLoads (std::atomic_uint64_t IoContextLoad::* counter) const
+        {
+            std::uint64_t count = 0;
+
+            for (auto iocs : {&m_restIocThreads, &m_wsIocThreads, &m_orderIocThreads})
+            {
+                for (auto& ioc : *iocs)
+                    count += ((*ioc.load).*counter).load(std::memory_order_relaxed);
+            }
+
+            return count;
+        }
+
+
+        /// Samples each io_context's IoContextLoad, so IoContextLoad::cost() is current without leastLoaded() measuring.
+        struct LoadSampler
+        {
+            explicit LoadSampler (net::io_context& ioc) : timer(ioc)
+            {
+            }
+
+            net::steady_timer timer;
+            std::vector<std::shared_ptr<IoContextLoad>> loads;
+            std::atomic_bool stopped {false};
+        };
+
+
+        void startLoadSampler()
+        {
+            std::shared_ptr<LoadSampler> sampler;
+
+            for (auto iocs : {&m_restIocThreads, &m_wsIocThreads, &m_orderIocThreads})
+            {
+                for (auto& ioc : *iocs)
+                {
+                    if (!sampler)
+                        sampler = std::make_shared<LoadSampler>(*ioc.ioc);
+
+                    sampler->loads.push_back(ioc.load);
+                }
+            }
+
+            if (!sampler)
+                return;
+
+            m_loadSampler = sampler;
+            net::post(sampler->timer.get_executor(), [sampler] { sampleLoads(sampler); });
+        }
+
+
+        static void sampleLoads (const std::shared_ptr<LoadSampler>& sampler)
+        {
+            if (sampler->stopped)
+                return;
+
+            // less than the timer's interval, so a late tick still samples
+            for (auto& load : sampler->loads)
+                load->rates(std::chrono::milliseconds{500});
+
+            sampler->timer.expires_after(std::chrono::seconds{1});
+            sampler->timer.async_wait([sampler](const beast::error_code& ec)
+            {
+                if (!ec)
+                    sampleLoads(sampler);
+            });
+        }
+
+
+        net::io_context& reactor()
+        {
+            if (!m_reactor)
+                throw std::runtime_error("BinanceRuntime: poll() and run_for() require reactor mode, see startReactor()");
+
+            return *m_reactor;
+        }
+
+
+        static void startIoContexts (std::vector<IoContext>& iocs, const std::vector<ThreadConfig>& config, const string& name)
+        {
+            iocs.resize(std::min<size_t>(config.size(), 24));   // clamp for sanity
+
+            for (size_t i = 0 ; i < iocs.size() ; ++i)
+                iocs[i].start(config[i], name + std::to_string(i));
+        }
+
+
+        static void attachIoContexts (std::vector<IoContext>& iocs, const std::vector<net::io_context*>& external, const int busyPollMicros)
+        {
+            iocs.resize(external.size());
+
+            for (size_t i = 0 ; i < iocs.size() ; ++i)
+            {
+                if (!external[i])
+                    throw std::runtime_error("BinanceRuntime: external io_context is null");
+
+                iocs[i].attach(*external[i], busyPollMicros);
+            }
+        }
+
+
+    private:
+        std::shared_ptr<ssl::context> m_sslCtx;           // verify_none
+        std::shared_ptr<ssl::context> m_sslVerifyCtx;     // verify_peer
+        bool m_testCertificatesLoaded = false;
+        std::shared_ptr<DnsCache> m_dnsCache = std::make_shared<DnsCache>(std::chrono::seconds{60});
+        std::unique_ptr<ConnectionRateLimiter> m_connectionLimiter;
+        std::mutex m_mux;
+        std::atomic_bool m_started {false};
+        bool m_external = false;
+        net::io_context * m_reactor = nullptr;          // reactor mode, the only io_context
+
+        // declared before the io_contexts, so the io_contexts' threads are joined first
+        std::unique_ptr<net::thread_pool> m_restCallersThreadPool;
+        std::optional<net::any_io_executor> m_handlerExecutor;
+
+        std::vector<IoContext> m_restIocThreads;
+        std::vector<IoContext> m_orderIocThreads;
+        std::vector<IoContext> m_wsIocThreads;
+        std::atomic_size_t m_nextWsIoContext {0};
+        std::shared_ptr<LoadSampler> m_loadSampler;
+    };
+}
+
+#endif
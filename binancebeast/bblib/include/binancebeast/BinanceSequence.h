@@ -0,0 +1,353 @@
+#ifndef BINANCEBEAST_SEQUENCE_H
+#define BINANCEBEAST_SEQUENCE_H
+
+#include "BinanceWebsockets.h"
+#include <atomic>
+#include <deque>
+#include <set>
+#include <unordered_map>
+
+
+namespace bblib
+{
+    /// An event whose update ids do not follow on from the previous event of the same stream.
+    struct SequenceGap
+    {
+        string key;                             // stream name, or event type and symbol for a raw stream, i.e. "depthUpdate|BTCUSDT"
+        string symbol;
+        std::uint64_t lastUpdateId = 0;         // "u" of the previous event, or the snapshot's lastUpdateId
+        std::uint64_t firstUpdateId = 0;        // "U" of this event
+        std::uint64_t previousUpdateId = 0;     // "pu" of this event, 0 for streams without it (SPOT)
+    };
+
+    using SequenceGapHandler = std::function<void(const SequenceGap&)>;
+
+
+    struct SequenceConfig
+    {
+        SequenceGapHandler onGap;               // called from the handler's thread, so the same rules as the handler apply
+        bool resync = false;                    // on a gap, buffer the stream's events, get a REST depth snapshot then replay the buffered events
+        size_t maxBuffered = 1000;              // per stream whilst resyncing, if exceeded the oldest is dropped, which causes another resync
+        unsigned snapshotLimit = 1000;          // "limit" for the depth snapshot
+    };
+
+
+    struct SequenceStats
+    {
+        std::uint64_t gaps = 0;
+        std::uint64_t resyncs = 0;              // snapshots applied
+        std::uint64_t stale = 0;                // events dropped because they are not newer than the previous event or snapshot
+        std::uint64_t overflow = 0;             // buffered events dropped whilst waiting for a snapshot
+    };
+
+
+    /// Validates the update ids of diff depth events before they are passed to the handler:
+    ///     - futures events have "pu", which must equal "u" of the previous event
+    ///     - SPOT events must have "U" equal to the previous event's "u" + 1
+    ///
+    /// Any event with "U" and "u" is validated, others are passed straight to the handler.
+    ///
+    /// With SequenceConfig::resync, a gap causes the stream's events to be buffered whilst a depth snapshot is
+    /// requested. The snapshot is passed to the handler as an event with "e":"depthSnapshot" and "s":<symbol> added
+    /// to the REST response, then the buffered events that follow the snapshot. The handler should reset its book
+    /// when it receives the snapshot. If the snapshot request fails, the handler receives a Fail response and the
+    /// buffered events are passed on unvalidated.
+    ///
+    /// onResponse() must be called in order from one thread, which it is when used as a WsHandlerDispatcher's handler,
+    /// including the snapshot, which is dispatched on the same dispatcher.
+    class SequenceValidator
+    {
+    public:
+        using SnapshotRequester = std::function<void(const string& symbol)>;
+
+        static constexpr const char * SnapshotEvent = "depthSnapshot";
+
+
+        SequenceValidator (WebSocketResponseHandler handler, SequenceConfig config, SnapshotRequester requestSnapshot = nullptr)
+            :   m_handler(std::move(handler)),
+                m_config(std::move(config)),
+                m_requestSnapshot(std::move(requestSnapshot))
+        {
+
+        }
+
+
+        /// Creates the response for onResponse() from a REST depth snapshot.
+        static WsResponse makeSnapshot (const string& symbol, json::value&& depth)
+        {
+            if (auto object = depth.if_object())
+            {
+                (*object)["e"] = SnapshotEvent;
+                (*object)["s"] = symbol.c_str();
+            }
+            return WsResponse{std::move(depth)};
+        }
+
+
+        /// Creates the response for onResponse() when the depth snapshot request failed.
+        static WsResponse makeSnapshotFail (const string& symbol, const string& reason)
+        {
+            json::object object;
+            object["e"] = SnapshotEvent;
+            object["s"] = symbol.c_str();
+            object["error"] = reason.c_str();
+            return WsResponse{json::value{std::move(object)}};
+        }
+
+
+        void onResponse (WsResponse&& response)
+        {
+            if (response.state != WsResponse::State::Success)
+                return m_handler(std::move(response));
+
+            const json::object * event = nullptr;
+            const json::value * stream = nullptr;
+
+            if (auto object = response.json.if_object())
+            {
+                if (stream = object->if_contains("stream"); stream && stream->is_string())
+                {
+                    auto data = object->if_contains("data");
+                    event = data ? data->if_object() : nullptr;
+                }
+                else
+                    event = object;
+            }
+
+            if (!event)
+                return m_handler(std::move(response));
+
+            if (auto e = event->if_contains("e"); e && e->is_string() && e->as_string() == SnapshotEvent)
+                return onSnapshot(std::move(response));
+
+            Ids ids;
+            if (!readId(event->if_contains("U"), ids.first) || !readId(event->if_contains("u"), ids.last))
+                return m_handler(std::move(response));
+
+            ids.hasPrevious = readId(event->if_contains("pu"), ids.previous);
+
+            auto symbol = event->if_contains("s");
+            if (!symbol || !symbol->is_string())
+                return m_handler(std::move(response));
+
+            if (stream && stream->is_string())
+                m_key = stream->as_string();
+            else
+            {
+                m_key.clear();
+
+                if (auto e = event->if_contains("e"); e && e->is_string())
+                    m_key = e->as_string();
+
+                m_key += '|';
+                m_key += symbol->as_string();
+            }
+
+            auto it = m_streams.find(m_key);
+            if (it == m_streams.end())
+            {
+                it = m_streams.emplace(m_key, StreamState{}).first;
+                it->second.symbol = symbol->as_string();
+            }
+
+            process(it->first, it->second, ids, std::move(response));
+        }
+
+
+        SequenceStats stats() const
+        {
+            return SequenceStats{m_gaps.load(), m_resyncs.load(), m_stale.load(), m_overflow.load()};
+        }
+
+
+    private:
+        struct Ids
+        {
+            std::uint64_t first = 0;        // U
+            std::uint64_t last = 0;         // u
+            std::uint64_t previous = 0;     // pu
+            bool hasPrevious = false;
+        };
+
+
+        struct BufferedEvent
+        {
+            Ids ids;
+            WsResponse response;
+        };
+
+
+        struct StreamState
+        {
+            string symbol;
+            std::uint64_t lastUpdateId = 0;
+            bool initialised = false;
+            bool afterSnapshot = false;     // lastUpdateId is from a snapshot rather than an event
+            bool resyncing = false;
+            std::deque<BufferedEvent> buffered;
+        };
+
+
+        static bool readId (const json::value * value, std::uint64_t& id)
+        {
+            if (!value)
+                return false;
+            else if (value->is_uint64())
+                id = value->as_uint64();
+            else if (value->is_int64())
+                id = static_cast<std::uint64_t>(value->as_int64());
+            else
+                return false;
+
+            return true;
+        }
+
+
+        void process (const string& key, StreamState& state, const Ids& ids, WsResponse&& response)
+        {
+            if (state.resyncing)
+            {
+                if (state.buffered.size() >= std::max<size_t>(1, m_config.maxBuffered))
+                {
+                    // the snapshot will not follow on from the remaining events, so there will be another resync
+                    state.buffered.pop_front();
+                    ++m_overflow;
+                }
+
+                state.buffered.push_back(BufferedEvent{ids, std::move(response)});
+                return;
+            }
+
+            if (!state.initialised)
+            {
+                state.initialised = true;
+                state.lastUpdateId = ids.last;
+                return m_handler(std::move(response));
+            }
+
+            const auto last = state.lastUpdateId;
+            bool stale, valid;
+
+            if (state.afterSnapshot)
+            {
+                // the first event after a snapshot must include the snapshot's update id
+                if (ids.hasPrevious)
+                {
+                    stale = ids.last < last;
+                    valid = (ids.first <= last && ids.last >= last) || ids.previous == last;
+                }
+                else
+                {
+                    stale = ids.last <= last;
+                    valid = ids.first <= last + 1 && ids.last >= last + 1;
+                }
+            }
+            else
+            {
+                stale = ids.last <= last;
+                valid = ids.hasPrevious ? ids.previous == last : ids.first == last + 1;
+            }
+
+            if (stale)
+            {
+                ++m_stale;
+                return;
+            }
+
+            if (!valid)
+            {
+                ++m_gaps;
+
+                if (m_config.onGap)
+                    m_config.onGap(SequenceGap{key, state.symbol, last, ids.first, ids.hasPrevious ? ids.previous : 0});
+
+                if (m_config.resync && m_requestSnapshot)
+                {
+                    state.resyncing = true;
+                    state.buffered.push_back(BufferedEvent{ids, std::move(response)});
+
+                    // one request per symbol, a symbol may be on more than one stream
+                    if (m_pendingSnapshots.insert(state.symbol).second)
+                        m_requestSnapshot(state.symbol);
+
+                    return;
+                }
+            }
+
+            state.lastUpdateId = ids.last;
+            state.afterSnapshot = false;
+            m_handler(std::move(response));
+        }
+
+
+        void onSnapshot (WsResponse&& snapshot)
+        {
+            const auto& object = snapshot.json.as_object();
+            const auto symbol = json::value_to<string>(object.at("s"));
+
+            m_pendingSnapshots.erase(symbol);
+
+            std::uint64_t snapshotId = 0;
+            const bool failed = object.if_contains("error") || !readId(object.if_contains("lastUpdateId"), snapshotId);
+
+            if (failed)
+            {
+                WsResponse fail {"depth snapshot failed for " + symbol + (object.if_contains("error") ? ": " + json::value_to<string>(object.at("error")) : "")};
+                m_handler(std::move(fail));
+            }
+            else
+            {
+                ++m_resyncs;
+                m_handler(std::move(snapshot));
+            }
+
+            for (auto& [key, state] : m_streams)
+            {
+                if (state.symbol != symbol || !state.resyncing)
+                    continue;
+
+                state.resyncing = false;
+
+                if (failed)
+                {
+                    // start again from the next event
+                    state.initialised = false;
+                    state.afterSnapshot = false;
+
+                    for (auto& event : state.buffered)
+                        m_handler(std::move(event.response));
+
+                    state.buffered.clear();
+                }
+                else
+                {
+                    state.initialised = true;
+                    state.afterSnapshot = true;
+                    state.lastUpdateId = snapshotId;
+
+                    // replay, a gap in the buffered events causes another resync, with the remaining events buffered again
+                    auto buffered = std::move(state.buffered);
+                    state.buffered.clear();
+
+                    for (auto& event : buffered)
+                        process(key, state, event.ids, std::move(event.response));
+                }
+            }
+        }
+
+
+    private:
+        WebSocketResponseHandler m_handler;
+        SequenceConfig m_config;
+        SnapshotRequester m_requestSnapshot;
+        std::unordered_map<string, StreamState> m_streams;
+        std::set<string> m_pendingSnapshots;
+        string m_key;       // reused to avoid an allocation per event
+        std::atomic_uint64_t m_gaps {0};
+        std::atomic_uint64_t m_resyncs {0};
+        std::atomic_uint64_t m_stale {0};
+        std::atomic_uint64_t m_overflow {0};
+    };
+}
+
+#endif
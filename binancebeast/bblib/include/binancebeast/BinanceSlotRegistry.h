@@ -0,0 +1,247 @@
+#ifndef BINANCEBEAST_SLOTREGISTRY_H
+#define BINANCEBEAST_SLOTREGISTRY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+
+namespace bblib
+{
+    /// Maps ids to values in a slot array, with lock free, O(1) insert, find and erase.
+    ///
+    /// An id is the slot's index and the slot's generation, which is incremented when the value is erased, so an id
+    /// is not found after it's erased even when the slot has been reused. The generation is 16 bits, so an id could
+    /// be found again after its slot is reused 65536 times.
+    ///
+    /// Slots are allocated in chunks as required and not freed until the registry is destroyed. Erased slots are
+    /// reused.
+    ///
+    /// find() copies the value, so T is usually a shared_ptr. erase() waits (spinning) for any find() of that slot
+    /// which is copying the value, which is brief.
+    template <typename T>
+    class SlotRegistry
+    {
+    public:
+        using Id = std::uint32_t;
+
+        static constexpr unsigned IndexBits = 16;
+        static constexpr size_t Capacity = (size_t{1} << IndexBits) - 1;    // the low bits are index + 1, so an id is never 0
+        static constexpr size_t ChunkSize = 256;
+        static constexpr size_t NumChunks = (Capacity + ChunkSize - 1) / ChunkSize;
+
+
+        SlotRegistry() = default;
+
+        ~SlotRegistry()
+        {
+            for (auto& chunk : m_chunks)
+                delete chunk.load();
+        }
+
+        SlotRegistry (const SlotRegistry&) = delete;
+        SlotRegistry& operator= (const SlotRegistry&) = delete;
+
+
+        /// Adds a value, returning its id. Throws if there are Capacity values.
+        Id insert (T value)
+        {
+            const auto index = allocate();
+            auto& s = slot(index);
+
+            s.value = std::move(value);
+
+            const Id id = (Id{s.generation} << IndexBits) | (index + 1);
+            s.id.store(id);     // publishes the value
+
+            m_size.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+
+
+        /// A copy of the id's value, or a default constructed T if not found.
+        T find (const Id id) const
+        {
+            T value {};
+
+            if (auto s = slotOf(id))
+            {
+                // erase() waits until there are no readers before changing the value, and insert() only changes the
+                // value of a slot with a different id, so the value can be copied whilst the id matches
+                s->readers.fetch_add(1);
+
+                if (s->id.load() == id)
+                    value = s->value;
+
+                s->readers.fetch_sub(1, std::memory_order_release);
+            }
+
+            return value;
+        }
+
+
+        bool contains (const Id id) const
+        {
+            auto s = slotOf(id);
+            return s && s->id.load(std::memory_order_acquire) == id;
+        }
+
+
+        /// Removes the id, returning its value, or a default constructed T if not found. If called concurrently for
+        /// the same id, only one call has the value.
+        T erase (const Id id)
+        {
+            T value {};
+
+            if (auto s = slotOf(id))
+            {
+                if (Id expected = id ; !s->id.compare_exchange_strong(expected, 0))
+                    return value;
+
+                // finds that saw the id before it was cleared. Sequentially consistent with find()'s increment then
+                // load, so either find() sees the cleared id or this sees the reader
+                while (s->readers.load() != 0)
+                    std::this_thread::yield();
+
+                value = std::move(s->value);
+                s->value = T{};
+                ++s->generation;
+
+                m_size.fetch_sub(1, std::memory_order_relaxed);
+                release((id & IndexMask) - 1);
+            }
+
+            return value;
+        }
+
+
+        /// Erases all values. Values inserted concurrently may not be erased.
+        /// If set, onErase is called with each erased value.
+        void clear (const std::function<void(T&&)>& onErase = nullptr)
+        {
+            const auto used = std::min<size_t>(m_next.load(std::memory_order_acquire), Capacity);
+
+            for (size_t index = 0 ; index < used ; ++index)
+            {
+                if (auto chunk = m_chunks[index / ChunkSize].load(std::memory_order_acquire))
+                {
+                    if (const auto id = chunk->slots[index % ChunkSize].id.load() ; id)
+                    {
+                        if (auto value = erase(id) ; onErase)
+                            onErase(std::move(value));
+                    }
+                }
+            }
+        }
+
+
+        size_t size() const
+        {
+            return m_size.load(std::memory_order_relaxed);
+        }
+
+
+    private:
+        static constexpr Id IndexMask = (Id{1} << IndexBits) - 1;
+
+
+        struct Slot
+        {
+            std::atomic<Id> id {0};                         // 0 when free
+            mutable std::atomic_uint32_t readers {0};
+            std::atomic_uint32_t nextFree {0};              // index + 1 of the next free slot, 0 for none
+            std::uint16_t generation = 0;                   // only changed by the slot's owner, insert() or erase()
+            T value {};
+        };
+
+        struct Chunk
+        {
+            std::array<Slot, ChunkSize> slots;
+        };
+
+
+        Slot& slot (const std::uint32_t index)
+        {
+            return m_chunks[index / ChunkSize].load(std::memory_order_acquire)->slots[index % ChunkSize];
+        }
+
+
+        /// The slot for the id's index, or nullptr if the slot's chunk has not been allocated. A slot in an allocated
+        /// chunk that has not been used has id 0, so is not found.
+        Slot * slotOf (const Id id) const
+        {
+            const auto low = id & IndexMask;
+
+            if (low == 0)
+                return nullptr;
+
+            const auto index = low - 1;
+            auto chunk = m_chunks[index / ChunkSize].load(std::memory_order_acquire);
+
+            return chunk ? &chunk->slots[index % ChunkSize] : nullptr;
+        }
+
+
+        std::uint32_t allocate()
+        {
+            // reuse an erased slot, the tag in the high bits prevents ABA
+            auto head = m_freeHead.load(std::memory_order_acquire);
+
+            while (static_cast<std::uint32_t>(head) != 0)
+            {
+                const auto index = static_cast<std::uint32_t>(head) - 1;
+                const std::uint64_t next = ((head >> 32) + 1) << 32 | slot(index).nextFree.load(std::memory_order_relaxed);
+
+                if (m_freeHead.compare_exchange_weak(head, next, std::memory_order_acquire))
+                    return index;
+            }
+
+            // a new slot
+            const auto index = m_next.fetch_add(1, std::memory_order_relaxed);
+
+            if (index >= Capacity)
+            {
+                m_next.fetch_sub(1, std::memory_order_relaxed);
+                throw std::runtime_error("registry full");
+            }
+
+            auto& chunk = m_chunks[index / ChunkSize];
+
+            if (!chunk.load(std::memory_order_acquire))
+            {
+                auto created = new Chunk;
+                Chunk * expected = nullptr;
+
+                if (!chunk.compare_exchange_strong(expected, created, std::memory_order_acq_rel))
+                    delete created;
+            }
+
+            return index;
+        }
+
+
+        void release (const std::uint32_t index)
+        {
+            auto head = m_freeHead.load(std::memory_order_relaxed);
+
+            do
+            {
+                slot(index).nextFree.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+            }
+            while (!m_freeHead.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (index + 1), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+
+    private:
+        std::array<std::atomic<Chunk *>, NumChunks> m_chunks {};
+        std::atomic_uint64_t m_freeHead {0};    // tag << 32 | index + 1 of the first free slot
+        std::atomic_uint32_t m_next {0};        // next never used slot
+        std::atomic_size_t m_size {0};
+    };
+}
+
+#endif
@@ -0,0 +1,355 @@
+#ifndef BINANCEBEAST_SYMBOLS_H
+#define BINANCEBEAST_SYMBOLS_H
+
+#include "BinanceBeast.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+
+namespace bblib
+{
+    /// A symbol's dense id, from SymbolRegistry. Ids are 0 to SymbolRegistry::size() - 1.
+    using SymbolId = std::uint16_t;
+
+    constexpr SymbolId InvalidSymbolId = std::numeric_limits<SymbolId>::max();
+
+
+    /// Maps a market's symbols to dense ids, so per-symbol state can be a flat array indexed by id rather than a map
+    /// keyed by string:
+    ///
+    ///     SymbolRegistry::load(bb, [&](auto registry, const string& failMessage)
+    ///     {
+    ///         books.resize(registry->size());
+    ///     });
+    ///
+    ///     // in the handler
+    ///     if (const auto id = registry->idOf(response.json); id != InvalidSymbolId)
+    ///         books[id].apply(response.json);
+    ///
+    /// Lookup is a minimal perfect hash (hash and displace): the symbol is hashed once, the hash's bucket has a
+    /// displacement which places each symbol at its own slot, and the slot is the id. There are no probes or chains,
+    /// so a lookup is one hash, two array reads and one compare, whatever the number of symbols. The compare rejects
+    /// symbols that aren't in the registry.
+    ///
+    /// Lookups are case insensitive, so stream names ("btcusdt@bookTicker") and event symbols ("BTCUSDT") have the
+    /// same id. The registry doesn't change once built, so it's safe to read from any thread.
+    class SymbolRegistry
+    {
+    public:
+        using LoadHandler = std::function<void(std::shared_ptr<const SymbolRegistry> registry, const string& failMessage)>;
+
+        static constexpr size_t MaxSymbols = InvalidSymbolId;
+
+
+        /// Duplicates, ignoring case, are ignored. Throws if there are more than MaxSymbols.
+        explicit SymbolRegistry (const std::vector<string>& symbols)
+        {
+            for (auto& symbol : symbols)
+            {
+                string upper {symbol};
+                std::transform(upper.begin(), upper.end(), upper.begin(), toUpper);
+                m_symbols.emplace_back(std::move(upper));
+            }
+
+            std::sort(m_symbols.begin(), m_symbols.end());
+            m_symbols.erase(std::unique(m_symbols.begin(), m_symbols.end()), m_symbols.end());
+
+            if (m_symbols.size() > MaxSymbols)
+                throw std::runtime_error("SymbolRegistry: more than " + std::to_string(MaxSymbols) + " symbols");
+
+            build();
+        }
+
+
+        /// From an exchangeInfo reply: each entry of "symbols" with a "symbol". Throws if the json isn't exchangeInfo.
+        static std::shared_ptr<const SymbolRegistry> fromExchangeInfo (const json::value& exchangeInfo)
+        {
+            auto object = exchangeInfo.if_object();
+            auto symbols = object ? object->if_contains("symbols") : nullptr;
+
+            if (!symbols || !symbols->is_array())
+                throw std::runtime_error("SymbolRegistry: exchangeInfo has no symbols");
+
+            std::vector<string> names;
+            names.reserve(symbols->as_array().size());
+
+            for (auto& entry : symbols->as_array())
+            {
+                if (auto symbol = entry.is_object() ? entry.as_object().if_contains("symbol") : nullptr; symbol && symbol->is_string())
+                    names.emplace_back(symbol->as_string().c_str(), symbol->as_string().size());
+            }
+
+            return std::make_shared<const SymbolRegistry>(names);
+        }
+
+
+        /// Request exchangeInfo for the client's market, ConnectionConfig::market, and build the registry. The handler is
+        /// called with the registry, or with nullptr and the reason if the request failed. Throws if the client has no
+        /// market, i.e. it's not started.
+        static void load (BinanceBeast& bb, LoadHandler handler)
+        {
+            const auto market = bb.config().market;
+            string path;
+
+            if (market == Market::USDM)
+                path = "/fapi/v1/exchangeInfo";
+            else if (market == Market::COINM)
+                path = "/dapi/v1/exchangeInfo";
+            else if (market == Market::SPOT)
+                path = "/api/v3/exchangeInfo";
+            else
+                throw std::runtime_error("SymbolRegistry::load() requires the client to have a market, see ConnectionConfig::market");
+
+            bb.sendRestRequest([handler = std::move(handler)](RestResponse result)
+            {
+                if (result.hasErrorCode())
+                    return handler(nullptr, result.failMessage);
+
+                std::shared_ptr<const SymbolRegistry> registry;
+
+                try
+                {
+                    registry = fromExchangeInfo(result.json);
+                }
+                catch (const std::exception& ex)
+                {
+                    return handler(nullptr, ex.what());
+                }
+
+                handler(std::move(registry), {});
+
+            }, path, RestSign::Unsigned, RestParams{}, RequestType::Get);
+        }
+
+
+        /// The symbol's id, InvalidSymbolId if it's not in the registry. Case insensitive.
+        SymbolId id (const string_view symbol) const noexcept
+        {
+            if (m_symbols.empty())
+                return InvalidSymbolId;
+
+            const auto h = hash(symbol);
+            const auto slot = slotOf(h, m_displacements[bucketOf(h)]);
+
+            return equalsUpper(symbol, m_symbols[slot]) ? static_cast<SymbolId>(slot) : InvalidSymbolId;
+        }
+
+
+        /// The id of an event's "s" field, or of a combined stream's "data"."s". InvalidSymbolId if there's no "s" or
+        /// it's not in the registry.
+        SymbolId idOf (const json::value& event) const noexcept
+        {
+            auto object = event.if_object();
+
+            if (object)
+            {
+                if (auto data = object->if_contains("data"); data && data->is_object())
+                    object = &data->as_object();
+            }
+
+            auto symbol = object ? object->if_contains("s") : nullptr;
+
+            return symbol && symbol->is_string() ? id(string_view{symbol->as_string().data(), symbol->as_string().size()}) : InvalidSymbolId;
+        }
+
+
+        /// The id of a stream name's symbol, i.e. "btcusdt@depth@100ms". InvalidSymbolId for streams without a symbol.
+        SymbolId idOfStream (const string_view stream) const noexcept
+        {
+            return id(stream.substr(0, stream.find('@')));
+        }
+
+
+        /// The symbol, upper case, for a valid id.
+        const string& symbol (const SymbolId id) const
+        {
+            return m_symbols[id];
+        }
+
+
+        bool contains (const string_view symbol) const noexcept
+        {
+            return id(symbol) != InvalidSymbolId;
+        }
+
+
+        /// The number of symbols, ids are 0 to size() - 1.
+        size_t size() const noexcept
+        {
+            return m_symbols.size();
+        }
+
+
+    private:
+        static constexpr std::uint32_t MaxDisplacement = 1U << 24;
+
+
+        static char toUpper (const char c) noexcept
+        {
+            return c >= 'a' && c <= 'z' ? static_cast<char>(c - ('a' - 'A')) : c;
+        }
+
+
+        /// 'upper' is upper case. Event symbols are upper case, so usually the memcmp.
+        static bool equalsUpper (const string_view symbol, const string& upper) noexcept
+        {
+            if (symbol.size() != upper.size())
+                return false;
+            else if (std::memcmp(symbol.data(), upper.data(), symbol.size()) == 0)
+                return true;
+
+            for (size_t i = 0 ; i < symbol.size() ; ++i)
+            {
+                if (toUpper(symbol[i]) != upper[i])
+                    return false;
+            }
+
+            return true;
+        }
+
+
+        /// 8 bytes at a time, with bit 0x20 cleared from each byte so lower and upper case letters hash the same.
+        /// That also folds some non-letters together, which only costs a compare, symbols are letters, digits and '_'.
+        static std::uint64_t hash (const string_view symbol) noexcept
+        {
+            constexpr std::uint64_t Fold = ~0x2020202020202020ULL;
+
+            std::uint64_t h = 0xcbf29ce484222325ULL ^ symbol.size();
+            size_t i = 0;
+
+            for ( ; i + 8 <= symbol.size() ; i += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, symbol.data() + i, 8);
+                h = (h ^ (word & Fold)) * 0x9e3779b97f4a7c15ULL;
+                h ^= h >> 29;
+            }
+
+            if (i < symbol.size())
+            {
+                // not a memcpy, which for a variable size is a call
+                std::uint64_t word = 0;
+                for (size_t shift = 0 ; i < symbol.size() ; ++i, shift += 8)
+                    word |= std::uint64_t{static_cast<unsigned char>(symbol[i])} << shift;
+
+                h = (h ^ (word & Fold)) * 0x9e3779b97f4a7c15ULL;
+            }
+
+            return mix(h);
+        }
+
+
+        static std::uint64_t mix (std::uint64_t h) noexcept
+        {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+
+        /// Map 32 bits to [0, n) without a division.
+        static std::uint32_t reduce (const std::uint32_t x, const size_t n) noexcept
+        {
+            return static_cast<std::uint32_t>((std::uint64_t{x} * n) >> 32);
+        }
+
+
+        size_t bucketOf (const std::uint64_t h) const noexcept
+        {
+            return reduce(static_cast<std::uint32_t>(h >> 32), m_displacements.size());
+        }
+
+
+        size_t slotOf (const std::uint64_t h, const std::uint32_t displacement) const noexcept
+        {
+            return reduce(static_cast<std::uint32_t>(((h ^ (displacement * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL) >> 32), m_symbols.size());
+        }
+
+
+        /// Buckets of about 4 symbols. Largest buckets first, each is given the first displacement that puts all of
+        /// its symbols in free slots.
+        void build()
+        {
+            const auto n = m_symbols.size();
+
+            if (n == 0)
+                return;
+
+            m_displacements.assign((n + 3) / 4, 0);
+
+            std::vector<std::vector<std::pair<std::uint64_t, std::uint16_t>>> buckets (m_displacements.size());    // hash and index into m_symbols
+
+            for (size_t i = 0 ; i < n ; ++i)
+            {
+                const auto h = hash(m_symbols[i]);
+                buckets[bucketOf(h)].emplace_back(h, static_cast<std::uint16_t>(i));
+            }
+
+            std::vector<size_t> order (buckets.size());
+            for (size_t i = 0 ; i < order.size() ; ++i)
+                order[i] = i;
+
+            std::stable_sort(order.begin(), order.end(), [&buckets](const size_t a, const size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+            std::vector<bool> used (n, false);
+            std::vector<size_t> slots;
+            std::vector<string> bySlot (n);
+
+            for (const auto b : order)
+            {
+                auto& bucket = buckets[b];
+
+                if (bucket.empty())
+                    break;
+
+                for (std::uint32_t displacement = 0 ; ; ++displacement)
+                {
+                    if (displacement == MaxDisplacement)
+                        throw std::runtime_error("SymbolRegistry: failed to build the perfect hash");
+
+                    slots.clear();
+
+                    const bool fits = std::all_of(bucket.cbegin(), bucket.cend(), [&](const auto& entry)
+                    {
+                        const auto slot = slotOf(entry.first, displacement);
+
+                        if (used[slot] || std::find(slots.cbegin(), slots.cend(), slot) != slots.cend())
+                            return false;
+
+                        slots.push_back(slot);
+                        return true;
+                    });
+
+                    if (fits)
+                    {
+                        for (size_t i = 0 ; i < bucket.size() ; ++i)
+                        {
+                            used[slots[i]] = true;
+                            bySlot[slots[i]] = std::move(m_symbols[bucket[i].second]);
+                        }
+
+                        m_displacements[b] = displacement;
+                        break;
+                    }
+                }
+            }
+
+            // the slot is the id
+            m_symbols = std::move(bySlot);
+        }
+
+
+    private:
+        std::vector<string> m_symbols;                  // upper case, by id
+        std::vector<std::uint32_t> m_displacements;     // by bucket
+    };
+}
+
+#endif
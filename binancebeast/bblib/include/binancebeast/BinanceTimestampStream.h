@@ -0,0 +1,211 @@
+#ifndef BINANCEBEAST_TIMESTAMPSTREAM_H
+#define BINANCEBEAST_TIMESTAMPSTREAM_H
+
+#include "BinanceCommon.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+namespace bblib
+{
+    /// A beast::tcp_stream that, once enable()'d, reads with recvmsg() to collect the kernel's software receive
+    /// timestamp (SO_TIMESTAMPNS) of each read. This is the time the packet arrived at the host, before any
+    /// io_context scheduling delay.
+    ///
+    /// Until enabled, reads go through the tcp_stream so its timeouts still apply, i.e. during connect and the
+    /// SSL handshake. Once enabled, tcp_stream timeouts do not apply to reads.
+    ///
+    /// Sits below the SSL stream, so beast::get_lowest_layer() still returns the tcp_stream.
+    class TimestampingTcpStream
+    {
+    public:
+        using next_layer_type = beast::tcp_stream;
+        using lowest_layer_type = beast::tcp_stream::socket_type;     // required by net::ssl::stream
+        using executor_type = beast::tcp_stream::executor_type;
+        using WallClock = std::chrono::system_clock;
+
+
+        template<typename Arg>
+        explicit TimestampingTcpStream (Arg&& arg) : m_stream(std::forward<Arg>(arg))
+        {
+
+        }
+
+
+        executor_type get_executor() noexcept
+        {
+            return m_stream.get_executor();
+        }
+
+
+        next_layer_type& next_layer() noexcept
+        {
+            return m_stream;
+        }
+
+
+        const next_layer_type& next_layer() const noexcept
+        {
+            return m_stream;
+        }
+
+
+        lowest_layer_type& lowest_layer() noexcept
+        {
+            return m_stream.socket();
+        }
+
+
+        const lowest_layer_type& lowest_layer() const noexcept
+        {
+            return m_stream.socket();
+        }
+
+
+        /// Set SO_TIMESTAMPNS on the socket and read with recvmsg(). Call when connected.
+        void enable (beast::error_code& ec)
+        {
+            int on = 1;
+            if (::setsockopt(m_stream.socket().native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0)
+                ec.assign(errno, beast::system_category());
+            else
+                m_enabled = true;
+        }
+
+
+        bool isEnabled() const
+        {
+            return m_enabled;
+        }
+
+
+        /// The kernel receive time of the most recent read, or the epoch if not enabled.
+        /// If a read spans several packets, this is the latest of them.
+        WallClock::time_point lastReceiveTime() const
+        {
+            return m_lastReceiveTime;
+        }
+
+
+        template<class MutableBufferSequence, class ReadHandler>
+        auto async_read_some (const MutableBufferSequence& buffers, ReadHandler&& handler)
+        {
+            return net::async_initiate<ReadHandler, void(beast::error_code, std::size_t)>([this](auto&& handler, const MutableBufferSequence& buffers)
+            {
+                if (m_enabled)
+                    readSome(buffers, std::move(handler), true);
+                else
+                    m_stream.async_read_some(buffers, std::move(handler));
+
+            }, handler, buffers);
+        }
+
+
+        template<class ConstBufferSequence, class WriteHandler>
+        auto async_write_some (const ConstBufferSequence& buffers, WriteHandler&& handler)
+        {
+            return m_stream.async_write_some(buffers, std::forward<WriteHandler>(handler));
+        }
+
+
+    private:
+        /// Read what is available, otherwise wait until the socket is readable. A handler must not be called from
+        /// within the initiating function, so an immediate completion is posted.
+        template<class MutableBufferSequence, class Handler>
+        void readSome (const MutableBufferSequence& buffers, Handler&& handler, const bool initiating)
+        {
+            beast::error_code ec;
+            const auto n = receive(buffers, ec);
+
+            if (ec == net::error::would_block)
+            {
+                auto executor = net::get_associated_executor(handler, get_executor());
+
+                m_stream.socket().async_wait(tcp::socket::wait_read, net::bind_executor(executor, [this, buffers, handler = std::move(handler)](beast::error_code ec) mutable
+                {
+                    if (ec)
+                        handler(ec, 0);
+                    else
+                        readSome(buffers, std::move(handler), false);
+                }));
+            }
+            else if (initiating)
+                net::post(get_executor(), beast::bind_front_handler(std::move(handler), ec, n));
+            else
+                handler(ec, n);
+        }
+
+
+        template<class MutableBufferSequence>
+        std::size_t receive (const MutableBufferSequence& buffers, beast::error_code& ec)
+        {
+            std::array<iovec, 16> iov;
+            size_t nIov = 0;
+            std::size_t total = 0;
+
+            for (auto it = net::buffer_sequence_begin(buffers) ; it != net::buffer_sequence_end(buffers) && nIov < iov.size() ; ++it)
+            {
+                net::mutable_buffer buffer (*it);
+                iov[nIov].iov_base = buffer.data();
+                iov[nIov].iov_len = buffer.size();
+                total += buffer.size();
+                ++nIov;
+            }
+
+            if (total == 0)
+                return 0;
+
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))];
+
+            msghdr msg {};
+            msg.msg_iov = iov.data();
+            msg.msg_iovlen = nIov;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t n;
+            do
+            {
+                n = ::recvmsg(m_stream.socket().native_handle(), &msg, MSG_DONTWAIT);
+            } while (n < 0 && errno == EINTR);
+
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    ec = net::error::would_block;
+                else
+                    ec.assign(errno, beast::system_category());
+
+                return 0;
+            }
+            else if (n == 0)
+            {
+                ec = net::error::eof;
+                return 0;
+            }
+
+            for (auto cmsg = CMSG_FIRSTHDR(&msg) ; cmsg ; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    timespec ts;
+                    std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    m_lastReceiveTime = WallClock::time_point{std::chrono::duration_cast<WallClock::duration>(std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec})};
+                }
+            }
+
+            return static_cast<std::size_t>(n);
+        }
+
+
+    private:
+        beast::tcp_stream m_stream;
+        WallClock::time_point m_lastReceiveTime;
+        bool m_enabled = false;
+    };
+}
+
+#endif
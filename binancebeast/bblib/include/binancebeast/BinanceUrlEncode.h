@@ -0,0 +1,247 @@
+#ifndef BINANCEBEAST_URLENCODE_H
+#define BINANCEBEAST_URLENCODE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace bblib
+{
+    namespace urlencode_detail
+    {
+        enum CharClass : std::uint8_t { Unreserved, Space, Escape };
+
+        constexpr std::array<std::uint8_t, 256> makeTable()
+        {
+            std::array<std::uint8_t, 256> table {};
+
+            for (int c = 0 ; c < 256 ; ++c)
+            {
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                    table[c] = Unreserved;
+                else if (c == ' ')
+                    table[c] = Space;
+                else
+                    table[c] = Escape;
+            }
+
+            return table;
+        }
+
+        inline constexpr std::array<std::uint8_t, 256> Table = makeTable();
+        inline constexpr char HexDigits[] = "0123456789ABCDEF";
+
+
+#ifdef __SSE2__
+        /// Bit i is set if byte i of the 16 at 'p' is [a-zA-Z0-9].
+        inline unsigned unreservedMask (const char * p)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+
+            // signed compares, bytes >= 0x80 are negative so never in range
+            const auto inRange = [bytes](const char low, const char high)
+            {
+                return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(high + 1)));
+            };
+
+            // setting bit 5 maps A-Z to a-z, and leaves digits unchanged
+            const __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+            const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+
+            return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(alpha, inRange('0', '9'))));
+        }
+#endif
+    }
+
+
+    /// The most bytes urlEncode() writes for 'size' bytes of input.
+    constexpr size_t urlEncodedMaxSize (const size_t size)
+    {
+        return size * 3;
+    }
+
+
+    /// URL encodes 's' to 'out', which must have room for urlEncodedMaxSize(s.size()) bytes, returning the number of
+    /// bytes written. [a-zA-Z0-9] are unchanged, space is '+' and everything else is %XX.
+    /// Runs of unchanged characters are copied 16 bytes at a time when SSE2 is available.
+    inline size_t urlEncode (std::string_view s, char * out)
+    {
+        using namespace urlencode_detail;
+
+        const char * in = s.data();
+        const char * const end = in + s.size();
+        char * const start = out;
+
+        while (in < end)
+        {
+#ifdef __SSE2__
+            while (end - in >= 16)
+            {
+                const unsigned mask = unreservedMask(in);
+
+                if (mask == 0xFFFF)
+                {
+                    std::memcpy(out, in, 16);
+                    in += 16;
+                    out += 16;
+                }
+                else
+                {
+                    // copy up to the first that needs encoding, then encode it below
+                    const unsigned run = static_cast<unsigned>(__builtin_ctz(~mask));
+                    std::memcpy(out, in, run);
+                    in += run;
+                    out += run;
+                    break;
+                }
+            }
+
+            if (in == end)
+                break;
+#endif
+            const auto c = static_cast<unsigned char>(*in++);
+
+            switch (Table[c])
+            {
+            case Unreserved:
+                *out++ = static_cast<char>(c);
+                break;
+
+            case Space:
+                *out++ = '+';
+                break;
+
+            default:
+                *out++ = '%';
+                *out++ = HexDigits[c >> 4];
+                *out++ = HexDigits[c & 0x0F];
+                break;
+            }
+        }
+
+        return static_cast<size_t>(out - start);
+    }
+
+
+    /// URL encodes 's', appending to 'out'.
+    inline void urlEncode (std::string_view s, std::string& out)
+    {
+        const auto size = out.size();
+        out.resize(size + urlEncodedMaxSize(s.size()));
+        out.resize(size + urlEncode(s, out.data() + size));
+    }
+
+
+    /// An order in a batch order, see encodeBatchOrders(). Empty fields are not sent.
+    struct BatchOrder
+    {
+        std::string_view symbol;
+        std::string_view side;
+        std::string_view positionSide;
+        std::string_view type;
+        std::string_view timeInForce;
+        std::string_view quantity;
+        std::string_view price;
+        std::string_view stopPrice;
+        std::string_view reduceOnly;
+        std::string_view newClientOrderId;
+        std::string_view workingType;
+        std::string_view newOrderRespType;
+    };
+
+
+    /// Appends the 'batchOrders' param value for /fapi/v1/batchOrders and /dapi/v1/batchOrders to 'out': the orders
+    /// as a JSON array, URL encoded, in one pass. This is the same as urlEncode(json::serialize(array)) without the
+    /// intermediate json::array and strings.
+    inline void encodeBatchOrders (const BatchOrder * orders, const size_t count, std::string& out)
+    {
+        // a field as "name":"value", URL encoded. JSON escapes the value's quotes, backslashes and control characters,
+        // as json::serialize() does
+        const auto field = [&out](const char * encodedName, const std::string_view value, bool& first)
+        {
+            if (value.empty())
+                return;
+
+            out += first ? "%22" : "%2C%22";
+            out += encodedName;
+            out += "%22%3A%22";
+
+            size_t from = 0;
+            for (size_t i = 0 ; i < value.size() ; ++i)
+            {
+                const auto c = static_cast<unsigned char>(value[i]);
+
+                if (c != '"' && c != '\\' && c >= 0x20)
+                    continue;
+
+                urlEncode(value.substr(from, i - from), out);
+                from = i + 1;
+
+                switch (c)
+                {
+                    case '"':   out += "%5C%22"; break;
+                    case '\\':  out += "%5C%5C"; break;
+                    case '\b':  out += "%5Cb"; break;
+                    case '\f':  out += "%5Cf"; break;
+                    case '\n':  out += "%5Cn"; break;
+                    case '\r':  out += "%5Cr"; break;
+                    case '\t':  out += "%5Ct"; break;
+                    default:
+                        out += "%5Cu00";
+                        out += "0123456789abcdef"[c >> 4];
+                        out += "0123456789abcdef"[c & 0x0F];
+                }
+            }
+            urlEncode(value.substr(from), out);
+
+            out += "%22";
+            first = false;
+        };
+
+        out += "%5B";
+
+        for (size_t i = 0 ; i < count ; ++i)
+        {
+            auto& order = orders[i];
+            bool first = true;
+
+            out += i ? "%2C%7B" : "%7B";
+
+            field("symbol", order.symbol, first);
+            field("side", order.side, first);
+            field("positionSide", order.positionSide, first);
+            field("type", order.type, first);
+            field("timeInForce", order.timeInForce, first);
+            field("quantity", order.quantity, first);
+            field("price", order.price, first);
+            field("stopPrice", order.stopPrice, first);
+            field("reduceOnly", order.reduceOnly, first);
+            field("newClientOrderId", order.newClientOrderId, first);
+            field("workingType", order.workingType, first);
+            field("newOrderRespType", order.newOrderRespType, first);
+
+            out += "%7D";
+        }
+
+        out += "%5D";
+    }
+
+
+    inline std::string encodeBatchOrders (const std::vector<BatchOrder>& orders)
+    {
+        std::string out;
+        out.reserve(orders.size() * 192);
+        encodeBatchOrders(orders.data(), orders.size(), out);
+        return out;
+    }
+}
+
+#endif
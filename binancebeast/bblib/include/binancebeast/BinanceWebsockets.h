@@ -2,7 +2,16 @@
 #define BINANCEBEAST_WS_H
 
 #include "BinanceCommon.h"
+#include "BinanceLatency.h"
+#include "BinanceTimestampStream.h"
+#include "BinanceRecorder.h"
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <ordered_thread_pool.h>
 
 
@@ -12,6 +21,8 @@ namespace bblib
     {
         enum class State { Fail, Success, Disconnect };
 
+        using Clock = std::chrono::steady_clock;
+
         WsResponse (const State s) : state(s)
         {
 
@@ -62,6 +73,20 @@ namespace bblib
         json::value json;
         State state;
         string failMessage;
+
+        /// When the frame arrived: the kernel receive time if enabled, otherwise receiveTime.
+        Clock::time_point arrivalTime() const
+        {
+            if (kernelReceiveTime == std::chrono::system_clock::time_point{})
+                return receiveTime;
+            else
+                return receiveTime - std::chrono::duration_cast<Clock::duration>(receiveWallTime - kernelReceiveTime);
+        }
+
+        Clock::time_point receiveTime;                              // frame read from the socket, only set for Success
+        Clock::time_point parseTime;                                // json parsed, only set for Success
+        std::chrono::system_clock::time_point receiveWallTime;      // as receiveTime, for comparing with Binance's event time
+        std::chrono::system_clock::time_point kernelReceiveTime;    // packet arrived at the host, see ConnectionConfig::kernelReceiveTimestamps
     };
 
     struct WsToken
@@ -74,7 +99,140 @@ namespace bblib
     };
 
     using WebSocketResponseHandler = std::function<void(WsResponse)>;
-    
+
+
+    /// Binance's event time ("E") in milliseconds, from a raw or combined stream payload, or 0 if not present.
+    inline std::int64_t eventTime (const json::value& msg)
+    {
+        const json::value * data = &msg;
+
+        if (auto object = msg.if_object(); object && object->if_contains("stream"))
+            data = object->if_contains("data");
+
+        // "all market" streams push an array, each entry has the same event time
+        if (auto arr = data ? data->if_array() : nullptr; arr && !arr->empty())
+            data = &*arr->begin();
+
+        if (auto event = data ? data->if_object() : nullptr)
+        {
+            if (auto e = event->if_contains("E"); e && e->is_int64())
+                return e->as_int64();
+            else if (e && e->is_uint64())
+                return static_cast<std::int64_t>(e->as_uint64());
+        }
+
+        return 0;
+    }
+
+
+    /// Records the exchange to socket and socket to parse latencies of a response.
+    inline void recordReceiveLatency (WsLatencyStats& stats, const WsResponse& response)
+    {
+        using namespace std::chrono;
+
+        const auto received = response.kernelReceiveTime == system_clock::time_point{} ? response.receiveWallTime : response.kernelReceiveTime;
+
+        if (const auto e = eventTime(response.json); e > 0)
+            stats.exchangeToSocket.record(received - system_clock::time_point{milliseconds{e}});
+
+        stats.socketToParse.record(response.parseTime - response.arrivalTime());
+    }
+
+
+    /// Calls a handler, in order, from a single thread, with responses from one or more WsSessions.
+    /// A token with several connections shares one dispatcher so the handler is never called concurrently.
+    /// Also keeps the token's latency stats, the sessions record the receive side and the dispatcher the handler side.
+    ///
+    /// If an executor is given, i.e. the application's io_context, the handler is called on a strand of the executor
+    /// rather than the dispatcher's own thread. Still in order and never concurrently.
+    class WsHandlerDispatcher : public std::enable_shared_from_this<WsHandlerDispatcher>
+    {
+    public:
+        explicit WsHandlerDispatcher (WebSocketResponseHandler handler, const std::optional<net::any_io_executor>& executor = std::nullopt)
+            :   m_handler(std::move(handler)),
+                m_latency(std::make_shared<WsLatencyStats>())
+        {
+            m_timedHandler = [this](WsResponse response)
+            {
+                const auto start = WsResponse::Clock::now();
+
+                if (response.parseTime != WsResponse::Clock::time_point{})
+                    m_latency->parseToHandler.record(start - response.parseTime);
+
+                m_handler(std::move(response));
+
+                m_latency->handlerDuration.record(WsResponse::Clock::now() - start);
+            };
+
+            if (executor)
+            {
+                // a strand keeps the order, and the handler non-reentrant, whichever threads run the executor
+                m_strand.emplace(net::make_strand(*executor));
+                return;
+            }
+
+            // the user's handler is documented as non-reentrant, but we don't want to delay io processing
+            // if the handler is still running, so we create a thread pool of 1, and we can queue up to 4 
+            // more before we block.
+            // NOTE: important: this thread pool gaurantees the handlers are called in the same order as 
+            //       as pushed onto the pool
+            m_handlersPool = std::make_unique<OrderedThreadPool<WsResponse>> (1, 4) ; 
+        }
+
+
+        void dispatch (WsResponse&& response)
+        {
+            if (m_strand)
+            {
+                net::post(*m_strand, [self = shared_from_this(), response = std::move(response)]() mutable
+                {
+                    self->m_timedHandler(std::move(response));
+                });
+            }
+            else
+                dispatch(m_timedHandler, std::move(response));
+        }
+
+
+        /// For replies to requests, which have their own handler but must be in order with the stream data.
+        void dispatch (const WebSocketResponseHandler& handler, WsResponse&& response)
+        {
+            if (m_strand)
+            {
+                net::post(*m_strand, [handler, response = std::move(response)]() mutable
+                {
+                    handler(std::move(response));
+                });
+                return;
+            }
+
+            // sessions on different io_contexts may dispatch at the same time
+            std::scoped_lock lock (m_mux);
+            m_handlersPool->Do(handler, std::move(response));
+        }
+
+
+        const WebSocketResponseHandler& handler() const
+        {
+            return m_handler;
+        }
+
+
+        const std::shared_ptr<WsLatencyStats>& latency() const
+        {
+            return m_latency;
+        }
+
+
+    private:
+        WebSocketResponseHandler m_handler;
+        WebSocketResponseHandler m_timedHandler;
+        std::shared_ptr<WsLatencyStats> m_latency;
+        std::unique_ptr<OrderedThreadPool<WsResponse>> m_handlersPool;
+        std::optional<net::strand<net::any_io_executor>> m_strand;     // instead of m_handlersPool, if there's an executor
+        std::mutex m_mux;
+    };
+
 
     /// Manages a websocket client session, from initial connection until disconnect.
     /// The websocket data (json) is sent via a WsResponse object to the supplied callback handler.
@@ -87,21 +245,36 @@ namespace bblib
 
     public:
         using CloseConnectionHandler = std::function<void(void)>;
+
+        /// If set, called on the io_context thread with each decoded response instead of queuing the
+        /// response for the handler. Used when the session is one leg of a FeedArbiter.
+        using ReceiveHandler = std::function<void(WsResponse&&)>;
+
+        /// If set, called on the io_context thread with the reason when the connection fails or is lost, before the
+        /// failure is reported to the handler. Not called for failures which don't end the connection, i.e. a message
+        /// which isn't JSON.
+        using DisconnectHandler = std::function<void(const string&)>;
         
         // Resolver and socket require an io_context
-        explicit WsSession(net::io_context& ioc, std::shared_ptr<ssl::context> ctx, WebSocketResponseHandler&& callback)
+        explicit WsSession(net::io_context& ioc, std::shared_ptr<ssl::context> ctx, WebSocketResponseHandler&& callback, ReceiveHandler&& onReceive = nullptr)
+            :   WsSession(ioc, ctx, onReceive ? nullptr : std::make_shared<WsHandlerDispatcher>(callback), std::move(onReceive))
+        {
+            m_callback = std::move(callback);
+        }
+
+
+        /// The handler is called via the dispatcher, which may be shared with other sessions.
+        explicit WsSession(net::io_context& ioc, std::shared_ptr<ssl::context> ctx, std::shared_ptr<WsHandlerDispatcher> dispatcher, ReceiveHandler&& onReceive = nullptr)
             :   m_resolver(net::make_strand(ioc)),
                 m_ws(net::make_strand(ioc), *ctx),
-                m_callback(std::move(callback)),
-                m_sslContext(ctx)
+                m_callback(dispatcher ? dispatcher->handler() : nullptr),
+                m_onReceive(std::move(onReceive)),
+                m_sslContext(ctx),
+                m_dispatcher(std::move(dispatcher)),
+                m_latency(m_dispatcher && !m_onReceive ? m_dispatcher->latency() : nullptr),
+                m_preferredEndpoint(0),
+                m_streamCount(0)
         {
-            // the user's handler is documented as non-reentrant, but we don't want to delay io processing
-            // if the handler is still running, so we create a thread pool of 1, and we can queue up to 4 
-            // more before we block.
-            // NOTE: important: this thread pool gaurantees the handlers are called in the same order as 
-            //       as pushed onto the pool
-            m_handlersPool = std::make_unique<OrderedThreadPool<WsResponse>> (1, 4) ; 
-
             // TODO is this actually worthwhile? it allows processing messages from the network sooner,
             //      but they'll still be be blocked until the handler queue is free.
             //      on the other hand, for handlers that can process before the next response is ready, it means
@@ -118,11 +291,71 @@ namespace bblib
         ~WsSession()
         {
             // let beast handle disconnection
+
+            if (m_load)
+                m_load->streams.fetch_sub(m_streamCount);
+        }
+
+
+        /// Count this session's messages and bytes against an io_context's load. Call before run().
+        void setLoad (std::shared_ptr<IoContextLoad> load)
+        {
+            m_load = std::move(load);
+        }
+
+
+        /// Set SO_BUSY_POLL on the socket when connected, see ThreadConfig::busyPollMicros. Call before run().
+        void setBusyPoll (const int micros)
+        {
+            m_busyPollMicros = micros;
+        }
+
+
+        /// Resolve the host through the cache rather than querying DNS for each connection. Call before run().
+        void setDnsCache (std::shared_ptr<DnsCache> cache)
+        {
+            m_dnsCache = std::move(cache);
+        }
+
+
+        /// Read with kernel receive timestamps (SO_TIMESTAMPNS), set in WsResponse::kernelReceiveTime. Call before run().
+        void setKernelTimestamps (const bool enable)
+        {
+            m_kernelTimestamps = enable;
+        }
+
+
+        /// See DisconnectHandler. Call before run().
+        void setDisconnectHandler (DisconnectHandler onDisconnect)
+        {
+            m_onDisconnect = std::move(onDisconnect);
+        }
+
+
+        /// Append each frame to the recorder, as received, before it's parsed. Call before run().
+        void setRecorder (std::shared_ptr<MarketDataRecorder> recorder, const std::uint32_t token, const std::uint32_t connection)
+        {
+            m_recorder = std::move(recorder);
+            m_recordToken = token;
+            m_recordConnection = connection;
+        }
+
+
+        /// Adjust the number of streams on this session, used for io_context placement. Not thread safe.
+        void addStreams (const std::int64_t n)
+        {
+            m_streamCount += n;
+
+            if (m_load)
+                m_load->streams.fetch_add(n);
         }
 
 
+        /// If the session hasn't been run, a later run() does nothing.
         void close (CloseConnectionHandler callback)
         {
+            m_closed = true;
+
             m_ws.async_close(websocket::close_code::normal, beast::bind_front_handler([callback](beast::error_code)
             {
                 callback();
@@ -130,6 +363,45 @@ namespace bblib
         }
 
 
+        net::any_io_executor executor()
+        {
+            return m_ws.get_executor();
+        }
+
+
+        /// Connect to the index'th resolved address first, falling back to the others. 
+        /// The host may resolve to several IPs, this lets sessions for the same host use different IPs.
+        /// Call before run().
+        void setPreferredEndpoint (const size_t index)
+        {
+            m_preferredEndpoint = index;
+        }
+
+
+        /// Send a request, such as SUBSCRIBE, over the connection. The "id" is set by this function and the reply with 
+        /// the same id is passed to onReply rather than the session's handler. 
+        /// Requests made before the connection is established are sent once the websocket handshake completes.
+        /// Thread safe. Returns the request id.
+        std::uint64_t sendRequest (json::object&& request, WebSocketResponseHandler&& onReply)
+        {
+            const auto id = m_nextRequestId.fetch_add(1);
+            request["id"] = id;
+
+            net::post(m_ws.get_executor(), [self = shared_from_this(), id, msg = json::serialize(request), onReply = std::move(onReply)]() mutable
+            {
+                if (onReply)
+                    self->m_pendingReplies.emplace(id, std::move(onReply));
+
+                self->m_writeQueue.emplace_back(std::move(msg));
+
+                if (self->m_handshakeComplete && self->m_writeQueue.size() == 1)
+                    self->write();
+            });
+
+            return id;
+        }
+
+
         /// Start the websocket session:
         ///     - resolve the address
         ///     - connect
@@ -137,31 +409,55 @@ namespace bblib
         ///     - read until stream closed by the server or object destruction
         void run(const string_view& host, const string_view& port, const string_view& path)
         {
+            if (m_closed)
+                return;
+
             m_host = host;
             m_path = path;
 
             // Look up the domain name
-            m_resolver.async_resolve(host, port, beast::bind_front_handler(&WsSession::on_resolve,shared_from_this()));
+            if (m_dnsCache)
+                m_dnsCache->resolve(m_resolver, host, port, beast::bind_front_handler(&WsSession::on_resolve,shared_from_this()));
+            else
+                m_resolver.async_resolve(host, port, beast::bind_front_handler(&WsSession::on_resolve,shared_from_this()));
         }
 
 
         void on_resolve(beast::error_code ec, tcp::resolver::results_type results)
         {
             if(ec)
-                return fail(ec, "resolve", m_callback);
+                return reportFailure(ec, "resolve");
 
             // Set a timeout on the operation
             beast::get_lowest_layer(m_ws).expires_after(std::chrono::seconds(30));
 
-            // Make the connection on the IP address we get from a lookup
-            beast::get_lowest_layer(m_ws).async_connect(results,beast::bind_front_handler(&WsSession::on_connect, shared_from_this()));
+            if (m_preferredEndpoint > 0 && results.size() > 1)
+            {
+                // rotate so the preferred address is tried first
+                std::vector<tcp::endpoint> endpoints (results.begin(), results.end());
+                std::rotate(endpoints.begin(), endpoints.begin() + (m_preferredEndpoint % endpoints.size()), endpoints.end());
+
+                beast::get_lowest_layer(m_ws).async_connect(endpoints, beast::bind_front_handler(&WsSession::on_connect, shared_from_this()));
+            }
+            else
+            {
+                // Make the connection on the IP address we get from a lookup
+                beast::get_lowest_layer(m_ws).async_connect(results,beast::bind_front_handler(&WsSession::on_connect, shared_from_this()));
+            }
         }
 
 
         void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type ep)
         {
             if(ec)
-                return fail(ec, "connect", m_callback);
+                return reportFailure(ec, "connect");
+
+            if (m_busyPollMicros)
+            {
+                // not fatal, the connection still works without it, so counted rather than reported to the handler
+                if (setSocketBusyPoll(beast::get_lowest_layer(m_ws).socket(), m_busyPollMicros, ec); ec && m_load)
+                    m_load->busyPollErrors.fetch_add(1, std::memory_order_relaxed);
+            }
 
             // Update the m_host string. This will provide the value of the host HTTP header during the WebSocket handshake.
             // See https://tools.ietf.org/html/rfc7230#section-5.4
@@ -173,7 +469,7 @@ namespace bblib
             if(!SSL_set_tlsext_host_name(m_ws.next_layer().native_handle(),m_host.c_str()))
             {
                 ec = beast::error_code(static_cast<int>(::ERR_get_error()),net::error::get_ssl_category());
-                return fail(ec, "connect", m_callback);
+                return reportFailure(ec, "connect");
             }
 
             // SSL handshake
@@ -184,11 +480,18 @@ namespace bblib
         void on_ssl_handshake(beast::error_code ec)
         {
             if(ec)
-                return fail(ec, "ssl handshake", m_callback);
+                return reportFailure(ec, "ssl handshake");
 
             // disable the timeout on the underlying tcp_stream because the websocket stream has its own timeout system
             beast::get_lowest_layer(m_ws).expires_never();
 
+            if (m_kernelTimestamps)
+            {
+                // not fatal, responses have user space timestamps without it, so counted rather than reported to the handler
+                if (m_ws.next_layer().next_layer().enable(ec); ec && m_load)
+                    m_load->timestampErrors.fetch_add(1, std::memory_order_relaxed);
+            }
+
             // set the websocket stream timeouts 
             m_ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
 
@@ -205,27 +508,77 @@ namespace bblib
         void on_handshake(beast::error_code ec)
         {
             if(ec)
-                return fail(ec, "handshake", m_callback);
+                return reportFailure(ec, "handshake");
             
+            m_handshakeComplete = true;
+
+            if (!m_writeQueue.empty())
+                write();
+
             m_ws.async_read(m_buffer, beast::bind_front_handler(&WsSession::on_read, shared_from_this()));
         }
 
 
-        void on_read(beast::error_code ec, std::size_t/* bytes_transferred*/)
+        void write()
+        {
+            m_ws.async_write(net::buffer(m_writeQueue.front()), beast::bind_front_handler(&WsSession::on_write, shared_from_this()));
+        }
+
+
+        void on_write(beast::error_code ec, std::size_t/* bytes_transferred*/)
+        {
+            if (ec == net::error::operation_aborted)
+                return;
+            else if (ec)
+                return reportFailure(ec, "write");
+
+            m_writeQueue.pop_front();
+
+            if (!m_writeQueue.empty())
+                write();
+        }
+
+
+        void on_read(beast::error_code ec, std::size_t bytes_transferred)
         {
             // operation_aborted: if user calls close() whilst there's a pending async_read() in the event queue            
             if (ec == net::error::shut_down || ec == net::error::operation_aborted)
                 return ;
             else if (ec)
-                return fail(ec, "read", m_callback);
+                return reportFailure(ec, "read");
+
+            const auto receiveTime = WsResponse::Clock::now();
+            const auto receiveWallTime = std::chrono::system_clock::now();
+
+            if (m_load)
+            {
+                m_load->messages.fetch_add(1, std::memory_order_relaxed);
+                m_load->bytes.fetch_add(bytes_transferred, std::memory_order_relaxed);
+            }
+
+            if (m_recorder)
+                record(receiveTime, receiveWallTime);
 
             json::error_code jsonEc;
             if (auto jsonValue = json::parse(beast::buffers_to_string(m_buffer.cdata()), jsonEc); jsonEc)
-                fail(jsonEc, "json read", m_callback);
+                reportFailure(jsonEc, "json read", false);
             else
             {
                 WsResponse result {std::move(jsonValue)};
-                m_handlersPool->Do(m_callback, std::move(result));
+                result.receiveTime = receiveTime;
+                result.receiveWallTime = receiveWallTime;
+                result.parseTime = WsResponse::Clock::now();
+                result.kernelReceiveTime = m_ws.next_layer().next_layer().lastReceiveTime();
+
+                if (m_latency)
+                    recordReceiveLatency(*m_latency, result);
+
+                if (isReply(result))
+                    onReply(std::move(result));
+                else if (m_onReceive)
+                    m_onReceive(std::move(result));
+                else
+                    m_dispatcher->dispatch(std::move(result));
             }
             
             m_buffer.clear();
@@ -239,17 +592,99 @@ namespace bblib
         }
 
 
+    private:
+        /// Through the dispatcher if there is one, so the handler isn't called concurrently with the data of the token's
+        /// other sessions. Otherwise the callback is called on this thread, i.e. a FeedArbiter leg's.
+        void reportFailure (const beast::error_code ec, const char * what, const bool disconnected = true)
+        {
+            WsResponse response {string{what} + " " + ec.message()};
+
+            if (disconnected && m_onDisconnect)
+                m_onDisconnect(response.failMessage);
+
+            if (m_dispatcher)
+                m_dispatcher->dispatch(std::move(response));
+            else if (m_callback)
+                m_callback(std::move(response));
+        }
+
+
+        void record (const WsResponse::Clock::time_point receiveTime, const std::chrono::system_clock::time_point receiveWallTime)
+        {
+            using namespace std::chrono;
+
+            const auto& stream = m_ws.next_layer().next_layer();
+            const bool kernel = stream.isEnabled() && stream.lastReceiveTime() != system_clock::time_point{};
+            const auto frame = m_buffer.cdata();
+
+            // dropped if the recorder can't keep up, which it counts
+            m_recorder->append(m_recordToken, m_recordConnection,
+                               duration_cast<nanoseconds>((kernel ? stream.lastReceiveTime() : receiveWallTime).time_since_epoch()).count(),
+                               duration_cast<nanoseconds>(receiveTime.time_since_epoch()).count(),
+                               kernel ? JournalRecordHeader::KernelTimestamp : 0,
+                               frame.data(), frame.size());
+        }
+
+
+        bool isReply (const WsResponse& response) const
+        {
+            if (m_pendingReplies.empty())
+                return false;
+            
+            auto object = response.json.if_object();
+            return object && object->if_contains("id");
+        }
+
+
+        void onReply (WsResponse&& response)
+        {
+            const auto& id = response.json.as_object().at("id");
+
+            if (auto it = id.is_uint64() || id.is_int64() ? m_pendingReplies.find(json::value_to<std::uint64_t>(id)) : m_pendingReplies.end() ; it != m_pendingReplies.end())
+            {
+                auto onReply = std::move(it->second);
+                m_pendingReplies.erase(it);
+
+                // keep replies in order with the stream data if there is a dispatcher
+                if (m_dispatcher)
+                    m_dispatcher->dispatch(onReply, std::move(response));
+                else
+                    onReply(std::move(response));
+            }
+            else if (m_onReceive)
+                m_onReceive(std::move(response));
+            else
+                m_dispatcher->dispatch(std::move(response));
+        }
+
+
     private:
         tcp::resolver m_resolver;
-        websocket::stream<beast::ssl_stream<beast::tcp_stream>> m_ws;
+        std::shared_ptr<DnsCache> m_dnsCache;
+        websocket::stream<beast::ssl_stream<TimestampingTcpStream>> m_ws;
         http::response<http::string_body> m_httpRes;
         beast::flat_buffer m_buffer;
         std::string m_host;
         std::string m_path;
         WebSocketResponseHandler m_callback;
+        ReceiveHandler m_onReceive;
+        DisconnectHandler m_onDisconnect;
         std::shared_ptr<ssl::context> m_sslContext;
-        std::unique_ptr<OrderedThreadPool<WsResponse>> m_handlersPool;
-        net::io_context m_handlersIoc;
+        std::shared_ptr<WsHandlerDispatcher> m_dispatcher;
+        std::shared_ptr<WsLatencyStats> m_latency;   // not set for FeedArbiter legs, the arbiter records delivered events
+        std::shared_ptr<IoContextLoad> m_load;
+        std::shared_ptr<MarketDataRecorder> m_recorder;
+        std::uint32_t m_recordToken = 0;
+        std::uint32_t m_recordConnection = 0;
+        size_t m_preferredEndpoint;
+        std::int64_t m_streamCount;
+        int m_busyPollMicros = 0;
+        bool m_kernelTimestamps = false;
+        std::atomic_uint64_t m_nextRequestId {1};
+        std::map<std::uint64_t, WebSocketResponseHandler> m_pendingReplies;     // only accessed on the strand
+        std::deque<string> m_writeQueue;                                        // only accessed on the strand
+        bool m_handshakeComplete = false;
+        std::atomic_bool m_closed {false};
     };
 }
 
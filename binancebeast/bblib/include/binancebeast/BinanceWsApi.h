@@ -0,0 +1,361 @@
+#ifndef BINANCEBEAST_WSAPI_H
+#define BINANCEBEAST_WSAPI_H
+
+#include "BinanceBeast.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+
+namespace bblib
+{
+    /// Order entry over Binance's websocket API rather than REST. The connection stays open, so a request is one
+    /// websocket frame, without an HTTP request or a connect and TLS handshake per order.
+    ///
+    /// Create with BinanceBeast::startWsApi(). The session runs on an order entry io_context (or a REST io_context if
+    /// there are none), see IoContextsConfig::orders.
+    ///
+    /// Requests take the same params as the REST endpoint, i.e. placeOrder() has the params of POST /fapi/v1/order,
+    /// and the handler is called with a RestResponse, from the same thread pool as sendRestRequest()'s handlers.
+    /// On success the RestResponse's json is Binance's "result", otherwise it's Binance's "error", which has the
+    /// "code" and "msg" as a REST error does. Requests sent before the connection is established are sent once it is.
+    ///
+    /// Signed requests are signed with the HMAC secret key, or with the Ed25519 key if there's no secret key. With an
+    /// Ed25519 key, logon() authenticates the connection instead, after which requests are sent with only a timestamp,
+    /// so there's no signing when sending an order.
+    ///
+    /// If the connection fails, handlers of requests without a reply are called with a Fail response, and the
+    /// session's handler is called. The session does not reconnect, call startWsApi() for a new session.
+    ///
+    /// Call close() when done, before the BinanceBeast is destroyed.
+    ///
+    /// See https://binance-docs.github.io/apidocs/futures/en/#websocket-api-general-info
+    class WsApiSession
+    {
+    public:
+        /// keys are for signing requests, the handler is called with failures and messages which are not replies, on the callers' executor.
+        WsApiSession (net::io_context& ioc, std::shared_ptr<ssl::context> ctx, net::any_io_executor callerExecutor, ConnectionConfig::ConnectionKeys keys, WebSocketResponseHandler handler)
+            :   m_keys(std::move(keys)),
+                m_pending(std::make_shared<PendingRequests>(std::move(callerExecutor), std::move(handler)))
+        {
+            m_session = std::make_shared<WsSession>(ioc, ctx, [pending = m_pending](WsResponse response)
+            {
+                pending->notify(std::move(response));
+            },
+            [pending = m_pending](WsResponse&& response)
+            {
+                pending->notify(std::move(response));
+            });
+
+            m_session->setDisconnectHandler([pending = m_pending](const string& reason)
+            {
+                // the connection failed, so there'll be no replies. Other failures, such as an invalid message, only
+                // go to the session's handler
+                pending->failAll(reason);
+            });
+        }
+
+
+        WsApiSession (const WsApiSession&) = delete;
+        WsApiSession& operator= (const WsApiSession&) = delete;
+
+
+        /// The underlying websocket session, to run() it.
+        WsSession& connection()
+        {
+            return *m_session;
+        }
+
+
+        /// order.place, with the params of a new order, i.e. POST /fapi/v1/order.
+        void placeOrder (RestResponseHandler handler, QueryParams params)
+        {
+            sendRequest(std::move(handler), "order.place", std::move(params));
+        }
+
+
+        /// order.cancel, with the params of a cancel, i.e. DELETE /fapi/v1/order.
+        void cancelOrder (RestResponseHandler handler, QueryParams params)
+        {
+            sendRequest(std::move(handler), "order.cancel", std::move(params));
+        }
+
+
+        /// order.modify, with the params of a modify, i.e. PUT /fapi/v1/order. Futures only.
+        void modifyOrder (RestResponseHandler handler, QueryParams params)
+        {
+            sendRequest(std::move(handler), "order.modify", std::move(params));
+        }
+
+
+        /// Send any websocket API method. If signed, the apiKey, timestamp and signature params are added, so don't
+        /// include them. Thread safe.
+        void sendRequest (RestResponseHandler handler, const string_view method, QueryParams params, const RestSign sign = RestSign::HMAC_SHA256)
+        {
+            RestTiming timing;
+            timing.requestTime = RestTiming::Clock::now();
+
+            json::object request;
+            request["method"] = method;
+            request["params"] = makeParams(params, sign == RestSign::Unsigned ? Signing::None : isLoggedOn() ? Signing::LoggedOn : m_keys.secret.empty() && m_keys.ed25519 ? Signing::Ed25519 : Signing::HMAC);
+
+            timing.runTime = RestTiming::Clock::now();
+
+            const auto key = m_pending->add(std::move(handler));
+
+            m_session->sendRequest(std::move(request), [pending = m_pending, key, timing](WsResponse response)
+            {
+                if (auto handler = pending->take(key))
+                    pending->post(std::move(handler), toRestResponse(std::move(response), timing));
+            });
+        }
+
+
+        /// session.logon, signed with ConnectionKeys::ed25519. Once Binance replies, requests are no longer signed.
+        /// Requests sent before the reply are signed. Throws if there's no Ed25519 key.
+        void logon (RestResponseHandler handler = nullptr)
+        {
+            if (!m_keys.ed25519)
+                throw std::runtime_error("logon(): requires an Ed25519 key, ConnectionKeys::ed25519");
+
+            RestTiming timing;
+            timing.requestTime = RestTiming::Clock::now();
+
+            json::object request;
+            request["method"] = "session.logon";
+            request["params"] = makeParams({}, Signing::Ed25519);
+
+            timing.runTime = RestTiming::Clock::now();
+
+            const auto key = m_pending->add(std::move(handler));
+
+            m_session->sendRequest(std::move(request), [pending = m_pending, loggedOn = m_loggedOn, key, timing](WsResponse response)
+            {
+                auto result = toRestResponse(std::move(response), timing);
+
+                if (!result.hasErrorCode())
+                    loggedOn->store(true, std::memory_order_release);
+
+                if (auto handler = pending->take(key))
+                    pending->post(std::move(handler), std::move(result));
+            });
+        }
+
+
+        /// If logon() has succeeded.
+        bool isLoggedOn() const
+        {
+            return m_loggedOn->load(std::memory_order_acquire);
+        }
+
+
+        /// Requests sent without a reply yet.
+        size_t pending() const
+        {
+            return m_pending->size();
+        }
+
+
+        /// Close the connection. Handlers of requests without a reply are called with a Fail response.
+        void close (WsSession::CloseConnectionHandler callback = nullptr)
+        {
+            m_pending->failAll("websocket API session closed");
+
+            m_session->close([callback]
+            {
+                if (callback)
+                    callback();
+            });
+        }
+
+
+        /// Binance's response to a request as a RestResponse, as if it were the REST reply.
+        static RestResponse toRestResponse (WsResponse&& response, const RestTiming& timing)
+        {
+            auto object = response.json.if_object();
+
+            if (response.state != WsResponse::State::Success || !object)
+            {
+                RestResponse result {response.failMessage.empty() ? string{"invalid websocket API response"} : response.failMessage};
+                result.timing = timing;
+                return result;
+            }
+
+            json::value value;
+            const bool isError = object->if_contains("error") != nullptr;
+
+            if (auto r = object->if_contains("result"))
+                value = std::move(*r);
+            else if (auto e = object->if_contains("error"))
+                value = std::move(*e);
+
+            RestResponse result {std::move(value)};
+            result.timing = timing;
+            result.timing.receiveTime = response.receiveTime;
+
+            if (auto status = object->if_contains("status"); status && status->is_number())
+                result.status = status->to_number<unsigned>();
+
+            if (isError)
+            {
+                // as a REST error reply: the json is Binance's {"code":-1121,"msg":"..."}
+                result.state = RestResponse::State::Fail;
+
+                if (auto error = result.json.if_object())
+                {
+                    if (auto msg = error->if_contains("msg"); msg && msg->is_string())
+                        result.failMessage = msg->as_string().c_str();
+                }
+            }
+
+            return result;
+        }
+
+
+    private:
+        /// Handlers for requests without a reply. Shared with the session's callbacks, which may outlive the WsApiSession.
+        class PendingRequests
+        {
+        public:
+            PendingRequests (net::any_io_executor callerExecutor, WebSocketResponseHandler handler) : m_callerExecutor(std::move(callerExecutor)), m_handler(std::move(handler))
+            {
+            }
+
+
+            std::uint64_t add (RestResponseHandler handler)
+            {
+                std::scoped_lock lock (m_mux);
+
+                const auto key = m_nextKey++;
+                m_handlers.emplace(key, std::move(handler));
+                return key;
+            }
+
+
+            /// The request's handler, or nullptr if already failed.
+            RestResponseHandler take (const std::uint64_t key)
+            {
+                RestResponseHandler handler;
+
+                std::scoped_lock lock (m_mux);
+
+                if (auto it = m_handlers.find(key); it != m_handlers.end())
+                {
+                    handler = std::move(it->second);
+                    m_handlers.erase(it);
+                }
+
+                return handler;
+            }
+
+
+            void failAll (const string& reason)
+            {
+                std::map<std::uint64_t, RestResponseHandler> handlers;
+                {
+                    std::scoped_lock lock (m_mux);
+                    handlers.swap(m_handlers);
+                }
+
+                for (auto& [key, handler] : handlers)
+                    post(std::move(handler), RestResponse{reason});
+            }
+
+
+            void post (RestResponseHandler&& handler, RestResponse&& result)
+            {
+                if (handler)
+                    net::post(m_callerExecutor, boost::bind(std::move(handler), std::move(result)));
+            }
+
+
+            void notify (WsResponse&& response)
+            {
+                if (m_handler)
+                    net::post(m_callerExecutor, boost::bind(m_handler, std::move(response)));
+            }
+
+
+            size_t size() const
+            {
+                std::scoped_lock lock (m_mux);
+                return m_handlers.size();
+            }
+
+
+        private:
+            net::any_io_executor m_callerExecutor;
+            WebSocketResponseHandler m_handler;
+            mutable std::mutex m_mux;
+            std::map<std::uint64_t, RestResponseHandler> m_handlers;
+            std::uint64_t m_nextKey = 1;
+        };
+
+
+        enum class Signing
+        {
+            None,
+            LoggedOn,       // the connection is authenticated, only the timestamp is added
+            HMAC,
+            Ed25519
+        };
+
+
+        /// The params as a json object. If signing, the params, with the apiKey and timestamp, are sorted by name,
+        /// joined as a query string and signed.
+        json::object makeParams (const QueryParams& params, const Signing signing) const
+        {
+            json::object object;
+
+            if (signing == Signing::None || signing == Signing::LoggedOn)
+            {
+                for (auto& [name, value] : params)
+                    object.emplace(name, string_view{value});
+
+                if (signing == Signing::LoggedOn)
+                    object.emplace("timestamp", std::int64_t{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()});
+
+                return object;
+            }
+
+            const std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            const auto timestamp = std::to_string(now);
+
+            std::vector<std::pair<string_view, string_view>> sorted (params.cbegin(), params.cend());
+            sorted.emplace_back("apiKey", m_keys.api);
+            sorted.emplace_back("timestamp", timestamp);
+            std::sort(sorted.begin(), sorted.end());
+
+            string payload;
+
+            for (auto& [name, value] : sorted)
+            {
+                if (!payload.empty())
+                    payload += '&';
+
+                payload.append(name).append(1, '=').append(value);
+
+                if (name == "timestamp")
+                    object.emplace(name, now);
+                else
+                    object.emplace(name, value);
+            }
+
+            if (signing == Signing::Ed25519)
+                object.emplace("signature", string_view{m_keys.ed25519->sign(payload)});
+            else
+                object.emplace("signature", string_view{BinanceBeast::createSignature(m_keys.secret, payload)});
+
+            return object;
+        }
+
+
+    private:
+        ConnectionConfig::ConnectionKeys m_keys;
+        std::shared_ptr<PendingRequests> m_pending;
+        std::shared_ptr<std::atomic_bool> m_loggedOn = std::make_shared<std::atomic_bool>(false);
+        std::shared_ptr<WsSession> m_session;
+    };
+}
+
+#endif
@@ -1,15 +1,13 @@
 #include <binancebeast/BinanceBeast.h>
-#include <binancebeast/SslCertificates.h>
+#include <binancebeast/BinanceWsApi.h>
 
 #include <functional>
 
 
 namespace bblib
 {
-    BinanceBeast::BinanceBeast() : m_nextWsIoContext(0), m_nextRestIoContext(0)
+    BinanceBeast::BinanceBeast() : m_runtime(std::make_shared<BinanceRuntime>())
     {
-        m_nextWsId.store(1);
-        m_sslCtx = std::make_shared<ssl::context> (ssl::context::tlsv12_client);
     }
 
 
@@ -22,77 +20,86 @@ namespace bblib
     void BinanceBeast::stop()
     {
         {
-            std::scoped_lock (m_wsSessionsMux);
-            m_wsSessions.clear();
+            std::scoped_lock lock (m_lifetime->mux);
+            m_lifetime->alive = false;
         }
 
-        // stop all io_context processing
-        m_wsIocThreads.clear();
-        m_restIocThreads.clear();
-        m_nextWsId.store(0);
-    }
+        if (m_ownsRuntime && !m_runtime->external())
+        {
+            m_wsSessions.clear();
 
+            // stop all io_context processing
+            m_runtime->stop();
+        }
+        else
+        {
+            // the runtime continues for its other clients, or the io_contexts are the application's, so close this 
+            // client's connections
+            m_wsSessions.clear([](std::shared_ptr<WsTokenSessions>&& tokenSessions)
+            {
+                // null if stopWebSocket() erased it first
+                if (!tokenSessions)
+                    return;
 
-    void BinanceBeast::start (const ConnectionConfig& config, const size_t nRestIoContexts, const size_t nWebsockIoContexts)
-    {  
-        m_nextWsIoContext = 0;
-        m_nextRestIoContext = 0;
-        m_config = config;        
+                std::scoped_lock lock (tokenSessions->mux);
 
-        boost::system::error_code ec;
+                for (auto& session : tokenSessions->sessions)
+                    session->close([session]{});
+            });
 
-        // using certificates shipped with Beast. Do not do this for production. Use loadRootCertificate()
-        if (config.usingTestRootCertificates)
-        {
-            load_test_certificates(*m_sslCtx, ec);
-            
-            if (ec)
-                fail(ec, "failed to load root certificates");
+            if (m_ownsRuntime)
+                m_runtime->stop();
         }
-            
-        
-        // if this enabled on the testnet, it fails validation.
-        // using some online tools shows the testnet does not send the root certificate, this maybe the cause of the problem
-        if (m_config.verifyPeer)
-            m_sslCtx->set_verify_mode(ssl::verify_peer); 
-        else
-            m_sslCtx->set_verify_mode(ssl::verify_none);
+    }
 
 
-        // rest io_contexts
-        m_nextRestIoContext.store(0);
+    void BinanceBeast::start (const ConnectionConfig& config, const size_t nRestIoContexts, const size_t nWebsockIoContexts)
+    {  
+        start(config, IoContextsConfig::Make(nRestIoContexts, nWebsockIoContexts));
+    }
 
-        m_restIocThreads.resize(std::max<size_t>(0, std::min<size_t>(nRestIoContexts, 24)));   // clamp for sanity
-        for (auto& ioc : m_restIocThreads)
-            ioc.start();
 
+    void BinanceBeast::start (const ConnectionConfig& config, const IoContextsConfig& iocs)
+    {  
+        // the runtime was created by the constructor, so certificates loaded before start() are kept
+        m_runtime->start(iocs);
+        start(config, m_runtime);
+        m_ownsRuntime = true;
+    }
 
-        // websocket io_contexts
-        m_nextWsIoContext.store(0);
 
-        m_wsIocThreads.resize(std::max<size_t>(0, std::min<size_t>(nWebsockIoContexts, 24)));   // clamp for sanity
-        for (auto& ioc : m_wsIocThreads)
-            ioc.start();
+    void BinanceBeast::start (const ConnectionConfig& config, const ExternalIoContexts& iocs)
+    {
+        m_runtime->start(iocs);
+        start(config, m_runtime);
+        m_ownsRuntime = true;
     }
 
 
-    net::io_context& BinanceBeast::getWsIoContext() noexcept
+    void BinanceBeast::startReactor (const ConnectionConfig& config, const std::chrono::seconds dnsTtl)
     {
-        size_t curr = m_nextWsIoContext.load();
-        size_t next = curr + 1 < m_wsIocThreads.size() ? curr + 1 : 0;
-
-        m_nextWsIoContext.store(next);
-        return *m_wsIocThreads[curr].ioc;
+        m_runtime->startReactor(dnsTtl);
+        start(config, m_runtime);
+        m_ownsRuntime = true;
     }
 
-    
-    net::io_context& BinanceBeast::getRestIoContext() noexcept
+
+    void BinanceBeast::start (const ConnectionConfig& config, std::shared_ptr<BinanceRuntime> runtime)
     {
-        size_t curr = m_nextRestIoContext.load();
-        size_t next = curr + 1 < m_restIocThreads.size() ? curr + 1 : 0;
+        if (!runtime || !runtime->started())
+            throw std::runtime_error("start(): the runtime is not started");
 
-        m_nextRestIoContext.store(next);
-        return *m_restIocThreads[curr].ioc;
+        m_ownsRuntime = false;
+        m_runtime = std::move(runtime);
+        m_config = config;
+
+        // using certificates shipped with Beast. Do not do this for production. Use loadRootCertificate()
+        if (config.usingTestRootCertificates)
+            m_runtime->useTestRootCertificates();
+
+        // if this enabled on the testnet, it fails validation.
+        // using some online tools shows the testnet does not send the root certificate, this maybe the cause of the problem
+        m_sslCtx = m_runtime->sslContext(m_config.verifyPeer);
     }
 
 
@@ -110,49 +117,406 @@ namespace bblib
 
     WsToken BinanceBeast::startWebSocket (WebSocketResponseHandler handler, const string& streamName)
     {
-        return createWsSession(m_config.wsApiUri, std::move("/ws/"+streamName), std::move(handler));
+        return createWsSession(m_config.wsApiUri, std::move("/ws/"+streamName), std::move(handler), {streamName});
     }
 
 
     WsToken BinanceBeast::startWebSocket (WebSocketResponseHandler handler, const std::vector<string>& streams)
     {
-        std::stringstream target ;
-        
-        for (auto& stream : streams)
-            target << stream + "/";
-
-        return createWsSession(m_config.wsApiUri, std::move("/stream?streams="+std::move(target.str())), std::move(handler));
+        return startWebSocket(std::move(handler), std::set<string>{streams.cbegin(), streams.cend()});
     }
 
 
     WsToken BinanceBeast::startWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams)
     {
-        std::stringstream target ;
+        // no session until the first subscribe()
+        if (streams.empty())
+            return createWsSession(m_config.wsApiUri, "", std::move(handler));
+
+        if (handler == nullptr)
+            throw std::runtime_error("callback is null");
+
+        auto tokenSessions = std::make_shared<WsTokenSessions>();
+        tokenSessions->handler = handler;
+        tokenSessions->dispatcher = std::make_shared<WsHandlerDispatcher>(std::move(handler), m_runtime->handlerExecutor());
+
+        // split into shards of at most maxStreamsPerConnection streams, each shard is a connection, on the
+        // least loaded io_context. All shards share the dispatcher, so the handler is still called in order
+        for (auto it = streams.cbegin() ; it != streams.cend() ; )
+        {
+            std::set<string> shard;
+
+            while (it != streams.cend() && shard.size() < m_config.maxStreamsPerConnection)
+                shard.insert(*it++);
+
+            tokenSessions->sessions.emplace_back(makeWsSession(m_runtime->wsIoContext(), tokenSessions->dispatcher, shard.size()));
+            tokenSessions->streams.emplace_back(std::move(shard));
+        }
+
+        // not yet running, so the sessions and streams can be copied without the lock
+        const auto sessions = tokenSessions->sessions;
+        const auto shards = tokenSessions->streams;
+        const auto wsid = m_wsSessions.insert(std::move(tokenSessions));
+
+        for (size_t i = 0 ; i < sessions.size() ; ++i)
+            runWsSession(wsid, sessions[i], makeCombinedStreamPath(shards[i]));
+
+        return WsToken{.id = wsid};
+    }
+
+
+    WsToken BinanceBeast::startWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams, SequenceConfig sequence)
+    {
+        if (handler == nullptr)
+            throw std::runtime_error("callback is null");
+
+        SequenceValidator::SnapshotRequester requestSnapshot;
+
+        // the token id is not known until the websocket is started, but it's only needed after a gap
+        auto tokenId = std::make_shared<std::atomic<WsToken::TokenId>>(0);
+
+        if (sequence.resync)
+        {
+            string depthPath;
+
+            if (m_config.market == Market::USDM)
+                depthPath = "/fapi/v1/depth";
+            else if (m_config.market == Market::COINM)
+                depthPath = "/dapi/v1/depth";
+            else if (m_config.market == Market::SPOT)
+                depthPath = "/api/v3/depth";
+            else
+                throw std::runtime_error("sequence resync requires ConnectionConfig::market");
+
+            requestSnapshot = [this, lifetime = m_lifetime, tokenId, depthPath, limit = std::to_string(sequence.snapshotLimit)](const string& symbol)
+            {
+                ifAlive(lifetime, [&]
+                {
+                    sendRestRequest([this, lifetime, tokenId, symbol](RestResponse result)
+                    {
+                        auto snapshot = result.hasErrorCode() ? SequenceValidator::makeSnapshotFail(symbol, result.failMessage) : 
+                                                                SequenceValidator::makeSnapshot(symbol, std::move(result.json));
+
+                        // the validator is the dispatcher's handler, so the snapshot is in order with the stream's events
+                        std::shared_ptr<WsHandlerDispatcher> dispatcher;
+
+                        ifAlive(lifetime, [&]
+                        {
+                            if (auto tokenSessions = m_wsSessions.find(tokenId->load()))
+                                dispatcher = tokenSessions->dispatcher;
+                        });
+
+                        // not under the lifetime lock: dispatch() blocks whilst the dispatcher's queue is full, and the
+                        // dispatcher's thread, running the validator, may be waiting on the lock to request a snapshot
+                        if (dispatcher)
+                            dispatcher->dispatch(std::move(snapshot));
+
+                    }, depthPath, RestSign::Unsigned, RestParams{QueryParams{{"symbol", symbol}, {"limit", limit}}}, RequestType::Get);
+                });
+            };
+        }
+
+        auto validator = std::make_shared<SequenceValidator>(std::move(handler), std::move(sequence), std::move(requestSnapshot));
+
+        auto token = startWebSocket([validator](WsResponse response)
+        {
+            validator->onResponse(std::move(response));
+        }, streams);
+
+        tokenId->store(token.id);
+
+        if (auto tokenSessions = m_wsSessions.find(token.id))
+        {
+            std::scoped_lock lock (tokenSessions->mux);
+            tokenSessions->sequencer = validator;
+        }
+
+        return token;
+    }
+
+
+    SequenceStats BinanceBeast::getSequenceStats (const WsToken& token)
+    {
+        std::shared_ptr<SequenceValidator> sequencer;
+
+        if (auto tokenSessions = m_wsSessions.find(token.id))
+        {
+            std::scoped_lock lock (tokenSessions->mux);
+            sequencer = tokenSessions->sequencer;
+        }
+
+        return sequencer ? sequencer->stats() : SequenceStats{};
+    }
+
+
+    WsToken BinanceBeast::startArbitratedWebSocket (WebSocketResponseHandler handler, const std::set<string>& streams, const size_t nLegs)
+    {
+        if (handler == nullptr)
+            throw std::runtime_error("callback is null");
+        else if (nLegs == 0)
+            throw std::runtime_error("arbitrated stream requires at least one leg");
+
+        // always use a combined stream so the stream name is in each response, it's part of the de-duplication key
+        const auto path = makeCombinedStreamPath(streams);
+
+        auto tokenSessions = std::make_shared<WsTokenSessions>();
+        tokenSessions->arbiter = std::make_shared<FeedArbiter>(handler, nLegs, m_runtime->handlerExecutor());
+        tokenSessions->dispatcher = tokenSessions->arbiter->dispatcher();
+        tokenSessions->handler = std::move(handler);
+
+        for (size_t leg = 0 ; leg < nLegs ; ++leg)
+        {
+            // legs on different io_contexts so a slow leg doesn't delay the others
+            auto& ioc = m_runtime->nextWsIoContext();
+
+            // the leg's failures go through the arbiter, which fails over its unkeyed events and dispatches the failure in order
+            auto session = std::make_shared<WsSession>(*ioc.ioc, m_sslCtx, [leg, arbiter = tokenSessions->arbiter](WsResponse response)
+            {
+                arbiter->onFailure(leg, std::move(response));
+            },
+            [leg, arbiter = tokenSessions->arbiter](WsResponse&& response)
+            {
+                arbiter->onReceive(leg, std::move(response));
+            });
+
+            session->setPreferredEndpoint(leg);
+            session->setLoad(ioc.load);
+            session->setBusyPoll(ioc.busyPollMicros);
+            session->setDnsCache(m_runtime->dnsCache());
+            session->setKernelTimestamps(m_config.kernelReceiveTimestamps);
+            session->addStreams(streams.size());
+            tokenSessions->sessions.emplace_back(std::move(session));
+            tokenSessions->streams.emplace_back(streams);
+        }
+
+        const auto sessions = tokenSessions->sessions;
+        const auto wsid = m_wsSessions.insert(std::move(tokenSessions));
+
+        for (auto& session : sessions)
+            runWsSession(wsid, session, path);
+
+        return WsToken{.id = wsid};
+    }
+
+
+    ArbitrationStats BinanceBeast::getArbitrationStats (const WsToken& token)
+    {
+        auto tokenSessions = m_wsSessions.find(token.id);
+        return tokenSessions && tokenSessions->arbiter ? tokenSessions->arbiter->stats() : ArbitrationStats{};
+    }
+
+
+    WsLatencySnapshot BinanceBeast::getLatencyStats (const WsToken& token)
+    {
+        auto tokenSessions = m_wsSessions.find(token.id);
+        return tokenSessions ? tokenSessions->dispatcher->latency()->snapshot() : WsLatencySnapshot{};
+    }
+
+
+    void BinanceBeast::subscribe (const WsToken& token, const std::set<string>& streams, WebSocketResponseHandler replyHandler)
+    {
+        // new streams for each session index, sent after releasing the lock
+        std::map<size_t, std::set<string>> added;
+        std::vector<std::shared_ptr<WsSession>> sessions;
+        size_t nExistingSessions = 0;
+        bool combined = true;
+
+        auto tokenSessionsPtr = m_wsSessions.find(token.id);
+        if (!tokenSessionsPtr)
+            return fail("subscribe(): token not found", replyHandler);
+
+        {
+            auto& tokenSessions = *tokenSessionsPtr;
+            std::scoped_lock lock (tokenSessions.mux);
+
+            nExistingSessions = tokenSessions.sessions.size();
+            combined = tokenSessions.combined;
+
+            auto haveStream = [&tokenSessions](const string& stream)
+            {
+                return std::any_of(tokenSessions.streams.cbegin(), tokenSessions.streams.cend(), [&stream](const std::set<string>& sessionStreams)
+                {
+                    return sessionStreams.count(stream) > 0;
+                });
+            };
+
+            for (auto& stream : streams)
+            {
+                if (haveStream(stream))
+                    continue;
+
+                if (tokenSessions.arbiter)
+                {
+                    // each leg has the same streams
+                    for (size_t leg = 0 ; leg < tokenSessions.sessions.size() ; ++leg)
+                    {
+                        tokenSessions.streams[leg].insert(stream);
+                        added[leg].insert(stream);
+                    }
+                }
+                else
+                {
+                    // pack into the first session with space, otherwise create a session
+                    size_t index = 0;
+                    while (index < tokenSessions.streams.size() && tokenSessions.streams[index].size() >= m_config.maxStreamsPerConnection)
+                        ++index;
+
+                    if (index == tokenSessions.sessions.size())
+                    {
+                        tokenSessions.sessions.emplace_back(makeWsSession(m_runtime->wsIoContext(), tokenSessions.dispatcher, 0));
+                        tokenSessions.streams.emplace_back();
+                    }
+
+                    tokenSessions.streams[index].insert(stream);
+                    added[index].insert(stream);
+                }
+            }
+
+            for (auto& [index, newStreams] : added)
+                tokenSessions.sessions[index]->addStreams(newStreams.size());
+
+            sessions = tokenSessions.sessions;
+        }
         
-        for (auto& stream : streams)
-            target << stream + "/";
 
-        return createWsSession(m_config.wsApiUri, std::move("/stream?streams="+std::move(target.str())), std::move(handler));
+        for (auto& [index, newStreams] : added)
+        {
+            auto& session = sessions[index];
+
+            if (index >= nExistingSessions)
+            {
+                // same format as the token's other sessions, so the handler doesn't receive both
+                runWsSession(token.id, session, combined ? makeCombinedStreamPath(newStreams) : makeRawStreamPath(newStreams));
+            }
+            else
+            {
+                session->sendRequest(makeStreamRequest("SUBSCRIBE", newStreams), [this, lifetime = m_lifetime, token, replyHandler, newStreams, session = session.get()](WsResponse response)
+                {
+                    if (response.hasErrorCode())
+                    {
+                        // not subscribed, so remove from the session's streams
+                        std::shared_ptr<WsTokenSessions> tokenSessionsPtr;
+
+                        ifAlive(lifetime, [&]
+                        {
+                            tokenSessionsPtr = m_wsSessions.find(token.id);
+                        });
+
+                        if (tokenSessionsPtr)
+                        {
+                            auto& tokenSessions = *tokenSessionsPtr;
+                            std::scoped_lock lock (tokenSessions.mux);
+                            
+                            for (size_t i = 0 ; i < tokenSessions.sessions.size() ; ++i)
+                            {
+                                if (tokenSessions.sessions[i].get() == session)
+                                {
+                                    for (auto& stream : newStreams)
+                                    {
+                                        if (tokenSessions.streams[i].erase(stream))
+                                            session->addStreams(-1);
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    if (replyHandler)
+                        replyHandler(std::move(response));
+                });
+            }
+        }
     }
 
 
-    void BinanceBeast::stopWebSocket (const WsToken& token, WebSocketResponseHandler handler)
+    void BinanceBeast::unsubscribe (const WsToken& token, const std::set<string>& streams, WebSocketResponseHandler replyHandler)
     {
-        std::scoped_lock (m_wsSessionsMux);
+        std::vector<std::pair<std::shared_ptr<WsSession>, std::set<string>>> requests;
 
-        if (auto sessionIt = m_wsSessions.find(token.id); sessionIt != m_wsSessions.end())
-        {                
-            m_wsSessions[token.id]->close([token, handler, this, session = m_wsSessions[token.id]]()
-            {                    
-                auto cb = handler ? handler : session->handler();
+        auto tokenSessionsPtr = m_wsSessions.find(token.id);
+        if (!tokenSessionsPtr)
+            return fail("unsubscribe(): token not found", replyHandler);
 
+        {
+            auto& tokenSessions = *tokenSessionsPtr;
+            std::scoped_lock lock (tokenSessions.mux);
+
+            for (size_t i = 0 ; i < tokenSessions.sessions.size() ; ++i)
+            {
+                std::set<string> removed;
+
+                for (auto& stream : streams)
+                {
+                    if (tokenSessions.streams[i].erase(stream))
+                        removed.insert(stream);
+                }
+
+                if (!removed.empty())
                 {
-                    std::scoped_lock (m_wsSessionsMux);
-                    m_wsSessions.erase(token.id);
+                    tokenSessions.sessions[i]->addStreams(-static_cast<std::int64_t>(removed.size()));
+                    requests.emplace_back(tokenSessions.sessions[i], std::move(removed));
                 }
+            }
+        }
+
+        for (auto& [session, removed] : requests)
+            session->sendRequest(makeStreamRequest("UNSUBSCRIBE", removed), WebSocketResponseHandler{replyHandler});
+    }
+
+
+    void BinanceBeast::listSubscriptions (const WsToken& token, WebSocketResponseHandler replyHandler)
+    {
+        if (replyHandler == nullptr)
+            throw std::runtime_error("callback is null");
+
+        std::vector<std::shared_ptr<WsSession>> sessions;
+
+        if (auto tokenSessions = m_wsSessions.find(token.id))
+        {
+            std::scoped_lock lock (tokenSessions->mux);
+            sessions = tokenSessions->sessions;
+        }
+        else
+            return fail("listSubscriptions(): token not found", replyHandler);
+
+        for (auto& session : sessions)
+            session->sendRequest(json::object{{"method", "LIST_SUBSCRIPTIONS"}}, WebSocketResponseHandler{replyHandler});
+    }
+
+
+    void BinanceBeast::stopWebSocket (const WsToken& token, WebSocketResponseHandler handler)
+    {
+        // removed now, so the token can't be stopped twice and sessions waiting to connect don't
+        auto tokenSessions = m_wsSessions.erase(token.id);
+
+        if (!tokenSessions)
+            return;
+
+        std::vector<std::shared_ptr<WsSession>> sessions;
+        {
+            std::scoped_lock lock (tokenSessions->mux);
+            sessions = tokenSessions->sessions;
+        }
+
+        auto cb = handler ? handler : tokenSessions->handler;
+
+        if (sessions.empty())
+        {
+            // subscribe() was never called, so there's no connection to close
+            cb(WsResponse {WsResponse::State::Disconnect});
+            return;
+        }
+
+        // the handler is called once, after all of the token's sessions have closed
+        auto remaining = std::make_shared<std::atomic_size_t>(sessions.size());
 
-                cb(WsResponse {WsResponse::State::Disconnect});                    
-            });                
+        for (auto& session : sessions)
+        {
+            session->close([cb, remaining, session]()
+            {                    
+                if (remaining->fetch_sub(1) == 1)
+                    cb(WsResponse {WsResponse::State::Disconnect});                    
+            });
         }
     }
 
@@ -163,77 +527,138 @@ namespace bblib
             throw std::runtime_error("callback is null");
 
         std::shared_ptr<RestSession> session;
+        auto& ioc = m_runtime->restIoContext(isOrderEntry(path, type));
 
         if (createStrand)
-            session = std::make_shared<RestSession>(net::make_strand(getRestIoContext()), m_sslCtx, m_config.keys, std::move(rc), m_restCallersThreadPool);
+            session = std::make_shared<RestSession>(net::make_strand(*ioc.ioc), m_sslCtx, m_config.keys, std::move(rc), m_runtime->callerExecutor());
         else
-            session = std::make_shared<RestSession>(getRestIoContext().get_executor(), m_sslCtx, m_config.keys, std::move(rc), m_restCallersThreadPool);
+            session = std::make_shared<RestSession>(ioc.ioc->get_executor(), m_sslCtx, m_config.keys, std::move(rc), m_runtime->callerExecutor());
+
+        session->setLoad(ioc.load);
+        session->setBusyPoll(ioc.busyPollMicros);
+        session->setDnsCache(m_runtime->dnsCache());
 
         // we don't need to worry about the session's lifetime because RestSession::run() passes the session's shared_ptr
         // by value into the io_context. The session will be destroyed when there are no more io operations pending.
 
-        if (!params.queryParams.empty())
-        {
-            string pathToSend;
-
-            if (sign)
-            {
-                // signing requires a 'signature' param which is a SHA256 of the query params:
-                // 
-                //  https://fapi.binance.com/fapi/v1/allOrders?symbol=ABCDEF&recvWindow=5000&timestamp=123454
-                //                                             ^                                            ^
-                //                                          from here                                    to here   
-                // the "&signature=123456456565672565624" is appended
-
-                std::ostringstream pathWithParams;
-            
-                for (auto& param : params.queryParams)
-                    pathWithParams << std::move(param.first) << "=" << std::move(param.second) << "&";                
+        session->run(host, m_config.restPort, makeRestTarget(path, params.queryParams, sign, m_config.keys.secret), 11, type);   // 11 is HTTP version 1.1
+    }
 
-                pathWithParams << "timestamp=" << std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::system_clock::now().time_since_epoch()).count(); 
-                
-                auto pathWithoutSig = pathWithParams.str();
-                pathToSend = path + "?" + std::move(pathWithoutSig) + "&signature=" + createSignature(m_config.keys.secret, pathWithoutSig);
-            }
-            else
-            {
-                std::ostringstream pathWithParams;
-                pathWithParams << path << "?";
 
-                for (auto& param : params.queryParams)
-                    pathWithParams << std::move(param.first) << "=" << std::move(param.second) << "&";                
+    string BinanceBeast::makeRestTarget (const string& path, QueryParams& params, const bool sign, const string& secretKey)
+    {
+        if (params.empty())
+            return path;
 
-                pathToSend = std::move(pathWithParams.str());
-            }
+        if (sign)
+        {
+            // signing requires a 'signature' param which is a SHA256 of the query params:
+            // 
+            //  https://fapi.binance.com/fapi/v1/allOrders?symbol=ABCDEF&recvWindow=5000&timestamp=123454
+            //                                             ^                                            ^
+            //                                          from here                                    to here   
+            // the "&signature=123456456565672565624" is appended
+
+            std::ostringstream pathWithParams;
+        
+            for (auto& param : params)
+                pathWithParams << std::move(param.first) << "=" << std::move(param.second) << "&";                
 
-            session->run(host, m_config.restPort, pathToSend, 11, type);   // 11 is HTTP version 1.1
+            pathWithParams << "timestamp=" << std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::system_clock::now().time_since_epoch()).count(); 
+            
+            auto pathWithoutSig = pathWithParams.str();
+            return path + "?" + pathWithoutSig + "&signature=" + createSignature(secretKey, pathWithoutSig);
         }
         else
         {
-            session->run(host, m_config.restPort, path, 11, type);
+            std::ostringstream pathWithParams;
+            pathWithParams << path << "?";
+
+            for (auto& param : params)
+                pathWithParams << std::move(param.first) << "=" << std::move(param.second) << "&";                
+
+            return pathWithParams.str();
         }
     }
 
 
-    WsToken BinanceBeast::createWsSession (const string& host, const std::string& path, WebSocketResponseHandler&& handler)
+    WsToken BinanceBeast::createWsSession (const string& host, const std::string& path, WebSocketResponseHandler&& handler, std::set<string> streams)
     {
         if (handler == nullptr)
             throw std::runtime_error("callback is null");
 
-        auto session = std::make_shared<WsSession>(getWsIoContext(), m_sslCtx, std::move(handler));
-        
-        auto wsid = m_nextWsId.load();
-        m_nextWsId.store(wsid+1U);
+        auto tokenSessions = std::make_shared<WsTokenSessions>();
+        tokenSessions->handler = handler;
+        tokenSessions->dispatcher = std::make_shared<WsHandlerDispatcher>(std::move(handler), m_runtime->handlerExecutor());
+        tokenSessions->combined = path.rfind("/ws/", 0) != 0;
+
+        // without a path, the session is created by the first subscribe()
+        std::shared_ptr<WsSession> session;
 
+        if (!path.empty())
         {
-            std::scoped_lock (m_wsSessionsMux);
-            m_wsSessions[wsid] = session;
+            session = makeWsSession(m_runtime->wsIoContext(), tokenSessions->dispatcher, streams.size());
+            tokenSessions->sessions.emplace_back(session);
+            tokenSessions->streams.emplace_back(std::move(streams));
         }
         
-        session->run(host, m_config.wsPort, path);
+        const auto wsid = m_wsSessions.insert(std::move(tokenSessions));
+        
+        if (session)
+            runWsSession(wsid, session, path, host);
 
         return WsToken{.id = wsid};
     }
+
+
+    std::shared_ptr<WsSession> BinanceBeast::makeWsSession (IoContext& ioc, std::shared_ptr<WsHandlerDispatcher> dispatcher, const size_t nStreams)
+    {
+        auto session = std::make_shared<WsSession>(*ioc.ioc, m_sslCtx, std::move(dispatcher));
+        session->setLoad(ioc.load);
+        session->setBusyPoll(ioc.busyPollMicros);
+        session->setDnsCache(m_runtime->dnsCache());
+        session->setKernelTimestamps(m_config.kernelReceiveTimestamps);
+        session->addStreams(nStreams);
+        return session;
+    }
+
+
+    void BinanceBeast::runWsSession (const WsToken::TokenId id, std::shared_ptr<WsSession> session, const string& path, const string& host)
+    {
+        const auto& wsHost = host.empty() ? m_config.wsApiUri : host;
+        const auto when = m_runtime->connectionLimiter(m_config).reserve();
+
+        if (m_recorder)
+            session->setRecorder(m_recorder, id, m_nextConnectionId.fetch_add(1));
+
+        if (when <= ConnectionRateLimiter::Clock::now())
+        {
+            session->run(wsHost, m_config.wsPort, path);
+        }
+        else
+        {
+            // Binance limits connection attempts, so wait until this attempt is within the limit
+            auto timer = std::make_shared<net::steady_timer>(session->executor(), when);
+
+            timer->async_wait([this, lifetime = m_lifetime, timer, id, path, wsHost, wsPort = m_config.wsPort, weakSession = std::weak_ptr<WsSession>{session}](beast::error_code ec)
+            {
+                auto session = weakSession.lock();
+
+                if (ec || !session)
+                    return;
+
+                // stopWebSocket() may have been called whilst waiting, or this client stopped if the runtime is shared
+                bool run = false;
+                ifAlive(lifetime, [&] { run = m_wsSessions.contains(id); });
+
+                if (!run)
+                    return;
+
+                // if stopped since the check, the session is closed so run() does nothing
+                session->run(wsHost, wsPort, path);
+            });
+        }
+    }
     
 
     WsToken BinanceBeast::startUserData(WebSocketResponseHandler handler, const string_view stream)
@@ -267,4 +692,22 @@ namespace bblib
             handler(WsResponse{string_view{"Failed to close listen key"}});
     }
 
+
+    std::shared_ptr<WsApiSession> BinanceBeast::startWsApi (WebSocketResponseHandler handler)
+    {
+        if (m_config.wsOrderApiUri.empty())
+            throw std::runtime_error("startWsApi(): ConnectionConfig::wsOrderApiUri is not set");
+
+        // order entry, so on the order io_contexts if there are any
+        auto& ioc = m_runtime->restIoContext(true);
+
+        auto api = std::make_shared<WsApiSession>(*ioc.ioc, m_sslCtx, m_runtime->callerExecutor(), m_config.keys, std::move(handler));
+        api->connection().setLoad(ioc.load);
+        api->connection().setBusyPoll(ioc.busyPollMicros);
+        api->connection().setDnsCache(m_runtime->dnsCache());
+        api->connection().run(m_config.wsOrderApiUri, m_config.wsOrderApiPort, m_config.wsOrderApiPath);
+
+        return api;
+    }
+
 }   // namespace BinanceBeast
@@ -0,0 +1,284 @@
+#include <binancebeast/BinanceBeast.h>
+#include <binancebeast/BinanceSymbols.h>
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+
+using namespace bblib;
+
+
+///
+/// Per-call cost of the library's hot paths, with Google Benchmark.
+///
+/// For machine readable output, to compare runs:
+///     benchhotpaths --benchmark_format=json --benchmark_out=hotpaths.json
+///
+/// Use --benchmark_filter=<regex> to run a subset.
+///
+
+
+namespace
+{
+    const string BookTickerFrame = R"({"e":"bookTicker","u":400900217,"E":1568014460893,"T":1568014460891,"s":"BNBUSDT","b":"25.35190000","B":"31.21000000","a":"25.36520000","A":"40.66000000"})";
+
+    const string AggTradeFrame = R"({"e":"aggTrade","E":123456789,"s":"BTCUSDT","a":5933014,"p":"0.001","q":"100","f":100,"l":105,"T":123456785,"m":true})";
+
+    const string CombinedFrame = R"({"stream":"btcusdt@bookTicker","data":)" + BookTickerFrame + "}";
+
+    const string OrderUpdateFrame = R"({"e":"ORDER_TRADE_UPDATE","E":1568879465651,"T":1568879465650,"o":{"s":"BTCUSDT","c":"TEST","S":"SELL","o":"TRAILING_STOP_MARKET",)"
+                                    R"("f":"GTC","q":"0.001","p":"0","ap":"0","sp":"7103.04","x":"NEW","X":"NEW","i":8886774,"l":"0","z":"0","L":"0","T":1568879465650,)"
+                                    R"("t":0,"b":"0","a":"9.91","m":false,"R":false,"wt":"CONTRACT_PRICE","ot":"TRAILING_STOP_MARKET","ps":"LONG","cp":false,"AP":"7476.89","cr":"5.0","rp":"0"}})";
+
+    string makeDepthFrame (const int levels)
+    {
+        std::ostringstream frame;
+        frame << R"({"e":"depthUpdate","E":123456789,"T":123456788,"s":"BTCUSDT","U":157,"u":160,"pu":149,"b":[)";
+
+        for (int i = 0 ; i < levels ; ++i)
+            frame << (i ? "," : "") << R"([")" << 30000 - i << R"(.10","1.250"])";
+
+        frame << R"(],"a":[)";
+
+        for (int i = 0 ; i < levels ; ++i)
+            frame << (i ? "," : "") << R"([")" << 30001 + i << R"(.10","0.750"])";
+
+        frame << "]}";
+        return frame.str();
+    }
+
+    const string DepthFrame = makeDepthFrame(20);
+
+    const string BatchOrders = R"([{"type":"LIMIT","timeInForce":"GTC","symbol":"BTCUSDT","side":"BUY","price":"10001","quantity":"0.001"},)"
+                               R"({"type":"LIMIT","timeInForce":"GTC","symbol":"BTCUSDT","side":"SELL","price":"20001","quantity":"0.001"}])";
+
+    const string SecretKey = "NhqPtmdSJYdKjVHjA7PZj4Mge3R5YNiP1e3UZjInClVN65XAbvqqM6A7H5fATj0j";
+}
+
+
+static void parseFrame (benchmark::State& state, const string& frame)
+{
+    for (auto _ : state)
+    {
+        json::error_code ec;
+        auto value = json::parse(frame, ec);
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(frame.size()));
+}
+
+BENCHMARK_CAPTURE(parseFrame, bookTicker, BookTickerFrame);
+BENCHMARK_CAPTURE(parseFrame, aggTrade, AggTradeFrame);
+BENCHMARK_CAPTURE(parseFrame, combined, CombinedFrame);
+BENCHMARK_CAPTURE(parseFrame, depth20, DepthFrame);
+BENCHMARK_CAPTURE(parseFrame, orderUpdate, OrderUpdateFrame);
+
+
+static void createSignature (benchmark::State& state)
+{
+    const string query = "symbol=BTCUSDT&side=BUY&type=LIMIT&quantity=1&price=9000&timeInForce=GTC&recvWindow=5000&timestamp=1591702613943";
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(BinanceBeast::createSignature(SecretKey, query));
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(createSignature);
+
+
+static void b2aHex (benchmark::State& state)
+{
+    char digest [32];
+    for (int i = 0 ; i < 32 ; ++i)
+        digest[i] = static_cast<char>(i * 7);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(BinanceBeast::b2a_hex(digest, 32));
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(b2aHex);
+
+
+static void urlEncode (benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(BinanceBeast::urlEncode(BatchOrders));
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(BatchOrders.size()));
+}
+
+BENCHMARK(urlEncode);
+
+
+static void urlEncodeBuffer (benchmark::State& state)
+{
+    std::vector<char> buffer (urlEncodedMaxSize(BatchOrders.size()));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bblib::urlEncode(BatchOrders, buffer.data()));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(BatchOrders.size()));
+}
+
+BENCHMARK(urlEncodeBuffer);
+
+
+/// A 5 order batch: serialising a json::array then URL encoding it, against encodeBatchOrders().
+static void batchOrdersSerialize (benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        json::array orders;
+
+        for (int i = 0 ; i < 5 ; ++i)
+            orders.emplace_back(json::object{{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "LIMIT"}, {"timeInForce", "GTC"}, {"quantity", "0.001"}, {"price", "10001"}});
+
+        benchmark::DoNotOptimize(BinanceBeast::urlEncode(json::serialize(orders)));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(batchOrdersSerialize);
+
+
+static void batchOrdersEncode (benchmark::State& state)
+{
+    BatchOrder order;
+    order.symbol = "BTCUSDT";
+    order.side = "BUY";
+    order.type = "LIMIT";
+    order.timeInForce = "GTC";
+    order.quantity = "0.001";
+    order.price = "10001";
+
+    const std::vector<BatchOrder> orders (5, order);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(encodeBatchOrders(orders));
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(batchOrdersEncode);
+
+
+static void makeRestTarget (benchmark::State& state)
+{
+    const bool sign = state.range(0) != 0;
+    const QueryParams params {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "LIMIT"}, {"quantity", "0.001"}, {"price", "9000"}, {"timeInForce", "GTC"}};
+
+    for (auto _ : state)
+    {
+        // params are moved from, so this includes a copy, as sendRestRequest() makes
+        auto copy = params;
+        benchmark::DoNotOptimize(BinanceBeast::makeRestTarget("/fapi/v1/order", copy, sign, SecretKey));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(makeRestTarget)->ArgName("signed")->Arg(0)->Arg(1);
+
+
+/// Dispatch through the handler's thread pool, as each websocket frame is, to the end of the handler.
+static void dispatch (benchmark::State& state)
+{
+    const auto batch = state.range(0);
+
+    std::atomic_int64_t handled {0};
+    WsHandlerDispatcher dispatcher {[&handled](WsResponse){ handled.fetch_add(1, std::memory_order_release); }};
+
+    json::value event = json::parse(BookTickerFrame);
+    std::int64_t sent = 0;
+
+    for (auto _ : state)
+    {
+        for (std::int64_t i = 0 ; i < batch ; ++i)
+            dispatcher.dispatch(WsResponse{json::value{event}});
+
+        sent += batch;
+
+        while (handled.load(std::memory_order_acquire) < sent)
+            std::this_thread::yield();
+    }
+
+    state.SetItemsProcessed(sent);
+}
+
+BENCHMARK(dispatch)->Arg(1)->Arg(64)->UseRealTime();
+
+
+static void hasErrorCode (benchmark::State& state, const string& frame)
+{
+    WsResponse response {json::parse(frame)};
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(response.hasErrorCode());
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(hasErrorCode, bookTicker, BookTickerFrame);
+BENCHMARK_CAPTURE(hasErrorCode, error, string{R"({"code":-1121,"msg":"Invalid symbol."})"});
+
+
+
+/// A symbol's id from SymbolRegistry against the unordered_map it replaces, over a USDM sized market of 300 symbols.
+static std::vector<string> makeSymbols()
+{
+    std::vector<string> symbols;
+
+    for (int i = 0 ; i < 300 ; ++i)
+        symbols.emplace_back("SYM" + std::to_string(i) + "USDT");
+
+    return symbols;
+}
+
+
+static void symbolId (benchmark::State& state)
+{
+    const auto symbols = makeSymbols();
+    const SymbolRegistry registry (symbols);
+    size_t i = 0;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(registry.id(symbols[i++ % symbols.size()]));
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(symbolId);
+
+
+static void symbolIdUnorderedMap (benchmark::State& state)
+{
+    const auto symbols = makeSymbols();
+    std::unordered_map<string, SymbolId> ids;
+
+    for (size_t i = 0 ; i < symbols.size() ; ++i)
+        ids.emplace(symbols[i], static_cast<SymbolId>(i));
+
+    size_t i = 0;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ids.find(symbols[i++ % symbols.size()])->second);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(symbolIdUnorderedMap);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,340 @@
+#include <binancebeast/BinanceBeast.h>
+#include <BinanceMockServer.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+
+using namespace bblib;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+
+///
+/// End-to-end load test: BinanceBeast against the mock server, as the number of websockets is stepped up.
+///
+/// For each step, a BinanceBeast is started with N websockets, each with S streams pushing M messages/s, plus
+/// R REST requests kept in flight. After a warm up, each step measures:
+///     - handled messages per second, against the rate the server generated
+///     - latency from the socket read to the end of the handler, p50/p99/p99.9
+///     - client CPU per message: CPU of all threads except the mock server's (bbmock), so includes the handler threads
+///     - resident memory per websocket
+///     - REST requests per second and latency
+///
+/// The mock server runs in this process, its threads are excluded from the CPU figure but its memory per connection
+/// is included in the memory figure. To exclude it, run mock/mockserver elsewhere and pass its address and port.
+///
+/// Each websocket token has its own handler thread, which limits how many websockets a process can have.
+///
+
+
+struct LoadConfig
+{
+    std::vector<size_t> steps {1, 10, 100, 500, 1000};     // websockets
+    size_t streamsPerSocket = 1;
+    double messagesPerSecond = 100;                        // per stream
+    size_t restConcurrency = 0;
+    size_t restIoContexts = 4;
+    size_t wsIoContexts = 6;
+    std::chrono::seconds duration {10};
+    string serverAddress;                                   // empty for an in-process mock server
+    string serverPort;
+};
+
+
+struct StepResult
+{
+    size_t sockets = 0;
+    size_t connected = 0;
+    double messagesPerSecond = 0;
+    double expectedPerSecond = 0;
+    LatencySnapshot handlerLatency;
+    double cpuMicrosPerMessage = 0;
+    double cpuPercent = 0;
+    double memoryPerSocketKb = 0;
+    double restPerSecond = 0;
+    LatencySnapshot restLatency;
+    std::uint64_t restErrors = 0;
+};
+
+
+/// CPU time of this process's threads, excluding threads named 'excludeName'.
+std::chrono::nanoseconds threadsCpu (const string& excludeName)
+{
+    const auto ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+    std::int64_t ticks = 0;
+
+    if (auto dir = ::opendir("/proc/self/task"))
+    {
+        while (auto entry = ::readdir(dir))
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            const string task = string{"/proc/self/task/"} + entry->d_name;
+
+            string name;
+            std::getline(std::ifstream{task + "/comm"}, name);
+
+            if (name == excludeName)
+                continue;
+
+            // the name is in brackets and may have spaces, utime and stime are the 12th and 13th fields after it
+            string stat;
+            std::getline(std::ifstream{task + "/stat"}, stat);
+
+            std::istringstream fields (stat.substr(stat.rfind(')') + 2));
+            string field;
+
+            for (int i = 0 ; i < 11 ; ++i)
+                fields >> field;
+
+            std::int64_t utime = 0, stime = 0;
+            fields >> utime >> stime;
+            ticks += utime + stime;
+        }
+
+        ::closedir(dir);
+    }
+
+    return std::chrono::nanoseconds{ticks * 1000000000LL / ticksPerSecond};
+}
+
+
+/// Resident set size, in KB.
+std::int64_t residentKb ()
+{
+    std::ifstream status ("/proc/self/status");
+    string line;
+
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmRSS:", 0) == 0)
+            return std::stoll(line.substr(6));
+    }
+
+    return 0;
+}
+
+
+/// Keeps 'concurrency' REST requests in flight until stopped.
+class RestLoad
+{
+public:
+    RestLoad (BinanceBeast& bb, const size_t concurrency) : m_bb(bb), m_concurrency(concurrency)
+    {
+    }
+
+
+    void start()
+    {
+        m_running = true;
+
+        for (size_t i = 0 ; i < m_concurrency ; ++i)
+            send();
+    }
+
+
+    /// Stop sending and wait for those in flight.
+    void stop()
+    {
+        m_running = false;
+
+        const auto deadline = Clock::now() + 30s;
+        while (m_inFlight.load() && Clock::now() < deadline)
+            std::this_thread::sleep_for(10ms);
+    }
+
+
+    std::uint64_t completed() const { return m_completed.load(); }
+    std::uint64_t errors() const { return m_errors.load(); }
+    const LatencyHistogram& latency() const { return m_latency; }
+
+
+private:
+    void send()
+    {
+        m_inFlight.fetch_add(1);
+
+        m_bb.sendRestRequest([this, start = Clock::now()](RestResponse result)
+        {
+            m_latency.record(Clock::now() - start);
+
+            if (result.hasErrorCode())
+                m_errors.fetch_add(1);
+            else
+                m_completed.fetch_add(1);
+
+            if (m_running)
+                send();
+
+            m_inFlight.fetch_sub(1);
+
+        }, "/fapi/v1/time", RestSign::Unsigned, RestParams{}, RequestType::Get);
+    }
+
+
+private:
+    BinanceBeast& m_bb;
+    size_t m_concurrency;
+    std::atomic_bool m_running {false};
+    std::atomic_uint64_t m_inFlight {0};
+    std::atomic_uint64_t m_completed {0};
+    std::atomic_uint64_t m_errors {0};
+    LatencyHistogram m_latency;
+};
+
+
+StepResult runStep (const LoadConfig& load, const size_t sockets, MockServer * server)
+{
+    StepResult result;
+    result.sockets = sockets;
+    result.expectedPerSecond = static_cast<double>(sockets * load.streamsPerSocket) * load.messagesPerSecond;
+
+    auto config = server ? server->connectionConfig(Market::USDM) : ConnectionConfig::MakeMockConfig(Market::USDM, load.serverPort, "", "", load.serverAddress);
+    config.maxConnectionAttempts = std::numeric_limits<size_t>::max();   // the mock server has no limit
+
+    std::atomic_uint64_t handled {0};
+    std::atomic_bool measuring {false};
+    LatencyHistogram latency;
+
+    const auto connectedBefore = server ? server->connections() : 0;
+    const auto rssBefore = residentKb();
+
+    BinanceBeast bb;
+    bb.start(config, load.restIoContexts, load.wsIoContexts);
+
+    std::vector<WsToken> tokens;
+    tokens.reserve(sockets);
+
+    for (size_t socket = 0 ; socket < sockets ; ++socket)
+    {
+        std::set<string> streams;
+        for (size_t stream = 0 ; stream < load.streamsPerSocket ; ++stream)
+            streams.insert("sym" + std::to_string(socket) + "x" + std::to_string(stream) + "@bookTicker");
+
+        tokens.emplace_back(bb.startWebSocket([&handled, &measuring, &latency](WsResponse response)
+        {
+            if (response.state != WsResponse::State::Success || !measuring.load(std::memory_order_relaxed))
+                return;
+
+            handled.fetch_add(1, std::memory_order_relaxed);
+
+            if (response.receiveTime != WsResponse::Clock::time_point{})
+                latency.record(WsResponse::Clock::now() - response.receiveTime);
+
+        }, streams));
+    }
+
+    // wait for the connections, only known with an in-process server
+    if (server)
+    {
+        const auto deadline = Clock::now() + 60s;
+        while (server->connections() - connectedBefore < sockets && Clock::now() < deadline)
+            std::this_thread::sleep_for(50ms);
+
+        result.connected = server->connections() - connectedBefore;
+    }
+    else
+    {
+        std::this_thread::sleep_for(5s);
+        result.connected = sockets;
+    }
+
+    // warm up
+    RestLoad rest (bb, load.restConcurrency);
+    rest.start();
+    std::this_thread::sleep_for(2s);
+
+    result.memoryPerSocketKb = static_cast<double>(residentKb() - rssBefore) / static_cast<double>(sockets);
+
+    const auto restBefore = rest.completed();
+    const auto cpuBefore = threadsCpu(MockServer::ThreadName);
+    const auto start = Clock::now();
+
+    measuring = true;
+    std::this_thread::sleep_for(load.duration);
+    measuring = false;
+
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto cpu = std::chrono::duration<double, std::micro>(threadsCpu(MockServer::ThreadName) - cpuBefore).count();
+
+    rest.stop();
+
+    result.messagesPerSecond = static_cast<double>(handled.load()) / seconds;
+    result.handlerLatency = latency.snapshot();
+    result.cpuMicrosPerMessage = handled.load() ? cpu / static_cast<double>(handled.load()) : 0;
+    result.cpuPercent = cpu / (seconds * 1e6) * 100.0;
+    result.restPerSecond = static_cast<double>(rest.completed() - restBefore) / seconds;
+    result.restLatency = rest.latency().snapshot();
+    result.restErrors = rest.errors();     // REST latency and errors include the warm up
+
+    for (auto& token : tokens)
+        bb.stopWebSocket(token);
+
+    return result;
+}
+
+
+int main (int argc, char ** argv)
+{
+    LoadConfig load;
+
+    if (argc > 1)
+    {
+        load.steps.clear();
+
+        std::istringstream steps (argv[1]);
+        for (string step ; std::getline(steps, step, ',') ; )
+            load.steps.push_back(std::stoul(step));
+    }
+
+    load.streamsPerSocket = argc > 2 ? std::stoul(argv[2]) : load.streamsPerSocket;
+    load.messagesPerSecond = argc > 3 ? std::stod(argv[3]) : load.messagesPerSecond;
+    load.restConcurrency = argc > 4 ? std::stoul(argv[4]) : load.restConcurrency;
+    load.restIoContexts = argc > 5 ? std::stoul(argv[5]) : load.restIoContexts;
+    load.wsIoContexts = argc > 6 ? std::stoul(argv[6]) : load.wsIoContexts;
+    load.duration = std::chrono::seconds{argc > 7 ? std::stol(argv[7]) : load.duration.count()};
+    load.serverAddress = argc > 8 ? argv[8] : "";
+    load.serverPort = argc > 9 ? argv[9] : "";
+
+    std::cout << "\n\nLoad test against the mock server\n"
+              << "Usage: " << argv[0] << " [websockets per step, i.e. 1,10,100] [streams per websocket] [messages/s per stream] [concurrent REST requests]"
+              << " [REST io_contexts] [websocket io_contexts] [seconds per step] [mock server address] [mock server port]\n\n";
+
+    std::unique_ptr<MockServer> server;
+
+    if (load.serverAddress.empty())
+    {
+        MockServerConfig mockConfig;
+        mockConfig.messagesPerSecond = load.messagesPerSecond;
+        mockConfig.threads = std::max(1U, std::thread::hardware_concurrency() / 2);
+        server = std::make_unique<MockServer>(mockConfig);
+    }
+
+    std::cout << std::left << std::setw(8) << "sockets" << std::setw(10) << "connected" << std::setw(12) << "expected/s" << std::setw(12) << "handled/s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us" << std::setw(10) << "cpu us/msg" << std::setw(8) << "cpu %"
+              << std::setw(12) << "KB/socket" << std::setw(10) << "REST/s" << std::setw(12) << "REST p99 ms" << "REST errors\n";
+
+    for (auto sockets : load.steps)
+    {
+        const auto result = runStep(load, sockets, server.get());
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(8) << result.sockets << std::setw(10) << result.connected
+                  << std::setw(12) << result.expectedPerSecond << std::setw(12) << result.messagesPerSecond
+                  << std::setw(10) << result.handlerLatency.percentile(0.5) / 1000.0
+                  << std::setw(10) << result.handlerLatency.percentile(0.99) / 1000.0
+                  << std::setw(10) << result.handlerLatency.percentile(0.999) / 1000.0
+                  << std::setw(10) << result.cpuMicrosPerMessage << std::setw(8) << result.cpuPercent
+                  << std::setw(12) << result.memoryPerSocketKb << std::setw(10) << result.restPerSecond
+                  << std::setw(12) << result.restLatency.percentile(0.99) / 1e6 << result.restErrors << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <binancebeast/BinanceBeast.h>
+#include <binancebeast/BinanceWsApi.h>
+#include <BinanceMockServer.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+
+using namespace bblib;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+
+///
+/// Order entry over REST (sendRestRequest()) compared with the websocket API (WsApiSession), against the in-process
+/// mock server, which routes both to the same order handler.
+///
+/// Each path sends signed LIMIT orders with 'inFlight' orders outstanding at a time, and reports the round trip, from
+/// the request being made to the handler being called, and the orders per second. With one in flight it's the
+/// latency of an order on its own, with more it's the throughput.
+///
+/// RestSession connects and handshakes for each request, so REST's round trip includes a TCP connect and TLS
+/// handshake, whilst the websocket API's is one frame each way on an open connection.
+///
+
+
+namespace
+{
+    struct Result
+    {
+        LatencySnapshot roundTrip;
+        std::chrono::duration<double> elapsed {};
+        size_t failed = 0;
+    };
+
+
+    /// Shared with the handlers, so a reply which arrives after run() has timed out doesn't use its locals.
+    struct RunState
+    {
+        LatencyHistogram roundTrip;
+        std::mutex mux;
+        std::condition_variable cv;
+        size_t sent = 0, replied = 0, failed = 0;
+        bool timedOut = false;      // no more are sent
+    };
+
+
+    const QueryParams OrderParams {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "LIMIT"}, {"timeInForce", "GTC"}, {"quantity", "0.001"}, {"price", "10000"}};
+
+
+    /// Sends an order with send(handler). Its reply sends the next until 'orders' have been sent.
+    template <typename Send>
+    void sendOrder (const std::shared_ptr<RunState>& state, const size_t orders, const Send& send)
+    {
+        const auto start = Clock::now();
+
+        send([state, orders, send, start](RestResponse reply)
+        {
+            state->roundTrip.record(Clock::now() - start);
+
+            bool more = false;
+            {
+                std::scoped_lock lock (state->mux);
+
+                if (reply.hasErrorCode())
+                    ++state->failed;
+
+                ++state->replied;
+                more = !state->timedOut && state->sent < orders;
+
+                if (more)
+                    ++state->sent;
+                else
+                    state->cv.notify_one();
+            }
+
+            if (more)
+                sendOrder(state, orders, send);
+        });
+    }
+
+
+    /// Sends 'orders' orders with send(handler), keeping 'inFlight' outstanding, and waits for all the replies.
+    template <typename Send>
+    void run (Result& result, const size_t orders, const size_t inFlight, const Send& send)
+    {
+        auto state = std::make_shared<RunState>();
+
+        const auto start = Clock::now();
+
+        for (size_t i = 0 ; i < std::min(inFlight, orders) ; ++i)
+        {
+            {
+                std::scoped_lock lock (state->mux);
+                ++state->sent;
+            }
+
+            sendOrder(state, orders, send);
+        }
+
+        std::unique_lock lock (state->mux);
+
+        if (!state->cv.wait_for(lock, std::chrono::seconds{60 + static_cast<long>(orders / 100)}, [&]{ return state->replied == orders; }))
+        {
+            state->timedOut = true;
+            std::cout << "timed out after " << state->replied << " replies\n";
+        }
+
+        result.elapsed = Clock::now() - start;
+        result.roundTrip = state->roundTrip.snapshot();
+        result.failed = state->failed;
+    }
+
+
+    void print (const string& name, const Result& result, const size_t orders)
+    {
+        const auto& snapshot = result.roundTrip;
+
+        std::cout << std::left << std::setw(16) << name << std::right
+                  << std::setw(10) << snapshot.mean() / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.5) / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.99) / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.999) / 1000.0
+                  << std::setw(10) << snapshot.max / 1000.0
+                  << std::setw(12) << orders / result.elapsed.count()
+                  << std::setw(8) << result.failed << "\n";
+    }
+}
+
+
+int main (int argc, char ** argv)
+{
+    const size_t orders = argc > 1 ? std::stoul(argv[1]) : 5000;
+    const size_t inFlight = argc > 2 ? std::max<size_t>(std::stoul(argv[2]), 1) : 1;
+    const size_t warmup = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    std::cout << "\n\nOrder entry, REST and websocket API, against the mock server\n"
+              << "Usage: " << argv[0] << " [orders] [in flight] [warm up orders]\n\n";
+
+    MockServer server;
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), IoContextsConfig::Make(1, 1, 1));
+
+    auto api = bb.startWsApi();
+
+    const auto sendRest = [&bb](RestResponseHandler handler)
+    {
+        bb.sendRestRequest(std::move(handler), "/fapi/v1/order", RestSign::HMAC_SHA256, RestParams{OrderParams}, RequestType::Post);
+    };
+
+    const auto sendWsApi = [&api](RestResponseHandler handler)
+    {
+        api->placeOrder(std::move(handler), OrderParams);
+    };
+
+    Result warmRest, warmWsApi, rest, wsApi;
+
+    // the first websocket API order also waits for the connection
+    run(warmRest, warmup, inFlight, sendRest);
+    run(warmWsApi, warmup, inFlight, sendWsApi);
+
+    run(rest, orders, inFlight, sendRest);
+    run(wsApi, orders, inFlight, sendWsApi);
+
+    std::cout << "orders: " << orders << " (after " << warmup << " warm up), in flight: " << inFlight << "\n\n"
+              << std::left << std::setw(16) << "round trip (us)" << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(10) << "max" << std::setw(12) << "orders/s" << std::setw(8) << "failed" << "\n";
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    print("REST", rest, orders);
+    print("websocket API", wsApi, orders);
+
+    api->close();
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <binancebeast/BinanceBeast.h>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+
+
+using namespace bblib;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+
+///
+/// Compares wake-to-handler latency of the io_context run modes (ThreadConfig::RunMode).
+///
+/// A writer thread sends an 8 byte timestamp over a loopback TCP connection, the reading socket is on the io_context 
+/// being measured. The latency is from just before the write to the start of the read handler, which includes the
+/// wake up from epoll in the blocking mode.
+///
+/// Between each write the writer waits so the io_context is idle, as it would be between market data frames.
+///
+/// The spin modes need a core to themselves, with fewer cores than busy threads the spinning thread competes
+/// with the writer and the results are meaningless. Use the cpu argument to pin the io_context thread.
+///
+
+
+struct Result
+{
+    string name;
+    std::vector<std::int64_t> latencies;    // nanoseconds, sorted
+};
+
+
+class Reader
+{
+public:
+    Reader (tcp::socket&& socket, std::vector<std::int64_t>& latencies) : 
+        m_socket(std::move(socket)), 
+        m_latencies(latencies)
+    {
+    }
+
+    void read()
+    {
+        net::async_read(m_socket, net::buffer(&m_stamp, sizeof(m_stamp)), [this](beast::error_code ec, std::size_t)
+        {
+            const auto now = Clock::now().time_since_epoch().count();
+
+            if (ec)
+                return;
+
+            m_latencies.push_back(now - m_stamp);
+            m_count.fetch_add(1, std::memory_order_release);
+
+            read();
+        });
+    }
+
+    size_t count() const { return m_count.load(std::memory_order_acquire); }
+
+    tcp::socket& socket() { return m_socket; }
+
+private:
+    tcp::socket m_socket;
+    std::int64_t m_stamp;
+    std::vector<std::int64_t>& m_latencies;
+    std::atomic_size_t m_count {0};
+};
+
+
+Result run (const string& name, const ThreadConfig& config, const size_t samples, const std::chrono::microseconds gap)
+{
+    Result result {name, {}};
+    result.latencies.reserve(samples);
+
+    net::io_context ioc;
+    net::io_context writerIoc;
+
+    // loopback connection, the reading end is on the io_context being measured
+    tcp::acceptor acceptor (writerIoc, tcp::endpoint{net::ip::address_v4::loopback(), 0});
+    tcp::socket writer (writerIoc);
+    writer.connect(acceptor.local_endpoint());
+    writer.set_option(tcp::no_delay{true});
+
+    Reader reader (acceptor.accept(ioc), result.latencies);
+
+    beast::error_code ec;
+    if (setSocketBusyPoll(reader.socket(), config.busyPollMicros, ec); ec)
+        std::cout << name << ": SO_BUSY_POLL not set: " << ec.message() << "\n";
+
+    auto guard = net::make_work_guard(ioc);
+    std::thread iocThread ([&ioc, &config] { runIoContext(ioc, config); });
+
+    if (config.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+
+        if (auto err = pthread_setaffinity_np(iocThread.native_handle(), sizeof(cpus), &cpus); err)
+            std::cout << name << ": affinity not set: " << std::strerror(err) << "\n";
+    }
+
+    reader.read();
+
+    for (size_t i = 0 ; i < samples ; ++i)
+    {
+        const std::int64_t stamp = Clock::now().time_since_epoch().count();
+        net::write(writer, net::buffer(&stamp, sizeof(stamp)));
+
+        while (reader.count() <= i)
+            ;
+
+        std::this_thread::sleep_for(gap);
+    }
+
+    guard.reset();
+    ioc.stop();
+    iocThread.join();
+
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+
+std::int64_t percentile (const std::vector<std::int64_t>& sorted, const double p)
+{
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+}
+
+
+int main (int argc, char ** argv)
+{
+    const size_t samples = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const int cpu = argc > 2 ? std::stoi(argv[2]) : -1;
+    const int busyPoll = argc > 3 ? std::stoi(argv[3]) : 0;
+
+    std::cout << "\n\nio_context run mode: wake-to-handler latency\n"
+              << "Usage: " << argv[0] << " [samples] [cpu for io_context thread] [SO_BUSY_POLL micros]\n\n";
+
+    ThreadConfig blocking;
+    blocking.cpu = cpu;
+    blocking.busyPollMicros = busyPoll;
+
+    ThreadConfig spin = blocking;
+    spin.runMode = ThreadConfig::RunMode::Spin;
+
+    ThreadConfig spinThenPark = spin;
+    spinThenPark.spinPolls = 10000;
+    spinThenPark.parkTimeout = 1000us;
+
+    std::vector<Result> results;
+    results.emplace_back(run("blocking", blocking, samples, 50us));
+    results.emplace_back(run("spin", spin, samples, 50us));
+    results.emplace_back(run("spin then park", spinThenPark, samples, 50us));
+
+    std::cout << std::left << std::setw(16) << "mode (ns)" << std::right
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" 
+              << std::setw(10) << "p99.9" << std::setw(12) << "max" << "\n";
+
+    for (auto& result : results)
+    {
+        std::cout << std::left << std::setw(16) << result.name << std::right
+                  << std::setw(10) << percentile(result.latencies, 0.5)
+                  << std::setw(10) << percentile(result.latencies, 0.9)
+                  << std::setw(10) << percentile(result.latencies, 0.99)
+                  << std::setw(10) << percentile(result.latencies, 0.999)
+                  << std::setw(12) << (result.latencies.empty() ? 0 : result.latencies.back()) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <binancebeast/BinanceBeast.h>
+#include <BinanceMockServer.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+using namespace bblib;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+
+///
+/// Tick-to-trade latency: from a market data frame being read from the socket in WsSession::on_read() to the order
+/// it triggers being written to the socket by RestSession, against the in-process mock server.
+///
+/// The strategy sends a signed LIMIT order on a bookTicker tick, with sendRestRequest(). Only one order is in flight
+/// at a time, ticks arriving whilst an order is in flight are ignored, so orders don't queue behind each other.
+///
+/// The latency is broken down by stage, using WsResponse's and RestResponse::timing's stamps:
+///     socket -> parse         frame read to json parsed (WsSession)
+///     parse -> handler        json parsed to the strategy's handler called (WsHandlerDispatcher)
+///     handler -> session      strategy decides and calls sendRestRequest(), RestSession created
+///     sign                    query built and signed
+///     resolve + connect       TCP connected. RestSession connects for every request
+///     TLS handshake
+///     write                   request written to the socket
+///     tick to trade           frame read to request written, the sum of the above
+///     write -> server         request written to the mock server's handler called (loopback, TLS and HTTP parse)
+///     order round trip        request written to response read
+///
+/// As RestSession connects and handshakes for each request, the connect and handshake usually dominate.
+///
+
+
+namespace
+{
+    struct Stage
+    {
+        string name;
+        LatencyHistogram latency;
+    };
+
+
+    struct Tick
+    {
+        WsResponse::Clock::time_point socket;
+        WsResponse::Clock::time_point parse;
+        WsResponse::Clock::time_point handler;
+    };
+}
+
+
+int main (int argc, char ** argv)
+{
+    const size_t orders = argc > 1 ? std::stoul(argv[1]) : 5000;
+    const double ticksPerSecond = argc > 2 ? std::stod(argv[2]) : 1000;
+    const size_t warmup = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    std::cout << "\n\nTick-to-trade latency against the mock server\n"
+              << "Usage: " << argv[0] << " [orders] [ticks/s] [warm up orders]\n\n";
+
+    enum StageId { SocketToParse, ParseToHandler, HandlerToSession, Sign, Connect, Handshake, Write, TickToTrade, WriteToServer, RoundTrip, NumStages };
+
+    std::vector<Stage> stages (NumStages);
+    stages[SocketToParse].name = "socket -> parse";
+    stages[ParseToHandler].name = "parse -> handler";
+    stages[HandlerToSession].name = "handler -> session";
+    stages[Sign].name = "sign";
+    stages[Connect].name = "resolve + connect";
+    stages[Handshake].name = "TLS handshake";
+    stages[Write].name = "write";
+    stages[TickToTrade].name = "tick to trade";
+    stages[WriteToServer].name = "write -> server";
+    stages[RoundTrip].name = "order round trip";
+
+    MockServerConfig mockConfig;
+    mockConfig.messagesPerSecond = ticksPerSecond;
+    MockServer server {mockConfig};
+
+    // when each order reached the exchange, by client order id
+    std::mutex serverTimesMux;
+    std::unordered_map<string, Clock::time_point> serverTimes;
+
+    server.setRestHandler(http::verb::post, "/fapi/v1/order", [&serverTimesMux, &serverTimes](const MockRestRequest& request)
+    {
+        const auto now = Clock::now();
+
+        if (auto it = request.params.find("newClientOrderId"); it != request.params.end())
+        {
+            std::scoped_lock lock (serverTimesMux);
+            serverTimes[it->second] = now;
+        }
+
+        return MockRestResponse{http::status::ok, R"({"orderId":1,"status":"NEW"})"};
+    });
+
+    std::atomic_bool inFlight {false};
+    std::atomic_size_t sent {0};
+    std::atomic_size_t failed {0};
+    std::promise<void> done;
+
+    auto onOrder = [&](const Tick tick, const string clientOrderId, RestResponse result)
+    {
+        const auto number = sent.load();
+
+        if (result.hasErrorCode())
+            failed.fetch_add(1);
+        else if (number > warmup)
+        {
+            const auto& timing = result.timing;
+
+            stages[SocketToParse].latency.record(tick.parse - tick.socket);
+            stages[ParseToHandler].latency.record(tick.handler - tick.parse);
+            stages[HandlerToSession].latency.record(timing.requestTime - tick.handler);
+            stages[Sign].latency.record(timing.runTime - timing.requestTime);
+            stages[Connect].latency.record(timing.connectTime - timing.runTime);
+            stages[Handshake].latency.record(timing.handshakeTime - timing.connectTime);
+            stages[Write].latency.record(timing.writeTime - timing.handshakeTime);
+            stages[TickToTrade].latency.record(timing.writeTime - tick.socket);
+            stages[RoundTrip].latency.record(timing.receiveTime - timing.writeTime);
+
+            std::scoped_lock lock (serverTimesMux);
+
+            if (auto it = serverTimes.find(clientOrderId); it != serverTimes.end())
+            {
+                stages[WriteToServer].latency.record(it->second - timing.writeTime);
+                serverTimes.erase(it);
+            }
+        }
+
+        if (number == orders + warmup)
+            done.set_value();
+        else
+            inFlight = false;
+    };
+
+    // after the state its handlers use, so it's destroyed, and its threads joined, first. After a timeout an order may
+    // still be in flight
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), 1, 1);
+
+    // the strategy: an order for each tick, unless one is in flight
+    auto token = bb.startWebSocket([&](WsResponse response)
+    {
+        if (response.state != WsResponse::State::Success || inFlight.exchange(true))
+            return;
+
+        const Tick tick {response.arrivalTime(), response.parseTime, WsResponse::Clock::now()};
+        const auto clientOrderId = "bb" + std::to_string(sent.fetch_add(1) + 1);
+
+        bb.sendRestRequest([&onOrder, tick, clientOrderId](RestResponse result)
+        {
+            onOrder(tick, clientOrderId, std::move(result));
+
+        }, "/fapi/v1/order", RestSign::HMAC_SHA256, RestParams{QueryParams{{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "LIMIT"}, {"timeInForce", "GTC"},
+                                                                          {"quantity", "0.001"}, {"price", "10000"}, {"newClientOrderId", clientOrderId}}}, RequestType::Post);
+
+    }, "btcusdt@bookTicker");
+
+    if (done.get_future().wait_for(std::chrono::seconds{60 + static_cast<long>(orders / 100)}) != std::future_status::ready)
+        std::cout << "timed out after " << sent.load() << " orders\n";
+
+    bb.stopWebSocket(token);
+
+    std::cout << "orders: " << orders << " (after " << warmup << " warm up), failed: " << failed.load() << "\n\n"
+              << std::left << std::setw(22) << "stage (us)" << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(10) << "max" << "\n";
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    for (auto& stage : stages)
+    {
+        const auto snapshot = stage.latency.snapshot();
+
+        std::cout << std::left << std::setw(22) << stage.name << std::right
+                  << std::setw(10) << snapshot.mean() / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.5) / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.9) / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.99) / 1000.0
+                  << std::setw(10) << snapshot.percentile(0.999) / 1000.0
+                  << std::setw(10) << snapshot.max / 1000.0 << "\n";
+    }
+
+    return 0;
+}
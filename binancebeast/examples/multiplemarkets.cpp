@@ -9,6 +9,7 @@
 #include <thread>
 #include <set>
 #include <map>
+#include <algorithm>
 
 using namespace bblib;
 using namespace std::chrono_literals;
@@ -18,6 +19,9 @@ using std::string;
 ///
 /// A simple example of how to receive data from multiple markets.
 ///
+/// Each market has its own BinanceBeast, but they share one BinanceRuntime, so there's one set of io_context
+/// threads however many markets (or accounts) are scanned.
+///
 
 
 class MarketScanner
@@ -41,17 +45,19 @@ public:
     }
 
 
-    void start ()
+    void start (std::shared_ptr<BinanceRuntime> runtime)
     {
         m_running.store(true);
 
-        m_bb.start(m_config);
+        m_bb.start(m_config, runtime);
 
 
         setSymbolsToScan();   // default is all symbols
 
         symbolBookTicker();
 
+        symbolsDepth();
+
         m_thread = std::move(std::thread{std::bind(&MarketScanner::run, this)});
     }
 
@@ -146,9 +152,36 @@ protected:
     }
 
 
+    /// Diff depth for every symbol being scanned. This can be more streams than Binance allows on one
+    /// connection, BinanceBeast splits them across connections but there's still one token and handler.
+    void symbolsDepth()
+    {
+        std::set<string> streams;
+
+        for (auto& symbol : m_symbolsToScan)
+        {
+            string stream {symbol + depthStreamSuffix()};
+            std::transform(stream.begin(), stream.end(), stream.begin(), ::tolower);
+            streams.insert(std::move(stream));
+        }
+
+        m_bb.startWebSocket([this](WsResponse result)
+        {
+            if (result.hasErrorCode())
+                std::cout << marketName() << ": " << result.failMessage << "\n";
+            else
+            {
+                // offload data to analyse, etc
+            }
+
+        }, streams);  
+    }
+
+
 private:
     virtual void run () = 0;
     virtual string allSymbolsStreamName() = 0;
+    virtual string depthStreamSuffix() = 0;     // the update speeds differ per market
 
 protected:
     BinanceBeast m_bb;
@@ -189,6 +222,11 @@ protected:
         return "/fapi/v1/ticker/price";
     }
 
+    virtual string depthStreamSuffix() override
+    {
+        return "@depth@500ms";
+    }
+
 private:
 };
 
@@ -219,6 +257,11 @@ protected:
         return "/dapi/v1/ticker/price ";
     }
 
+    virtual string depthStreamSuffix() override
+    {
+        return "@depth@500ms";
+    }
+
 
 private:
 
@@ -252,6 +295,12 @@ protected:
         return "/api/v3/ticker/price ";
     }
 
+    virtual string depthStreamSuffix() override
+    {
+        // SPOT has 1000ms (the default) or 100ms
+        return "@depth";
+    }
+
 
 private:
 };
@@ -275,8 +324,11 @@ int main (int argc, char ** argv)
     };
 
 
+    // 2 REST and 4 websocket io_contexts for all three markets, rather than 4 and 6 for each
+    auto runtime = BinanceRuntime::Make(IoContextsConfig::Make(2, 4));
+
     for (auto& scanner : scanners)
-        scanner->start();
+        scanner->start(runtime);
 
 
     auto cmdFut = std::async(std::launch::async, []
@@ -64,12 +64,15 @@ int main (int argc, char ** argv)
     // See the GitHub for more info.
 
     // create a batch order (max of 5)
-    // the safest way is to use boost::json to create the json then serialise
-    boost::json::array order =
-    {
-        {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "MARKET"}, {"quantity", "0.001"}},
-        {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "MARKET"}, {"quantity", "0.001"}}
-    };
+    // encodeBatchOrders() creates the URL encoded JSON array directly from the orders. Alternatively, use boost::json
+    // to create the array then BinanceBeast::urlEncode(json::serialize(array))
+    BatchOrder order;
+    order.symbol = "BTCUSDT";
+    order.side = "BUY";
+    order.type = "MARKET";
+    order.quantity = "0.001";
+
+    std::vector<BatchOrder> orders {order, order};
 
     bb.sendRestRequest([&](RestResponse result)
     {
@@ -82,7 +85,7 @@ int main (int argc, char ** argv)
     },
     "/fapi/v1/batchOrders",
     RestSign::HMAC_SHA256,
-    RestParams{{{"batchOrders", BinanceBeast::urlEncode(json::serialize(order))}}},
+    RestParams{{{"batchOrders", encodeBatchOrders(orders)}}},
     RequestType::Post);
 
     
@@ -0,0 +1,951 @@
+#ifndef BINANCEBEAST_MOCKSERVER_H
+#define BINANCEBEAST_MOCKSERVER_H
+
+#include <binancebeast/BinanceCommon.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/x509.h>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+
+namespace bblib
+{
+    struct MockServerConfig
+    {
+        string address = "127.0.0.1";
+        unsigned short port = 0;                        // 0 for any free port, see MockServer::port()
+        size_t threads = 1;                             // io_context threads
+        std::chrono::microseconds restLatency {0};      // delay before each REST and websocket API response is sent
+        size_t restFailEvery = 0;                       // every n'th REST request fails with HTTP 429 and code -1003, 0 for never
+        double messagesPerSecond = 0;                   // generated per stream, per connection. 0 to only send publish()'d messages
+        size_t disconnectAfter = 0;                     // drop each websocket connection after sending this many messages, 0 for never
+        size_t maxQueuedMessages = 4096;                // per connection, generated messages are dropped when a slow client has this many queued
+    };
+
+
+    struct MockRestRequest
+    {
+        http::verb method;
+        string path;                                    // without the query
+        std::map<string, string> params;                // query params, as sent
+        string apiKey;                                  // X-MBX-APIKEY
+        string body;
+    };
+
+
+    struct MockRestResponse
+    {
+        /// Binance's error format, i.e. {"code":-1121,"msg":"Invalid symbol."}
+        static MockRestResponse error (const int code, const string& msg, const http::status status = http::status::bad_request)
+        {
+            return MockRestResponse{status, json::serialize(json::object{{"code", code}, {"msg", msg.c_str()}})};
+        }
+
+        http::status status = http::status::ok;
+        string body = "{}";                             // sent as application/json
+    };
+
+
+    using MockRestHandler = std::function<MockRestResponse(const MockRestRequest&)>;
+
+    /// Checks a websocket API session.logon's params, i.e. the Ed25519 signature, returns false to reject.
+    using MockLogonHandler = std::function<bool(const MockRestRequest&)>;
+
+    /// Returns the event, without the combined stream wrapper, for the sequence'th message of a stream on a connection.
+    using MockStreamGenerator = std::function<string(const string& stream, const std::uint64_t sequence)>;
+
+
+    /// A local stand-in for the Binance REST and websocket servers, so tests and benchmarks can run without a network
+    /// connection, and at rates the real servers would not allow.
+    ///
+    /// HTTPS and WSS are served on one port, with a self-signed certificate created at start, so use with
+    /// ConnectionConfig::MakeMockConfig() (or connectionConfig()) which does not verify the peer.
+    ///
+    /// REST: requests are routed by method and path to a MockRestHandler. There are handlers for ping, time, depth,
+    /// order and the user data listen key on each market's paths. Others return 404.
+    ///
+    /// Websocket API: "/ws-fapi/v1", "/ws-dapi/v1" and "/ws-api/v3" accept order.place, order.cancel, order.modify,
+    /// order.status, ping and time, which are routed to the REST handler of the equivalent endpoint, i.e. order.place
+    /// on "/ws-fapi/v1" to POST "/fapi/v1/order", so REST and websocket API order entry can be compared.
+    /// session.logon is accepted, or checked with setLogonHandler(), and later requests on the connection have its apiKey.
+    ///
+    /// Websockets: "/ws/<stream>[/<stream>...]" sends raw events, "/stream?streams=<stream>/..." sends combined events.
+    /// SUBSCRIBE, UNSUBSCRIBE and LIST_SUBSCRIPTIONS are supported. Events are generated for each stream at
+    /// MockServerConfig::messagesPerSecond by a MockStreamGenerator, which by default creates bookTicker, aggTrade,
+    /// depthUpdate and markPriceUpdate events according to the stream name, with increasing ids. Events can also
+    /// be sent with publish().
+    ///
+    /// The server runs on its own threads, from construction until destruction.
+    class MockServer
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t restRequests = 0;
+            std::uint64_t wsConnections = 0;            // accepted in total
+            std::uint64_t wsMessages = 0;               // queued to send
+            std::uint64_t wsDropped = 0;                // generated but not queued because the client was too slow
+            std::uint64_t wsApiRequests = 0;
+        };
+
+
+        /// The server's threads are named this, so they can be told apart from the client's in a profiler or load test.
+        static constexpr const char * ThreadName = "bbmock";
+
+
+        /// Throws if the address can't be bound.
+        explicit MockServer (MockServerConfig config = {}) :
+            m_config(std::move(config)),
+            m_sslCtx(ssl::context::tlsv12_server),
+            m_ioc(std::make_unique<net::io_context>(static_cast<int>(std::max<size_t>(1, m_config.threads)))),
+            m_acceptor(net::make_strand(*m_ioc))
+        {
+            makeCertificate(m_sslCtx);
+            addDefaultRoutes();
+
+            const tcp::endpoint endpoint {net::ip::make_address(m_config.address), m_config.port};
+
+            m_acceptor.open(endpoint.protocol());
+            m_acceptor.set_option(net::socket_base::reuse_address(true));
+            m_acceptor.bind(endpoint);
+            m_acceptor.listen(net::socket_base::max_listen_connections);
+
+            m_port = m_acceptor.local_endpoint().port();
+
+            accept();
+
+            for (size_t i = 0 ; i < std::max<size_t>(1, m_config.threads) ; ++i)
+            {
+                m_threads.emplace_back([this]{ m_ioc->run(); });
+                pthread_setname_np(m_threads.back().native_handle(), ThreadName);
+            }
+        }
+
+
+        ~MockServer()
+        {
+            m_ioc->stop();
+
+            for (auto& thread : m_threads)
+                thread.join();
+        }
+
+
+        MockServer (const MockServer&) = delete;
+        MockServer& operator= (const MockServer&) = delete;
+
+
+        unsigned short port() const
+        {
+            return m_port;
+        }
+
+
+        /// A config for BinanceBeast::start() which connects to this server.
+        ConnectionConfig connectionConfig (const Market market, const string& apiKey = "", const string& secretKey = "") const
+        {
+            return ConnectionConfig::MakeMockConfig(market, std::to_string(m_port), apiKey, secretKey, m_config.address);
+        }
+
+
+        /// Set the handler for a method and path, replacing any existing handler. Call before connecting clients, or
+        /// at least not whilst REST requests are in flight.
+        void setRestHandler (const http::verb method, const string& path, MockRestHandler handler)
+        {
+            std::scoped_lock lock (m_routesMux);
+            m_routes[{method, path}] = std::move(handler);
+        }
+
+
+        /// Check websocket API logons, rather than accepting any. Call before connecting clients.
+        void setLogonHandler (MockLogonHandler handler)
+        {
+            m_logonHandler = std::move(handler);
+        }
+
+
+        /// Replace the default event generator. Call before connecting clients.
+        void setStreamGenerator (MockStreamGenerator generator)
+        {
+            m_generator = std::move(generator);
+        }
+
+
+        /// Send an event to every connection subscribed to the stream. Thread safe.
+        void publish (const string& stream, const string& event)
+        {
+            for (auto& session : sessions())
+                session->publish(stream, event);
+        }
+
+
+        /// Drop every websocket connection, without a close frame, as a network failure would. Thread safe.
+        void disconnectAll()
+        {
+            for (auto& session : sessions())
+                session->disconnect();
+        }
+
+
+        /// Websocket connections open now.
+        size_t connections()
+        {
+            return sessions().size();
+        }
+
+
+        Stats stats() const
+        {
+            return Stats{m_restRequests.load(), m_wsConnections.load(), m_wsMessages.load(), m_wsDropped.load(), m_wsApiRequests.load()};
+        }
+
+
+        /// The default generator's event for a stream, i.e. "btcusdt@bookTicker".
+        static string defaultEvent (const string& stream, const std::uint64_t sequence)
+        {
+            const auto at = stream.find('@');
+            const auto type = at == string::npos ? string{} : stream.substr(at + 1);
+
+            string symbol = stream.substr(0, at);
+            std::transform(symbol.begin(), symbol.end(), symbol.begin(), [](unsigned char c){ return std::toupper(c); });
+
+            const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            const auto id = static_cast<std::int64_t>(sequence);
+            const auto price = std::to_string(100 + static_cast<double>(sequence % 100) / 100.0);
+
+            json::object event;
+
+            if (type == "bookTicker")
+            {
+                event = json::object{{"e", "bookTicker"}, {"u", id}, {"E", now}, {"T", now}, {"s", symbol.c_str()},
+                                     {"b", price.c_str()}, {"B", "1.000"}, {"a", price.c_str()}, {"A", "1.000"}};
+            }
+            else if (type == "aggTrade")
+            {
+                event = json::object{{"e", "aggTrade"}, {"E", now}, {"a", id}, {"s", symbol.c_str()}, {"p", price.c_str()}, {"q", "0.010"},
+                                     {"f", id}, {"l", id}, {"T", now}, {"m", sequence % 2 == 0}};
+            }
+            else if (type.rfind("depth", 0) == 0)
+            {
+                // follows on from the previous event by the rules of both futures (pu) and SPOT (U)
+                event = json::object{{"e", "depthUpdate"}, {"E", now}, {"T", now}, {"s", symbol.c_str()}, {"U", id}, {"u", id}, {"pu", id - 1},
+                                     {"b", json::array{json::array{price.c_str(), "1.000"}}}, {"a", json::array{}}};
+            }
+            else if (type.rfind("markPrice", 0) == 0)
+            {
+                event = json::object{{"e", "markPriceUpdate"}, {"E", now}, {"s", symbol.c_str()}, {"p", price.c_str()}, {"r", "0.00010000"}};
+            }
+            else
+                event = json::object{{"e", "mock"}, {"E", now}, {"s", symbol.c_str()}, {"n", id}};
+
+            return json::serialize(event);
+        }
+
+
+    private:
+        class WsSession;
+
+
+        /// Reads the first request, then either serves REST requests or upgrades to a WsSession.
+        class Connection : public std::enable_shared_from_this<Connection>
+        {
+        public:
+            Connection (MockServer& server, tcp::socket&& socket) : m_server(server), m_stream(std::move(socket), server.m_sslCtx)
+            {
+            }
+
+
+            void run()
+            {
+                net::dispatch(m_stream.get_executor(), beast::bind_front_handler(&Connection::on_run, shared_from_this()));
+            }
+
+
+        private:
+            void on_run()
+            {
+                beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(30));
+                m_stream.async_handshake(ssl::stream_base::server, beast::bind_front_handler(&Connection::on_handshake, shared_from_this()));
+            }
+
+
+            void on_handshake (beast::error_code ec)
+            {
+                if (!ec)
+                    read();
+            }
+
+
+            void read()
+            {
+                m_req = {};
+                beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(30));
+                http::async_read(m_stream, m_buffer, m_req, beast::bind_front_handler(&Connection::on_read, shared_from_this()));
+            }
+
+
+            void on_read (beast::error_code ec, std::size_t)
+            {
+                if (ec == http::error::end_of_stream)
+                    return shutdown();
+                else if (ec)
+                    return;
+
+                if (websocket::is_upgrade(m_req))
+                {
+                    beast::get_lowest_layer(m_stream).expires_never();
+                    std::make_shared<WsSession>(m_server, std::move(m_stream))->run(std::move(m_req));
+                    return;
+                }
+
+                const auto response = m_server.handleRest(m_req);
+
+                m_res = {};
+                m_res.version(m_req.version());
+                m_res.keep_alive(m_req.keep_alive());
+                m_res.result(response.status);
+                m_res.set(http::field::content_type, "application/json");
+                m_res.body() = response.body;
+                m_res.prepare_payload();
+
+                if (m_server.m_config.restLatency.count() > 0)
+                {
+                    m_timer = std::make_unique<net::steady_timer>(m_stream.get_executor(), m_server.m_config.restLatency);
+                    m_timer->async_wait([self = shared_from_this()](beast::error_code){ self->write(); });
+                }
+                else
+                    write();
+            }
+
+
+            void write()
+            {
+                http::async_write(m_stream, m_res, beast::bind_front_handler(&Connection::on_write, shared_from_this()));
+            }
+
+
+            void on_write (beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return;
+                else if (!m_res.keep_alive())
+                    return shutdown();
+
+                read();
+            }
+
+
+            void shutdown()
+            {
+                m_stream.async_shutdown([self = shared_from_this()](beast::error_code){});
+            }
+
+
+        private:
+            MockServer& m_server;
+            beast::ssl_stream<beast::tcp_stream> m_stream;
+            beast::flat_buffer m_buffer;
+            http::request<http::string_body> m_req;
+            http::response<http::string_body> m_res;
+            std::unique_ptr<net::steady_timer> m_timer;
+        };
+
+
+        class WsSession : public std::enable_shared_from_this<WsSession>
+        {
+        public:
+            WsSession (MockServer& server, beast::ssl_stream<beast::tcp_stream>&& stream) :
+                m_server(server),
+                m_ws(std::move(stream)),
+                m_timer(m_ws.get_executor())
+            {
+            }
+
+
+            ~WsSession()
+            {
+                m_server.removeSession(this);
+            }
+
+
+            void run (http::request<http::string_body>&& req)
+            {
+                const auto target = string{req.target()};
+
+                if (target.rfind("/stream", 0) == 0)
+                {
+                    m_combined = true;
+
+                    if (const auto query = target.find("streams="); query != string::npos)
+                        addStreams(target.substr(query + 8));
+                }
+                else if (target.rfind("/ws/", 0) == 0)
+                    addStreams(target.substr(4));
+                else if (target.rfind("/ws-fapi/v1", 0) == 0)
+                    m_apiPrefix = "/fapi/v1";
+                else if (target.rfind("/ws-dapi/v1", 0) == 0)
+                    m_apiPrefix = "/dapi/v1";
+                else if (target.rfind("/ws-api/v3", 0) == 0)
+                    m_apiPrefix = "/api/v3";
+
+                m_ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+                m_ws.async_accept(req, beast::bind_front_handler(&WsSession::on_accept, shared_from_this()));
+            }
+
+
+            void publish (const string& stream, const string& event)
+            {
+                net::post(m_ws.get_executor(), [self = shared_from_this(), stream, event]()
+                {
+                    if (self->m_accepted && self->m_streams.count(stream))
+                        self->send(stream, event);
+                });
+            }
+
+
+            void disconnect()
+            {
+                net::post(m_ws.get_executor(), [self = shared_from_this()]()
+                {
+                    self->close();
+                });
+            }
+
+
+        private:
+            void addStreams (const string& streams)
+            {
+                size_t start = 0;
+
+                while (start < streams.size())
+                {
+                    auto end = streams.find('/', start);
+                    if (end == string::npos)
+                        end = streams.size();
+
+                    if (end > start)
+                        m_streams.insert(streams.substr(start, end - start));
+
+                    start = end + 1;
+                }
+            }
+
+
+            void on_accept (beast::error_code ec)
+            {
+                if (ec)
+                    return;
+
+                m_accepted = true;
+                m_server.m_wsConnections.fetch_add(1, std::memory_order_relaxed);
+                m_server.addSession(shared_from_this());
+
+                read();
+
+                if (m_server.m_config.messagesPerSecond > 0)
+                {
+                    m_start = std::chrono::steady_clock::now();
+                    m_nextTick = m_start;
+                    tick();
+                }
+            }
+
+
+            void read()
+            {
+                m_ws.async_read(m_buffer, beast::bind_front_handler(&WsSession::on_read, shared_from_this()));
+            }
+
+
+            void on_read (beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return close();
+
+                json::error_code jsonEc;
+                auto value = json::parse(beast::buffers_to_string(m_buffer.data()), jsonEc);
+                m_buffer.consume(m_buffer.size());
+
+                json::object reply;
+
+                if (auto request = value.if_object(); !jsonEc && request && request->if_contains("method") && !m_apiPrefix.empty())
+                {
+                    reply = m_server.handleWsApi(m_apiPrefix, *request, m_apiKey);
+
+                    if (m_server.m_config.restLatency.count() > 0)
+                    {
+                        auto timer = std::make_shared<net::steady_timer>(m_ws.get_executor(), m_server.m_config.restLatency);
+
+                        timer->async_wait([self = shared_from_this(), timer, msg = json::serialize(reply)](beast::error_code) mutable
+                        {
+                            self->queue(std::move(msg));
+                        });
+
+                        return read();
+                    }
+                }
+                else if (auto request = value.if_object(); !jsonEc && request && request->if_contains("method"))
+                {
+                    reply["id"] = request->if_contains("id") ? request->at("id") : json::value{};
+
+                    // value_to<string>() throws for other types, which would end this io thread
+                    const auto method = request->at("method").is_string() ? json::value_to<string>(request->at("method")) : string{};
+                    const auto params = request->if_contains("params") ? request->at("params").if_array() : nullptr;
+                    const bool streamParams = params && std::all_of(params->begin(), params->end(), [](const json::value& param) { return param.is_string(); });
+
+                    if ((method == "SUBSCRIBE" || method == "UNSUBSCRIBE") && !streamParams)
+                        reply["error"] = json::object{{"code", 2}, {"msg", "Invalid request: params must be stream names"}};
+                    else if (method == "SUBSCRIBE")
+                    {
+                        for (auto& stream : *params)
+                            m_streams.insert(json::value_to<string>(stream));
+
+                        reply["result"] = nullptr;
+                    }
+                    else if (method == "UNSUBSCRIBE")
+                    {
+                        for (auto& stream : *params)
+                            m_streams.erase(json::value_to<string>(stream));
+
+                        reply["result"] = nullptr;
+                    }
+                    else if (method == "LIST_SUBSCRIPTIONS")
+                    {
+                        json::array streams;
+                        for (auto& stream : m_streams)
+                            streams.emplace_back(stream.c_str());
+
+                        reply["result"] = std::move(streams);
+                    }
+                    else
+                        reply["error"] = json::object{{"code", 2}, {"msg", "Invalid request"}};
+                }
+                else
+                    reply["error"] = json::object{{"code", 3}, {"msg", "Invalid JSON"}};
+
+                queue(json::serialize(reply));
+                read();
+            }
+
+
+            /// Generate the messages due since the last tick, at least 1ms apart so high rates are sent in batches.
+            void tick()
+            {
+                using namespace std::chrono;
+
+                const auto rate = m_server.m_config.messagesPerSecond;
+                const auto elapsed = duration<double>(steady_clock::now() - m_start).count();
+                const auto due = static_cast<std::uint64_t>(elapsed * rate) + 1;
+
+                for ( ; m_generated < due && m_open ; ++m_generated)
+                {
+                    for (auto& stream : m_streams)
+                    {
+                        if (m_writeQueue.size() >= m_server.m_config.maxQueuedMessages)
+                            m_server.m_wsDropped.fetch_add(1, std::memory_order_relaxed);
+                        else
+                            send(stream, m_server.m_generator(stream, m_generated + 1));
+                    }
+                }
+
+                if (!m_open)
+                    return;
+
+                m_nextTick += std::max<steady_clock::duration>(duration_cast<steady_clock::duration>(duration<double>{1.0 / rate}), milliseconds{1});
+                m_timer.expires_at(m_nextTick);
+                m_timer.async_wait([self = shared_from_this()](beast::error_code ec)
+                {
+                    if (!ec)
+                        self->tick();
+                });
+            }
+
+
+            void send (const string& stream, const string& event)
+            {
+                if (m_combined)
+                    queue(R"({"stream":")" + stream + R"(","data":)" + event + "}");
+                else
+                    queue(event);
+
+                m_server.m_wsMessages.fetch_add(1, std::memory_order_relaxed);
+
+                if (const auto after = m_server.m_config.disconnectAfter; after && ++m_sent >= after)
+                    close();
+            }
+
+
+            void queue (string msg)
+            {
+                if (!m_open)
+                    return;
+
+                m_writeQueue.emplace_back(std::move(msg));
+
+                if (m_writeQueue.size() == 1)
+                    write();
+            }
+
+
+            void write()
+            {
+                m_ws.async_write(net::buffer(m_writeQueue.front()), beast::bind_front_handler(&WsSession::on_write, shared_from_this()));
+            }
+
+
+            void on_write (beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return close();
+
+                m_writeQueue.pop_front();
+
+                if (!m_writeQueue.empty() && m_open)
+                    write();
+            }
+
+
+            /// Close the socket without a websocket close, outstanding operations complete with an error.
+            void close()
+            {
+                if (!m_open)
+                    return;
+
+                m_open = false;
+                m_timer.cancel();
+
+                beast::error_code ec;
+                beast::get_lowest_layer(m_ws).socket().shutdown(tcp::socket::shutdown_both, ec);
+                beast::get_lowest_layer(m_ws).socket().close(ec);
+            }
+
+
+        private:
+            MockServer& m_server;
+            websocket::stream<beast::ssl_stream<beast::tcp_stream>> m_ws;
+            net::steady_timer m_timer;
+            beast::flat_buffer m_buffer;
+            std::set<string> m_streams;
+            string m_apiPrefix;                         // REST path prefix of the websocket API's endpoints, empty if not the websocket API
+            string m_apiKey;                            // after a websocket API session.logon
+            std::deque<string> m_writeQueue;
+            std::chrono::steady_clock::time_point m_start;
+            std::chrono::steady_clock::time_point m_nextTick;
+            std::uint64_t m_generated = 0;
+            std::uint64_t m_sent = 0;
+            bool m_combined = false;
+            bool m_accepted = false;
+            bool m_open = true;
+        };
+
+
+        void accept()
+        {
+            m_acceptor.async_accept(net::make_strand(*m_ioc), [this](beast::error_code ec, tcp::socket socket)
+            {
+                if (!ec)
+                {
+                    socket.set_option(tcp::no_delay(true), ec);
+                    std::make_shared<Connection>(*this, std::move(socket))->run();
+                }
+
+                if (m_acceptor.is_open())
+                    accept();
+            });
+        }
+
+
+        MockRestResponse handleRest (const http::request<http::string_body>& req)
+        {
+            const auto count = m_restRequests.fetch_add(1, std::memory_order_relaxed) + 1;
+
+            if (m_config.restFailEvery && count % m_config.restFailEvery == 0)
+                return MockRestResponse::error(-1003, "Too many requests.", http::status::too_many_requests);
+
+            MockRestRequest request;
+            request.method = req.method();
+            request.body = req.body();
+
+            if (auto key = req.find("X-MBX-APIKEY"); key != req.end())
+                request.apiKey = string{key->value()};
+
+            const auto target = string{req.target()};
+            const auto query = target.find('?');
+
+            request.path = target.substr(0, query);
+
+            if (query != string::npos)
+            {
+                for (size_t start = query + 1 ; start < target.size() ; )
+                {
+                    auto end = target.find('&', start);
+                    if (end == string::npos)
+                        end = target.size();
+
+                    if (const auto param = target.substr(start, end - start); !param.empty())
+                    {
+                        const auto equals = param.find('=');
+                        request.params[param.substr(0, equals)] = equals == string::npos ? "" : param.substr(equals + 1);
+                    }
+
+                    start = end + 1;
+                }
+            }
+
+            return route(request);
+        }
+
+
+        MockRestResponse route (const MockRestRequest& request)
+        {
+            MockRestHandler handler;
+            {
+                std::scoped_lock lock (m_routesMux);
+
+                if (auto it = m_routes.find({request.method, request.path}); it != m_routes.end())
+                    handler = it->second;
+            }
+
+            return handler ? handler(request) : MockRestResponse::error(-1, "Not found.", http::status::not_found);
+        }
+
+
+        /// A websocket API request, routed to the equivalent REST handler. The reply has the REST handler's body as the
+        /// "result", or as the "error" if the status is not 200 OK. sessionApiKey is the connection's, set by session.logon.
+        json::object handleWsApi (const string& prefix, const json::object& request, string& sessionApiKey)
+        {
+            static const std::map<string, std::pair<http::verb, string>> Endpoints {{"order.place", {http::verb::post, "/order"}}, {"order.cancel", {http::verb::delete_, "/order"}},
+                                                                                   {"order.modify", {http::verb::put, "/order"}}, {"order.status", {http::verb::get, "/order"}},
+                                                                                   {"ping", {http::verb::get, "/ping"}}, {"time", {http::verb::get, "/time"}}};
+
+            m_wsApiRequests.fetch_add(1, std::memory_order_relaxed);
+
+            json::object reply;
+            reply["id"] = request.if_contains("id") ? request.at("id") : json::value{};
+
+            const auto method = request.at("method").is_string() ? json::value_to<string>(request.at("method")) : string{};
+            const auto endpoint = Endpoints.find(method);
+
+            if (endpoint == Endpoints.end() && method != "session.logon")
+            {
+                reply["status"] = 400;
+                reply["error"] = json::object{{"code", -1100}, {"msg", "Unknown method."}};
+                return reply;
+            }
+
+            MockRestRequest rest;
+
+            if (auto params = request.if_contains("params") ? request.at("params").if_object() : nullptr)
+            {
+                for (auto& param : *params)
+                {
+                    auto value = param.value().is_string() ? json::value_to<string>(param.value()) : json::serialize(param.value());
+
+                    if (param.key() == "apiKey")
+                        rest.apiKey = std::move(value);
+                    else
+                        rest.params[string{param.key()}] = std::move(value);
+                }
+            }
+
+            if (method == "session.logon")
+            {
+                if (m_logonHandler && !m_logonHandler(rest))
+                {
+                    reply["status"] = 401;
+                    reply["error"] = json::object{{"code", -1022}, {"msg", "Signature for this request is not valid."}};
+                    return reply;
+                }
+
+                const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+                sessionApiKey = rest.apiKey;
+                reply["status"] = 200;
+                reply["result"] = json::object{{"apiKey", sessionApiKey.c_str()}, {"authorizedSince", now}, {"connectedSince", now}, {"returnRateLimits", false}, {"serverTime", now}};
+                return reply;
+            }
+
+            rest.method = endpoint->second.first;
+            rest.path = prefix + endpoint->second.second;
+
+            if (rest.apiKey.empty())
+                rest.apiKey = sessionApiKey;
+
+            const auto response = route(rest);
+
+            json::error_code ec;
+            auto body = json::parse(response.body, ec);
+
+            reply["status"] = static_cast<int>(response.status);
+            reply[response.status == http::status::ok ? "result" : "error"] = ec ? json::value{} : std::move(body);
+
+            return reply;
+        }
+
+
+        void addDefaultRoutes()
+        {
+            const auto empty = [](const MockRestRequest&) { return MockRestResponse{}; };
+
+            const auto time = [](const MockRestRequest&)
+            {
+                const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                return MockRestResponse{http::status::ok, json::serialize(json::object{{"serverTime", now}})};
+            };
+
+            const auto depth = [this](const MockRestRequest&)
+            {
+                json::object depth {{"lastUpdateId", static_cast<std::int64_t>(m_restRequests.load())}, {"bids", json::array{}}, {"asks", json::array{}}};
+                return MockRestResponse{http::status::ok, json::serialize(depth)};
+            };
+
+            const auto order = [this](const MockRestRequest& request)
+            {
+                const auto param = [&request](const string& name) { auto it = request.params.find(name); return it == request.params.end() ? string{} : it->second; };
+
+                if (param("symbol").empty())
+                    return MockRestResponse::error(-1102, "Mandatory parameter 'symbol' was not sent, was empty/null, or malformed.");
+
+                const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+                json::object ack {{"orderId", static_cast<std::int64_t>(m_nextOrderId.fetch_add(1))}, {"symbol", param("symbol").c_str()}, {"status", "NEW"},
+                                  {"clientOrderId", param("newClientOrderId").c_str()}, {"side", param("side").c_str()}, {"type", param("type").c_str()},
+                                  {"origQty", param("quantity").c_str()}, {"price", param("price").c_str()}, {"updateTime", now}};
+
+                return MockRestResponse{http::status::ok, json::serialize(ack)};
+            };
+
+            // cancel and modify reply with the order, as far as the request says
+            const auto changeOrder = [](const string status)
+            {
+                return [status](const MockRestRequest& request)
+                {
+                    const auto param = [&request](const string& name) { auto it = request.params.find(name); return it == request.params.end() ? string{} : it->second; };
+
+                    if (param("symbol").empty())
+                        return MockRestResponse::error(-1102, "Mandatory parameter 'symbol' was not sent, was empty/null, or malformed.");
+
+                    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    const std::int64_t orderId = param("orderId").empty() ? 0 : std::stoll(param("orderId"));
+
+                    json::object order {{"orderId", orderId}, {"symbol", param("symbol").c_str()}, {"status", status.c_str()},
+                                        {"clientOrderId", param("origClientOrderId").c_str()}, {"updateTime", now}};
+
+                    return MockRestResponse{http::status::ok, json::serialize(order)};
+                };
+            };
+
+            const auto listenKey = [](const MockRestRequest&) { return MockRestResponse{http::status::ok, R"({"listenKey":"mocklistenkey"})"}; };
+
+            for (const string prefix : {"/fapi/v1", "/dapi/v1", "/api/v3"})
+            {
+                setRestHandler(http::verb::get, prefix + "/ping", empty);
+                setRestHandler(http::verb::get, prefix + "/time", time);
+                setRestHandler(http::verb::get, prefix + "/depth", depth);
+                setRestHandler(http::verb::post, prefix + "/order", order);
+                setRestHandler(http::verb::delete_, prefix + "/order", changeOrder("CANCELED"));
+                setRestHandler(http::verb::put, prefix + "/order", changeOrder("NEW"));
+            }
+
+            for (const string path : {"/fapi/v1/listenKey", "/dapi/v1/listenKey", "/api/v3/userDataStream"})
+            {
+                setRestHandler(http::verb::post, path, listenKey);
+                setRestHandler(http::verb::put, path, empty);
+                setRestHandler(http::verb::delete_, path, empty);
+            }
+        }
+
+
+        static void makeCertificate (ssl::context& ctx)
+        {
+            std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> keyCtx {EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr), &EVP_PKEY_CTX_free};
+            EVP_PKEY * rawKey = nullptr;
+
+            if (!keyCtx || EVP_PKEY_keygen_init(keyCtx.get()) <= 0 || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyCtx.get(), NID_X9_62_prime256v1) <= 0 ||
+                EVP_PKEY_keygen(keyCtx.get(), &rawKey) <= 0)
+            {
+                throw std::runtime_error("mock server failed to create key");
+            }
+
+            std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key {rawKey, &EVP_PKEY_free};
+            std::unique_ptr<X509, decltype(&X509_free)> cert {X509_new(), &X509_free};
+
+            ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+            X509_gmtime_adj(X509_getm_notAfter(cert.get()), 365L * 24 * 60 * 60);
+            X509_set_pubkey(cert.get(), key.get());
+
+            auto name = X509_get_subject_name(cert.get());
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+            X509_set_issuer_name(cert.get(), name);
+
+            if (!X509_sign(cert.get(), key.get(), EVP_sha256()) ||
+                SSL_CTX_use_certificate(ctx.native_handle(), cert.get()) != 1 ||
+                SSL_CTX_use_PrivateKey(ctx.native_handle(), key.get()) != 1)
+            {
+                throw std::runtime_error("mock server failed to create certificate");
+            }
+        }
+
+
+        void addSession (const std::shared_ptr<WsSession>& session)
+        {
+            std::scoped_lock lock (m_sessionsMux);
+            m_sessions[session.get()] = session;
+        }
+
+
+        void removeSession (WsSession * session)
+        {
+            std::scoped_lock lock (m_sessionsMux);
+            m_sessions.erase(session);
+        }
+
+
+        std::vector<std::shared_ptr<WsSession>> sessions()
+        {
+            std::vector<std::shared_ptr<WsSession>> sessions;
+
+            std::scoped_lock lock (m_sessionsMux);
+
+            for (auto& [ptr, weak] : m_sessions)
+            {
+                if (auto session = weak.lock())
+                    sessions.emplace_back(std::move(session));
+            }
+
+            return sessions;
+        }
+
+
+    private:
+        MockServerConfig m_config;
+        std::mutex m_routesMux;
+        std::map<std::pair<http::verb, string>, MockRestHandler> m_routes;
+        MockStreamGenerator m_generator {&MockServer::defaultEvent};
+        MockLogonHandler m_logonHandler;
+        std::mutex m_sessionsMux;
+        std::map<WsSession *, std::weak_ptr<WsSession>> m_sessions;
+        std::atomic_uint64_t m_restRequests {0};
+        std::atomic_uint64_t m_wsConnections {0};
+        std::atomic_uint64_t m_wsMessages {0};
+        std::atomic_uint64_t m_wsDropped {0};
+        std::atomic_uint64_t m_wsApiRequests {0};
+        std::atomic_uint64_t m_nextOrderId {1};
+        ssl::context m_sslCtx;
+        std::unique_ptr<net::io_context> m_ioc;     // after what the sessions use, they're destroyed with the io_context
+        tcp::acceptor m_acceptor;
+        unsigned short m_port = 0;
+        std::vector<std::thread> m_threads;
+    };
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include "BinanceMockServer.h"
+#include <csignal>
+#include <iostream>
+
+
+using namespace bblib;
+
+
+///
+/// Runs the mock server standalone, for load tests and benchmarks from other processes or machines.
+/// Connect with ConnectionConfig::MakeMockConfig(market, port).
+///
+
+
+namespace
+{
+    std::atomic_bool g_stop {false};
+}
+
+
+int main (int argc, char ** argv)
+{
+    MockServerConfig config;
+    config.address = argc > 1 ? argv[1] : "127.0.0.1";
+    config.port = argc > 2 ? static_cast<unsigned short>(std::stoul(argv[2])) : 0;
+    config.messagesPerSecond = argc > 3 ? std::stod(argv[3]) : 10;
+    config.restLatency = std::chrono::microseconds{argc > 4 ? std::stol(argv[4]) : 0};
+    config.threads = argc > 5 ? std::stoul(argv[5]) : 1;
+
+    std::cout << "Usage: " << argv[0] << " [address] [port] [messages per second per stream] [REST latency micros] [threads]\n\n";
+
+    std::signal(SIGINT, [](int){ g_stop = true; });
+    std::signal(SIGTERM, [](int){ g_stop = true; });
+
+    MockServer server {config};
+
+    std::cout << "Listening on " << config.address << ":" << server.port() << ", Ctrl+C to stop\n";
+
+    while (!g_stop)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds{5});
+
+        const auto stats = server.stats();
+        std::cout << "connections: " << server.connections() << " REST requests: " << stats.restRequests 
+                  << " ws messages: " << stats.wsMessages << " dropped: " << stats.wsDropped << "\n";
+    }
+
+    return 0;
+}
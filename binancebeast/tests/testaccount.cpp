@@ -0,0 +1,297 @@
+#include <binancebeast/BinanceAccount.h>
+#include <BinanceMockServer.h>
+#include "testcommon.h"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+namespace
+{
+    const auto AccountReply = json::parse(R"({"assets":[{"asset":"USDT","walletBalance":"100.5","crossWalletBalance":"100.5","updateTime":2000}],)"
+                                          R"("positions":[{"symbol":"BTCUSDT","positionSide":"BOTH","positionAmt":"0.5","entryPrice":"30000","unrealizedProfit":"10","isolated":false,"isolatedWallet":"0","updateTime":2000},)"
+                                          R"({"symbol":"ETHUSDT","positionSide":"BOTH","positionAmt":"0","entryPrice":"0","unrealizedProfit":"0","isolated":false,"isolatedWallet":"0","updateTime":0}]})");
+
+    const auto OpenOrdersReply = json::parse(R"([{"symbol":"BTCUSDT","clientOrderId":"a","orderId":1,"side":"BUY","positionSide":"BOTH","type":"LIMIT","timeInForce":"GTC",)"
+                                             R"("status":"NEW","price":"29000","stopPrice":"0","avgPrice":"0","origQty":"0.1","executedQty":"0","reduceOnly":false,"updateTime":2000}])");
+
+
+    WsResponse accountUpdate (const std::int64_t time, const string& walletBalance, const string& btcAmount)
+    {
+        return WsResponse{json::parse(R"({"e":"ACCOUNT_UPDATE","E":)" + std::to_string(time) + R"(,"T":)" + std::to_string(time) + R"(,"a":{"m":"ORDER",)"
+                                      R"("B":[{"a":"USDT","wb":")" + walletBalance + R"(","cw":")" + walletBalance + R"(","bc":"0"}],)"
+                                      R"("P":[{"s":"BTCUSDT","pa":")" + btcAmount + R"(","ep":"30000","cr":"0","up":"0","mt":"cross","iw":"0","ps":"BOTH"}]}})")};
+    }
+
+
+    WsResponse orderUpdate (const std::int64_t time, const std::int64_t orderId, const string& status, const string& filled = "0")
+    {
+        return WsResponse{json::parse(R"({"e":"ORDER_TRADE_UPDATE","E":)" + std::to_string(time) + R"(,"T":)" + std::to_string(time) + R"(,"o":{"s":"BTCUSDT","c":"c)" + std::to_string(orderId) + 
+                                      R"(","S":"BUY","o":"LIMIT","f":"GTC","q":"0.1","p":"29000","ap":"0","sp":"0","x":"NEW","X":")" + status + R"(","i":)" + std::to_string(orderId) + 
+                                      R"(,"l":"0","z":")" + filled + R"(","L":"0","T":)" + std::to_string(time) + R"(,"ps":"BOTH","R":false}})")};
+    }
+}
+
+
+TEST (AccountStateTest, bootstrap)
+{
+    AccountState account {Market::USDM};
+
+    EXPECT_FALSE(account.isBootstrapped());
+
+    account.bootstrap(AccountReply, OpenOrdersReply);
+
+    EXPECT_TRUE(account.isBootstrapped());
+    ASSERT_TRUE(account.balance("USDT"));
+    EXPECT_DOUBLE_EQ(account.balance("USDT")->walletBalance, 100.5);
+
+    // zero positions are not kept
+    ASSERT_TRUE(account.position("BTCUSDT"));
+    EXPECT_DOUBLE_EQ(account.position("BTCUSDT")->amount, 0.5);
+    EXPECT_FALSE(account.position("ETHUSDT"));
+
+    ASSERT_EQ(account.openOrders().size(), 1U);
+    EXPECT_EQ(account.order(1)->clientOrderId, "a");
+}
+
+
+TEST (AccountStateTest, events)
+{
+    AccountState account {Market::USDM};
+    account.bootstrap(AccountReply, OpenOrdersReply);
+
+    account.onUserData(accountUpdate(3000, "90.25", "0.75"));
+
+    EXPECT_DOUBLE_EQ(account.balance("USDT")->walletBalance, 90.25);
+    EXPECT_DOUBLE_EQ(account.position("BTCUSDT")->amount, 0.75);
+
+    // partially filled stays open, filled is removed, a new order is added
+    account.onUserData(orderUpdate(3001, 1, "PARTIALLY_FILLED", "0.05"));
+    EXPECT_DOUBLE_EQ(account.order(1)->filledQuantity, 0.05);
+
+    account.onUserData(orderUpdate(3002, 2, "NEW"));
+    account.onUserData(orderUpdate(3003, 1, "FILLED", "0.1"));
+
+    EXPECT_FALSE(account.order(1));
+    ASSERT_TRUE(account.order(2));
+    EXPECT_EQ(account.openOrders("BTCUSDT").size(), 1U);
+    EXPECT_TRUE(account.openOrders("ETHUSDT").empty());
+
+    // position closed
+    account.onUserData(accountUpdate(3004, "91", "0"));
+    EXPECT_FALSE(account.position("BTCUSDT"));
+
+    account.read([](const AccountSnapshot& snapshot)
+    {
+        EXPECT_EQ(snapshot.eventTime(), 3004);
+        EXPECT_FALSE(snapshot.isStale());
+    });
+
+    account.onUserData(WsResponse{json::parse(R"({"e":"listenKeyExpired","E":3005})")});
+    account.read([](const AccountSnapshot& snapshot) { EXPECT_TRUE(snapshot.isStale()); });
+}
+
+
+TEST (AccountStateTest, oldEventsIgnored)
+{
+    AccountState account {Market::USDM};
+    account.bootstrap(AccountReply, OpenOrdersReply);
+
+    // before the bootstrap's updateTime
+    account.onUserData(accountUpdate(1000, "1", "2"));
+    account.onUserData(orderUpdate(1000, 1, "CANCELED"));
+
+    EXPECT_DOUBLE_EQ(account.balance("USDT")->walletBalance, 100.5);
+    EXPECT_DOUBLE_EQ(account.position("BTCUSDT")->amount, 0.5);
+    EXPECT_TRUE(account.order(1));
+
+    // an order which is already done isn't added
+    account.onUserData(orderUpdate(3000, 5, "CANCELED"));
+    EXPECT_FALSE(account.order(5));
+}
+
+
+TEST (AccountStateTest, unchangedTablesShared)
+{
+    AccountState account {Market::USDM};
+    account.bootstrap(AccountReply, OpenOrdersReply);
+
+    const AccountSnapshot::Balances * balances = nullptr;
+    std::uint64_t version = 0;
+
+    account.read([&](const AccountSnapshot& snapshot)
+    {
+        balances = &snapshot.balances();
+        version = snapshot.version();
+    });
+
+    account.onUserData(orderUpdate(3000, 2, "NEW"));
+
+    account.read([&](const AccountSnapshot& snapshot)
+    {
+        EXPECT_EQ(&snapshot.balances(), balances);
+        EXPECT_EQ(snapshot.version(), version + 1);
+    });
+}
+
+
+TEST (AccountStateTest, concurrentReads)
+{
+    AccountState account {Market::USDM};
+    account.bootstrap(AccountReply, OpenOrdersReply);
+
+    std::atomic_bool stop {false};
+    std::atomic_size_t inconsistent {0};
+    std::vector<std::thread> readers;
+
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            std::uint64_t lastVersion = 0;
+
+            while (!stop)
+            {
+                account.read([&](const AccountSnapshot& snapshot)
+                {
+                    // the writer keeps the wallet balance and the position amount equal
+                    auto balance = snapshot.balances().find("USDT");
+                    auto position = snapshot.positions().find(AccountSnapshot::positionKey("BTCUSDT", "BOTH"));
+
+                    const bool consistent = snapshot.version() == 1 || (balance != snapshot.balances().end() && position != snapshot.positions().end() &&
+                                                                        balance->second.walletBalance == position->second.amount);
+
+                    if (!consistent || snapshot.version() < lastVersion)
+                        inconsistent.fetch_add(1);
+
+                    lastVersion = snapshot.version();
+                });
+            }
+        });
+    }
+
+    for (int i = 1 ; i <= 20000 ; ++i)
+        account.onUserData(accountUpdate(3000 + i, std::to_string(i), std::to_string(i)));
+
+    stop = true;
+
+    for (auto& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(inconsistent.load(), 0U);
+    EXPECT_DOUBLE_EQ(account.position("BTCUSDT")->amount, 20000);
+}
+
+
+TEST (AccountStateTest, bootstrapFromServer)
+{
+    // the exchange's clock is far behind the local clock, which bootstrap() shouldn't use
+    static constexpr std::int64_t ServerTime = 10'000'000;
+
+    MockServer server;
+    auto account = std::make_shared<AccountState>(Market::USDM);
+
+    server.setRestHandler(http::verb::get, "/fapi/v1/time", [](const MockRestRequest&)
+    {
+        return MockRestResponse{http::status::ok, json::serialize(json::object{{"serverTime", ServerTime}})};
+    });
+
+    server.setRestHandler(http::verb::get, "/fapi/v2/account", [account](const MockRestRequest&)
+    {
+        // received whilst bootstrapping: an order closed before the requests were sent, and one opened after
+        account->onUserData(orderUpdate(ServerTime - 60'000, 7, "NEW"));
+        account->onUserData(orderUpdate(ServerTime + 1'000, 8, "NEW"));
+
+        return MockRestResponse{http::status::ok, json::serialize(AccountReply)};
+    });
+
+    server.setRestHandler(http::verb::get, "/fapi/v1/openOrders", [](const MockRestRequest&)
+    {
+        return MockRestResponse{http::status::ok, json::serialize(OpenOrdersReply)};
+    });
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), 1, 1);
+
+    std::promise<string> done;
+
+    account->bootstrap(bb, [&done](const bool success, const string& failMessage)
+    {
+        done.set_value(success ? string{} : failMessage);
+    });
+
+    auto future = done.get_future();
+    ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(future.get(), "");
+
+    EXPECT_TRUE(account->isBootstrapped());
+    EXPECT_TRUE(account->order(1));
+    EXPECT_FALSE(account->order(7));
+    EXPECT_TRUE(account->order(8));
+
+}
+
+
+TEST (AccountStateTest, bootstrapRequiresSharedPtr)
+{
+    BinanceBeast bb;
+    AccountState account {Market::USDM};
+
+    EXPECT_THROW(account.bootstrap(bb), std::runtime_error);
+}
+
+
+TEST (AccountStateTest, destroyedDuringBootstrap)
+{
+    MockServer server;
+    std::promise<void> destroyed;
+    auto destroyedFuture = destroyed.get_future().share();
+    std::promise<void> replied;
+
+    server.setRestHandler(http::verb::get, "/fapi/v2/account", [destroyedFuture, &replied](const MockRestRequest&)
+    {
+        destroyedFuture.wait_for(5s);
+        replied.set_value();
+        return MockRestResponse{http::status::ok, json::serialize(AccountReply)};
+    });
+
+    server.setRestHandler(http::verb::get, "/fapi/v1/openOrders", [destroyedFuture](const MockRestRequest&)
+    {
+        destroyedFuture.wait_for(5s);
+        return MockRestResponse{http::status::ok, json::serialize(OpenOrdersReply)};
+    });
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), 1, 1);
+
+    std::atomic_bool handlerCalled {false};
+
+    auto account = std::make_shared<AccountState>(Market::USDM);
+    account->bootstrap(bb, [&handlerCalled](const bool, const string&) { handlerCalled = true; });
+
+    std::weak_ptr<AccountState> weak = account;
+    account.reset();
+    EXPECT_TRUE(weak.expired());
+
+    destroyed.set_value();
+    ASSERT_EQ(replied.get_future().wait_for(5s), std::future_status::ready);
+
+    // the replies are dropped rather than applied to the destroyed AccountState
+    std::this_thread::sleep_for(200ms);
+    EXPECT_FALSE(handlerCalled);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Account State\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// These test FeedArbiter de-duplication without a network connection, the legs are simulated.
+class ArbiterTest : public testing::Test
+{
+protected:
+    ArbiterTest() : m_arbiter([this](WsResponse) { ++m_delivered; }, 2)
+    {
+    }
+
+
+    void receive(const size_t leg, const string& frame)
+    {
+        m_arbiter.onReceive(leg, WsResponse{json::parse(frame)});
+    }
+
+
+    bool waitDelivered(const size_t expected)
+    {
+        for (int i = 0 ; i < 100 && m_delivered.load() != expected ; ++i)
+            std::this_thread::sleep_for(10ms);
+
+        return m_delivered.load() == expected;
+    }
+
+
+protected:
+    std::atomic_size_t m_delivered {0};
+    FeedArbiter m_arbiter;
+};
+
+
+TEST_F(ArbiterTest, firstLegWins)
+{
+    receive(0, R"({"stream":"btcusdt@bookTicker","data":{"e":"bookTicker","u":100,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@bookTicker","data":{"e":"bookTicker","u":100,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@bookTicker","data":{"e":"bookTicker","u":101,"s":"BTCUSDT"}})");
+    receive(0, R"({"stream":"btcusdt@bookTicker","data":{"e":"bookTicker","u":101,"s":"BTCUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(2));
+
+    auto stats = m_arbiter.stats();
+    ASSERT_EQ(stats.legs.size(), 2U);
+    EXPECT_EQ(stats.delivered, 2U);
+    EXPECT_EQ(stats.legs[0].wins, 1U);
+    EXPECT_EQ(stats.legs[1].wins, 1U);
+    EXPECT_EQ(stats.legs[0].duplicates, 1U);
+    EXPECT_EQ(stats.legs[1].duplicates, 1U);
+    EXPECT_EQ(stats.legs[0].advantageSamples, 1U);
+    EXPECT_EQ(stats.legs[1].advantageSamples, 1U);
+}
+
+
+TEST_F(ArbiterTest, staleEventDropped)
+{
+    receive(0, R"({"stream":"btcusdt@aggTrade","data":{"e":"aggTrade","a":5,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@aggTrade","data":{"e":"aggTrade","a":4,"s":"BTCUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(1));
+    EXPECT_EQ(m_arbiter.stats().legs[1].stale, 1U);
+}
+
+
+TEST_F(ArbiterTest, keyedPerSymbol)
+{
+    receive(0, R"({"stream":"!bookTicker","data":{"e":"bookTicker","u":7,"s":"BTCUSDT"}})");
+    receive(0, R"({"stream":"!bookTicker","data":{"e":"bookTicker","u":7,"s":"ETHUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(2));
+}
+
+
+TEST_F(ArbiterTest, tradesInSameMillisecond)
+{
+    // same "E", different trade ids
+    receive(0, R"({"stream":"btcusdt@trade","data":{"e":"trade","E":1000,"t":1,"s":"BTCUSDT"}})");
+    receive(0, R"({"stream":"btcusdt@trade","data":{"e":"trade","E":1000,"t":2,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@trade","data":{"e":"trade","E":1000,"t":2,"s":"BTCUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(2));
+    EXPECT_EQ(m_arbiter.stats().legs[1].duplicates, 1U);
+}
+
+
+TEST_F(ArbiterTest, eventTimeNotAnId)
+{
+    receive(0, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":1000,"s":"BTCUSDT"}})");
+    receive(0, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":1000,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":1000,"s":"BTCUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(2));
+    EXPECT_EQ(m_arbiter.stats().unkeyed, 2U);
+}
+
+
+TEST_F(ArbiterTest, unkeyedOnlyFromFirstLeg)
+{
+    receive(0, R"({"result":null,"id":1})");
+    receive(1, R"({"result":null,"id":1})");
+
+    EXPECT_TRUE(waitDelivered(1));
+    EXPECT_EQ(m_arbiter.stats().unkeyed, 1U);
+}
+
+
+TEST_F(ArbiterTest, unkeyedFailOver)
+{
+    receive(0, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":1000,"s":"BTCUSDT"}})");
+    receive(1, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":1000,"s":"BTCUSDT"}})");
+
+    // the failure is delivered, then leg 1 delivers the unkeyed events
+    m_arbiter.onFailure(0, WsResponse{string_view{"read: connection reset"}});
+    receive(1, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":2000,"s":"BTCUSDT"}})");
+    receive(0, R"({"stream":"btcusdt@markPrice","data":{"e":"markPriceUpdate","E":2000,"s":"BTCUSDT"}})");
+
+    EXPECT_TRUE(waitDelivered(3));
+
+    auto stats = m_arbiter.stats();
+    EXPECT_EQ(stats.unkeyed, 2U);
+    EXPECT_FALSE(stats.legs[0].connected);
+    EXPECT_TRUE(stats.legs[1].connected);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Feed Arbiter\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();    
+}
@@ -62,5 +62,43 @@ namespace bblib_test
     }
 
 
+    /// A new Ed25519 private key, as PEM.
+    std::string makeEd25519Pem()
+    {
+        // not EVP_PKEY_Q_keygen(), which is OpenSSL 3 only
+        std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> keyCtx {EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr), &EVP_PKEY_CTX_free};
+        EVP_PKEY * rawKey = nullptr;
+
+        if (!keyCtx || EVP_PKEY_keygen_init(keyCtx.get()) <= 0 || EVP_PKEY_keygen(keyCtx.get(), &rawKey) <= 0)
+            throw std::runtime_error("failed to create Ed25519 key");
+
+        std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key {rawKey, &EVP_PKEY_free};
+        std::unique_ptr<BIO, decltype(&BIO_free)> bio {BIO_new(BIO_s_mem()), &BIO_free};
+
+        if (!bio || PEM_write_bio_PrivateKey(bio.get(), key.get(), nullptr, nullptr, 0, nullptr, nullptr) != 1)
+            throw std::runtime_error("failed to create Ed25519 key");
+
+        char * data = nullptr;
+        const auto size = BIO_get_mem_data(bio.get(), &data);
+        return std::string(data, static_cast<size_t>(size));
+    }
+
+
+    /// Verify a base64 Ed25519 signature with the PEM public key.
+    bool verifyEd25519 (const std::string& publicKeyPem, const std::string& data, const std::string& signature)
+    {
+        std::unique_ptr<BIO, decltype(&BIO_free)> bio {BIO_new_mem_buf(publicKeyPem.data(), static_cast<int>(publicKeyPem.size())), &BIO_free};
+        std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key {PEM_read_bio_PUBKEY(bio.get(), nullptr, nullptr, nullptr), &EVP_PKEY_free};
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx {EVP_MD_CTX_new(), &EVP_MD_CTX_free};
+
+        unsigned char decoded [66];
+
+        if (!key || signature.size() != 88 || EVP_DecodeBlock(decoded, reinterpret_cast<const unsigned char *>(signature.data()), 88) != 66)
+            return false;
+
+        // 64 bytes, the decoded block has 2 bytes of padding
+        return EVP_DigestVerifyInit(ctx.get(), nullptr, nullptr, nullptr, key.get()) == 1 &&
+               EVP_DigestVerify(ctx.get(), decoded, 64, reinterpret_cast<const unsigned char *>(data.data()), data.size()) == 1;
+    }
 }
 #endif
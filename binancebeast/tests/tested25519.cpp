@@ -0,0 +1,55 @@
+#include <binancebeast/BinanceEd25519.h>
+#include "testcommon.h"
+#include <openssl/rsa.h>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+TEST (Ed25519Test, signVerifies)
+{
+    auto key = Ed25519Key::fromPem(makeEd25519Pem());
+
+    const std::string payload {"apiKey=mockapikey&timestamp=1700000000000"};
+    const auto signature = key->sign(payload);
+
+    // 64 bytes, base64
+    EXPECT_EQ(signature.size(), 88U);
+    EXPECT_TRUE(verifyEd25519(key->publicKeyPem(), payload, signature));
+    EXPECT_FALSE(verifyEd25519(key->publicKeyPem(), payload + "1", signature));
+
+    // Ed25519 is deterministic
+    EXPECT_EQ(key->sign(payload), signature);
+}
+
+
+TEST (Ed25519Test, otherKeysRejected)
+{
+    EXPECT_THROW(Ed25519Key::fromPem("not a key"), std::runtime_error);
+    EXPECT_THROW(Ed25519Key::fromFile("/nonexistent/private.pem"), std::runtime_error);
+
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> keyCtx {EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr), &EVP_PKEY_CTX_free};
+    EVP_PKEY * rawKey = nullptr;
+
+    ASSERT_TRUE(keyCtx && EVP_PKEY_keygen_init(keyCtx.get()) > 0 && EVP_PKEY_CTX_set_rsa_keygen_bits(keyCtx.get(), 2048) > 0 && EVP_PKEY_keygen(keyCtx.get(), &rawKey) > 0);
+
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> rsa {rawKey, &EVP_PKEY_free};
+    std::unique_ptr<BIO, decltype(&BIO_free)> bio {BIO_new(BIO_s_mem()), &BIO_free};
+    ASSERT_EQ(PEM_write_bio_PrivateKey(bio.get(), rsa.get(), nullptr, nullptr, 0, nullptr, nullptr), 1);
+
+    char * data = nullptr;
+    const auto size = BIO_get_mem_data(bio.get(), &data);
+
+    EXPECT_THROW(Ed25519Key::fromPem(std::string(data, static_cast<size_t>(size))), std::runtime_error);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Ed25519\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// These test KlineBuilder without a network connection, trades are added directly.
+class KlinesTest : public testing::Test
+{
+protected:
+    KlinesTest() : m_builder({1min, 5min}, [this](const string&, const KlineBuilder::Interval interval, const Kline& kline)
+    {
+        if (interval == 1min)
+            m_closed1m.push_back(kline);
+        else
+            m_closed5m.push_back(kline);
+    })
+    {
+    }
+
+
+    static constexpr std::int64_t Minute = 60000;
+    static constexpr std::int64_t Start = 1640995200000;     // 2022-01-01 00:00:00 UTC
+
+
+protected:
+    KlineBuilder m_builder;
+    std::vector<Kline> m_closed1m;
+    std::vector<Kline> m_closed5m;
+};
+
+
+TEST_F (KlinesTest, parseInterval)
+{
+    EXPECT_EQ(KlineBuilder::parseInterval("1m"), 1min);
+    EXPECT_EQ(KlineBuilder::parseInterval("15m"), 15min);
+    EXPECT_EQ(KlineBuilder::parseInterval("4h"), 4h);
+    EXPECT_EQ(KlineBuilder::parseInterval("1w"), 168h);
+    EXPECT_THROW(KlineBuilder::parseInterval("1M"), std::runtime_error);
+    EXPECT_THROW(KlineBuilder::parseInterval("m"), std::runtime_error);
+}
+
+
+TEST_F (KlinesTest, candle)
+{
+    m_builder.addTrade("BTCUSDT", Start + 1000, 100.0, 1.0, false);
+    m_builder.addTrade("BTCUSDT", Start + 2000, 105.0, 2.0, true);
+    m_builder.addTrade("BTCUSDT", Start + 3000, 95.0, 1.0, false, 3);
+    m_builder.addTrade("BTCUSDT", Start + 4000, 101.0, 1.0, true);
+
+    EXPECT_TRUE(m_closed1m.empty());
+
+    auto current = m_builder.current("BTCUSDT", 1min);
+    ASSERT_NE(current, nullptr);
+    EXPECT_EQ(current->openTime, Start);
+    EXPECT_EQ(current->closeTime, Start + Minute - 1);
+    EXPECT_DOUBLE_EQ(current->open, 100.0);
+    EXPECT_DOUBLE_EQ(current->high, 105.0);
+    EXPECT_DOUBLE_EQ(current->low, 95.0);
+    EXPECT_DOUBLE_EQ(current->close, 101.0);
+    EXPECT_DOUBLE_EQ(current->volume, 5.0);
+    EXPECT_DOUBLE_EQ(current->quoteVolume, 100.0 + 210.0 + 95.0 + 101.0);
+    EXPECT_DOUBLE_EQ(current->takerBuyVolume, 2.0);
+    EXPECT_EQ(current->trades, 6U);
+    EXPECT_FALSE(current->closed);
+}
+
+
+TEST_F (KlinesTest, closeAndGaps)
+{
+    m_builder.addTrade("BTCUSDT", Start + 1000, 100.0, 1.0, false);
+    m_builder.addTrade("BTCUSDT", Start + 3 * Minute + 1000, 110.0, 1.0, false);    // minutes 1 and 2 have no trades
+
+    ASSERT_EQ(m_closed1m.size(), 3U);
+    EXPECT_TRUE(m_closed1m[0].closed);
+    EXPECT_EQ(m_closed1m[0].openTime, Start);
+    EXPECT_EQ(m_closed1m[1].openTime, Start + Minute);
+    EXPECT_EQ(m_closed1m[1].trades, 0U);
+    EXPECT_DOUBLE_EQ(m_closed1m[1].open, 100.0);
+    EXPECT_DOUBLE_EQ(m_closed1m[2].close, 100.0);
+
+    // 5m candle still open
+    EXPECT_TRUE(m_closed5m.empty());
+    EXPECT_EQ(m_builder.current("BTCUSDT", 5min)->trades, 2U);
+
+    // new candle opens at the first trade's price
+    EXPECT_DOUBLE_EQ(m_builder.current("BTCUSDT", 1min)->open, 110.0);
+
+    m_builder.advance(Start + 5 * Minute);
+
+    ASSERT_EQ(m_closed5m.size(), 1U);
+    EXPECT_DOUBLE_EQ(m_closed5m[0].high, 110.0);
+    EXPECT_EQ(m_closed1m.size(), 5U);
+    EXPECT_EQ(m_builder.history("BTCUSDT", 1min).size(), 5U);
+    EXPECT_EQ(m_builder.history("BTCUSDT", 1min).back().openTime, Start + 4 * Minute);
+}
+
+
+TEST_F (KlinesTest, aggTrade)
+{
+    auto trade = json::parse(R"({"stream":"btcusdt@aggTrade","data":{"e":"aggTrade","E":1640995201000,"s":"BTCUSDT","a":5933014,"p":"46000.10","q":"0.500","f":100,"l":104,"T":1640995201000,"m":true}})");
+
+    EXPECT_TRUE(m_builder.onAggTrade(trade));
+    EXPECT_FALSE(m_builder.onAggTrade(json::parse(R"({"e":"depthUpdate","s":"BTCUSDT"})")));
+
+    auto current = m_builder.current("BTCUSDT", 1min);
+    ASSERT_NE(current, nullptr);
+    EXPECT_DOUBLE_EQ(current->close, 46000.10);
+    EXPECT_EQ(current->trades, 5U);
+    EXPECT_DOUBLE_EQ(current->takerBuyVolume, 0.0);
+}
+
+
+TEST (KlinesHistoryTest, ringBuffer)
+{
+    KlineBuilder builder ({1min}, nullptr, 3);
+
+    for (std::int64_t i = 0 ; i < 10 ; ++i)
+        builder.addTrade("ETHUSDT", i * 60000, static_cast<double>(i), 1.0, false);
+
+    auto history = builder.history("ETHUSDT", 1min);
+    ASSERT_EQ(history.size(), 3U);
+    EXPECT_DOUBLE_EQ(history[0].close, 6.0);
+    EXPECT_DOUBLE_EQ(history[2].close, 8.0);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Kline Builder\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();    
+}
@@ -0,0 +1,93 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+TEST (LatencyHistogramTest, bucketAccuracy)
+{
+    // small values are exact, larger values are within the bucket width (1/16th)
+    for (std::uint64_t v : {0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456ULL, 5000000000ULL})
+    {
+        const auto recorded = LatencyHistogram::bucketValue(LatencyHistogram::bucketIndex(v));
+
+        EXPECT_GE(recorded, static_cast<std::int64_t>(v));
+        EXPECT_LE(recorded - static_cast<std::int64_t>(v), static_cast<std::int64_t>(v / LatencyHistogram::SubBuckets));
+    }
+
+    // buckets are contiguous
+    for (size_t i = 1 ; i < LatencyHistogram::NumBuckets ; ++i)
+        EXPECT_EQ(LatencyHistogram::bucketIndex(LatencyHistogram::bucketValue(i - 1) + 1), i);
+
+    // clamped, not out of range
+    EXPECT_EQ(LatencyHistogram::bucketIndex(~0ULL), LatencyHistogram::NumBuckets - 1);
+
+    // MaxValue is the last bucket's upper bound, ~146 minutes
+    EXPECT_EQ(LatencyHistogram::bucketValue(LatencyHistogram::NumBuckets - 1), LatencyHistogram::MaxValue);
+    EXPECT_EQ(LatencyHistogram::bucketIndex(LatencyHistogram::MaxValue), LatencyHistogram::NumBuckets - 1);
+    EXPECT_EQ(LatencyHistogram::bucketIndex(LatencyHistogram::MaxValue / 2), LatencyHistogram::NumBuckets - 1 - LatencyHistogram::SubBuckets);
+    EXPECT_EQ(std::chrono::duration_cast<std::chrono::minutes>(std::chrono::nanoseconds{LatencyHistogram::MaxValue}).count(), 146);
+}
+
+
+TEST (LatencyHistogramTest, percentiles)
+{
+    LatencyHistogram histogram;
+
+    for (std::int64_t v = 1 ; v <= 1000 ; ++v)
+        histogram.record(std::chrono::microseconds{v});
+
+    histogram.record(-5);
+
+    const auto snapshot = histogram.snapshot();
+
+    EXPECT_EQ(snapshot.count, 1001U);
+    EXPECT_EQ(histogram.negative(), 1U);
+    EXPECT_EQ(snapshot.max, 1000000);
+    EXPECT_NEAR(snapshot.percentile(0.5), 500000, 500000 / 16);
+    EXPECT_NEAR(snapshot.percentile(0.99), 990000, 990000 / 16);
+    EXPECT_EQ(snapshot.percentile(1.0), 1000000);
+}
+
+
+TEST (LatencyHistogramTest, dispatcherStages)
+{
+    std::atomic_size_t handled {0};
+
+    WsHandlerDispatcher dispatcher ([&](WsResponse) { ++handled; });
+
+    WsResponse response {json::parse(R"({"stream":"btcusdt@aggTrade","data":{"e":"aggTrade","E":1000,"s":"BTCUSDT","a":1}})")};
+    response.receiveTime = WsResponse::Clock::now();
+    response.receiveWallTime = std::chrono::system_clock::time_point{1005ms};
+    response.parseTime = response.receiveTime + 1us;
+
+    EXPECT_EQ(eventTime(response.json), 1000);
+
+    recordReceiveLatency(*dispatcher.latency(), response);
+    dispatcher.dispatch(std::move(response));
+
+    for (int i = 0 ; i < 100 && dispatcher.latency()->handlerDuration.snapshot().count == 0 ; ++i)
+        std::this_thread::sleep_for(10ms);
+
+    const auto stats = dispatcher.latency()->snapshot();
+
+    EXPECT_EQ(handled.load(), 1U);
+    EXPECT_EQ(stats.exchangeToSocket.max, 5000000);
+    EXPECT_EQ(stats.socketToParse.max, 1000);
+    EXPECT_EQ(stats.parseToHandler.count, 1U);
+    EXPECT_EQ(stats.handlerDuration.count, 1U);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Latency Histograms\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();    
+}
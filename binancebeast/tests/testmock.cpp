@@ -0,0 +1,488 @@
+#include <binancebeast/BinanceBeast.h>
+#include <binancebeast/BinanceWsApi.h>
+#include <BinanceMockServer.h>
+#include "testcommon.h"
+#include <future>
+#include <chrono>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// Runs BinanceBeast against the mock server, so these need no network connection or API keys.
+class MockTest : public testing::Test
+{
+protected:
+    void start (MockServerConfig config = {})
+    {
+        m_server = std::make_unique<MockServer>(config);
+        m_bb.start(m_server->connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), 1, 1);
+    }
+
+
+    RestResponse rest (const string& path, RestParams params = {}, const RestSign sign = RestSign::Unsigned, const RequestType type = RequestType::Get)
+    {
+        std::promise<RestResponse> reply;
+
+        m_bb.sendRestRequest([&reply](RestResponse result)
+        {
+            reply.set_value(std::move(result));
+
+        }, path, sign, params, type);
+
+        auto future = reply.get_future();
+
+        if (future.wait_for(5s) != std::future_status::ready)
+            return RestResponse{string{"timeout"}};
+
+        return future.get();
+    }
+
+
+protected:
+    std::unique_ptr<MockServer> m_server;
+    BinanceBeast m_bb;
+};
+
+
+TEST_F (MockTest, restPing)
+{
+    start();
+
+    auto result = rest("/fapi/v1/ping");
+
+    EXPECT_FALSE(result.hasErrorCode());
+    EXPECT_EQ(m_server->stats().restRequests, 1U);
+}
+
+
+TEST_F (MockTest, restSignedOrder)
+{
+    start();
+
+    MockRestRequest received;
+
+    m_server->setRestHandler(http::verb::post, "/fapi/v1/order", [&received](const MockRestRequest& request)
+    {
+        received = request;
+        return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"};
+    });
+
+    auto result = rest("/fapi/v1/order", RestParams{{{"symbol", "BTCUSDT"}, {"side", "BUY"}}}, RestSign::HMAC_SHA256, RequestType::Post);
+
+    ASSERT_FALSE(result.hasErrorCode());
+    EXPECT_EQ(json::value_to<std::int64_t>(result.json.as_object()["orderId"]), 7);
+    EXPECT_EQ(received.apiKey, "mockapikey");
+    EXPECT_EQ(received.params["symbol"], "BTCUSDT");
+    EXPECT_EQ(received.params.count("timestamp"), 1U);
+    EXPECT_EQ(received.params.count("signature"), 1U);
+}
+
+
+TEST_F (MockTest, restErrors)
+{
+    MockServerConfig config;
+    config.restFailEvery = 2;
+    start(config);
+
+    m_server->setRestHandler(http::verb::get, "/fapi/v1/ticker/price", [](const MockRestRequest&)
+    {
+        return MockRestResponse::error(-1121, "Invalid symbol.");
+    });
+
+    auto invalid = rest("/fapi/v1/ticker/price", RestParams{{{"symbol", "NOTASYMBOL"}}});
+    EXPECT_TRUE(invalid.hasErrorCode());
+    EXPECT_EQ(invalid.failMessage, "Invalid symbol.");
+
+    // the second request
+    auto limited = rest("/fapi/v1/ping");
+    EXPECT_TRUE(limited.hasErrorCode());
+    EXPECT_EQ(json::value_to<std::int64_t>(limited.json.as_object()["code"]), -1003);
+
+    auto notFound = rest("/fapi/v1/notAnEndpoint");
+    EXPECT_EQ(notFound.state, RestResponse::State::Fail);
+}
+
+
+TEST_F (MockTest, restLatency)
+{
+    MockServerConfig config;
+    config.restLatency = 100ms;
+    start(config);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto result = rest("/fapi/v1/time");
+
+    EXPECT_FALSE(result.hasErrorCode());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 100ms);
+}
+
+
+TEST_F (MockTest, restTiming)
+{
+    start();
+
+    auto result = rest("/fapi/v1/order", RestParams{{{"symbol", "BTCUSDT"}, {"side", "BUY"}}}, RestSign::HMAC_SHA256, RequestType::Post);
+
+    ASSERT_FALSE(result.hasErrorCode());
+
+    auto& timing = result.timing;
+    EXPECT_NE(timing.requestTime, RestTiming::Clock::time_point{});
+    EXPECT_LE(timing.requestTime, timing.runTime);
+    EXPECT_LE(timing.runTime, timing.connectTime);
+    EXPECT_LE(timing.connectTime, timing.handshakeTime);
+    EXPECT_LE(timing.handshakeTime, timing.writeTime);
+    EXPECT_LE(timing.writeTime, timing.receiveTime);
+}
+
+
+TEST_F (MockTest, wsStream)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 1000;
+    start(config);
+
+    std::promise<void> done;
+    size_t count = 0;
+    bool valid = true;
+    std::int64_t lastId = 0;
+
+    auto token = m_bb.startWebSocket([&](WsResponse result)
+    {
+        if (result.state != WsResponse::State::Success || count >= 100)
+            return;
+
+        auto& event = result.json.as_object();
+        const auto id = json::value_to<std::int64_t>(event["u"]);
+
+        valid = valid && json::value_to<string>(event["e"]) == "bookTicker" && id == lastId + 1;
+        lastId = id;
+
+        if (++count == 100)
+            done.set_value();
+
+    }, "btcusdt@bookTicker");
+
+    ASSERT_EQ(done.get_future().wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(valid);
+
+    m_bb.stopWebSocket(token);
+}
+
+
+TEST_F (MockTest, wsSubscribeAndPublish)
+{
+    start();
+
+    std::promise<void> subscribed, published;
+
+    auto token = m_bb.startWebSocket([&](WsResponse result)
+    {
+        if (result.state != WsResponse::State::Success)
+            return;
+
+        auto& msg = result.json.as_object();
+
+        if (msg.if_contains("stream") && json::value_to<string>(msg["stream"]) == "ethusdt@aggTrade")
+            published.set_value();
+
+    }, std::set<string>{"btcusdt@bookTicker"});
+
+    m_bb.subscribe(token, {"ethusdt@aggTrade"}, [&](WsResponse reply)
+    {
+        if (!reply.hasErrorCode())
+            subscribed.set_value();
+    });
+
+    ASSERT_EQ(subscribed.get_future().wait_for(5s), std::future_status::ready);
+
+    m_server->publish("ethusdt@aggTrade", MockServer::defaultEvent("ethusdt@aggTrade", 1));
+
+    EXPECT_EQ(published.get_future().wait_for(5s), std::future_status::ready);
+
+    m_bb.stopWebSocket(token);
+}
+
+
+TEST_F (MockTest, wsSubscribeInvalidParams)
+{
+    start();
+
+    auto config = m_server->connectionConfig(Market::USDM);
+
+    net::io_context ioc;
+    auto guard = net::make_work_guard(ioc);
+    std::thread iocThread ([&ioc]{ ioc.run(); });
+
+    auto ctx = std::make_shared<ssl::context>(ssl::context::tlsv12_client);
+    ctx->set_verify_mode(ssl::verify_none);
+
+    std::promise<WsResponse> invalid, listed;
+
+    auto session = std::make_shared<WsSession>(ioc, ctx, [](WsResponse) { });
+    session->run(config.wsApiUri, config.wsPort, "/ws/btcusdt@bookTicker");
+
+    session->sendRequest(json::object{{"method", "SUBSCRIBE"}, {"params", json::array{1, "ethusdt@aggTrade"}}}, [&invalid](WsResponse reply)
+    {
+        invalid.set_value(std::move(reply));
+    });
+
+    // the connection is still served
+    session->sendRequest(json::object{{"method", "LIST_SUBSCRIPTIONS"}}, [&listed](WsResponse reply)
+    {
+        listed.set_value(std::move(reply));
+    });
+
+    auto invalidReply = invalid.get_future();
+    auto listedReply = listed.get_future();
+
+    ASSERT_EQ(invalidReply.wait_for(5s), std::future_status::ready);
+    ASSERT_EQ(listedReply.wait_for(5s), std::future_status::ready);
+
+    EXPECT_TRUE(invalidReply.get().hasErrorCode());
+
+    auto list = listedReply.get();
+    ASSERT_FALSE(list.hasErrorCode());
+    EXPECT_EQ(list.json.as_object()["result"].as_array().size(), 1U);
+
+    std::promise<void> closed;
+    session->close([&closed]{ closed.set_value(); });
+    closed.get_future().wait_for(5s);
+
+    guard.reset();
+    ioc.stop();
+    iocThread.join();
+}
+
+
+TEST_F (MockTest, wsSubscribeRawOverflow)
+{
+    MockServerConfig serverConfig;
+    serverConfig.messagesPerSecond = 100;
+    start(serverConfig);
+
+    auto config = m_server->connectionConfig(Market::USDM);
+    config.maxStreamsPerConnection = 1;
+
+    // before the client, which may call the handler until it's destroyed
+    std::promise<void> haveAggTrade;
+    std::atomic_bool first {true}, allRaw {true};
+
+    BinanceBeast bb;
+    bb.start(config, 1, 1);
+
+    // a raw stream, the subscribed stream is on a second connection which must also be raw
+    auto token = bb.startWebSocket([&](WsResponse result)
+    {
+        if (result.state != WsResponse::State::Success || !result.json.is_object())
+            return;
+
+        auto& msg = result.json.as_object();
+
+        if (msg.if_contains("stream"))
+            allRaw = false;
+        else if (auto e = msg.if_contains("e"); e && e->is_string() && e->as_string() == "aggTrade" && first.exchange(false))
+            haveAggTrade.set_value();
+
+    }, "btcusdt@bookTicker");
+
+    bb.subscribe(token, {"ethusdt@aggTrade"});
+
+    EXPECT_EQ(haveAggTrade.get_future().wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(allRaw);
+
+    bb.stopWebSocket(token);
+}
+
+
+TEST_F (MockTest, wsDisconnect)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 100;
+    start(config);
+
+    std::promise<void> connected, failed;
+    bool haveData = false, haveFail = false;
+
+    m_bb.startWebSocket([&](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Success && !haveData)
+        {
+            haveData = true;
+            connected.set_value();
+        }
+        else if (result.state == WsResponse::State::Fail && !haveFail)
+        {
+            haveFail = true;
+            failed.set_value();
+        }
+
+    }, "btcusdt@depth@100ms");
+
+    ASSERT_EQ(connected.get_future().wait_for(5s), std::future_status::ready);
+
+    m_server->disconnectAll();
+
+    EXPECT_EQ(failed.get_future().wait_for(5s), std::future_status::ready);
+}
+
+
+TEST_F (MockTest, wsApiOrders)
+{
+    start();
+
+    MockRestRequest received;
+
+    m_server->setRestHandler(http::verb::post, "/fapi/v1/order", [&received](const MockRestRequest& request)
+    {
+        received = request;
+        return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"};
+    });
+
+    auto api = m_bb.startWsApi();
+
+    const auto send = [&api](const string& method, QueryParams params)
+    {
+        std::promise<RestResponse> reply;
+
+        api->sendRequest([&reply](RestResponse result) { reply.set_value(std::move(result)); }, method, std::move(params));
+
+        auto future = reply.get_future();
+        return future.wait_for(5s) == std::future_status::ready ? future.get() : RestResponse{string{"timeout"}};
+    };
+
+    auto placed = send("order.place", {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"type", "MARKET"}, {"quantity", "0.001"}});
+
+    ASSERT_FALSE(placed.hasErrorCode());
+    EXPECT_EQ(json::value_to<std::int64_t>(placed.json.as_object()["orderId"]), 7);
+    EXPECT_EQ(received.apiKey, "mockapikey");
+    EXPECT_EQ(received.params["symbol"], "BTCUSDT");
+    EXPECT_EQ(received.params.count("timestamp"), 1U);
+    EXPECT_LE(placed.timing.requestTime, placed.timing.receiveTime);
+
+    // signed over all params, including the apiKey, sorted by name
+    auto signedParams = received.params;
+    signedParams.erase("signature");
+    signedParams["apiKey"] = received.apiKey;
+
+    string payload;
+    for (auto& [name, value] : signedParams)
+        payload += (payload.empty() ? "" : "&") + name + "=" + value;
+
+    EXPECT_EQ(received.params["signature"], BinanceBeast::createSignature("mocksecretkey", payload));
+
+    auto canceled = send("order.cancel", {{"symbol", "BTCUSDT"}, {"orderId", "7"}});
+
+    ASSERT_FALSE(canceled.hasErrorCode());
+    EXPECT_EQ(json::value_to<string>(canceled.json.as_object()["status"]), "CANCELED");
+
+    // Binance's error, as a REST error. Set before the caller checks hasErrorCode()
+    auto rejected = send("order.modify", {{"orderId", "7"}});
+
+    EXPECT_EQ(rejected.state, RestResponse::State::Fail);
+    EXPECT_FALSE(rejected.failMessage.empty());
+    EXPECT_TRUE(rejected.hasErrorCode());
+    EXPECT_EQ(json::value_to<std::int64_t>(rejected.json.as_object()["code"]), -1102);
+
+    EXPECT_EQ(m_server->stats().wsApiRequests, 3U);
+    EXPECT_EQ(api->pending(), 0U);
+
+    api->close();
+}
+
+
+TEST_F (MockTest, wsApiLogon)
+{
+    m_server = std::make_unique<MockServer>();
+
+    auto config = m_server->connectionConfig(Market::USDM, "mockapikey");
+    config.keys.ed25519 = Ed25519Key::fromPem(makeEd25519Pem());
+
+    const auto publicKey = config.keys.ed25519->publicKeyPem();
+
+    m_server->setLogonHandler([&publicKey](const MockRestRequest& request)
+    {
+        auto it = request.params.find("signature");
+        auto timestamp = request.params.find("timestamp");
+
+        return it != request.params.end() && timestamp != request.params.end() &&
+               verifyEd25519(publicKey, "apiKey=" + request.apiKey + "&timestamp=" + timestamp->second, it->second);
+    });
+
+    MockRestRequest received;
+
+    m_server->setRestHandler(http::verb::post, "/fapi/v1/order", [&received](const MockRestRequest& request)
+    {
+        received = request;
+        return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"};
+    });
+
+    m_bb.start(config, 1, 1);
+
+    auto api = m_bb.startWsApi();
+
+    std::promise<RestResponse> loggedOn, placed;
+
+    api->logon([&loggedOn](RestResponse result) { loggedOn.set_value(std::move(result)); });
+
+    auto logonReply = loggedOn.get_future();
+    ASSERT_EQ(logonReply.wait_for(5s), std::future_status::ready);
+    ASSERT_FALSE(logonReply.get().hasErrorCode());
+    EXPECT_TRUE(api->isLoggedOn());
+
+    api->placeOrder([&placed](RestResponse result) { placed.set_value(std::move(result)); }, {{"symbol", "BTCUSDT"}, {"side", "BUY"}});
+
+    auto placedReply = placed.get_future();
+    ASSERT_EQ(placedReply.wait_for(5s), std::future_status::ready);
+    EXPECT_FALSE(placedReply.get().hasErrorCode());
+
+    // not signed, the connection has the api key
+    EXPECT_EQ(received.params.count("signature"), 0U);
+    EXPECT_EQ(received.params.count("timestamp"), 1U);
+    EXPECT_EQ(received.apiKey, "mockapikey");
+
+    api->close();
+}
+
+
+TEST_F (MockTest, wsApiDisconnect)
+{
+    MockServerConfig config;
+    config.restLatency = 10s;
+    start(config);
+
+    std::promise<void> sessionFailed;
+
+    auto api = m_bb.startWsApi([&sessionFailed](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Fail)
+            sessionFailed.set_value();
+    });
+
+    std::promise<RestResponse> reply;
+
+    api->placeOrder([&reply](RestResponse result) { reply.set_value(std::move(result)); }, {{"symbol", "BTCUSDT"}, {"side", "BUY"}});
+
+    // the request has reached the server, which holds the reply
+    for (int i = 0 ; i < 500 && m_server->stats().wsApiRequests == 0 ; ++i)
+        std::this_thread::sleep_for(10ms);
+
+    m_server->disconnectAll();
+
+    auto future = reply.get_future();
+    ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(future.get().state, RestResponse::State::Fail);
+    EXPECT_EQ(sessionFailed.get_future().wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(api->pending(), 0U);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Mock Server\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
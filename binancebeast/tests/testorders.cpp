@@ -0,0 +1,327 @@
+#include <binancebeast/BinanceOrders.h>
+#include <BinanceMockServer.h>
+#include "testcommon.h"
+#include <future>
+#include <mutex>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// Sends orders to the mock server, the user data events are passed to the manager directly.
+class OrderManagerTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        m_server = std::make_unique<MockServer>();
+        m_bb.start(m_server->connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), 1, 1);
+    }
+
+
+    void start (MockRestResponse reply, OrderManagerConfig config = {})
+    {
+        m_server->setRestHandler(http::verb::post, "/fapi/v1/order", [this, reply](const MockRestRequest& request)
+        {
+            std::scoped_lock lock{m_mux};
+            m_received.push_back(request);
+            return reply;
+        });
+
+        m_orders = std::make_unique<OrderManager>(m_bb, Market::USDM, [this](const OrderRecord& record)
+        {
+            std::scoped_lock lock{m_mux};
+            m_updates.push_back(record);
+
+            if (m_waitForAck && record.ackTime != OrderRecord::Clock::time_point{})
+            {
+                m_waitForAck = false;
+                m_acked.set_value();
+            }
+
+        }, config);
+    }
+
+
+    bool waitForAck()
+    {
+        return m_acked.get_future().wait_for(5s) == std::future_status::ready;
+    }
+
+
+    static OrderRequest limitBuy()
+    {
+        OrderRequest request;
+        request.symbol = "BTCUSDT";
+        request.side = "BUY";
+        request.type = "LIMIT";
+        request.timeInForce = "GTC";
+        request.quantity = "0.1";
+        request.price = "29000";
+        return request;
+    }
+
+
+    static WsResponse orderUpdate (const string& clientOrderId, const string& execution, const string& status, const string& filled)
+    {
+        return WsResponse{json::parse(R"({"e":"ORDER_TRADE_UPDATE","E":5000,"T":5000,"o":{"s":"BTCUSDT","c":")" + clientOrderId +
+                                      R"(","S":"BUY","o":"LIMIT","f":"GTC","q":"0.1","p":"29000","ap":"29000","sp":"0","x":")" + execution +
+                                      R"(","X":")" + status + R"(","i":7,"l":"0","z":")" + filled + R"(","L":"0","T":5001,"ps":"BOTH","R":false}})")};
+    }
+
+
+protected:
+    // outlive the server and the client, handlers already queued may run while they are destroyed
+    std::mutex m_mux;
+    std::vector<MockRestRequest> m_received;
+    std::vector<OrderRecord> m_updates;
+    bool m_waitForAck = true;
+    std::promise<void> m_acked;
+
+    std::unique_ptr<MockServer> m_server;
+    BinanceBeast m_bb;
+    std::unique_ptr<OrderManager> m_orders;
+};
+
+
+TEST_F (OrderManagerTest, ackThenFill)
+{
+    start(MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW","updateTime":4000})"});
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    EXPECT_EQ(clientOrderId.rfind(m_orders->clientIdPrefix(), 0), 0U);
+    ASSERT_TRUE(waitForAck());
+
+    {
+        std::scoped_lock lock{m_mux};
+        ASSERT_EQ(m_received.size(), 1U);
+        EXPECT_EQ(m_received[0].params["newClientOrderId"], clientOrderId);
+        EXPECT_EQ(m_received[0].params["price"], "29000");
+        EXPECT_EQ(m_received[0].params.count("stopPrice"), 0U);
+    }
+
+    auto record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::New);
+    EXPECT_EQ(record->orderId, 7);
+    EXPECT_EQ(record->exchangeAckTime, 4000);
+    EXPECT_STREQ(record->symbol, "BTCUSDT");
+    EXPECT_TRUE(record->isBuy);
+    EXPECT_LE(record->sendTime, record->ackTime);
+    EXPECT_EQ(m_orders->live(), 1U);
+
+    m_orders->onUserData(orderUpdate(clientOrderId, "TRADE", "PARTIALLY_FILLED", "0.04"));
+    m_orders->onUserData(orderUpdate(clientOrderId, "TRADE", "FILLED", "0.1"));
+
+    record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Filled);
+    EXPECT_DOUBLE_EQ(record->filledQuantity, 0.1);
+    EXPECT_NE(record->firstFillTime, OrderRecord::Clock::time_point{});
+    EXPECT_LE(record->firstFillTime, record->finalTime);
+    EXPECT_EQ(record->exchangeFinalTime, 5001);
+    EXPECT_EQ(m_orders->live(), 0U);
+
+    const auto latency = m_orders->latency();
+    EXPECT_EQ(latency.sendToAck.count, 1U);
+    EXPECT_EQ(latency.sendToFirstFill.count, 1U);
+    EXPECT_EQ(latency.sendToFinal.count, 1U);
+}
+
+
+TEST_F (OrderManagerTest, eventBeforeAck)
+{
+    start(MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW","updateTime":4000})"});
+
+    // the server replies slowly, so the user data event arrives first
+    m_server->setRestHandler(http::verb::post, "/fapi/v1/order", [](const MockRestRequest&)
+    {
+        std::this_thread::sleep_for(100ms);
+        return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW","updateTime":4000})"};
+    });
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    m_orders->onUserData(orderUpdate(clientOrderId, "TRADE", "FILLED", "0.1"));
+    EXPECT_EQ(m_orders->find(clientOrderId)->state, OrderRecord::State::Filled);
+
+    // the ack doesn't change the state back
+    ASSERT_TRUE(waitForAck());
+    EXPECT_EQ(m_orders->find(clientOrderId)->state, OrderRecord::State::Filled);
+}
+
+
+TEST_F (OrderManagerTest, rejected)
+{
+    start(MockRestResponse{http::status::bad_request, R"({"code":-2019,"msg":"Margin is insufficient."})"});
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    ASSERT_TRUE(waitForAck());
+
+    auto record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Rejected);
+    EXPECT_EQ(record->errorCode, -2019);
+    EXPECT_TRUE(record->isFinal());
+    EXPECT_EQ(m_orders->latency().sendToFinal.count, 1U);
+}
+
+
+TEST_F (OrderManagerTest, transportFailureUnknown)
+{
+    // not Binance's reply, i.e. from a proxy after the connection to Binance failed
+    start(MockRestResponse{http::status::bad_gateway, "upstream connect error"});
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    ASSERT_TRUE(waitForAck());
+
+    auto record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Unknown);
+    EXPECT_EQ(record->errorCode, 0);
+    EXPECT_FALSE(record->isFinal());
+    EXPECT_EQ(m_orders->live(), 1U);
+    EXPECT_EQ(m_orders->latency().sendToFinal.count, 0U);
+
+    // the order was placed
+    m_orders->onUserData(orderUpdate(clientOrderId, "NEW", "NEW", "0"));
+    EXPECT_EQ(m_orders->find(clientOrderId)->state, OrderRecord::State::New);
+}
+
+
+TEST_F (OrderManagerTest, internalErrorUnknown)
+{
+    start(MockRestResponse::error(-1001, "Internal error; unable to process your request. Please try again."));
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    ASSERT_TRUE(waitForAck());
+
+    auto record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Unknown);
+    EXPECT_EQ(record->errorCode, -1001);
+    EXPECT_FALSE(record->isFinal());
+    EXPECT_EQ(m_orders->latency().sendToFinal.count, 0U);
+}
+
+
+TEST_F (OrderManagerTest, serverErrorUnknown)
+{
+    // Binance's reply, but a 5xx status means the execution status is unknown whatever the code
+    start(MockRestResponse::error(-1000, "An unknown error occured while processing the request.", http::status::service_unavailable));
+
+    const auto clientOrderId = m_orders->send(limitBuy());
+
+    ASSERT_TRUE(waitForAck());
+
+    auto record = m_orders->find(clientOrderId);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Unknown);
+    EXPECT_EQ(record->errorCode, -1000);
+    EXPECT_FALSE(record->isFinal());
+    EXPECT_EQ(m_orders->live(), 1U);
+}
+
+
+TEST_F (OrderManagerTest, unknownResolvedByQuery)
+{
+    m_server->setRestHandler(http::verb::get, "/fapi/v1/order", [](const MockRestRequest& request)
+    {
+        if (request.params.at("origClientOrderId").back() == '1')
+            return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"FILLED","executedQty":"0.1","avgPrice":"29000","updateTime":6000})"};
+        else
+            return MockRestResponse::error(-2013, "Order does not exist.");
+    });
+
+    OrderManagerConfig config;
+    config.clientIdPrefix = "q-";
+    start(MockRestResponse::error(-1007, "Timeout waiting for response from backend server. Send status unknown; execution status unknown."), config);
+
+    const auto filled = m_orders->send(limitBuy());
+    ASSERT_TRUE(waitForAck());
+
+    const auto missing = m_orders->send(limitBuy());
+    EXPECT_EQ(missing, "q-2");
+
+    for (int i = 0 ; i < 5000 && m_orders->find(missing)->state == OrderRecord::State::Sending ; ++i)
+        std::this_thread::sleep_for(1ms);
+
+    auto record = m_orders->find(filled);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state, OrderRecord::State::Unknown);
+    EXPECT_EQ(record->errorCode, -1007);
+
+    for (auto& clientOrderId : {filled, missing})
+    {
+        std::promise<void> queried;
+
+        m_orders->query(clientOrderId, [&queried](RestResponse) { queried.set_value(); });
+        ASSERT_EQ(queried.get_future().wait_for(5s), std::future_status::ready);
+    }
+
+    record = m_orders->find(filled);
+    EXPECT_EQ(record->state, OrderRecord::State::Filled);
+    EXPECT_DOUBLE_EQ(record->filledQuantity, 0.1);
+    EXPECT_EQ(record->orderId, 7);
+    EXPECT_EQ(record->exchangeFinalTime, 6000);
+
+    // Binance doesn't have it, so it was never placed
+    record = m_orders->find(missing);
+    EXPECT_EQ(record->state, OrderRecord::State::Rejected);
+    EXPECT_EQ(record->errorCode, -2013);
+    EXPECT_EQ(m_orders->live(), 0U);
+}
+
+
+TEST_F (OrderManagerTest, unknownEventsIgnored)
+{
+    start(MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"});
+
+    m_orders->onUserData(orderUpdate("web_abc123", "NEW", "NEW", "0"));
+    m_orders->onUserData(orderUpdate(m_orders->clientIdPrefix() + "99", "NEW", "NEW", "0"));
+    m_orders->onUserData(WsResponse{json::parse(R"({"e":"ACCOUNT_UPDATE","E":1})")});
+
+    EXPECT_FALSE(m_orders->find("web_abc123"));
+    EXPECT_TRUE(m_updates.empty());
+}
+
+
+TEST_F (OrderManagerTest, tableFull)
+{
+    OrderManagerConfig config;
+    config.capacity = 2;
+    config.clientIdPrefix = "t-";
+
+    start(MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"}, config);
+
+    const auto first = m_orders->send(limitBuy());
+    EXPECT_EQ(first, "t-1");
+    const auto second = m_orders->send(limitBuy());
+
+    // the first order's entry is reused by the third, it's not final
+    EXPECT_THROW(m_orders->send(limitBuy()), std::runtime_error);
+
+    m_orders->onUserData(orderUpdate(first, "CANCELED", "CANCELED", "0"));
+    m_orders->onUserData(orderUpdate(second, "CANCELED", "CANCELED", "0"));
+    EXPECT_EQ(m_orders->find(first)->state, OrderRecord::State::Canceled);
+
+    // the failed send used sequence 3, this reuses the second order's entry
+    EXPECT_EQ(m_orders->send(limitBuy()), "t-4");
+    EXPECT_FALSE(m_orders->find(second));
+    EXPECT_TRUE(m_orders->find(first));
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Order Manager\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
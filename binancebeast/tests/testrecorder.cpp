@@ -0,0 +1,200 @@
+#include <binancebeast/BinanceRecorder.h>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace std::chrono_literals;
+
+
+/// Appends to journals in a temporary directory and reads the segment files back, no network connection.
+class RecorderTest : public testing::Test
+{
+protected:
+    struct Record
+    {
+        JournalRecordHeader header;
+        std::string frame;
+    };
+
+
+    RecorderTest() : m_directory(std::filesystem::temp_directory_path() / ("bbrecordertest." + std::to_string(::getpid())))
+    {
+        m_config.directory = m_directory;
+        m_config.prefix = "test";
+        m_config.segmentSize = 64 * 1024;
+    }
+
+
+    void SetUp() override
+    {
+        std::filesystem::remove_all(m_directory);
+    }
+
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(m_directory);
+    }
+
+
+    /// The records of a segment file, checking its header.
+    std::vector<Record> readSegment (const std::uint64_t index)
+    {
+        std::ifstream file (MarketDataRecorder::segmentPath(m_directory, m_config.prefix, index), std::ios::binary);
+        std::vector<char> bytes ((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        std::vector<Record> records;
+
+        if (bytes.size() < sizeof(JournalSegmentHeader))
+        {
+            ADD_FAILURE() << "segment " << index << " is " << bytes.size() << " bytes";
+            return records;
+        }
+
+        JournalSegmentHeader segment;
+        std::memcpy(&segment, bytes.data(), sizeof(segment));
+
+        EXPECT_EQ(segment.magic, JournalSegmentHeader::Magic);
+        EXPECT_EQ(segment.version, JournalSegmentHeader::Version);
+        EXPECT_EQ(segment.segmentIndex, index);
+
+        for (size_t offset = segment.headerSize ; offset + sizeof(JournalRecordHeader) <= bytes.size() ; )
+        {
+            Record record;
+            std::memcpy(&record.header, bytes.data() + offset, sizeof(JournalRecordHeader));
+
+            if (record.header.length == 0 || record.header.length == JournalRecordHeader::EndOfSegment)
+                break;
+
+            record.frame.assign(bytes.data() + offset + sizeof(JournalRecordHeader), record.header.length);
+            offset += (sizeof(JournalRecordHeader) + record.header.length + 7) & ~size_t{7};
+
+            records.emplace_back(std::move(record));
+        }
+
+        return records;
+    }
+
+
+    /// Appends, waiting if the next segment isn't ready yet.
+    static void append (MarketDataRecorder& recorder, const std::uint32_t n, const std::string& frame)
+    {
+        while (!recorder.append(1, 2, n * 10, n, 0, frame.data(), frame.size()))
+            std::this_thread::sleep_for(1ms);
+    }
+
+
+protected:
+    std::filesystem::path m_directory;
+    RecorderConfig m_config;
+};
+
+
+TEST_F (RecorderTest, append)
+{
+    {
+        MarketDataRecorder recorder {m_config};
+
+        ASSERT_TRUE(recorder.append(7, 3, 1000, 100, JournalRecordHeader::KernelTimestamp, "{\"a\":1}", 7));
+        ASSERT_TRUE(recorder.append(7, 4, 2000, 200, 0, "{\"bb\":22}", 9));
+
+        const auto stats = recorder.stats();
+        EXPECT_EQ(stats.records, 2U);
+        EXPECT_EQ(stats.bytes, 16U);
+        EXPECT_EQ(stats.dropped, 0U);
+    }
+
+    const auto records = readSegment(0);
+    ASSERT_EQ(records.size(), 2U);
+
+    EXPECT_EQ(records[0].frame, "{\"a\":1}");
+    EXPECT_EQ(records[0].header.token, 7U);
+    EXPECT_EQ(records[0].header.connection, 3U);
+    EXPECT_EQ(records[0].header.flags, JournalRecordHeader::KernelTimestamp);
+    EXPECT_EQ(records[0].header.receiveTime, 1000);
+    EXPECT_EQ(records[0].header.monotonicTime, 100);
+
+    EXPECT_EQ(records[1].frame, "{\"bb\":22}");
+    EXPECT_EQ(records[1].header.connection, 4U);
+
+    // truncated to the used size, and the unused lookahead segments are removed
+    EXPECT_LT(std::filesystem::file_size(MarketDataRecorder::segmentPath(m_directory, m_config.prefix, 0)), m_config.segmentSize);
+    EXPECT_FALSE(std::filesystem::exists(MarketDataRecorder::segmentPath(m_directory, m_config.prefix, 1)));
+}
+
+
+TEST_F (RecorderTest, segmentRotation)
+{
+    const std::string frame (1000, 'x');
+    const std::uint32_t n = 300;        // ~312KB, so 5 segments of 64KB
+
+    std::uint64_t segments = 0;
+    {
+        MarketDataRecorder recorder {m_config};
+
+        for (std::uint32_t i = 0 ; i < n ; ++i)
+            append(recorder, i, frame);
+
+        segments = recorder.stats().segments;
+        EXPECT_EQ(recorder.stats().records, n);
+    }
+
+    EXPECT_GE(segments, 5U);
+
+    // every record, in order, across the segments
+    std::vector<Record> records;
+
+    for (std::uint64_t index = 0 ; std::filesystem::exists(MarketDataRecorder::segmentPath(m_directory, m_config.prefix, index)) ; ++index)
+    {
+        auto segment = readSegment(index);
+        EXPECT_FALSE(segment.empty());
+        records.insert(records.end(), segment.begin(), segment.end());
+    }
+
+    ASSERT_EQ(records.size(), n);
+
+    for (std::uint32_t i = 0 ; i < n ; ++i)
+    {
+        EXPECT_EQ(records[i].header.monotonicTime, static_cast<std::int64_t>(i));
+        EXPECT_EQ(records[i].frame.size(), frame.size());
+    }
+}
+
+
+TEST_F (RecorderTest, dropped)
+{
+    MarketDataRecorder recorder {m_config};
+
+    // a frame larger than a segment is dropped, not truncated
+    const std::string tooLarge (m_config.segmentSize, 'x');
+    EXPECT_FALSE(recorder.append(1, 1, 0, 0, 0, tooLarge.data(), tooLarge.size()));
+
+    EXPECT_TRUE(recorder.append(1, 1, 0, 0, 0, "{}", 2));
+
+    const auto stats = recorder.stats();
+    EXPECT_EQ(stats.dropped, 1U);
+    EXPECT_EQ(stats.records, 1U);
+}
+
+
+TEST_F (RecorderTest, invalidConfig)
+{
+    m_config.segmentSize = 1024;
+    EXPECT_THROW(MarketDataRecorder{m_config}, std::runtime_error);
+
+    m_config.segmentSize = 64 * 1024 + 4;
+    EXPECT_THROW(MarketDataRecorder{m_config}, std::runtime_error);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Market Data Recorder\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+using Registry = SlotRegistry<std::shared_ptr<int>>;
+
+
+TEST (SlotRegistryTest, insertFindErase)
+{
+    Registry registry;
+
+    const auto a = registry.insert(std::make_shared<int>(1));
+    const auto b = registry.insert(std::make_shared<int>(2));
+
+    EXPECT_NE(a, 0U);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(registry.size(), 2U);
+    EXPECT_EQ(*registry.find(a), 1);
+    EXPECT_EQ(*registry.find(b), 2);
+    EXPECT_TRUE(registry.contains(a));
+
+    auto erased = registry.erase(a);
+    ASSERT_TRUE(erased);
+    EXPECT_EQ(*erased, 1);
+    EXPECT_EQ(registry.find(a), nullptr);
+    EXPECT_FALSE(registry.contains(a));
+    EXPECT_EQ(registry.erase(a), nullptr);
+    EXPECT_EQ(registry.size(), 1U);
+
+    // never inserted
+    EXPECT_EQ(registry.find(0), nullptr);
+    EXPECT_EQ(registry.find(12345), nullptr);
+}
+
+
+TEST (SlotRegistryTest, reusedSlotHasNewId)
+{
+    Registry registry;
+
+    const auto first = registry.insert(std::make_shared<int>(1));
+    registry.erase(first);
+
+    const auto second = registry.insert(std::make_shared<int>(2));
+
+    // same slot, different generation
+    EXPECT_EQ(first & 0xFFFF, second & 0xFFFF);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(registry.find(first), nullptr);
+    EXPECT_EQ(*registry.find(second), 2);
+}
+
+
+TEST (SlotRegistryTest, clear)
+{
+    Registry registry;
+    std::vector<Registry::Id> ids;
+
+    for (int i = 0 ; i < 1000 ; ++i)
+        ids.push_back(registry.insert(std::make_shared<int>(i)));
+
+    registry.clear();
+
+    EXPECT_EQ(registry.size(), 0U);
+
+    for (auto id : ids)
+        EXPECT_FALSE(registry.contains(id));
+}
+
+
+TEST (SlotRegistryTest, capacity)
+{
+    SlotRegistry<int> registry;
+
+    for (size_t i = 0 ; i < Registry::Capacity ; ++i)
+        registry.insert(1);
+
+    EXPECT_THROW(registry.insert(1), std::runtime_error);
+}
+
+
+TEST (SlotRegistryTest, concurrent)
+{
+    Registry registry;
+    std::atomic_bool stop {false};
+    std::atomic_size_t badReads {0};
+
+    // ids that stay in the registry, read whilst other threads insert and erase
+    std::vector<Registry::Id> stable;
+    for (int i = 0 ; i < 64 ; ++i)
+        stable.push_back(registry.insert(std::make_shared<int>(i)));
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0 ; t < 4 ; ++t)
+    {
+        threads.emplace_back([&registry, &stop, t]
+        {
+            while (!stop)
+            {
+                std::vector<Registry::Id> ids;
+
+                for (int i = 0 ; i < 100 ; ++i)
+                    ids.push_back(registry.insert(std::make_shared<int>(-1 - t)));
+
+                for (auto id : ids)
+                    registry.erase(id);
+            }
+        });
+    }
+
+    for (int t = 0 ; t < 2 ; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            while (!stop)
+            {
+                for (size_t i = 0 ; i < stable.size() ; ++i)
+                {
+                    if (auto value = registry.find(stable[i]); !value || *value != static_cast<int>(i))
+                        badReads.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(500ms);
+    stop = true;
+
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(badReads.load(), 0U);
+    EXPECT_EQ(registry.size(), stable.size());
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Slot Registry\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// Records frames to journals in a temporary directory then replays them, no network connection.
+class ReplayTest : public testing::Test
+{
+protected:
+    ReplayTest() : m_directory(std::filesystem::temp_directory_path() / ("bbreplaytest." + std::to_string(::getpid())))
+    {
+    }
+
+
+    void SetUp() override
+    {
+        std::filesystem::remove_all(m_directory);
+    }
+
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(m_directory);
+    }
+
+
+    /// Write frames {"E":<time>,"n":<n>} with receive times 'times' to the journal 'prefix'.
+    void record(const string& prefix, const std::vector<std::int64_t>& times, const std::uint32_t token = 1)
+    {
+        RecorderConfig config;
+        config.directory = m_directory;
+        config.prefix = prefix;
+        config.segmentSize = 64 * 1024;
+
+        MarketDataRecorder recorder {config};
+
+        for (auto time : times)
+        {
+            const auto frame = R"({"E":)" + std::to_string(time) + R"(,"s":")" + prefix + R"("})";
+            // the recorder drops rather than blocks if the next segment isn't ready yet
+            while (!recorder.append(token, 1, time * 1000000, time, 0, frame.data(), frame.size()))
+                std::this_thread::sleep_for(1ms);
+        }
+    }
+
+
+protected:
+    std::filesystem::path m_directory;
+};
+
+
+TEST_F (ReplayTest, mergeOrder)
+{
+    record("a", {1, 4, 5, 9});
+    record("b", {2, 3, 6, 10});
+
+    std::vector<std::int64_t> times;
+    std::vector<string> sources;
+
+    ReplayConfig config;
+    config.sources = {ReplaySource{m_directory, "a"}, ReplaySource{m_directory, "b"}};
+
+    ReplayEngine replay (config, [&](WsResponse result)
+    {
+        times.push_back(json::value_to<std::int64_t>(result.json.as_object()["E"]));
+        sources.push_back(json::value_to<string>(result.json.as_object()["s"]));
+    });
+
+    auto stats = replay.run();
+
+    EXPECT_EQ(stats.records, 8U);
+    EXPECT_EQ(times, (std::vector<std::int64_t>{1, 2, 3, 4, 5, 6, 9, 10}));
+    EXPECT_EQ(sources.front(), "a");
+    EXPECT_EQ(sources.back(), "b");
+    EXPECT_EQ(replay.latency()->handlerDuration.snapshot().count, 8U);
+}
+
+
+TEST_F (ReplayTest, segmentsAndTokens)
+{
+    // enough to rotate the 64KB segments
+    std::vector<std::int64_t> times (5000);
+    for (size_t i = 0 ; i < times.size() ; ++i)
+        times[i] = static_cast<std::int64_t>(i);
+
+    record("a", times, 1);
+    record("b", {1, 2, 3}, 2);
+
+    ReplayConfig config;
+    config.sources = {ReplaySource{m_directory, "a"}, ReplaySource{m_directory, "b"}};
+    config.tokens = {1};
+    config.useDispatcher = false;
+
+    std::int64_t last = -1;
+    bool ordered = true;
+
+    ReplayEngine replay (config, [&](WsResponse result)
+    {
+        const auto time = json::value_to<std::int64_t>(result.json.as_object()["E"]);
+        ordered = ordered && time == last + 1;
+        last = time;
+    });
+
+    auto stats = replay.run();
+
+    EXPECT_GT(std::distance(std::filesystem::directory_iterator{m_directory}, std::filesystem::directory_iterator{}), 2);
+    EXPECT_EQ(stats.records, times.size());
+    EXPECT_EQ(stats.skipped, 3U);
+    EXPECT_TRUE(ordered);
+    EXPECT_GT(stats.recordsPerSecond(), 0.0);
+}
+
+
+TEST_F (ReplayTest, realTime)
+{
+    record("a", {0, 100, 200});     // milliseconds
+
+    ReplayConfig config;
+    config.sources = {ReplaySource{m_directory, "a"}};
+    config.speed = 2.0;
+
+    ReplayEngine replay (config, [](WsResponse) {});
+
+    auto stats = replay.run();
+
+    // 200ms at twice real time
+    EXPECT_GE(stats.elapsed, 100ms);
+    EXPECT_LT(stats.elapsed, 1s);
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Replay\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();    
+}
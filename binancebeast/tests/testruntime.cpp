@@ -0,0 +1,393 @@
+#include <binancebeast/BinanceBeast.h>
+#include <binancebeast/BinanceWsApi.h>
+#include <BinanceMockServer.h>
+#include "testcommon.h"
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+namespace
+{
+    RestResponse ping (BinanceBeast& bb)
+    {
+        std::promise<RestResponse> reply;
+
+        bb.sendRestRequest([&reply](RestResponse result)
+        {
+            reply.set_value(std::move(result));
+
+        }, "/fapi/v1/ping", RestSign::Unsigned, RestParams{}, RequestType::Get);
+
+        auto future = reply.get_future();
+
+        if (future.wait_for(5s) != std::future_status::ready)
+            return RestResponse{string{"timeout"}};
+
+        return future.get();
+    }
+}
+
+
+TEST (Runtime, clientsShareThreads)
+{
+    MockServer server;
+
+    auto runtime = BinanceRuntime::Make(IoContextsConfig::Make(1, 1));
+    ASSERT_EQ(runtime->threadCount(), 2U);
+
+    std::vector<std::unique_ptr<BinanceBeast>> clients;
+
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+        clients.emplace_back(std::make_unique<BinanceBeast>());
+        clients.back()->start(server.connectionConfig(Market::USDM), runtime);
+    }
+
+    for (auto& client : clients)
+    {
+        EXPECT_EQ(client->runtime(), runtime);
+        EXPECT_FALSE(ping(*client).hasErrorCode());
+    }
+
+    EXPECT_EQ(runtime->threadCount(), 2U);
+    EXPECT_EQ(server.stats().restRequests, 4U);
+
+    // resolved once, then from the cache
+    const auto [hits, misses] = runtime->dnsCache()->hitsAndMisses();
+    EXPECT_EQ(misses, 1U);
+    EXPECT_EQ(hits, 3U);
+}
+
+
+TEST (Runtime, loadSampled)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 1000;
+    MockServer server (config);
+
+    auto runtime = BinanceRuntime::Make(IoContextsConfig::Make(1, 1));
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM), runtime);
+
+    auto token = bb.startWebSocket([](WsResponse) { }, "btcusdt@bookTicker");
+
+    // cost() is only updated by the runtime's timer, once a second
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+
+    while (runtime->wsIoContext().load->cost() == 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(100ms);
+
+    EXPECT_GT(runtime->wsIoContext().load->cost(), 0);
+
+    bb.stopWebSocket(token);
+}
+
+
+TEST (Runtime, notStarted)
+{
+    BinanceBeast bb;
+    EXPECT_THROW(bb.start(ConnectionConfig::MakeMockConfig(Market::USDM, "1"), std::make_shared<BinanceRuntime>()), std::runtime_error);
+    EXPECT_THROW(bb.start(ConnectionConfig::MakeMockConfig(Market::USDM, "1"), std::shared_ptr<BinanceRuntime>{}), std::runtime_error);
+}
+
+
+TEST (Runtime, clientDestroyedRuntimeContinues)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 100;
+    MockServer server (config);
+
+    auto runtime = BinanceRuntime::Make(IoContextsConfig::Make(1, 1));
+
+    BinanceBeast remaining;
+    remaining.start(server.connectionConfig(Market::USDM), runtime);
+
+    {
+        BinanceBeast destroyed;
+        destroyed.start(server.connectionConfig(Market::USDM), runtime);
+
+        std::promise<void> haveData;
+        std::atomic_bool first {true};
+
+        destroyed.startWebSocket([&](WsResponse result)
+        {
+            if (result.state == WsResponse::State::Success && first.exchange(false))
+                haveData.set_value();
+
+        }, "btcusdt@bookTicker");
+
+        ASSERT_EQ(haveData.get_future().wait_for(5s), std::future_status::ready);
+    }
+
+    // the runtime's threads are still running for the remaining client
+    EXPECT_TRUE(runtime->started());
+    EXPECT_FALSE(ping(remaining).hasErrorCode());
+
+    std::promise<void> haveData;
+    std::atomic_bool first {true};
+
+    auto token = remaining.startWebSocket([&](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Success && first.exchange(false))
+            haveData.set_value();
+
+    }, "ethusdt@bookTicker");
+
+    EXPECT_EQ(haveData.get_future().wait_for(5s), std::future_status::ready);
+
+    remaining.stopWebSocket(token);
+}
+
+
+TEST (Runtime, dnsCacheDisabled)
+{
+    MockServer server;
+
+    auto iocs = IoContextsConfig::Make(1, 1);
+    iocs.dnsTtl = std::chrono::seconds{0};
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM), iocs);
+
+    EXPECT_FALSE(ping(bb).hasErrorCode());
+    EXPECT_FALSE(ping(bb).hasErrorCode());
+
+    const auto [hits, misses] = bb.runtime()->dnsCache()->hitsAndMisses();
+    EXPECT_EQ(hits, 0U);
+    EXPECT_EQ(misses, 0U);
+}
+
+
+TEST (Runtime, busyPollErrorNotReported)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 100;
+    MockServer server (config);
+
+    // above net.core.busy_read, so without CAP_NET_ADMIN it can't be set, but the connections work without it
+    auto iocs = IoContextsConfig::Make(1, 1);
+    iocs.rest[0].busyPollMicros = 1'000'000;
+    iocs.websockets[0].busyPollMicros = 1'000'000;
+
+    std::atomic_size_t replies {0}, received {0}, failures {0};
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM), iocs);
+
+    bb.sendRestRequest([&replies, &failures](RestResponse result)
+    {
+        ++replies;
+
+        if (result.hasErrorCode(true))
+            ++failures;
+
+    }, "/fapi/v1/ping", RestSign::Unsigned, RestParams{}, RequestType::Get);
+
+    auto token = bb.startWebSocket([&received, &failures](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Fail)
+            ++failures;
+        else
+            ++received;
+
+    }, "btcusdt@bookTicker");
+
+    for (int i = 0 ; i < 500 && (replies == 0 || received < 5) ; ++i)
+        std::this_thread::sleep_for(10ms);
+
+    bb.stopWebSocket(token);
+
+    EXPECT_EQ(replies.load(), 1U);
+    EXPECT_GE(received.load(), 5U);
+    EXPECT_EQ(failures.load(), 0U);
+
+    // either set, or counted
+    std::cout << "busy poll errors: " << bb.runtime()->busyPollErrors() << "\n";
+}
+
+
+TEST (Runtime, busyPollErrorKeepsWsApiRequests)
+{
+    MockServer server;
+
+    server.setRestHandler(http::verb::post, "/fapi/v1/order", [](const MockRestRequest&)
+    {
+        return MockRestResponse{http::status::ok, R"({"orderId":7,"status":"NEW"})"};
+    });
+
+    // the websocket API runs on the order entry io_context
+    auto iocs = IoContextsConfig::Make(1, 1, 1);
+    iocs.orders[0].busyPollMicros = 1'000'000;
+
+    std::atomic_size_t failures {0};
+    std::promise<RestResponse> placed;
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM, "mockapikey", "mocksecretkey"), iocs);
+
+    auto api = bb.startWsApi([&failures](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Fail)
+            ++failures;
+    });
+
+    // queued until the connection is established, so it's pending when SO_BUSY_POLL is set
+    api->placeOrder([&placed](RestResponse result) { placed.set_value(std::move(result)); }, {{"symbol", "BTCUSDT"}, {"side", "BUY"}});
+
+    auto reply = placed.get_future();
+    ASSERT_EQ(reply.wait_for(5s), std::future_status::ready);
+
+    auto result = reply.get();
+    EXPECT_EQ(result.state, RestResponse::State::Success);
+    EXPECT_FALSE(result.hasErrorCode());
+    EXPECT_EQ(failures.load(), 0U);
+    EXPECT_EQ(api->pending(), 0U);
+
+    api->close();
+}
+
+
+TEST (Runtime, externalIoContext)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 100;
+    MockServer server (config);
+
+    // the application's event loop, everything runs on this thread
+    net::io_context ioc;
+    auto guard = net::make_work_guard(ioc);
+    std::thread appThread ([&ioc]{ ioc.run(); });
+
+    // outlive the client, handlers already queued on the io_context may run after it's destroyed
+    std::promise<std::thread::id> restThread, wsThread;
+    std::atomic_bool first {true};
+
+    {
+        BinanceBeast bb;
+        bb.start(server.connectionConfig(Market::USDM), ExternalIoContexts::Make(ioc));
+
+        EXPECT_EQ(bb.runtime()->threadCount(), 0U);
+        EXPECT_TRUE(bb.runtime()->external());
+
+        bb.sendRestRequest([&](RestResponse result)
+        {
+            restThread.set_value(result.hasErrorCode() ? std::thread::id{} : std::this_thread::get_id());
+
+        }, "/fapi/v1/ping", RestSign::Unsigned, RestParams{}, RequestType::Get);
+
+        bb.startWebSocket([&](WsResponse result)
+        {
+            if (result.state == WsResponse::State::Success && first.exchange(false))
+                wsThread.set_value(std::this_thread::get_id());
+
+        }, "btcusdt@bookTicker");
+
+        auto restFuture = restThread.get_future();
+        auto wsFuture = wsThread.get_future();
+
+        ASSERT_EQ(restFuture.wait_for(5s), std::future_status::ready);
+        ASSERT_EQ(wsFuture.wait_for(5s), std::future_status::ready);
+
+        EXPECT_EQ(restFuture.get(), appThread.get_id());
+        EXPECT_EQ(wsFuture.get(), appThread.get_id());
+    }
+
+    // destroying the client doesn't stop the application's io_context
+    EXPECT_FALSE(ioc.stopped());
+
+    guard.reset();
+    ioc.stop();
+    appThread.join();
+}
+
+
+TEST (Runtime, externalRequiresIoContexts)
+{
+    net::io_context ioc;
+
+    ExternalIoContexts iocs;
+    EXPECT_THROW(BinanceRuntime::Make(iocs), std::runtime_error);
+
+    iocs.rest = {&ioc};
+    EXPECT_THROW(BinanceRuntime::Make(iocs), std::runtime_error);
+
+    iocs.websockets = {&ioc};
+    EXPECT_NO_THROW(BinanceRuntime::Make(iocs));
+}
+
+
+TEST (Runtime, reactor)
+{
+    MockServerConfig config;
+    config.messagesPerSecond = 100;
+    MockServer server (config);
+
+    BinanceBeast bb;
+    bb.startReactor(server.connectionConfig(Market::USDM));
+
+    EXPECT_TRUE(bb.runtime()->isReactor());
+    EXPECT_EQ(bb.runtime()->threadCount(), 0U);
+
+    // nothing happens until polled, and every handler is called on this thread
+    const auto thisThread = std::this_thread::get_id();
+    bool haveReply = false, restOnThisThread = false;
+    size_t wsMessages = 0;
+    bool wsOnThisThread = true;
+
+    bb.sendRestRequest([&](RestResponse result)
+    {
+        haveReply = !result.hasErrorCode();
+        restOnThisThread = std::this_thread::get_id() == thisThread;
+
+    }, "/fapi/v1/ping", RestSign::Unsigned, RestParams{}, RequestType::Get);
+
+    auto token = bb.startWebSocket([&](WsResponse result)
+    {
+        if (result.state == WsResponse::State::Success)
+        {
+            ++wsMessages;
+            wsOnThisThread = wsOnThisThread && std::this_thread::get_id() == thisThread;
+        }
+
+    }, "btcusdt@bookTicker");
+
+    // returns without waiting for the reply
+    bb.poll();
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+
+    while ((!haveReply || wsMessages < 10) && std::chrono::steady_clock::now() < deadline)
+        bb.run_for(10ms);
+
+    EXPECT_TRUE(haveReply);
+    EXPECT_TRUE(restOnThisThread);
+    EXPECT_GE(wsMessages, 10U);
+    EXPECT_TRUE(wsOnThisThread);
+
+    bool closed = false;
+    bb.stopWebSocket(token, [&closed](WsResponse) { closed = true; });
+
+    while (!closed && std::chrono::steady_clock::now() < deadline + 5s)
+        bb.run_for(10ms);
+
+    EXPECT_TRUE(closed);
+}
+
+
+TEST (Runtime, pollRequiresReactor)
+{
+    MockServer server;
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM), 1, 1);
+
+    EXPECT_THROW(bb.poll(), std::runtime_error);
+    EXPECT_THROW(bb.run_for(1ms), std::runtime_error);
+}
@@ -0,0 +1,180 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// These test SequenceValidator without a network connection. The validator is called directly, as the dispatcher would.
+class SequenceTest : public testing::Test
+{
+protected:
+    SequenceTest()
+    {
+    }
+
+
+    void makeValidator(const bool resync)
+    {
+        SequenceConfig config;
+        config.resync = resync;
+        config.onGap = [this](const SequenceGap& gap) { m_gaps.push_back(gap); };
+
+        m_validator = std::make_unique<SequenceValidator>([this](WsResponse result)
+        {
+            if (result.state == WsResponse::State::Fail)
+                m_delivered.push_back(0);
+            else
+            {
+                auto& data = result.json.as_object().contains("data") ? result.json.as_object()["data"].as_object() : result.json.as_object();
+                m_delivered.push_back(data.contains("u") ? json::value_to<std::uint64_t>(data["u"]) : json::value_to<std::uint64_t>(data["lastUpdateId"]));
+            }
+        },
+        config,
+        [this](const string& symbol) { m_snapshotRequests.push_back(symbol); });
+    }
+
+
+    /// Futures diff depth event, in a combined stream.
+    void futures(const std::uint64_t U, const std::uint64_t u, const std::uint64_t pu)
+    {
+        m_validator->onResponse(WsResponse{json::parse(R"({"stream":"btcusdt@depth@100ms","data":{"e":"depthUpdate","E":1,"s":"BTCUSDT","U":)" + 
+                                                        std::to_string(U) + R"(,"u":)" + std::to_string(u) + R"(,"pu":)" + std::to_string(pu) + "}}")});
+    }
+
+
+    /// SPOT diff depth event, raw stream.
+    void spot(const std::uint64_t U, const std::uint64_t u)
+    {
+        m_validator->onResponse(WsResponse{json::parse(R"({"e":"depthUpdate","E":1,"s":"BTCUSDT","U":)" + std::to_string(U) + R"(,"u":)" + std::to_string(u) + "}")});
+    }
+
+
+    void snapshot(const std::uint64_t lastUpdateId)
+    {
+        m_validator->onResponse(SequenceValidator::makeSnapshot("BTCUSDT", json::parse(R"({"lastUpdateId":)" + std::to_string(lastUpdateId) + R"(,"bids":[],"asks":[]})")));
+    }
+
+
+protected:
+    std::unique_ptr<SequenceValidator> m_validator;
+    std::vector<std::uint64_t> m_delivered;
+    std::vector<SequenceGap> m_gaps;
+    std::vector<string> m_snapshotRequests;
+};
+
+
+TEST_F (SequenceTest, futuresContinuous)
+{
+    makeValidator(false);
+
+    futures(10, 15, 9);
+    futures(16, 20, 15);
+    futures(21, 30, 20);
+
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 20, 30}));
+    EXPECT_TRUE(m_gaps.empty());
+}
+
+
+TEST_F (SequenceTest, futuresGapReported)
+{
+    makeValidator(false);
+
+    futures(10, 15, 9);
+    futures(21, 30, 20);    // missed pu 15 -> u 20
+    futures(31, 35, 30);
+
+    ASSERT_EQ(m_gaps.size(), 1U);
+    EXPECT_EQ(m_gaps[0].lastUpdateId, 15U);
+    EXPECT_EQ(m_gaps[0].previousUpdateId, 20U);
+    EXPECT_EQ(m_gaps[0].symbol, "BTCUSDT");
+
+    // without resync, events are still delivered
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 30, 35}));
+    EXPECT_EQ(m_validator->stats().gaps, 1U);
+}
+
+
+TEST_F (SequenceTest, spotGapAndStale)
+{
+    makeValidator(false);
+
+    spot(10, 15);
+    spot(16, 20);
+    spot(16, 20);   // duplicate, dropped
+    spot(25, 30);   // gap
+
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 20, 30}));
+    EXPECT_EQ(m_validator->stats().stale, 1U);
+    EXPECT_EQ(m_validator->stats().gaps, 1U);
+}
+
+
+TEST_F (SequenceTest, futuresResync)
+{
+    makeValidator(true);
+
+    futures(10, 15, 9);
+    futures(21, 30, 20);    // gap, buffered
+    futures(31, 35, 30);    // buffered
+    futures(36, 40, 35);    // buffered
+
+    ASSERT_EQ(m_snapshotRequests.size(), 1U);
+    EXPECT_EQ(m_snapshotRequests[0], "BTCUSDT");
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15}));
+
+    // snapshot at 33: event u=30 is stale, event 31-35 includes the snapshot
+    snapshot(33);
+    futures(41, 45, 40);
+
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 33, 35, 40, 45}));
+    EXPECT_EQ(m_validator->stats().resyncs, 1U);
+    EXPECT_EQ(m_validator->stats().stale, 1U);
+}
+
+
+TEST_F (SequenceTest, snapshotTooOld)
+{
+    makeValidator(true);
+
+    spot(10, 15);
+    spot(21, 30);       // gap
+
+    // snapshot doesn't reach the buffered event, so another resync
+    snapshot(18);
+
+    EXPECT_EQ(m_snapshotRequests.size(), 2U);
+    EXPECT_EQ(m_gaps.size(), 2U);
+
+    snapshot(25);
+    spot(31, 35);
+
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 18, 25, 30, 35}));
+}
+
+
+TEST_F (SequenceTest, snapshotFail)
+{
+    makeValidator(true);
+
+    spot(10, 15);
+    spot(21, 30);       // gap
+
+    m_validator->onResponse(SequenceValidator::makeSnapshotFail("BTCUSDT", "timeout"));
+    spot(31, 35);
+
+    // fail response, then the buffered event unvalidated, then continue
+    EXPECT_EQ(m_delivered, (std::vector<std::uint64_t>{15, 0, 30, 35}));
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest Sequence Validation\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();    
+}
@@ -0,0 +1,154 @@
+#include <binancebeast/BinanceSymbols.h>
+#include <BinanceMockServer.h>
+#include "testcommon.h"
+#include <future>
+#include <set>
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+namespace
+{
+    std::vector<string> makeSymbols (const size_t n)
+    {
+        std::vector<string> symbols;
+
+        for (size_t i = 0 ; i < n ; ++i)
+            symbols.emplace_back("SYM" + std::to_string(i) + (i % 2 ? "USDT" : "BUSD"));
+
+        return symbols;
+    }
+}
+
+
+TEST (Symbols, denseUniqueIds)
+{
+    for (const size_t n : {1U, 2U, 5U, 300U, 5000U})
+    {
+        const auto symbols = makeSymbols(n);
+        SymbolRegistry registry (symbols);
+
+        ASSERT_EQ(registry.size(), n);
+
+        std::set<SymbolId> ids;
+
+        for (auto& symbol : symbols)
+        {
+            const auto id = registry.id(symbol);
+
+            ASSERT_LT(id, n);
+            EXPECT_EQ(registry.symbol(id), symbol);
+            ids.insert(id);
+        }
+
+        EXPECT_EQ(ids.size(), n);
+    }
+}
+
+
+TEST (Symbols, lookup)
+{
+    SymbolRegistry registry ({"BTCUSDT", "ethusdt", "BTCUSD_PERP", "ETHUSDT"});
+
+    // duplicates ignoring case
+    ASSERT_EQ(registry.size(), 3U);
+
+    EXPECT_NE(registry.id("BTCUSDT"), InvalidSymbolId);
+    EXPECT_EQ(registry.id("btcusdt"), registry.id("BTCUSDT"));
+    EXPECT_EQ(registry.id("EthUsdt"), registry.id("ETHUSDT"));
+    EXPECT_EQ(registry.symbol(registry.id("ethusdt")), "ETHUSDT");
+    EXPECT_EQ(registry.symbol(registry.id("btcusd_perp")), "BTCUSD_PERP");
+
+    EXPECT_EQ(registry.id("XRPUSDT"), InvalidSymbolId);
+    EXPECT_EQ(registry.id("BTCUSD"), InvalidSymbolId);
+    EXPECT_EQ(registry.id(""), InvalidSymbolId);
+    EXPECT_FALSE(registry.contains("BTCUSDTX"));
+    EXPECT_TRUE(registry.contains("btcusdt"));
+
+    SymbolRegistry empty {std::vector<string>{}};
+    EXPECT_EQ(empty.size(), 0U);
+    EXPECT_EQ(empty.id("BTCUSDT"), InvalidSymbolId);
+}
+
+
+TEST (Symbols, events)
+{
+    SymbolRegistry registry ({"BTCUSDT", "ETHUSDT"});
+
+    const auto id = registry.id("BTCUSDT");
+
+    EXPECT_EQ(registry.idOf(json::parse(R"({"e":"bookTicker","s":"BTCUSDT","b":"100.1"})")), id);
+    EXPECT_EQ(registry.idOf(json::parse(R"({"stream":"btcusdt@bookTicker","data":{"e":"bookTicker","s":"BTCUSDT"}})")), id);
+    EXPECT_EQ(registry.idOf(json::parse(R"({"e":"bookTicker","s":"XRPUSDT"})")), InvalidSymbolId);
+    EXPECT_EQ(registry.idOf(json::parse(R"({"e":"listenKeyExpired"})")), InvalidSymbolId);
+    EXPECT_EQ(registry.idOf(json::parse(R"([1,2])")), InvalidSymbolId);
+
+    EXPECT_EQ(registry.idOfStream("btcusdt@depth@100ms"), id);
+    EXPECT_EQ(registry.idOfStream("btcusdt"), id);
+    EXPECT_EQ(registry.idOfStream("!bookTicker"), InvalidSymbolId);
+}
+
+
+TEST (Symbols, fromExchangeInfo)
+{
+    auto registry = SymbolRegistry::fromExchangeInfo(json::parse(R"({"timezone":"UTC","symbols":[{"symbol":"BTCUSDT","status":"TRADING"},{"symbol":"ETHUSDT"},{"status":"TRADING"}]})"));
+
+    EXPECT_EQ(registry->size(), 2U);
+    EXPECT_TRUE(registry->contains("ETHUSDT"));
+
+    EXPECT_THROW(SymbolRegistry::fromExchangeInfo(json::parse(R"({"code":-1121,"msg":"error"})")), std::runtime_error);
+    EXPECT_THROW(SymbolRegistry::fromExchangeInfo(json::parse(R"([])")), std::runtime_error);
+}
+
+
+TEST (Symbols, load)
+{
+    MockServer server;
+
+    server.setRestHandler(http::verb::get, "/fapi/v1/exchangeInfo", [](const MockRestRequest&)
+    {
+        return MockRestResponse{http::status::ok, R"({"symbols":[{"symbol":"BTCUSDT"},{"symbol":"ETHUSDT"},{"symbol":"XRPUSDT"}]})"};
+    });
+
+    BinanceBeast bb;
+    bb.start(server.connectionConfig(Market::USDM), 1, 1);
+
+    std::promise<std::shared_ptr<const SymbolRegistry>> loaded;
+
+    SymbolRegistry::load(bb, [&loaded](std::shared_ptr<const SymbolRegistry> registry, const string&)
+    {
+        loaded.set_value(std::move(registry));
+    });
+
+    auto future = loaded.get_future();
+    ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+
+    auto registry = future.get();
+    ASSERT_TRUE(registry);
+    EXPECT_EQ(registry->size(), 3U);
+    EXPECT_TRUE(registry->contains("xrpusdt"));
+
+    // Binance's error reply
+    server.setRestHandler(http::verb::get, "/fapi/v1/exchangeInfo", [](const MockRestRequest&)
+    {
+        return MockRestResponse::error(-1003, "Too many requests.", http::status::too_many_requests);
+    });
+
+    std::promise<string> failed;
+
+    SymbolRegistry::load(bb, [&failed](std::shared_ptr<const SymbolRegistry> registry, const string& failMessage)
+    {
+        failed.set_value(registry ? string{} : failMessage);
+    });
+
+    auto failedFuture = failed.get_future();
+    ASSERT_EQ(failedFuture.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(failedFuture.get(), "Too many requests.");
+
+    // not started, so no market
+    BinanceBeast notStarted;
+    EXPECT_THROW(SymbolRegistry::load(notStarted, nullptr), std::runtime_error);
+}
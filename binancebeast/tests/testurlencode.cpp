@@ -0,0 +1,112 @@
+#include <binancebeast/BinanceBeast.h>
+#include "testcommon.h"
+#include <gtest/gtest.h>
+
+
+using namespace bblib;
+using namespace bblib_test;
+
+
+/// The encoding BinanceBeast::urlEncode() had before the table/SIMD encoder, one character at a time.
+string referenceEncode (const string_view s)
+{
+    static const char * hex = "0123456789ABCDEF";
+    string encoded;
+
+    for (const char ch : s)
+    {
+        const auto c = static_cast<unsigned char>(ch);
+
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            encoded += ch;
+        else if (c == ' ')
+            encoded += '+';
+        else
+        {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0x0F];
+        }
+    }
+
+    return encoded;
+}
+
+
+TEST (UrlEncodeTest, matchesReference)
+{
+    EXPECT_EQ(BinanceBeast::urlEncode(""), "");
+    EXPECT_EQ(BinanceBeast::urlEncode("BTCUSDT"), "BTCUSDT");
+    EXPECT_EQ(BinanceBeast::urlEncode("a b"), "a+b");
+    EXPECT_EQ(BinanceBeast::urlEncode(R"([{"q":"0.1"}])"), "%5B%7B%22q%22%3A%220%2E1%22%7D%5D");
+
+    // every byte, at every offset around the 16 byte blocks
+    string all;
+    for (int c = 0 ; c < 256 ; ++c)
+        all += static_cast<char>(c);
+
+    const string alnum = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    for (size_t offset = 0 ; offset < 40 ; ++offset)
+    {
+        const auto input = alnum.substr(0, offset) + all + alnum + "@`[{/:" + alnum.substr(offset);
+        ASSERT_EQ(BinanceBeast::urlEncode(input), referenceEncode(input)) << "offset " << offset;
+    }
+}
+
+
+TEST (UrlEncodeTest, callerBuffer)
+{
+    const string input = "symbol=BTCUSDT&side=BUY";
+    char buffer [urlEncodedMaxSize(23)];
+
+    const auto size = urlEncode(input, buffer);
+
+    EXPECT_EQ(string(buffer, size), referenceEncode(input));
+
+    // appends
+    string out = "batchOrders=";
+    urlEncode("[]", out);
+    EXPECT_EQ(out, "batchOrders=%5B%5D");
+}
+
+
+TEST (UrlEncodeTest, batchOrders)
+{
+    BatchOrder limit;
+    limit.symbol = "BTCUSDT";
+    limit.side = "BUY";
+    limit.type = "LIMIT";
+    limit.timeInForce = "GTC";
+    limit.quantity = "0.001";
+    limit.price = "10001";
+
+    BatchOrder market;
+    market.symbol = "ETHUSDT";
+    market.side = "SELL";
+    market.type = "MARKET";
+    market.quantity = "0.01";
+    market.newClientOrderId = R"(my "id")";
+
+    const auto json = R"([{"symbol":"BTCUSDT","side":"BUY","type":"LIMIT","timeInForce":"GTC","quantity":"0.001","price":"10001"},)"
+                      R"({"symbol":"ETHUSDT","side":"SELL","type":"MARKET","quantity":"0.01","newClientOrderId":"my \"id\""}])";
+
+    EXPECT_EQ(encodeBatchOrders({limit, market}), referenceEncode(json));
+    EXPECT_EQ(encodeBatchOrders({}), "%5B%5D");
+
+    // control characters are escaped as json::serialize() escapes them
+    BatchOrder control;
+    control.symbol = "BTCUSDT";
+    control.newClientOrderId = "a\tb\nc\x01" "d\x1f\\";
+
+    EXPECT_EQ(encodeBatchOrders({control}), referenceEncode(R"([{"symbol":"BTCUSDT","newClientOrderId":"a\tb\nc\u0001d\u001f\\"}])"));
+}
+
+
+int main (int argc, char ** argv)
+{
+    std::cout << "\n\nTest URL Encode\n\n";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -157,6 +157,51 @@ protected:
 
 
 
+/// Start a websocket with no streams, subscribe to a stream and wait for its data.
+class SubscribeWsTest : public WsTest
+{
+public:
+    SubscribeWsTest() : WsTest(Market::USDM)
+    {
+    }
+
+protected:
+    virtual void SetUp() override
+    {
+        m_bb.start(ConnectionConfig::MakeLiveConfig(m_market, g_futuresKeyFile));
+    }
+
+    bool runTest(const string& stream) override
+    {
+        bool dataError = false;
+        
+        auto token = m_bb.startWebSocket([&, this](WsResponse result)
+        {
+            dataError = result.hasErrorCode();
+            m_cvHaveReply.notify_all(); 
+        }, std::set<string>{});
+
+        // first subscribe opens the connection
+        m_bb.subscribe(token, {stream});
+
+        if (!waitReply(m_cvHaveReply) || dataError)
+            return false;
+
+        // second subscribe is sent over the existing connection, so there is a reply
+        std::condition_variable cvSubscribed;
+        bool subscribeFail = true;
+
+        m_bb.subscribe(token, {"ethusdt@aggTrade"}, [&](WsResponse result)
+        {
+            subscribeFail = result.hasErrorCode(true);
+            cvSubscribed.notify_one();
+        });
+
+        return waitReply(cvSubscribed) && !subscribeFail;
+    }
+};
+
+
 // Futures USDM
 TEST_F (FuturesUsdmTest, aggregrateTrade) { EXPECT_TRUE(runTest("btcusdt@aggTrade")); }
 TEST_F (FuturesUsdmTest, markPrice) { EXPECT_TRUE(runTest("btcusdt@markPrice@1s")); }
@@ -176,6 +221,8 @@ TEST_F (FuturesUsdmTest, compositeIndexSymbolInfo) { EXPECT_TRUE(runTest("defius
 
 TEST_F (DisconnectWsTest, allBookTicker) { EXPECT_TRUE(runTest("!bookTicker"));}
 
+TEST_F (SubscribeWsTest, bookTicker) { EXPECT_TRUE(runTest("btcusdt@bookTicker"));}
+
  
 
 // SPOT